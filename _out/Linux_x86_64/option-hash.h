@@ -0,0 +1,59 @@
+/*
+ * Generated by gen_option_hash_helper() from __options;
+ * do not edit.
+ */
+
+static const NVGetoptHashKey __options_hash_keys[25] = {
+    { "version", 0, 0 },
+    { "help", 1, 0 },
+    { "create-nvidia-device-file", 2, 0 },
+    { "unified-memory", 3, 0 },
+    { "modeset", 4, 0 },
+    { "nvswitch", 5, 0 },
+    { "nvlink", 6, 0 },
+    { "nvidia-capability-device-file", 7, 0 },
+    { "nvidia-imex-channel-device-file", 8, 0 },
+    { "auto-online-movable", 9, 0 },
+    { "online-movable-memory", 10, 0 },
+    { "audit-movable-memory", 11, 0 },
+    { "reserve-hugepages", 12, 0 },
+    { "irq-affinity", 13, 0 },
+    { "reload-driver", 14, 0 },
+    { "bring-up", 15, 0 },
+    { "budget-ms", 16, 0 },
+    { "jobs", 17, 0 },
+    { "timing", 18, 0 },
+    { "stats", 19, 0 },
+    { "output", 20, 0 },
+    { "metrics-dir", 21, 0 },
+    { "report", 22, 0 },
+    { "event-log", 23, 0 },
+    { "decode-events", 24, 0 },
+};
+
+static const unsigned short __options_hash_slots[64] = {
+    9, 25, 0, 14, 8, 22, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 6, 23, 0, 0, 0, 0, 4, 0, 0, 0, 1, 0, 3, 0,
+    0, 18, 5, 0, 17, 19, 0, 7, 16, 0, 2, 10, 0, 21, 20, 13,
+    12, 15, 0, 0, 0, 0, 0, 0, 0, 0, 11, 0, 24, 0, 0, 0,
+};
+
+static const unsigned short __options_hash_short_options[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 10, 0, 3, 0, 0, 8, 0, 2, 9, 18, 0, 7, 5, 0, 0,
+    0, 0, 0, 6, 0, 4, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const NVGetoptHash __options_hash = {
+    __options,
+    332u, /* seed */
+    0x3f, /* mask */
+    __options_hash_keys,
+    __options_hash_slots,
+    __options_hash_short_options,
+};
@@ -0,0 +1 @@
+#define NVIDIA_VERSION "565.57.01"
@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Check that warm nvidia-modprobe runs make no heap allocations:
+#
+#   alloc-check.sh ALLOC_COUNT NVIDIA_MODPROBE DIR
+#
+# ALLOC_COUNT is the allocation counter built from
+# nvidia-modprobe-alloc-count.c.  Each scenario runs nvidia-modprobe
+# against a fake tree built in DIR by gen-fake-root.sh (see there for the
+# privileges needed), with the arguments gen-fake-root.sh prints, once to
+# create the device files and then again under ALLOC_COUNT:
+#
+#   gpus         8 GPUs and 4 capability files, kernel modules loaded
+#   imex         8 IMEX channels, kernel modules loaded
+#
+# The check fails if any of the second runs makes an allocation.  Runs
+# with more steps than the step graph holds inline (see
+# nvidia-modprobe-steps.h) allocate the rest, and are not checked.
+
+set -e
+
+if [ $# -ne 3 ]; then
+    echo "usage: $0 ALLOC_COUNT NVIDIA_MODPROBE DIR" >&2
+    exit 1
+fi
+
+alloc_count=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+modprobe=$2
+dir=$3
+gen=$(dirname "$0")/gen-fake-root.sh
+count=$dir.count
+
+failed=0
+
+# scenario NAME GEN_ARGS... - run a warm scenario under the counter
+
+scenario() {
+    name=$1
+    shift
+    args=$(sh "$gen" "$@" "$dir")
+    env -i NVIDIA_MODPROBE_ROOT="$dir" "$modprobe" $args > /dev/null
+    rm -f "$count"
+    env -i NVIDIA_MODPROBE_ROOT="$dir" LD_PRELOAD="$alloc_count" \
+        NVIDIA_MODPROBE_ALLOC_COUNT_FILE="$count" "$modprobe" $args > /dev/null
+    n=$(cat "$count" 2> /dev/null || echo "no count")
+    echo "alloc-check: $name: $n allocations"
+    if [ "$n" != 0 ]; then
+        failed=$((failed + 1))
+    fi
+}
+
+scenario gpus -l -g 8 -c 4
+scenario imex -l -i 8
+rm -f "$count"
+
+if [ $failed -ne 0 ]; then
+    echo "alloc-check: $failed warm runs allocated memory"
+    exit 1
+fi
@@ -65,39 +65,40 @@ void *nvalloc(size_t size)
 
 
 /*
- * nvvstrcat() - allocate a new string, copying all given strings
- * into it.
+ * str_append() - append n bytes of s to the string of length *len in
+ * *buf, an allocation of *size bytes which grows geometrically, so that
+ * building a string piecewise takes amortized linear time.
  */
 
-char *nvvstrcat(const char *str, va_list ap)
+static void str_append(char **buf, size_t *len, size_t *size,
+                       const char *s, size_t n)
 {
-    const char *s;
-    char *result;
-    size_t len;
-    va_list ap2;
-
-    /* walk the varargs to compute the length of the result string */
-
-    va_copy(ap2, ap);
-
-    for (s = str, len = 1; s; s = va_arg(ap2, char *)) {
-        len += strlen(s);
+    if (*len + n + 1 > *size) {
+        *size = NV_MAX(*size * 2, *len + n + 1);
+        *buf = nvrealloc(*buf, *size);
     }
 
-    va_end(ap2);
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+}
 
-    /* allocate the result string */
 
-    result = nvalloc(len);
-    if (!result) {
-        return result;
-    }
-    result[0] = '\0';
+/*
+ * nvvstrcat() - allocate a new string, copying all given strings
+ * into it.  The varargs are walked once.
+ */
 
-    /* concatenate the input strings, writing into the result string */
+char *nvvstrcat(const char *str, va_list ap)
+{
+    const char *s;
+    char *result = NULL;
+    size_t len = 0, size = 0;
+
+    str_append(&result, &len, &size, "", 0);
 
     for (s = str; s; s = va_arg(ap, char *)) {
-        strcat(result, s);
+        str_append(&result, &len, &size, s, strlen(s));
     }
 
     return result;
@@ -381,57 +382,48 @@ char *nv_prepend_to_string_list(char *list, const char *item, const char *delim)
  * The eof parameter is set to TRUE when EOF is encountered.  In all
  * cases, the returned string is null-terminated.
  *
- * XXX this function will be rather slow because it uses fgetc() to
- * pull each character off the stream one at a time; this is done so
- * that each character can be examined as it's read so that we can
- * appropriately deal with EOFs and newlines.  A better implementation
- * would use fgets(), but that would still require us to parse each
- * read line, checking for newlines or guessing if we hit an EOF.
+ * Each character is examined as it is read, so that EOFs, newlines and
+ * nul terminators can be dealt with; a nul ends the line, and the next
+ * call returns what follows it.  The stream is locked once for the whole
+ * line so that getc_unlocked() can be used, and the buffer is doubled
+ * as needed, so that long lines are read in linear time.
  */
 char *fget_next_line(FILE *fp, int *eof)
 {
-    char *buf = NULL, *tmpbuf;
-    char *c = NULL;
-    int len = 0, buflen = 0;
+    char *buf = NULL;
+    size_t len = 0, buflen = 0;
     int ret;
 
-    const int __fget_next_line_len = 32;
-
     if (eof) {
         *eof = FALSE;
     }
 
+    flockfile(fp);
+
     while (1) {
         if (buflen == len) { /* buffer isn't big enough -- grow it */
-            buflen += __fget_next_line_len;
-            tmpbuf = nvalloc(buflen);
-            if (buf) {
-                memcpy(tmpbuf, buf, len);
-                nvfree(buf);
-            }
-            buf = tmpbuf;
-            c = buf + len;
+            buflen = buflen ? (buflen * 2) : 64;
+            buf = nvrealloc(buf, buflen);
         }
 
-        ret = fgetc(fp);
+        ret = getc_unlocked(fp);
 
         if ((ret == EOF) && (eof)) {
             *eof = TRUE;
         }
 
         if ((ret == EOF) || (ret == '\n') || (ret == '\0')) {
-            *c = '\0';
-            return buf;
+            buf[len] = '\0';
+            break;
         }
 
-        *c = (char) ret;
-
-        len++;
-        c++;
+        buf[len++] = (char) ret;
 
     } /* while (1) */
 
-    return NULL; /* should never get here */
+    funlockfile(fp);
+
+    return buf;
 }
 
 char *nvstrchrnul(char *s, int c)
@@ -616,16 +608,19 @@ int nv_mkdir_recursive(const char *path, const mode_t mode,
 char *nvdircat(const char *str, ...)
 {
     const char *s;
-    char *result = nvstrdup("");
+    char *result = NULL;
+    size_t len = 0, size = 0;
     va_list ap;
 
+    str_append(&result, &len, &size, "", 0);
+
     va_start(ap, str);
 
     for (s = str; s; s = va_arg(ap, char *)) {
-        char *oldresult = result;
-
-        result = nvstrcat(result, s == str ? "" : "/", s, NULL);
-        nvfree(oldresult);
+        if (s != str) {
+            str_append(&result, &len, &size, "/", 1);
+        }
+        str_append(&result, &len, &size, s, strlen(s));
     }
 
     va_end(ap);
@@ -836,3 +831,209 @@ void collapse_multiple_slashes(char *s)
         }
     }
 }
+
+
+
+/****************************************************************************/
+/* NVArena */
+/****************************************************************************/
+
+#define NV_ARENA_DEFAULT_BLOCK_SIZE 4096
+#define NV_ARENA_ALIGN 16
+#define NV_ARENA_ROUND_UP(n) (((n) + NV_ARENA_ALIGN - 1) & ~(NV_ARENA_ALIGN - 1))
+
+struct NVArenaBlockRec {
+    NVArenaBlock *next;
+    size_t size;            /* bytes of data, following the header */
+    size_t used;
+};
+
+#define NV_ARENA_BLOCK_DATA(b) \
+    ((char *)(b) + NV_ARENA_ROUND_UP(sizeof(NVArenaBlock)))
+
+
+void nv_arena_init(NVArena *arena, size_t block_size)
+{
+    arena->head = NULL;
+    arena->block_size = block_size ? block_size : NV_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+
+/*
+ * arena_new_block() - allocate a block of at least size bytes; it
+ * becomes the arena's current block, unless behind is TRUE and there
+ * already is one, so that a large allocation does not waste the space
+ * left in the current block.
+ */
+
+static NVArenaBlock *arena_new_block(NVArena *arena, size_t size, int behind)
+{
+    NVArenaBlock *block;
+
+    size = NV_ARENA_ROUND_UP(NV_MAX(size, arena->block_size));
+
+    block = nvalloc(NV_ARENA_ROUND_UP(sizeof(NVArenaBlock)) + size);
+    block->size = size;
+    block->used = 0;
+
+    if (behind && arena->head) {
+        block->next = arena->head->next;
+        arena->head->next = block;
+    } else {
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    return block;
+}
+
+
+/*
+ * nv_arena_alloc() - allocate size bytes from the arena, aligned for any
+ * type; the memory is not necessarily zeroed.
+ */
+
+void *nv_arena_alloc(NVArena *arena, size_t size)
+{
+    NVArenaBlock *block = arena->head;
+    char *ptr;
+
+    size = NV_ARENA_ROUND_UP(size ? size : 1);
+
+    if (!block || (block->size - block->used < size)) {
+        block = arena_new_block(arena, size, size > arena->block_size / 2);
+    }
+
+    ptr = NV_ARENA_BLOCK_DATA(block) + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+
+/*
+ * arena_str_append() - append n bytes of s to the string of length *len
+ * being built at the top of the current block; returns the string, which
+ * moves to a new block, twice as large as needed, if it outgrows the
+ * current one.  The string is allocated by arena_str_finish().
+ */
+
+static char *arena_str_append(NVArena *arena, char *str, size_t *len,
+                              const char *s, size_t n)
+{
+    NVArenaBlock *block = arena->head;
+
+    if (!block || (block->size - block->used < *len + n + 1)) {
+        block = arena_new_block(arena, (*len + n + 1) * 2, FALSE);
+        if (*len) {
+            memcpy(NV_ARENA_BLOCK_DATA(block), str, *len);
+        }
+    }
+
+    str = NV_ARENA_BLOCK_DATA(block) + block->used;
+    memcpy(str + *len, s, n);
+    *len += n;
+    str[*len] = '\0';
+
+    return str;
+}
+
+static char *arena_str_finish(NVArena *arena, char *str, size_t len)
+{
+    NVArenaBlock *block = arena->head;
+
+    block->used = NV_MIN(block->used + NV_ARENA_ROUND_UP(len + 1),
+                         block->size);
+    return str;
+}
+
+
+char *nv_arena_strdup(NVArena *arena, const char *s)
+{
+    size_t len = strlen(s);
+
+    return memcpy(nv_arena_alloc(arena, len + 1), s, len + 1);
+}
+
+
+/*
+ * nv_arena_vstrcat() - allocate a new string from the arena, copying
+ * all given strings into it; the varargs are walked once.
+ */
+
+char *nv_arena_vstrcat(NVArena *arena, const char *str, va_list ap)
+{
+    const char *s;
+    char *result;
+    size_t len = 0;
+
+    result = arena_str_append(arena, NULL, &len, "", 0);
+
+    for (s = str; s; s = va_arg(ap, char *)) {
+        result = arena_str_append(arena, result, &len, s, strlen(s));
+    }
+
+    return arena_str_finish(arena, result, len);
+}
+
+char *nv_arena_strcat(NVArena *arena, const char *str, ...)
+{
+    va_list ap;
+    char *ret;
+
+    va_start(ap, str);
+    ret = nv_arena_vstrcat(arena, str, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+
+/*
+ * nv_arena_dircat() - nvdircat(), allocating the result from the arena.
+ */
+
+char *nv_arena_dircat(NVArena *arena, const char *str, ...)
+{
+    const char *s;
+    char *result;
+    size_t len = 0;
+    va_list ap;
+
+    result = arena_str_append(arena, NULL, &len, "", 0);
+
+    va_start(ap, str);
+
+    for (s = str; s; s = va_arg(ap, char *)) {
+        if (s != str) {
+            result = arena_str_append(arena, result, &len, "/", 1);
+        }
+        result = arena_str_append(arena, result, &len, s, strlen(s));
+    }
+
+    va_end(ap);
+
+    result = arena_str_finish(arena, result, len);
+
+    collapse_multiple_slashes(result);
+
+    return result;
+}
+
+
+/*
+ * nv_arena_free() - free everything allocated from the arena; it may be
+ * used again afterwards.
+ */
+
+void nv_arena_free(NVArena *arena)
+{
+    NVArenaBlock *block, *next;
+
+    for (block = arena->head; block; block = next) {
+        next = block->next;
+        nvfree(block);
+    }
+
+    arena->head = NULL;
+}
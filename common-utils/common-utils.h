@@ -88,6 +88,30 @@ void collapse_multiple_slashes(char *s);
 
 int directory_exists(const char *dir);
 
+/*
+ * NVArena: a bump allocator, for building many strings or text rows
+ * that are all freed at once with nv_arena_free().  Allocations are
+ * carved from blocks of at least block_size bytes, 0 meaning a default
+ * size; like nvalloc(), they only return on success.
+ */
+
+typedef struct NVArenaBlockRec NVArenaBlock;
+
+struct NVArenaRec {
+    NVArenaBlock *head;     /* the block allocations are carved from */
+    size_t block_size;
+};
+
+typedef struct NVArenaRec NVArena;
+
+void nv_arena_init(NVArena *arena, size_t block_size);
+void *nv_arena_alloc(NVArena *arena, size_t size);
+char *nv_arena_strdup(NVArena *arena, const char *s);
+char *nv_arena_strcat(NVArena *arena, const char *str, ...);
+char *nv_arena_vstrcat(NVArena *arena, const char *str, va_list ap);
+char *nv_arena_dircat(NVArena *arena, const char *str, ...);
+void nv_arena_free(NVArena *arena);
+
 #if defined(__GNUC__)
 # define NV_INLINE __inline__
 #else
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * gen-option-hash-helper.c - print a C header defining an NVGetoptHash
+ * for an option table, so that nvgetopt_r() can look the options up
+ * without scanning the table.  The table is known at build time, so a
+ * seed for which no two option names collide is simply searched for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvgetopt.h"
+#include "gen-option-hash-helper.h"
+
+#define MAX_SEEDS 100000
+
+typedef struct {
+    char name[128];
+    int option;
+    int negate;
+} Key;
+
+static int add_key(Key *keys, int num_keys, const char *prefix,
+                   const char *name, int option, int negate)
+{
+    Key *key = &keys[num_keys];
+    int i;
+
+    snprintf(key->name, sizeof(key->name), "%s%s", prefix, name);
+
+    /* a name matches the first option with that name, as in nvgetopt_r() */
+
+    for (i = 0; i < num_keys; i++) {
+        if (strcmp(keys[i].name, key->name) == 0) {
+            return num_keys;
+        }
+    }
+
+    key->option = option;
+    key->negate = negate;
+
+    return num_keys + 1;
+}
+
+/*
+ * Fill slots (mask + 1 entries) with the key indices + 1 for the given
+ * seed; returns 1 if no two keys collide.
+ */
+
+static int try_seed(const Key *keys, int num_keys, unsigned int seed,
+                    unsigned int mask, unsigned short *slots)
+{
+    unsigned int h;
+    int i;
+
+    memset(slots, 0, sizeof(*slots) * (mask + 1));
+
+    for (i = 0; i < num_keys; i++) {
+        h = nvgetopt_hash(keys[i].name, seed) & mask;
+        if (slots[h]) {
+            return 0;
+        }
+        slots[h] = i + 1;
+    }
+
+    return 1;
+}
+
+static void print_array(const char *name, const unsigned short *array,
+                        unsigned int n)
+{
+    unsigned int i;
+
+    printf("static const unsigned short %s[%u] = {", name, n);
+    for (i = 0; i < n; i++) {
+        printf("%s%u,", (i % 16) ? " " : "\n    ", array[i]);
+    }
+    printf("\n};\n\n");
+}
+
+void gen_option_hash_helper(const NVGetoptOption *options,
+                            const char *options_name)
+{
+    unsigned short short_options[128] = { 0 };
+    unsigned short *slots = NULL;
+    unsigned int mask, seed = 0;
+    char name[128];
+    Key *keys;
+    int num_options, num_keys = 0, found = 0, i;
+
+    for (num_options = 0; options[num_options].name; num_options++);
+
+    keys = calloc(2 * num_options + 1, sizeof(*keys));
+    if (!keys) {
+        fprintf(stderr, "gen-option-hash: out of memory\n");
+        exit(1);
+    }
+
+    /*
+     * An option that can be negated is matched by its "no-" prefixed
+     * name, and by its own name unless that starts with "no-" itself.
+     */
+
+    for (i = 0; i < num_options; i++) {
+        const NVGetoptOption *o = &options[i];
+        int negatable = (o->flags & (NVGETOPT_IS_BOOLEAN |
+                                     NVGETOPT_ALLOW_DISABLE)) != 0;
+
+        if (negatable) {
+            num_keys = add_key(keys, num_keys, "no-", o->name, i, 1);
+        }
+        if (!negatable || strncmp(o->name, "no-", 3) != 0) {
+            num_keys = add_key(keys, num_keys, "", o->name, i, 0);
+        }
+
+        if ((o->val > 0) && (o->val < 128) && !short_options[o->val]) {
+            short_options[o->val] = i + 1;
+        }
+    }
+
+    /* try ever larger tables, starting at twice the number of keys */
+
+    for (mask = 1; mask + 1 < 2 * (unsigned int) num_keys; mask = mask * 2 + 1);
+
+    while (!found) {
+        slots = realloc(slots, sizeof(*slots) * (mask + 1));
+        if (!slots) {
+            fprintf(stderr, "gen-option-hash: out of memory\n");
+            exit(1);
+        }
+
+        for (seed = 0; seed < MAX_SEEDS; seed++) {
+            if (try_seed(keys, num_keys, seed, mask, slots)) {
+                found = 1;
+                break;
+            }
+        }
+
+        if (!found) {
+            mask = mask * 2 + 1;
+        }
+    }
+
+    printf("/*\n"
+           " * Generated by gen_option_hash_helper() from %s;\n"
+           " * do not edit.\n"
+           " */\n\n", options_name);
+
+    printf("static const NVGetoptHashKey %s_hash_keys[%d] = {\n",
+           options_name, num_keys);
+    for (i = 0; i < num_keys; i++) {
+        printf("    { \"%s\", %d, %d },\n",
+               keys[i].name, keys[i].option, keys[i].negate);
+    }
+    printf("};\n\n");
+
+    snprintf(name, sizeof(name), "%s_hash_slots", options_name);
+    print_array(name, slots, mask + 1);
+
+    snprintf(name, sizeof(name), "%s_hash_short_options", options_name);
+    print_array(name, short_options, 128);
+
+    printf("static const NVGetoptHash %s_hash = {\n"
+           "    %s,\n"
+           "    %uu, /* seed */\n"
+           "    %#x, /* mask */\n"
+           "    %s_hash_keys,\n"
+           "    %s_hash_slots,\n"
+           "    %s_hash_short_options,\n"
+           "};\n",
+           options_name, options_name, seed, mask,
+           options_name, options_name, options_name);
+
+    free(slots);
+    free(keys);
+}
@@ -40,18 +40,25 @@
 /*
  * verbosity, controls output of errors, warnings and other
  * information.
+ *
+ * The verbosity and the terminal width are process-wide settings;
+ * they are only ever accessed with atomic loads and stores, so that
+ * the message functions below can be called from multiple threads.
  */
 
 static NvVerbosity __verbosity = NV_VERBOSITY_DEFAULT;
 
+#define NV_ATOMIC_LOAD(x)       __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define NV_ATOMIC_STORE(x, v)   __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
 NvVerbosity nv_get_verbosity(void)
 {
-    return __verbosity;
+    return NV_ATOMIC_LOAD(__verbosity);
 }
 
 void nv_set_verbosity(NvVerbosity level)
 {
-    __verbosity = level;
+    NV_ATOMIC_STORE(__verbosity, level);
 }
 
 
@@ -75,14 +82,14 @@ void reset_current_terminal_width(unsigned short new_val)
     struct winsize ws;
 
     if (new_val) {
-        __terminal_width = new_val;
+        NV_ATOMIC_STORE(__terminal_width, new_val);
         return;
     }
 
     if (ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-        __terminal_width = DEFAULT_WIDTH;
+        NV_ATOMIC_STORE(__terminal_width, DEFAULT_WIDTH);
     } else {
-        __terminal_width = ws.ws_col - 1;
+        NV_ATOMIC_STORE(__terminal_width, ws.ws_col - 1);
     }
 }
 
@@ -92,15 +99,23 @@ static void format(FILE *stream, const char *prefix, const char *buf,
 {
     if (isatty(fileno(stream))) {
         int i;
+        unsigned short width;
+        NVArena arena;
         TextRows *t;
 
-        if (!__terminal_width) reset_current_terminal_width(0);
+        width = NV_ATOMIC_LOAD(__terminal_width);
+        if (!width) {
+            reset_current_terminal_width(0);
+            width = NV_ATOMIC_LOAD(__terminal_width);
+        }
 
-        t = nv_format_text_rows(prefix, buf, __terminal_width, whitespace);
+        nv_arena_init(&arena, 0);
+
+        t = nv_arena_format_text_rows(&arena, prefix, buf, width, whitespace);
 
         for (i = 0; i < t->n; i++) fprintf(stream, "%s\n", t->t[i]);
 
-        nv_free_text_rows(t);
+        nv_arena_free(&arena);
     } else {
         fprintf(stream, "%s%s\n", prefix ? prefix : "", buf);
     }
@@ -125,7 +140,7 @@ do {                                               \
 
 void nv_error_msg(const char *fmt, ...)
 {
-    if (__verbosity < NV_VERBOSITY_ERROR) return;
+    if (nv_get_verbosity() < NV_VERBOSITY_ERROR) return;
 
     format(stderr, NULL, "", TRUE);
     NV_FORMAT(stderr, "ERROR: ", fmt, TRUE);
@@ -142,7 +157,7 @@ void nv_error_msg(const char *fmt, ...)
 
 void nv_deprecated_msg(const char *fmt, ...)
 {
-    if (__verbosity < NV_VERBOSITY_DEPRECATED) return;
+    if (nv_get_verbosity() < NV_VERBOSITY_DEPRECATED) return;
 
     format(stderr, NULL, "", TRUE);
     NV_FORMAT(stderr, "DEPRECATED: ", fmt, TRUE);
@@ -159,7 +174,7 @@ void nv_deprecated_msg(const char *fmt, ...)
 
 void nv_warning_msg(const char *fmt, ...)
 {
-    if (__verbosity < NV_VERBOSITY_WARNING) return;
+    if (nv_get_verbosity() < NV_VERBOSITY_WARNING) return;
 
     format(stderr, NULL, "", TRUE);
     NV_FORMAT(stderr, "WARNING: ", fmt, TRUE);
@@ -176,7 +191,7 @@ void nv_warning_msg(const char *fmt, ...)
 
 void nv_info_msg(const char *prefix, const char *fmt, ...)
 {
-    if (__verbosity < NV_VERBOSITY_ALL) return;
+    if (nv_get_verbosity() < NV_VERBOSITY_ALL) return;
 
     NV_FORMAT(stdout, prefix, fmt, TRUE);
 } /* nv_info_msg() */
@@ -190,7 +205,7 @@ void nv_info_msg(const char *prefix, const char *fmt, ...)
 
 void nv_info_msg_to_file(FILE *stream, const char *prefix, const char *fmt, ...)
 {
-    if (__verbosity < NV_VERBOSITY_ALL) return;
+    if (nv_get_verbosity() < NV_VERBOSITY_ALL) return;
 
     NV_FORMAT(stream, prefix, fmt, TRUE);
 } /* nv_info_msg_to_file() */
@@ -238,19 +253,63 @@ int vsnprintf(char *str, size_t size, const char  *format,
 /****************************************************************************/
 
 /*
- * nv_format_text_rows() - this function breaks the given string str
- * into some number of rows, where each row is not longer than the
- * specified width.
- *
- * If prefix is non-NULL, the first line is prepended with the prefix,
- * and subsequent lines are indented to line up with the prefix.
- *
- * If word_boundary is TRUE, then attempt to only break lines on
- * boundaries between words.
+ * text_rows_alloc() - allocate size bytes from the arena, or with
+ * malloc() if it is NULL.
  */
 
-TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
-                              int word_boundary)
+static void *text_rows_alloc(NVArena *arena, size_t size)
+{
+    return arena ? nv_arena_alloc(arena, size) : malloc(size);
+}
+
+static char *text_rows_strdup(NVArena *arena, const char *s)
+{
+    return arena ? nv_arena_strdup(arena, s) : strdup(s);
+}
+
+
+/*
+ * text_rows_reserve() - make room for n rows in t.  The row array grows
+ * to the next power of two rather than by one row at a time, so that
+ * appending rows takes amortized constant time; its capacity is implied
+ * by the number of rows.
+ */
+
+static int text_rows_capacity(int n)
+{
+    int capacity = 1;
+
+    if (n == 0) return 0;
+    while (capacity < n) capacity *= 2;
+
+    return capacity;
+}
+
+static void text_rows_reserve(NVArena *arena, TextRows *t, int n)
+{
+    int capacity = text_rows_capacity(n);
+    char **rows;
+
+    if (capacity <= text_rows_capacity(t->n)) return;
+
+    if (arena) {
+        rows = nv_arena_alloc(arena, sizeof(char *) * capacity);
+        if (t->n) memcpy(rows, t->t, sizeof(char *) * t->n);
+        t->t = rows;
+    } else {
+        t->t = (char **) realloc(t->t, sizeof(char *) * capacity);
+    }
+}
+
+
+/*
+ * format_text_rows() - implement nv_format_text_rows(), allocating from
+ * the arena if it is not NULL.
+ */
+
+static TextRows *format_text_rows(NVArena *arena, const char *prefix,
+                                  const char *str, int width,
+                                  int word_boundary)
 {
     int len, prefix_len, z, w, i;
     char *line, *buf, *local_prefix, *a, *b, *c;
@@ -258,7 +317,7 @@ TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
 
     /* initialize the TextRows structure */
 
-    t = (TextRows *) malloc(sizeof(TextRows));
+    t = (TextRows *) text_rows_alloc(arena, sizeof(TextRows));
 
     if (!t) return NULL;
 
@@ -268,7 +327,7 @@ TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
 
     if (!str) return t;
 
-    buf = strdup(str);
+    buf = text_rows_strdup(arena, str);
 
     if (!buf) return t;
 
@@ -279,7 +338,7 @@ TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
 
     if (prefix) {
         prefix_len = strlen(prefix);
-        local_prefix = strdup(prefix);
+        local_prefix = text_rows_strdup(arena, prefix);
     } else {
         prefix_len = 0;
         local_prefix = NULL;
@@ -324,14 +383,14 @@ TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
 
         len = b-a;
         len += prefix_len;
-        line = (char *) malloc(len+1);
+        line = (char *) text_rows_alloc(arena, len+1);
         if (local_prefix) strncpy(line, local_prefix, prefix_len);
         strncpy(line + prefix_len, a, len - prefix_len);
         line[len] = '\0';
 
         /* append the new line to the array of text rows */
 
-        t->t = (char **) realloc(t->t, sizeof(char *) * (t->n + 1));
+        text_rows_reserve(arena, t, t->n + 1);
         t->t[t->n] = line;
         t->n++;
 
@@ -359,25 +418,60 @@ TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
 
     } while (z > 0);
 
-    if (local_prefix) free(local_prefix);
-    free(buf);
+    if (!arena) {
+        if (local_prefix) free(local_prefix);
+        free(buf);
+    }
 
     return t;
 }
 
 
+/*
+ * nv_format_text_rows() - this function breaks the given string str
+ * into some number of rows, where each row is not longer than the
+ * specified width.
+ *
+ * If prefix is non-NULL, the first line is prepended with the prefix,
+ * and subsequent lines are indented to line up with the prefix.
+ *
+ * If word_boundary is TRUE, then attempt to only break lines on
+ * boundaries between words.
+ */
+
+TextRows *nv_format_text_rows(const char *prefix, const char *str, int width,
+                              int word_boundary)
+{
+    return format_text_rows(NULL, prefix, str, width, word_boundary);
+}
+
+
+/*
+ * nv_arena_format_text_rows() - nv_format_text_rows(), allocating the
+ * TextRows and its rows from the arena; they are freed with the arena
+ * rather than with nv_free_text_rows().
+ */
+
+TextRows *nv_arena_format_text_rows(NVArena *arena, const char *prefix,
+                                    const char *str, int width,
+                                    int word_boundary)
+{
+    return format_text_rows(arena, prefix, str, width, word_boundary);
+}
+
+
 /*
  * nv_text_rows_append() - append the given msg to the existing TextRows
  */
 
-void nv_text_rows_append(TextRows *t, const char *msg)
+static void text_rows_append(NVArena *arena, TextRows *t, const char *msg)
 {
     int len;
 
-    t->t = realloc(t->t, sizeof(char *) * (t->n + 1));
+    text_rows_reserve(arena, t, t->n + 1);
 
     if (msg) {
-        t->t[t->n] = strdup(msg);
+        t->t[t->n] = text_rows_strdup(arena, msg);
         len = strlen(msg);
         if (t->m < len) t->m = len;
     } else {
@@ -387,6 +481,16 @@ void nv_text_rows_append(TextRows *t, const char *msg)
     t->n++;
 }
 
+void nv_text_rows_append(TextRows *t, const char *msg)
+{
+    text_rows_append(NULL, t, msg);
+}
+
+void nv_arena_text_rows_append(NVArena *arena, TextRows *t, const char *msg)
+{
+    text_rows_append(arena, t, msg);
+}
+
 /*
  * nv_concat_text_rows() - concatenate two text rows, storing the
  * result in t0
@@ -398,7 +502,7 @@ void nv_concat_text_rows(TextRows *t0, TextRows *t1)
 
     n = t0->n + t1->n;
 
-    t0->t = realloc(t0->t, sizeof(char *) * n);
+    text_rows_reserve(NULL, t0, n);
 
     for (i = 0; i < t1->n; i++) {
         t0->t[i + t0->n] = strdup(t1->t[i]);
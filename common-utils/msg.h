@@ -139,5 +139,15 @@ void nv_text_rows_append(TextRows *t, const char *msg);
 void nv_concat_text_rows(TextRows *t0, TextRows *t1);
 void nv_free_text_rows(TextRows *t);
 
+/* versions allocating from an NVArena; see common-utils.h */
+
+struct NVArenaRec;
+
+TextRows *nv_arena_format_text_rows(struct NVArenaRec *arena,
+                                    const char *prefix, const char *str,
+                                    int width, int word_boundary);
+void nv_arena_text_rows_append(struct NVArenaRec *arena, TextRows *t,
+                               const char *msg);
+
 
 #endif /* __MSG_H__ */
@@ -33,6 +33,93 @@
 #include "nvgetopt.h"
 #include "common-utils.h"
 
+/* options at least this long are copied to the heap rather than the stack */
+#define NVGETOPT_ARG_BUF_LEN 256
+
+
+/*
+ * find_short_option() - return the first option whose val is c, or NULL.
+ */
+
+static const NVGetoptOption *find_short_option(const NVGetoptState *state,
+                                               const NVGetoptOption *options,
+                                               char c)
+{
+    const NVGetoptHash *hash = state->hash;
+    int i;
+
+    if (hash && hash->options == options) {
+        unsigned short index;
+
+        if ((c <= 0) || ((unsigned char) c >= 128)) return NULL;
+
+        index = hash->short_options[(unsigned char) c];
+        return index ? &options[index - 1] : NULL;
+    }
+
+    for (i = 0; options[i].name; i++) {
+        if (options[i].val == c) {
+            return &options[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * find_long_option() - return the option named name, or NULL.  If the
+ * option allows negation by prepending with "--no-" (true for
+ * IS_BOOLEAN and ALLOW_DISABLE), then a leading "no-" in name is skipped,
+ * and negate set to TRUE.
+ */
+
+static const NVGetoptOption *find_long_option(const NVGetoptState *state,
+                                              const NVGetoptOption *options,
+                                              const char *name, int *negate)
+{
+    const NVGetoptHash *hash = state->hash;
+    int i;
+
+    if (hash && hash->options == options) {
+        const NVGetoptHashKey *key;
+        unsigned short index;
+
+        index = hash->slots[nvgetopt_hash(name, hash->seed) & hash->mask];
+        if (!index) return NULL;
+
+        key = &hash->keys[index - 1];
+        if (strcmp(key->name, name) != 0) return NULL;
+
+        *negate = key->negate ? NVGETOPT_TRUE : NVGETOPT_FALSE;
+        return &options[key->option];
+    }
+
+    for (i = 0; options[i].name; i++) {
+        const char *tmpname;
+        int tmp_negate;
+
+        if ((options[i].flags & (NVGETOPT_IS_BOOLEAN |
+                                 NVGETOPT_ALLOW_DISABLE)) &&
+            (name[0] == 'n') &&
+            (name[1] == 'o') &&
+            (name[2] == '-')) {
+            tmpname = name + 3;
+            tmp_negate = NVGETOPT_TRUE;
+        } else {
+            tmpname = name;
+            tmp_negate = NVGETOPT_FALSE;
+        }
+
+        if (strcmp(tmpname, options[i].name) == 0) {
+            *negate = tmp_negate;
+            return &options[i];
+        }
+    }
+
+    return NULL;
+}
+
 
 int nvgetopt(int argc,
              char *argv[],
@@ -42,15 +129,35 @@ int nvgetopt(int argc,
              int *intval,
              double *doubleval,
              int *disable_val)
+{
+    static NVGetoptState state = NVGETOPT_STATE_INIT;
+
+    return nvgetopt_r(&state, argc, argv, options, strval, boolval,
+                      intval, doubleval, disable_val);
+
+} /* nvgetopt() */
+
+
+int nvgetopt_r(NVGetoptState *state,
+               int argc,
+               char *argv[],
+               const NVGetoptOption *options,
+               char **strval,
+               int *boolval,
+               int *intval,
+               double *doubleval,
+               int *disable_val)
 {
     char *c, *a, *arg, *name = NULL, *argument=NULL;
+    char arg_buf[NVGETOPT_ARG_BUF_LEN], *arg_src;
+    size_t arg_len;
     int i, found = NVGETOPT_FALSE;
     int ret = 0;
     int negate = NVGETOPT_FALSE;
     int disable = NVGETOPT_FALSE;
     int double_dash = NVGETOPT_FALSE;
     const NVGetoptOption *o = NULL;
-    static int argv_index = 0;
+    int argv_index = state->argv_index;
 
     if (strval) *strval = NULL;
     if (boolval) *boolval = NVGETOPT_FALSE;
@@ -62,11 +169,25 @@ int nvgetopt(int argc,
 
     /* if no more options, return -1 */
 
-    if (argv_index >= argc) return -1;
+    if (argv_index >= argc) {
+        state->argv_index = argv_index;
+        return -1;
+    }
 
-    /* get the argument in question */
+    /*
+     * get the argument in question; it is copied so that the '=' of
+     * "--name=argument" can be zeroed out, into a buffer on the stack
+     * unless it is unusually long
+     */
 
-    arg = strdup(argv[argv_index]);
+    arg_src = argv[argv_index];
+    arg_len = strlen(arg_src);
+
+    if (arg_len < sizeof(arg_buf)) {
+        arg = memcpy(arg_buf, arg_src, arg_len + 1);
+    } else {
+        arg = strdup(arg_src);
+    }
 
     /* look for "--" or "-" */
 
@@ -108,41 +229,9 @@ int nvgetopt(int argc,
             goto done;
         }
     } else if (name[1] == '\0') { /* short option */
-        for (i = 0; options[i].name; i++) {
-            if (options[i].val == name[0]) {
-                o = &options[i];
-                break;
-            }
-        }
+        o = find_short_option(state, options, name[0]);
     } else { /* long option */
-        for (i = 0; options[i].name; i++) {
-            const char *tmpname;
-            int tmp_negate;
-
-            /*
-             * if this option allows negation by prepending with
-             * "--no-" (true for IS_BOOLEAN and ALLOW_DISABLE), then
-             * skip any leading "no-" in the argument
-             */
-
-            if ((options[i].flags & (NVGETOPT_IS_BOOLEAN |
-                                     NVGETOPT_ALLOW_DISABLE)) &&
-                (name[0] == 'n') &&
-                (name[1] == 'o') &&
-                (name[2] == '-')) {
-                tmpname = name + 3;
-                tmp_negate = NVGETOPT_TRUE;
-            } else {
-                tmpname = name;
-                tmp_negate = NVGETOPT_FALSE;
-            }
-
-            if (strcmp(tmpname, options[i].name) == 0) {
-                o = &options[i];
-                negate = tmp_negate;
-                break;
-            }
-        }
+        o = find_long_option(state, options, name, &negate);
     }
 
     /*
@@ -152,13 +241,7 @@ int nvgetopt(int argc,
 
     if (!o) {
         for (c = name; *c; c++) {
-            found = NVGETOPT_FALSE;
-            for (i = 0; options[i].name; i++) {
-                if (options[i].val == *c) {
-                    found = NVGETOPT_TRUE;
-                    break;
-                }
-            }
+            found = (find_short_option(state, options, *c) != NULL);
             if (!found) break;
         }
 
@@ -169,38 +252,36 @@ int nvgetopt(int argc,
              * interpret them that way
              */
 
-            for (i = 0; options[i].name; i++) {
-                if (options[i].val == name[0]) {
+            const NVGetoptOption *first =
+                find_short_option(state, options, name[0]);
 
-                    /*
-                     * don't allow options with arguments to be
-                     * processed in this way
-                     */
+            /*
+             * don't allow options with arguments to be processed in
+             * this way
+             */
 
-                    if (options[i].flags & NVGETOPT_HAS_ARGUMENT) break;
+            if (!(first->flags & NVGETOPT_HAS_ARGUMENT)) {
 
-                    /*
-                     * remove the first short option from
-                     * argv[argv_index]
-                     */
+                /*
+                 * remove the first short option from
+                 * argv[argv_index]
+                 */
 
-                    a = argv[argv_index];
-                    if (a[0] == '-') a++;
-                    if (a[0] == '-') a++;
-                    if (a[0] == '+') a++;
+                a = argv[argv_index];
+                if (a[0] == '-') a++;
+                if (a[0] == '-') a++;
+                if (a[0] == '+') a++;
 
-                    while (a[0]) { a[0] = a[1]; a++; }
+                while (a[0]) { a[0] = a[1]; a++; }
 
-                    /*
-                     * decrement argv_index so that we process this
-                     * entry again
-                     */
+                /*
+                 * decrement argv_index so that we process this
+                 * entry again
+                 */
 
-                    argv_index--;
+                argv_index--;
 
-                    o = &options[i];
-                    break;
-                }
+                o = first;
             }
         }
     }
@@ -319,9 +400,19 @@ int nvgetopt(int argc,
             }
         } else if ((o->flags & NVGETOPT_STRING_ARGUMENT) && (strval)) {
 
-            /* treat the argument as a string */
+            /*
+             * treat the argument as a string; if the caller asked for
+             * it in argv[] and it follows the '=' in our copy of the
+             * option, point at the same characters in argv[] instead
+             */
 
-            *strval = strdup(argument);
+            if (!(state->flags & NVGETOPT_STATE_STRVAL_IN_ARGV)) {
+                *strval = strdup(argument);
+            } else if ((argument >= arg) && (argument < arg + arg_len)) {
+                *strval = arg_src + (argument - arg);
+            } else {
+                *strval = argument;
+            }
         } else if ((o->flags & NVGETOPT_DOUBLE_ARGUMENT) && (doubleval)) {
 
             /* parse the argument as a double */
@@ -361,10 +452,14 @@ int nvgetopt(int argc,
 
     if (disable_val) *disable_val = disable;
 
-    free(arg);
+    state->argv_index = argv_index;
+
+    if (arg != arg_buf) {
+        free(arg);
+    }
     return ret;
 
-} /* nvgetopt() */
+} /* nvgetopt_r() */
 
 
 /*
@@ -23,6 +23,8 @@
 #ifndef __NVGETOPT_H__
 #define __NVGETOPT_H__
 
+#include <stddef.h>
+
 #define NVGETOPT_FALSE 0
 #define NVGETOPT_TRUE  1
 
@@ -141,12 +143,91 @@ typedef struct {
 } NVGetoptOption;
 
 
+/*
+ * NVGetoptHash - a perfect hash of the option names of an NVGetoptOption
+ * table, generated at build time by gen_option_hash_helper(), so that
+ * nvgetopt_r() finds each option with one hash and one strcmp() rather
+ * than by scanning the table.
+ *
+ * There is a key for each long option name, and for its "no-" prefixed
+ * name if it can be negated; slots[nvgetopt_hash(name, seed) & mask] is
+ * the index + 1 of the only key the name can be, or 0.  short_options[c]
+ * is the index + 1 of the first option whose val is c, or 0.
+ */
+
+typedef struct {
+    const char *name;
+    unsigned short option;      /* index in the option table */
+    unsigned short negate;      /* name is the "no-" prefixed name */
+} NVGetoptHashKey;
+
+typedef struct {
+    const NVGetoptOption *options;  /* the table the hash was generated for */
+    unsigned int seed;
+    unsigned int mask;
+    const NVGetoptHashKey *keys;
+    const unsigned short *slots;
+    const unsigned short *short_options;
+} NVGetoptHash;
+
+/*
+ * FNV-1a, with the seed folded into the offset basis, and the bits mixed
+ * at the end so that the low bits used as the slot depend on all of them.
+ */
+
+static __inline__ unsigned int nvgetopt_hash(const char *s, unsigned int seed)
+{
+    unsigned int h = 2166136261u ^ seed;
+
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+
+/*
+ * NVGetoptState - parser position for nvgetopt_r().  Initialize with
+ * NVGETOPT_STATE_INIT (or zero it) before the first call; each caller
+ * that parses its own argv[] concurrently needs its own state.
+ *
+ * If hash is set, with NVGETOPT_STATE_INIT_WITH_HASH(), and was
+ * generated for the options passed to nvgetopt_r(), it is used to look
+ * the options up.
+ *
+ * If NVGETOPT_STATE_STRVAL_IN_ARGV is set in flags, strval points into
+ * argv[] rather than to a copy: it remains valid for as long as argv[]
+ * does, and must not be freed by the caller.
+ */
+
+#define NVGETOPT_STATE_STRVAL_IN_ARGV   0x1
+
+typedef struct {
+    int argv_index;
+    const NVGetoptHash *hash;
+    unsigned int flags;
+} NVGetoptState;
+
+#define NVGETOPT_STATE_INIT { 0, NULL, 0 }
+#define NVGETOPT_STATE_INIT_WITH_HASH(hash) { 0, (hash), 0 }
+
+
 /*
  * nvgetopt() - see the glibc getopt_long(3) manpage for usage
  * description.  Options can be prepended with "--", "-", or "--no-".
  *
  * A global variable stores the current index into the argv array, so
- * subsequent calls to nvgetopt() will advance through argv[].
+ * subsequent calls to nvgetopt() will advance through argv[].  Use
+ * nvgetopt_r() to keep that index in a caller-provided NVGetoptState
+ * instead.
  *
  * On success, the matching NVGetoptOption.val is returned.
  *
@@ -161,7 +242,9 @@ typedef struct {
  * NVGETOPT_STRING_ARGUMENT, NVGETOPT_INTEGER_ARGUMENT, or
  * NVGETOPT_DOUBLE_ARGUMENT is set in the option's flags.  If strval
  * is assigned to a non-NULL value by nvgetopt, then it is the
- * caller's responsibility to free the string when done with it.
+ * caller's responsibility to free the string when done with it, unless
+ * NVGETOPT_STATE_STRVAL_IN_ARGV is set in the NVGetoptState passed to
+ * nvgetopt_r().
  *
  * On failure, an error is printed to stderr, and 0 is returned.
  *
@@ -177,6 +260,16 @@ int nvgetopt(int argc,
              double *doubleval,
              int *disable_val);
 
+int nvgetopt_r(NVGetoptState *state,
+               int argc,
+               char *argv[],
+               const NVGetoptOption *options,
+               char **strval,
+               int *boolval,
+               int *intval,
+               double *doubleval,
+               int *disable_val);
+
 /*
  * nvgetopt_print_help() - print a help message for each option in the
  * provided NVGetoptOption array.  This is useful for a utility's
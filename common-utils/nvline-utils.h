@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * nvline-utils.h - iterate over the lines of a buffer holding a whole
+ * file, e.g. read with a single read(2) or mapped with mmap(2), without
+ * copying them.  It is header-only, so that it can be used without
+ * linking the rest of common-utils.
+ */
+
+#ifndef __NVLINE_UTILS_H__
+#define __NVLINE_UTILS_H__
+
+#include <stddef.h>
+#include <string.h>
+
+typedef struct {
+    char *pos;
+    char *end;
+} NVLineIter;
+
+static __inline__ void nv_line_iter_init(NVLineIter *iter, char *buf,
+                                         size_t len)
+{
+    iter->pos = buf;
+    iter->end = buf + len;
+}
+
+/*
+ * Return the next line of the buffer through line and len, not including
+ * its newline; the last line need not end with one.  Returns 1, or 0 once
+ * the buffer is consumed.
+ *
+ * The line is a slice of the buffer: line[len] is its newline, or the
+ * end of the buffer, which callers owning a writable buffer one byte
+ * longer may overwrite with a nul terminator.
+ */
+static __inline__ int nv_line_iter_next(NVLineIter *iter, char **line,
+                                        size_t *len)
+{
+    char *newline;
+
+    if (iter->pos >= iter->end) {
+        return 0;
+    }
+
+    newline = memchr(iter->pos, '\n', iter->end - iter->pos);
+
+    *line = iter->pos;
+
+    if (newline) {
+        *len = newline - iter->pos;
+        iter->pos = newline + 1;
+    } else {
+        *len = iter->end - iter->pos;
+        iter->pos = iter->end;
+    }
+
+    return 1;
+}
+
+#endif /* __NVLINE_UTILS_H__ */
@@ -10,6 +10,7 @@ COMMON_UTILS_SRC        += msg.c
 COMMON_UTILS_EXTRA_DIST += nvgetopt.h
 COMMON_UTILS_EXTRA_DIST += common-utils.h
 COMMON_UTILS_EXTRA_DIST += msg.h
+COMMON_UTILS_EXTRA_DIST += nvline-utils.h
 COMMON_UTILS_EXTRA_DIST += src.mk
 
 # only build nvpci-utils.c for programs that actually use libpciaccess, to
@@ -38,3 +39,7 @@ COMMON_UTILS_EXTRA_DIST += nvpci-utils.h
 COMMON_UTILS_EXTRA_DIST += gen-manpage-opts-helper.c
 COMMON_UTILS_EXTRA_DIST += gen-manpage-opts-helper.h
 
+# likewise gen-option-hash-helper.c, used by the utility's gen-option-hash
+COMMON_UTILS_EXTRA_DIST += gen-option-hash-helper.c
+COMMON_UTILS_EXTRA_DIST += gen-option-hash-helper.h
+
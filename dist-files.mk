@@ -1,8 +1,34 @@
 SRC += nvidia-modprobe.c
+SRC += nvidia-modprobe-steps.c
+SRC += nvidia-modprobe-bringup.c
+SRC += nvidia-modprobe-memory.c
+SRC += nvidia-modprobe-irq.c
+SRC += nvidia-modprobe-reload.c
+SRC += nvidia-modprobe-output.c
+SRC += nvidia-modprobe-metrics.c
+SRC += nvidia-modprobe-events.c
 
 DIST_FILES := $(SRC)
 DIST_FILES += COPYING
 DIST_FILES += dist-files.mk
 DIST_FILES += option-table.h
+DIST_FILES += nvidia-modprobe-steps.h
+DIST_FILES += nvidia-modprobe-bringup.h
+DIST_FILES += nvidia-modprobe-memory.h
+DIST_FILES += nvidia-modprobe-irq.h
+DIST_FILES += nvidia-modprobe-reload.h
+DIST_FILES += nvidia-modprobe-output.h
+DIST_FILES += nvidia-modprobe-metrics.h
+DIST_FILES += nvidia-modprobe-events.h
 DIST_FILES += nvidia-modprobe.1.m4
 DIST_FILES += gen-manpage-opts.c
+DIST_FILES += gen-option-hash.c
+DIST_FILES += gen-fake-root.sh
+DIST_FILES += stats-check.sh
+DIST_FILES += stats-baseline.txt
+DIST_FILES += alloc-check.sh
+DIST_FILES += nvidia-modprobe-alloc-count.c
+DIST_FILES += nvidia-modprobe-bench.c
+DIST_FILES += nvidia-modprobe-bench-utils.c
+DIST_FILES += nvidia-modprobe-bench-utils.h
+DIST_FILES += nvidia-modprobe-stress.c
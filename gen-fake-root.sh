@@ -0,0 +1,410 @@
+#!/bin/sh
+#
+# Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Build a fake /sys, /proc and /dev tree for running nvidia-modprobe
+# without any NVIDIA hardware:
+#
+#   gen-fake-root.sh [-g GPUS] [-v VFS] [-c CAPS] [-i CHANNELS] [-m BLOCKS]
+#                    [-z BLOCKS] [-o PROCS] [-l] ROOT
+#
+#   -g GPUS      number of GPUs, each below its own PCIe bridge (default 1)
+#   -v VFS       number of SR-IOV virtual functions per GPU (default 0)
+#   -c CAPS      number of capability files (default 0)
+#   -i CHANNELS  number of IMEX channels (default 0)
+#   -m BLOCKS    number of offline memory blocks in each GPU's NUMA node
+#                (default 0, no GPU NUMA nodes)
+#   -z BLOCKS    number of additional memory blocks in each GPU's NUMA node
+#                onlined in ZONE_NORMAL rather than ZONE_MOVABLE (default 0)
+#   -o PROCS     number of processes holding /dev/nvidiactl open, which
+#                keep the nvidia module from being unloaded (default 0)
+#   -l           mark the kernel modules as already loaded
+#
+# ROOT should be on a tmpfs, e.g. below /dev/shm, so that file system
+# timings are not dominated by the disk.  Run nvidia-modprobe with
+# NVIDIA_MODPROBE_ROOT=ROOT and the arguments printed on stdout, which
+# request every device file, capability and IMEX channel of the tree.
+#
+# The kernel modules are "loaded" by a fake modprobe installed in
+# ROOT/sbin, along with the modules they depend on, and "unloaded" by a
+# fake rmmod, which fails while a module is in use; both keep
+# ROOT/proc/modules up to date.  The device files are really created below
+# ROOT/dev, which needs CAP_MKNOD; the device file owner is set to the
+# caller.
+
+set -e
+
+gpus=1
+vfs=0
+caps=0
+channels=0
+blocks=0
+misplaced=0
+procs=0
+loaded=0
+
+usage() {
+    echo "usage: $0 [-g GPUS] [-v VFS] [-c CAPS] [-i CHANNELS] [-m BLOCKS]" \
+         "[-z BLOCKS] [-o PROCS] [-l] ROOT" >&2
+    exit 1
+}
+
+while getopts g:v:c:i:m:z:o:l opt; do
+    case $opt in
+        g) gpus=$OPTARG ;;
+        v) vfs=$OPTARG ;;
+        c) caps=$OPTARG ;;
+        i) channels=$OPTARG ;;
+        m) blocks=$OPTARG ;;
+        z) misplaced=$OPTARG ;;
+        o) procs=$OPTARG ;;
+        l) loaded=1 ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+[ $# -eq 1 ] || usage
+root=$1
+
+if [ "$gpus" -gt 1024 ] || [ "$vfs" -gt 248 ]; then
+    echo "$0: at most 1024 GPUs and 248 VFs per GPU are supported" >&2
+    exit 1
+fi
+
+# write_bytes FILE OFFSET BYTE... - write the given bytes (in hexadecimal)
+# at the given offset of FILE
+write_bytes() {
+    file=$1
+    off=$2
+    shift 2
+    fmt=
+    for b in "$@"; do
+        fmt="$fmt\\$(printf '%03o' "0x$b")"
+    done
+    printf "$fmt" | dd of="$file" bs=1 seek="$off" conv=notrunc 2>/dev/null
+}
+
+# pci_device DIR BDF VENDOR DEVICE CLASS SUBCLASS - create the sysfs
+# directory of a PCI device with a 256 byte config space, and its link
+# in /sys/bus/pci/devices
+pci_device() {
+    dir=$1
+    bdf=$2
+    mkdir -p "$dir"
+    dd if=/dev/zero of="$dir/config" bs=256 count=1 2>/dev/null
+    write_bytes "$dir/config" 0 \
+        "${3#??}" "${3%??}" "${4#??}" "${4%??}"
+    write_bytes "$dir/config" 10 "$6" "$5"
+    echo 0 > "$dir/numa_node"
+    ln -s "../../..${dir#$root/sys}" "$root/sys/bus/pci/devices/$bdf"
+}
+
+# Only ever remove a tree this script built.
+
+if [ -e "$root" ] && [ -n "$(ls -A "$root")" ] &&
+   [ ! -e "$root/.nvidia-modprobe-fake-root" ]; then
+    echo "$0: $root exists and is not a fake root" >&2
+    exit 1
+fi
+
+rm -rf "$root"
+mkdir -p "$root/sys/bus/pci/devices" \
+         "$root/sys/module" \
+         "$root/sys/devices/system/memory" \
+         "$root/sys/devices/system/node" \
+         "$root/proc/sys/kernel" \
+         "$root/proc/driver/nvidia/gpus" \
+         "$root/proc/driver/nvidia/capabilities" \
+         "$root/sbin" \
+         "$root/dev/char"
+root=$(cd "$root" && pwd)
+: > "$root/.nvidia-modprobe-fake-root"
+
+echo offline > "$root/sys/devices/system/memory/auto_online_blocks"
+
+# memory_block NODE BLOCK STATE ZONES - create a memory block of a NUMA
+# node, with the given valid_zones
+
+memory_block() {
+    mkdir -p "$root/sys/devices/system/memory/memory$2"
+    echo "$3" > "$root/sys/devices/system/memory/memory$2/state"
+    echo "$4" > "$root/sys/devices/system/memory/memory$2/valid_zones"
+    ln -s "../../memory/memory$2" "$root/sys/devices/system/node/node$1/memory$2"
+}
+
+# zone NODE NAME BLOCKS - add a zone with the given number of present
+# memory blocks of 128 MiB to /proc/zoneinfo
+
+echo 8000000 > "$root/sys/devices/system/memory/block_size_bytes"
+
+zone() {
+    pages=$(($3 * 32768))
+    printf 'Node %d, zone %8s\n  pages free     %d\n' $1 $2 $pages
+    printf '        spanned  %d\n        present  %d\n' $pages $pages
+    printf '        managed  %d\n' $pages
+} >> "$root/proc/zoneinfo"
+
+# Node 0 has the CPUs and the system memory, which is online; with -m,
+# the memory of GPU i is NUMA node i + 1.
+
+mkdir -p "$root/sys/devices/system/node/node0"
+echo 0-3 > "$root/sys/devices/system/node/node0/cpulist"
+for size in 2048 1048576; do
+    mkdir -p "$root/sys/devices/system/node/node0/hugepages/hugepages-${size}kB"
+    echo 0 > "$root/sys/devices/system/node/node0/hugepages/hugepages-${size}kB/nr_hugepages"
+done
+echo "Hugepagesize:       2048 kB" > "$root/proc/meminfo"
+memory_block 0 0 online Normal
+memory_block 0 1 online Normal
+zone 0 DMA 0
+zone 0 Normal 2
+zone 0 Movable 0
+block=2
+
+# The fake modprobe and rmmod find the root from their own path, since
+# they are run with a minimal environment, and share the helpers below.
+# A module's users are the modules linked in its holders directory, and
+# the count in its fake_users file, if any.
+
+cat > "$root/sbin/fake-modules" <<'EOF'
+# deps MODULE - list the modules MODULE depends on
+deps() {
+    case $1 in
+        nvidia_uvm|nvidia_modeset|nvidia_peermem) echo nvidia ;;
+        nvidia_drm) echo nvidia_modeset ;;
+    esac
+}
+
+# Modules may be loaded and unloaded concurrently.
+lock() {
+    until mkdir "$root/.modules-lock" 2>/dev/null; do
+        sleep 0.01
+    done
+}
+
+unlock() {
+    rmdir "$root/.modules-lock"
+}
+
+# update - write /proc/modules and the refcnt files from /sys/module
+update() {
+    for dir in "$root"/sys/module/*; do
+        [ -f "$dir/initstate" ] || continue
+        holders=
+        refcnt=0
+        for holder in "$dir"/holders/*; do
+            [ -e "$holder" ] || continue
+            holders="$holders${holder##*/},"
+            refcnt=$((refcnt + 1))
+        done
+        if [ -f "$dir/fake_users" ]; then
+            refcnt=$((refcnt + $(cat "$dir/fake_users")))
+        fi
+        echo $refcnt > "$dir/refcnt"
+        echo "${dir##*/} 0 $refcnt ${holders:--} Live 0x0000000000000000"
+    done > "$root/proc/modules.new"
+    mv "$root/proc/modules.new" "$root/proc/modules"
+}
+EOF
+
+cat > "$root/sbin/modprobe" <<'EOF'
+#!/bin/sh
+PATH=/bin:/usr/bin
+root=$(cd "$(dirname "$0")/.." && pwd)
+. "$root/sbin/fake-modules"
+
+load() {
+    for dep in $(deps "$1"); do
+        load "$dep"
+        mkdir -p "$root/sys/module/$dep/holders"
+        ln -sfn "../../$1" "$root/sys/module/$dep/holders/$1"
+    done
+    mkdir -p "$root/sys/module/$1/holders"
+    echo live > "$root/sys/module/$1/initstate"
+}
+
+for module; do :; done
+lock
+load "$(echo "$module" | tr - _)"
+update
+unlock
+EOF
+
+# The fake rmmod exits with the errno of delete_module(2): ENOENT if the
+# module is not loaded, and EAGAIN if it is in use.
+
+cat > "$root/sbin/rmmod" <<'EOF'
+#!/bin/sh
+PATH=/bin:/usr/bin
+root=$(cd "$(dirname "$0")/.." && pwd)
+. "$root/sbin/fake-modules"
+
+module=$(echo "$1" | tr - _)
+dir=$root/sys/module/$module
+lock
+update
+status=0
+if [ ! -f "$dir/initstate" ]; then
+    status=2
+elif [ "$(cat "$dir/refcnt")" -ne 0 ]; then
+    status=11
+else
+    for dep in $(deps "$module"); do
+        rm -f "$root/sys/module/$dep/holders/$module"
+    done
+    rm -rf "$dir"
+    update
+fi
+unlock
+exit $status
+EOF
+chmod 755 "$root/sbin/modprobe" "$root/sbin/rmmod"
+echo /sbin/modprobe > "$root/proc/sys/kernel/modprobe"
+
+# Each fake process holds /dev/nvidiactl open on its fd 3.
+
+i=0
+while [ $i -lt "$procs" ]; do
+    pid=$((4000 + i))
+    mkdir -p "$root/proc/$pid/fd"
+    echo nvidia-smi > "$root/proc/$pid/comm"
+    ln -s "$root/dev/nvidiactl" "$root/proc/$pid/fd/3"
+    i=$((i + 1))
+done
+
+if [ "$procs" -gt 0 ]; then
+    mkdir -p "$root/sys/module/nvidia"
+    echo "$procs" > "$root/sys/module/nvidia/fake_users"
+fi
+
+if [ $loaded -eq 1 ]; then
+    "$root/sbin/modprobe" nvidia-uvm
+    "$root/sbin/modprobe" nvidia-modeset
+fi
+
+(. "$root/sbin/fake-modules" && update)
+
+cat > "$root/proc/devices" <<EOF
+Character devices:
+  1 mem
+  5 /dev/tty
+195 nvidia-frontend
+234 nvidia-uvm
+235 nvidia-nvswitch
+236 nvidia-nvlink
+237 nvidia-caps
+238 nvidia-caps-imex-channels
+
+Block devices:
+  8 sd
+EOF
+
+cat > "$root/proc/driver/nvidia/params" <<EOF
+DeviceFileUID: $(id -u)
+DeviceFileGID: $(id -g)
+DeviceFileMode: 438
+ModifyDeviceFiles: 1
+EOF
+
+# Each GPU sits below a PCIe bridge reporting Data Link Layer Link
+# Active, so that --bring-up finds its link up right away.
+
+args=
+i=0
+while [ $i -lt "$gpus" ]; do
+    dom=$(printf '%04x' $((i / 32)))
+    dev=$(printf '%02x' $((i % 32)))
+    bus=$(printf '%02x' $((i % 32 + 1)))
+    vfbus=$(printf '%02x' $((i % 32 + 0x80)))
+
+    bridge=$dom:00:$dev.0
+    gpu=$dom:$bus:00.0
+    bridge_dir=$root/sys/devices/pci$dom:00/$bridge
+
+    pci_device "$bridge_dir" "$bridge" 10b5 8747 06 04
+    write_bytes "$bridge_dir/config" 52 40         # capabilities pointer
+    write_bytes "$bridge_dir/config" 64 10 00      # PCI Express, last
+    write_bytes "$bridge_dir/config" 78 10         # LNKCAP: DLLLARC
+    write_bytes "$bridge_dir/config" 83 20         # LNKSTA: DLLLA
+    : > "$bridge_dir/rescan"
+
+    pci_device "$bridge_dir/$gpu" "$gpu" 10de 2330 03 02
+
+    # Four MSI-X interrupts, handled by every CPU rather than the two
+    # local ones.
+
+    echo 0-1 > "$bridge_dir/$gpu/local_cpulist"
+    mkdir -p "$bridge_dir/$gpu/msi_irqs"
+    k=0
+    while [ $k -lt 4 ]; do
+        irq=$((100 + i * 4 + k))
+        echo msix > "$bridge_dir/$gpu/msi_irqs/$irq"
+        mkdir -p "$root/proc/irq/$irq"
+        echo 0-3 > "$root/proc/irq/$irq/smp_affinity_list"
+        k=$((k + 1))
+    done
+
+    mkdir -p "$root/proc/driver/nvidia/gpus/$gpu"
+    echo "Device Minor: $i" > "$root/proc/driver/nvidia/gpus/$gpu/information"
+
+    if [ "$blocks" -gt 0 ]; then
+        node=$((i + 1))
+        mkdir -p "$root/sys/devices/system/node/node$node"
+        echo > "$root/sys/devices/system/node/node$node/cpulist"
+        printf 'Node: %d\nStatus: online\n' $node \
+            > "$root/proc/driver/nvidia/gpus/$gpu/numa_status"
+        j=0
+        while [ $j -lt "$blocks" ]; do
+            memory_block $node $block offline "Normal Movable"
+            block=$((block + 1))
+            j=$((j + 1))
+        done
+        j=0
+        while [ $j -lt "$misplaced" ]; do
+            memory_block $node $block online Normal
+            block=$((block + 1))
+            j=$((j + 1))
+        done
+        zone $node Normal "$misplaced"
+        zone $node Movable 0
+    fi
+
+    j=0
+    while [ $j -lt "$vfs" ]; do
+        vf=$dom:$vfbus:$(printf '%02x' $((j / 8))).$((j % 8))
+        pci_device "$root/sys/devices/pci$dom:$vfbus/$vf" "$vf" \
+            10de 2330 03 02
+        j=$((j + 1))
+    done
+
+    args="$args -c $i"
+    i=$((i + 1))
+done
+
+i=0
+while [ $i -lt "$caps" ]; do
+    cap=$root/proc/driver/nvidia/capabilities/cap$i
+    printf 'DeviceFileMinor: %d\nDeviceFileMode: 292\nDeviceFileModify: 1\n' \
+        $i > "$cap"
+    args="$args -f /proc/driver/nvidia/capabilities/cap$i"
+    i=$((i + 1))
+done
+
+if [ "$channels" -gt 0 ]; then
+    args="$args -i 0:$channels"
+fi
+
+echo $args
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file implements the non-blocking modprobe-utils operations
+ * declared in nvidia-modprobe-async.h.
+ */
+
+#if defined(NV_LINUX)
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "nvidia-modprobe-async.h"
+#include "nvidia-modprobe-internal.h"
+#include "nvidia-modprobe-io.h"
+#include "pci-sysfs.h"
+
+/* How often to check on modprobe when pidfds are not available. */
+#define NV_ASYNC_CHILD_POLL_NS          10000000    /* 10 ms */
+
+/* How often to check the Data Link Layer Link Active bit. */
+#define NV_ASYNC_LINK_POLL_NS           1000000     /* 1 ms */
+
+/* modprobe processes left running by nvidia_async_op_free() */
+#define NV_ASYNC_MAX_ORPHANS            32
+
+typedef enum
+{
+    NvAsyncStageDone = 0,   /* finished; fd is a signaled eventfd */
+    NvAsyncStageWaitChild,  /* fd is a pidfd, or a polling timerfd */
+    NvAsyncStageLinkPoll,   /* fd is a periodic timerfd */
+    NvAsyncStageLinkDelay,  /* fd is a one-shot timerfd */
+    NvAsyncStageComplete    /* the callback has been called */
+} NvAsyncStage;
+
+struct NvModprobeAsyncOpRec
+{
+    NvModprobeContext *ctx;
+    NvAsyncStage stage;
+    int fd;
+    int result;
+    NvModprobeAsyncCallback *callback;
+    void *data;
+
+    /* modprobe operations */
+    const char *module_name;
+    pid_t pid;
+
+    /* PCI link operations */
+    uint32_t domain;
+    uint8_t bus;
+    uint8_t device;
+    uint8_t ftn;
+    pci_link_info_t link;
+    struct timespec start;
+};
+
+/*
+ * The modprobe processes of the operations freed before they completed.
+ * Rather than waiting for them, they are reaped with WNOHANG whenever an
+ * operation is started or freed, so that they do not linger as zombies.
+ */
+static pid_t orphans[NV_ASYNC_MAX_ORPHANS];
+static int num_orphans;
+static pthread_mutex_t orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void reap_orphans_locked(void)
+{
+    int i = 0;
+
+    while (i < num_orphans)
+    {
+        if (waitpid(orphans[i], NULL, WNOHANG) != 0)
+        {
+            orphans[i] = orphans[--num_orphans];
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+static void reap_orphans(void)
+{
+    pthread_mutex_lock(&orphans_lock);
+    reap_orphans_locked();
+    pthread_mutex_unlock(&orphans_lock);
+}
+
+/*
+ * If the table is full, the process is left to be reaped when the
+ * caller exits.
+ */
+static void add_orphan(pid_t pid)
+{
+    pthread_mutex_lock(&orphans_lock);
+
+    reap_orphans_locked();
+
+    if ((waitpid(pid, NULL, WNOHANG) == 0) &&
+        (num_orphans < NV_ASYNC_MAX_ORPHANS))
+    {
+        orphans[num_orphans++] = pid;
+    }
+
+    pthread_mutex_unlock(&orphans_lock);
+}
+
+static NvModprobeAsyncOp *alloc_op(NvModprobeContext *ctx,
+                                   NvModprobeAsyncCallback *callback,
+                                   void *data)
+{
+    NvModprobeAsyncOp *op;
+
+    reap_orphans();
+
+    op = calloc(1, sizeof(*op));
+
+    if (op == NULL)
+    {
+        return NULL;
+    }
+
+    op->ctx = ctx;
+    op->fd = -1;
+    op->pid = -1;
+    op->callback = callback;
+    op->data = data;
+
+    return op;
+}
+
+static void set_fd(NvModprobeAsyncOp *op, int fd)
+{
+    if (op->fd >= 0)
+    {
+        close(op->fd);
+    }
+    op->fd = fd;
+}
+
+/*
+ * Arm a CLOCK_MONOTONIC timerfd that expires after 'ns' nanoseconds, and
+ * then every 'ns' nanoseconds if 'periodic' is set.  Returns 0 on success,
+ * or an errno value.
+ */
+static int arm_timer(NvModprobeAsyncOp *op, long long ns, int periodic)
+{
+    struct itimerspec its;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ns / 1000000000LL;
+    its.it_value.tv_nsec = ns % 1000000000LL;
+    if (periodic)
+    {
+        its.it_interval = its.it_value;
+    }
+
+    if (timerfd_settime(fd, 0, &its, NULL) != 0)
+    {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    set_fd(op, fd);
+
+    return 0;
+}
+
+/*
+ * Record the result of an operation that finished without needing to
+ * wait; the callback is deferred to the next nvidia_async_op_dispatch(),
+ * which the caller's event loop triggers through the signaled eventfd.
+ */
+static void finish_later(NvModprobeAsyncOp *op, int result)
+{
+    op->result = result;
+    op->stage = NvAsyncStageDone;
+    set_fd(op, eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC));
+}
+
+static void complete_now(NvModprobeAsyncOp *op, int result)
+{
+    op->result = result;
+    op->stage = NvAsyncStageComplete;
+    set_fd(op, -1);
+
+    if (op->callback != NULL)
+    {
+        op->callback(op, result, op->data);
+    }
+}
+
+static long long elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000LL +
+           (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static NvModprobeAsyncOp *modprobe_async_helper(NvModprobeContext *ctx,
+                                                const int print_errors,
+                                                const char *module_name,
+                                                bool allow_on_tegra,
+                                                NvModprobeAsyncCallback *callback,
+                                                void *data)
+{
+    NvModprobeAsyncOp *op = alloc_op(ctx, callback, data);
+    NvModprobeSpawnStatus status;
+    int fd = -1;
+
+    if (op == NULL)
+    {
+        return NULL;
+    }
+
+    op->module_name = module_name;
+
+    status = nvidia_modprobe_spawn(ctx, print_errors, module_name,
+                                   allow_on_tegra, &op->pid);
+
+    if (status != NvModprobeSpawnStarted)
+    {
+        finish_later(op, status == NvModprobeSpawnLoaded);
+        return op;
+    }
+
+    op->stage = NvAsyncStageWaitChild;
+
+#if defined(SYS_pidfd_open)
+    fd = syscall(SYS_pidfd_open, op->pid, 0);
+#endif
+
+    /*
+     * Without pidfd_open(2) (Linux < 5.3), check on the child periodically
+     * instead.
+     */
+    if (fd >= 0)
+    {
+        set_fd(op, fd);
+    }
+    else if (arm_timer(op, NV_ASYNC_CHILD_POLL_NS, 1) != 0)
+    {
+        nv_io_waitpid(op->pid, NULL, 0);
+        finish_later(op, nvidia_is_module_loaded(module_name));
+    }
+
+    return op;
+}
+
+/*
+ * Attempt to load the NVIDIA kernel module without waiting for modprobe.
+ */
+NvModprobeAsyncOp *nvidia_modprobe_async(NvModprobeContext *ctx,
+                                         const int print_errors,
+                                         NvModprobeAsyncCallback *callback,
+                                         void *data)
+{
+    return modprobe_async_helper(ctx, print_errors, NV_NVIDIA_MODULE_NAME,
+                                 false, callback, data);
+}
+
+/*
+ * Attempt to load the NVIDIA Unified Memory kernel module without
+ * waiting for modprobe.
+ */
+NvModprobeAsyncOp *nvidia_uvm_modprobe_async(NvModprobeContext *ctx,
+                                             NvModprobeAsyncCallback *callback,
+                                             void *data)
+{
+    return modprobe_async_helper(ctx, 0, NV_UVM_MODULE_NAME,
+                                 false, callback, data);
+}
+
+/*
+ * Attempt to load the NVIDIA modeset driver without waiting for modprobe.
+ */
+NvModprobeAsyncOp *nvidia_modeset_modprobe_async(NvModprobeContext *ctx,
+                                                 NvModprobeAsyncCallback *callback,
+                                                 void *data)
+{
+    return modprobe_async_helper(ctx, 0, NV_MODESET_MODULE_NAME,
+                                 true, callback, data);
+}
+
+/*
+ * Enable or disable a bridge link; when enabling, the operation completes
+ * once the link is up and has settled, as with
+ * pci_bridge_link_set_enable(), but without blocking the caller.  The
+ * wait for the link ends with ETIME if the context's deadline passes.
+ */
+NvModprobeAsyncOp *pci_bridge_link_set_enable_async(NvModprobeContext *ctx,
+                                                    uint32_t domain,
+                                                    uint8_t bus,
+                                                    uint8_t device,
+                                                    uint8_t ftn,
+                                                    int enable,
+                                                    NvModprobeAsyncCallback *callback,
+                                                    void *data)
+{
+    NvModprobeAsyncOp *op = alloc_op(ctx, callback, data);
+    int err;
+
+    if (op == NULL)
+    {
+        return NULL;
+    }
+
+    op->domain = domain;
+    op->bus = bus;
+    op->device = device;
+    op->ftn = ftn;
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        finish_later(op, ETIME);
+        return op;
+    }
+
+    err = pci_bridge_link_write_enable(domain, bus, device, ftn,
+                                       enable, &op->link);
+
+    if ((err != 0) || !enable)
+    {
+        finish_later(op, err);
+        return op;
+    }
+
+    if (op->link.dlllarc)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &op->start);
+        op->stage = NvAsyncStageLinkPoll;
+        err = arm_timer(op, NV_ASYNC_LINK_POLL_NS, 1);
+    }
+    else
+    {
+        /* See pci_bridge_link_set_enable() for these delays. */
+        op->stage = NvAsyncStageLinkDelay;
+        err = arm_timer(op, (long long) PCI_LINK_DLLLAR_DISABLE_DELAY_NS +
+                            PCI_LINK_DELAY_NS, 0);
+    }
+
+    if (err != 0)
+    {
+        finish_later(op, err);
+    }
+
+    return op;
+}
+
+/*
+ * Rescan a PCI bridge (or the whole PCI tree).  The rescan itself is a
+ * single sysfs write; the operation exists so that callers can chain it
+ * with the other operations through the same completion path.
+ */
+NvModprobeAsyncOp *pci_rescan_async(NvModprobeContext *ctx,
+                                    uint32_t domain,
+                                    uint8_t bus,
+                                    uint8_t slot,
+                                    uint8_t function,
+                                    NvModprobeAsyncCallback *callback,
+                                    void *data)
+{
+    NvModprobeAsyncOp *op = alloc_op(ctx, callback, data);
+
+    if (op == NULL)
+    {
+        return NULL;
+    }
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        finish_later(op, ETIME);
+        return op;
+    }
+
+    finish_later(op, pci_rescan(domain, bus, slot, function));
+
+    return op;
+}
+
+/*
+ * Return the file descriptor to wait on for readability, or -1 once the
+ * operation has completed.  If -1 is returned for an operation that has
+ * not completed (a descriptor could not be allocated), the caller should
+ * call nvidia_async_op_dispatch() directly.
+ */
+int nvidia_async_op_get_fd(const NvModprobeAsyncOp *op)
+{
+    return op->fd;
+}
+
+/*
+ * Advance the operation; call this when its file descriptor is readable.
+ * Returns 1 once the operation has completed (the callback has been
+ * called), or 0 if it is still in progress.  The operation is not
+ * touched after its callback returns, so the callback may free it.
+ */
+int nvidia_async_op_dispatch(NvModprobeAsyncOp *op)
+{
+    uint64_t count;
+    pid_t ret;
+    int active;
+    int err;
+
+    /* Drain the eventfd/timerfd; reading a pidfd fails, which is fine. */
+
+    if ((op->fd >= 0) && (read(op->fd, &count, sizeof(count)) < 0))
+    {
+        count = 0;
+    }
+
+    switch (op->stage)
+    {
+        case NvAsyncStageDone:
+            complete_now(op, op->result);
+            return 1;
+
+        case NvAsyncStageWaitChild:
+            ret = nv_io_waitpid(op->pid, NULL, WNOHANG);
+            if (ret == 0)
+            {
+                return 0;
+            }
+
+            /*
+             * As in modprobe_helper(), ignore waitpid(2) errors and check
+             * whether the kernel module is loaded.
+             */
+            complete_now(op, nvidia_is_module_loaded(op->module_name));
+            return 1;
+
+        case NvAsyncStageLinkPoll:
+            err = pci_bridge_link_is_active(op->domain, op->bus, op->device,
+                                            op->ftn, &op->link, &active);
+            if (err != 0)
+            {
+                complete_now(op, err);
+                return 1;
+            }
+            else if (active)
+            {
+                op->stage = NvAsyncStageLinkDelay;
+                err = arm_timer(op, PCI_LINK_DELAY_NS, 0);
+                if (err != 0)
+                {
+                    complete_now(op, err);
+                    return 1;
+                }
+            }
+            else if ((elapsed_us(&op->start) >= PCI_LINK_WAIT_US) ||
+                     nvidia_modprobe_context_out_of_time(op->ctx))
+            {
+                complete_now(op, ETIME);
+                return 1;
+            }
+            break;
+
+        case NvAsyncStageLinkDelay:
+            complete_now(op, 0);
+            return 1;
+
+        case NvAsyncStageComplete:
+            return 1;
+    }
+
+    return 0;
+}
+
+int nvidia_async_op_is_complete(const NvModprobeAsyncOp *op)
+{
+    return op->stage == NvAsyncStageComplete;
+}
+
+int nvidia_async_op_get_result(const NvModprobeAsyncOp *op)
+{
+    return op->result;
+}
+
+/*
+ * Release an operation.  An operation may be freed before it completes,
+ * in which case its callback is never called; a modprobe that is still
+ * running is not waited for, but reaped later (see reap_orphans()).
+ */
+void nvidia_async_op_free(NvModprobeAsyncOp *op)
+{
+    if (op == NULL)
+    {
+        return;
+    }
+
+    if (op->stage == NvAsyncStageWaitChild)
+    {
+        add_orphan(op->pid);
+    }
+    else
+    {
+        reap_orphans();
+    }
+
+    set_fd(op, -1);
+    free(op);
+}
+
+#endif /* NV_LINUX */
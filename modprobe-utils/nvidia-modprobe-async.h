@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file provides non-blocking variants of the modprobe-utils
+ * operations that otherwise wait on a child process or on a PCI link,
+ * for use from poll(2)/epoll(7) based event loops.
+ *
+ * Each operation returns a handle exposing a file descriptor.  When the
+ * descriptor becomes readable, the caller invokes
+ * nvidia_async_op_dispatch(), which advances the operation and, once it
+ * has finished, calls the completion callback.  The callback is only
+ * ever called from nvidia_async_op_dispatch(), never from the function
+ * that started the operation, and may free the operation with
+ * nvidia_async_op_free().  The file descriptor of an operation may
+ * change as it moves between stages, so callers must re-read it with
+ * nvidia_async_op_get_fd() after each dispatch.
+ *
+ * Freeing an operation never blocks: a modprobe still running is reaped
+ * later, when another operation is started or freed.
+ *
+ * An operation uses the context it was started with until it completes;
+ * operations sharing a context must be dispatched from the same thread.
+ */
+
+#ifndef __NVIDIA_MODPROBE_ASYNC_H__
+#define __NVIDIA_MODPROBE_ASYNC_H__
+
+#if defined(NV_LINUX)
+
+#include <stdint.h>
+
+#include "nvidia-modprobe-utils.h"
+
+typedef struct NvModprobeAsyncOpRec NvModprobeAsyncOp;
+
+/*
+ * 'result' follows the convention of the corresponding synchronous
+ * function: 1/0 for the modprobe operations, 0/errno for the PCI ones.
+ */
+typedef void NvModprobeAsyncCallback(NvModprobeAsyncOp *op, int result,
+                                     void *data);
+
+NvModprobeAsyncOp *nvidia_modprobe_async(NvModprobeContext *ctx,
+                                         const int print_errors,
+                                         NvModprobeAsyncCallback *callback,
+                                         void *data);
+NvModprobeAsyncOp *nvidia_uvm_modprobe_async(NvModprobeContext *ctx,
+                                             NvModprobeAsyncCallback *callback,
+                                             void *data);
+NvModprobeAsyncOp *nvidia_modeset_modprobe_async(NvModprobeContext *ctx,
+                                                 NvModprobeAsyncCallback *callback,
+                                                 void *data);
+NvModprobeAsyncOp *pci_bridge_link_set_enable_async(NvModprobeContext *ctx,
+                                                    uint32_t domain,
+                                                    uint8_t bus,
+                                                    uint8_t device,
+                                                    uint8_t ftn,
+                                                    int enable,
+                                                    NvModprobeAsyncCallback *callback,
+                                                    void *data);
+NvModprobeAsyncOp *pci_rescan_async(NvModprobeContext *ctx,
+                                    uint32_t domain,
+                                    uint8_t bus,
+                                    uint8_t slot,
+                                    uint8_t function,
+                                    NvModprobeAsyncCallback *callback,
+                                    void *data);
+
+int nvidia_async_op_get_fd(const NvModprobeAsyncOp *op);
+int nvidia_async_op_dispatch(NvModprobeAsyncOp *op);
+int nvidia_async_op_is_complete(const NvModprobeAsyncOp *op);
+int nvidia_async_op_get_result(const NvModprobeAsyncOp *op);
+void nvidia_async_op_free(NvModprobeAsyncOp *op);
+
+#endif /* NV_LINUX */
+
+#endif /* __NVIDIA_MODPROBE_ASYNC_H__ */
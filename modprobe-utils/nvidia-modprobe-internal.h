@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file declares helpers shared between the modprobe-utils source
+ * files; it is not part of the modprobe-utils interface.
+ */
+
+#ifndef __NVIDIA_MODPROBE_INTERNAL_H__
+#define __NVIDIA_MODPROBE_INTERNAL_H__
+
+#if defined(NV_LINUX)
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "nvidia-modprobe-utils.h"
+
+#define NV_NVIDIA_MODULE_NAME "nvidia"
+#define NV_UVM_MODULE_NAME "nvidia-uvm"
+#define NV_MODESET_MODULE_NAME "nvidia-modeset"
+
+typedef enum
+{
+    NvModprobeSpawnFailed = 0,
+    NvModprobeSpawnLoaded,
+    NvModprobeSpawnStarted
+} NvModprobeSpawnStatus;
+
+int nvidia_is_module_loaded(const char *nv_module_name);
+NvModprobeSpawnStatus nvidia_modprobe_spawn(NvModprobeContext *ctx,
+                                            const int print_errors,
+                                            const char *module_name,
+                                            bool allow_on_tegra,
+                                            pid_t *pid_out);
+
+#endif /* NV_LINUX */
+
+#endif /* __NVIDIA_MODPROBE_INTERNAL_H__ */
@@ -0,0 +1,907 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if defined(NV_LINUX)
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "nvidia-modprobe-io.h"
+#include "nvidia-modprobe-trace.h"
+
+/*
+ * The counters are kept per thread, like the contexts, so that threads
+ * running requests concurrently do not contend on them.
+ */
+static __thread NvModprobeStats nv_io_stats;
+
+#define NV_IO_COUNT(stat) (nv_io_stats.count[(stat)]++)
+
+#define NV_MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/*
+ * The root prefix, by contrast, is process-wide: it is set once, before
+ * any request is started, and only read afterwards.
+ */
+static char nv_io_root[PATH_MAX];
+static size_t nv_io_root_len;
+
+/*
+ * Prepend the root prefix to an absolute path, using 'buf' (PATH_MAX
+ * bytes) if needed.  Returns NULL, with errno set, if the result does
+ * not fit.
+ */
+static const char *nv_io_path(const char *path, char *buf)
+{
+    size_t len;
+
+    if ((nv_io_root_len == 0) || (path[0] != '/'))
+    {
+        return path;
+    }
+
+    len = strlen(path);
+    if (nv_io_root_len + len >= PATH_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    memcpy(buf, nv_io_root, nv_io_root_len);
+    memcpy(buf + nv_io_root_len, path, len + 1);
+
+    return buf;
+}
+
+/*
+ * Remove the root prefix from a path resolved below it, in place, so that
+ * callers see the same paths with and without a root prefix.
+ */
+static void nv_io_unprefix(char *path)
+{
+    if ((nv_io_root_len != 0) &&
+        (strncmp(path, nv_io_root, nv_io_root_len) == 0) &&
+        (path[nv_io_root_len] == '/'))
+    {
+        memmove(path, path + nv_io_root_len,
+                strlen(path + nv_io_root_len) + 1);
+    }
+}
+
+#define NV_IO_PATH(real_path, path, buf, fail)  \
+do {                                            \
+    (real_path) = nv_io_path((path), (buf));    \
+    if ((real_path) == NULL)                    \
+    {                                           \
+        return (fail);                          \
+    }                                           \
+} while (0)
+
+/*
+ * When recording, each operation is timed and logged with the path given
+ * by the caller; when replaying, it is served by nvidia-modprobe-trace.c
+ * without touching the file system.
+ */
+#define NV_IO_RECORDING (nv_trace_mode == NvModprobeTraceRecord)
+#define NV_IO_REPLAYING (nv_trace_mode == NvModprobeTraceReplay)
+
+#define NV_IO_START() (NV_IO_RECORDING ? nv_trace_now() : 0)
+
+#define NV_IO_RECORD(op, path, start, ret, st, resolved_path)           \
+do {                                                                    \
+    if (NV_IO_RECORDING)                                                \
+    {                                                                   \
+        nv_trace_record((op), (path), (start), (ret), errno, (st),      \
+                        (resolved_path));                               \
+    }                                                                   \
+} while (0)
+
+static const char *stat_names[NvModprobeNumStats] = {
+    [NvModprobeStatOpen]     = "open",
+    [NvModprobeStatRead]     = "read",
+    [NvModprobeStatWrite]    = "write",
+    [NvModprobeStatStat]     = "stat",
+    [NvModprobeStatMknod]    = "mknod",
+    [NvModprobeStatMkdir]    = "mkdir",
+    [NvModprobeStatChmod]    = "chmod",
+    [NvModprobeStatChown]    = "chown",
+    [NvModprobeStatSymlink]  = "symlink",
+    [NvModprobeStatRemove]   = "remove",
+    [NvModprobeStatSpawn]    = "spawn",
+    [NvModprobeStatDeleteModule] = "delete-module",
+    [NvModprobeStatCacheHit] = "cache-hit",
+};
+
+void nvidia_modprobe_get_stats(NvModprobeStats *stats)
+{
+    *stats = nv_io_stats;
+}
+
+void nvidia_modprobe_reset_stats(void)
+{
+    memset(&nv_io_stats, 0, sizeof(nv_io_stats));
+}
+
+void nv_io_count(NvModprobeStat stat)
+{
+    NV_IO_COUNT(stat);
+}
+
+const char *nvidia_modprobe_stat_name(NvModprobeStat stat)
+{
+    if ((stat < 0) || (stat >= NvModprobeNumStats))
+    {
+        return "unknown";
+    }
+
+    return stat_names[stat];
+}
+
+int nv_io_is_setuid(void)
+{
+    return (getuid() != geteuid()) || (getgid() != getegid());
+}
+
+/*
+ * Set the root prefix; a NULL or empty root removes it.  The prefix is
+ * not honored in a setuid or setgid process, where it would let the
+ * caller choose the files written with elevated privileges.
+ */
+int nvidia_modprobe_set_root(const char *root)
+{
+    size_t len;
+
+    if ((root == NULL) || (root[0] == '\0'))
+    {
+        nv_io_root[0] = '\0';
+        nv_io_root_len = 0;
+        return 0;
+    }
+
+    if (nv_io_is_setuid())
+    {
+        return EPERM;
+    }
+
+    if (root[0] != '/')
+    {
+        return EINVAL;
+    }
+
+    len = strlen(root);
+    while ((len > 1) && (root[len - 1] == '/'))
+    {
+        len--;
+    }
+
+    if (len >= sizeof(nv_io_root))
+    {
+        return ENAMETOOLONG;
+    }
+
+    memcpy(nv_io_root, root, len);
+    nv_io_root[len] = '\0';
+    nv_io_root_len = (len == 1) ? 0 : len;
+
+    return 0;
+}
+
+/*
+ * Set the root prefix from the NV_MODPROBE_ROOT_ENV environment variable,
+ * if it is set.
+ */
+int nvidia_modprobe_set_root_from_env(void)
+{
+    const char *root = getenv(NV_MODPROBE_ROOT_ENV);
+
+    if (root == NULL)
+    {
+        return 0;
+    }
+
+    return nvidia_modprobe_set_root(root);
+}
+
+const char *nvidia_modprobe_get_root(void)
+{
+    return nv_io_root_len ? nv_io_root : "";
+}
+
+/*
+ * nv_io_fopen() - open path for reading into the caller's NvIoFile;
+ * returns fp, or NULL with errno set.  It is opened, recorded and
+ * replayed like nv_io_open(O_RDONLY).
+ */
+NvIoFile *nv_io_fopen(NvIoFile *fp, const char *path)
+{
+    fp->fd = nv_io_open(path, O_RDONLY, 0);
+    if (fp->fd < 0)
+    {
+        return NULL;
+    }
+
+    fp->eof = 0;
+    fp->error = 0;
+    fp->pos = 0;
+    fp->len = 0;
+
+    return fp;
+}
+
+int nv_io_fclose(NvIoFile *fp)
+{
+    return nv_io_close(fp->fd);
+}
+
+int nv_io_ferror(const NvIoFile *fp)
+{
+    return fp->error;
+}
+
+/*
+ * Refill the buffer of fp once it has been consumed; returns the number
+ * of buffered bytes, or 0 at end of file or on error.  The refills are
+ * not counted: each nv_io_fread() or nv_io_fgets() counts as one read,
+ * as with stdio.
+ */
+static size_t nv_io_fill(NvIoFile *fp)
+{
+    ssize_t n;
+
+    if (fp->pos < fp->len)
+    {
+        return fp->len - fp->pos;
+    }
+
+    if (fp->eof || fp->error)
+    {
+        return 0;
+    }
+
+    do
+    {
+        n = read(fp->fd, fp->buf, sizeof(fp->buf));
+    } while ((n < 0) && (errno == EINTR));
+
+    fp->pos = 0;
+    fp->len = (n > 0) ? n : 0;
+
+    if (n == 0)
+    {
+        fp->eof = 1;
+    }
+    else if (n < 0)
+    {
+        fp->error = 1;
+    }
+
+    return fp->len;
+}
+
+size_t nv_io_fread(void *ptr, size_t size, size_t n, NvIoFile *fp)
+{
+    char *dst = ptr;
+    size_t total, done = 0, avail;
+
+    NV_IO_COUNT(NvModprobeStatRead);
+
+    if ((size == 0) || (n == 0))
+    {
+        return 0;
+    }
+
+    total = size * n;
+
+    while ((done < total) && ((avail = nv_io_fill(fp)) > 0))
+    {
+        avail = NV_MIN(avail, total - done);
+        memcpy(dst + done, fp->buf + fp->pos, avail);
+        fp->pos += avail;
+        done += avail;
+    }
+
+    return done / size;
+}
+
+char *nv_io_fgets(char *s, int size, NvIoFile *fp)
+{
+    size_t done = 0, avail;
+    const char *newline;
+
+    NV_IO_COUNT(NvModprobeStatRead);
+
+    if (size <= 0)
+    {
+        return NULL;
+    }
+
+    while ((done < (size_t) size - 1) && ((avail = nv_io_fill(fp)) > 0))
+    {
+        avail = NV_MIN(avail, (size_t) size - 1 - done);
+
+        newline = memchr(fp->buf + fp->pos, '\n', avail);
+        if (newline != NULL)
+        {
+            avail = newline - (fp->buf + fp->pos) + 1;
+        }
+
+        memcpy(s + done, fp->buf + fp->pos, avail);
+        fp->pos += avail;
+        done += avail;
+
+        if (newline != NULL)
+        {
+            break;
+        }
+    }
+
+    if ((done == 0) || fp->error)
+    {
+        return NULL;
+    }
+
+    s[done] = '\0';
+
+    return s;
+}
+
+int nv_io_open(const char *path, int flags, mode_t mode)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int fd;
+
+    NV_IO_COUNT(NvModprobeStatOpen);
+
+    if (NV_IO_REPLAYING)
+    {
+        fd = nv_trace_replay_open(path);
+    }
+    else
+    {
+        NV_IO_PATH(real_path, path, buf, -1);
+
+        start = NV_IO_START();
+        fd = open(real_path, flags, mode);
+
+        if (NV_IO_RECORDING)
+        {
+            nv_trace_record_open(path, real_path, start, (fd < 0) ? -1 : 0,
+                                 errno, (flags & O_ACCMODE) != O_WRONLY);
+        }
+    }
+
+    if ((fd >= 0) && (nv_trace_mode != NvModprobeTraceOff))
+    {
+        nv_trace_set_fd_path(fd, path);
+    }
+
+    return fd;
+}
+
+int nv_io_close(int fd)
+{
+    if (nv_trace_mode != NvModprobeTraceOff)
+    {
+        nv_trace_set_fd_path(fd, NULL);
+    }
+
+    return close(fd);
+}
+
+ssize_t nv_io_read(int fd, void *buf, size_t count)
+{
+    NV_IO_COUNT(NvModprobeStatRead);
+    return read(fd, buf, count);
+}
+
+/*
+ * Writes are traced by the path the fd was opened with; a replayed write
+ * returns the recorded result, and only goes to the memory file serving
+ * the fd.
+ */
+ssize_t nv_io_write(int fd, const void *buf, size_t count)
+{
+    const char *path = NULL;
+    long long start;
+    ssize_t ret;
+
+    NV_IO_COUNT(NvModprobeStatWrite);
+
+    if (nv_trace_mode != NvModprobeTraceOff)
+    {
+        path = nv_trace_get_fd_path(fd);
+    }
+
+    if (NV_IO_REPLAYING && (path != NULL))
+    {
+        return nv_trace_replay(NvTraceWrite, path, NULL, NULL);
+    }
+
+    start = NV_IO_START();
+    ret = write(fd, buf, count);
+
+    if (path != NULL)
+    {
+        NV_IO_RECORD(NvTraceWrite, path, start, ret, NULL, NULL);
+    }
+
+    return ret;
+}
+
+DIR *nv_io_opendir(const char *path)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    DIR *dir;
+
+    NV_IO_COUNT(NvModprobeStatOpen);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay_opendir(path);
+    }
+
+    NV_IO_PATH(real_path, path, buf, NULL);
+
+    start = NV_IO_START();
+    dir = opendir(real_path);
+
+    if (NV_IO_RECORDING)
+    {
+        nv_trace_record_opendir(path, real_path, start, dir ? 0 : -1, errno);
+    }
+
+    return dir;
+}
+
+struct dirent *nv_io_readdir(DIR *dir)
+{
+    NV_IO_COUNT(NvModprobeStatRead);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay_readdir(dir);
+    }
+
+    return readdir(dir);
+}
+
+int nv_io_closedir(DIR *dir)
+{
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay_closedir(dir);
+    }
+
+    return closedir(dir);
+}
+
+int nv_io_access(const char *path, int mode)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatStat);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceAccess, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = access(real_path, mode);
+    NV_IO_RECORD(NvTraceAccess, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_stat(const char *path, struct stat *st)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatStat);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceStat, path, st, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = stat(real_path, st);
+    NV_IO_RECORD(NvTraceStat, path, start, ret, st, NULL);
+
+    return ret;
+}
+
+/*
+ * The root prefix is removed from the resolved path, so that callers see
+ * the same paths with and without a root prefix.
+ */
+char *nv_io_realpath(const char *path, char *resolved_path)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    char *ret;
+
+    NV_IO_COUNT(NvModprobeStatStat);
+
+    if (NV_IO_REPLAYING)
+    {
+        return (nv_trace_replay(NvTraceRealpath, path, NULL,
+                                resolved_path) == 0) ? resolved_path : NULL;
+    }
+
+    NV_IO_PATH(real_path, path, buf, NULL);
+
+    start = NV_IO_START();
+    ret = realpath(real_path, resolved_path);
+
+    if (ret != NULL)
+    {
+        nv_io_unprefix(resolved_path);
+    }
+
+    NV_IO_RECORD(NvTraceRealpath, path, start, ret ? 0 : -1, NULL, ret);
+
+    return ret;
+}
+
+/*
+ * Unlike readlink(2), the target is nul-terminated, truncated to fit
+ * 'size' bytes if needed, and the root prefix is removed from it as from
+ * the paths resolved by nv_io_realpath().  Returns the length of the
+ * target, or -1 with errno set.
+ */
+ssize_t nv_io_readlink(const char *path, char *buf, size_t size)
+{
+    char path_buf[PATH_MAX], target[PATH_MAX];
+    const char *real_path;
+    long long start;
+    ssize_t len;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatStat);
+
+    target[0] = '\0';
+
+    if (NV_IO_REPLAYING)
+    {
+        ret = nv_trace_replay(NvTraceReadlink, path, NULL, target);
+    }
+    else
+    {
+        NV_IO_PATH(real_path, path, path_buf, -1);
+
+        start = NV_IO_START();
+        len = readlink(real_path, target, sizeof(target) - 1);
+        ret = (len < 0) ? -1 : 0;
+
+        if (ret == 0)
+        {
+            target[len] = '\0';
+            nv_io_unprefix(target);
+        }
+
+        NV_IO_RECORD(NvTraceReadlink, path, start, ret, NULL,
+                     (ret == 0) ? target : NULL);
+    }
+
+    if ((ret != 0) || (size == 0))
+    {
+        return -1;
+    }
+
+    len = NV_MIN(strlen(target), size - 1);
+    memcpy(buf, target, len);
+    buf[len] = '\0';
+
+    return len;
+}
+
+int nv_io_mknod(const char *path, mode_t mode, dev_t dev)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatMknod);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceMknod, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = mknod(real_path, mode, dev);
+    NV_IO_RECORD(NvTraceMknod, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_mkdir(const char *path, mode_t mode)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatMkdir);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceMkdir, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = mkdir(real_path, mode);
+    NV_IO_RECORD(NvTraceMkdir, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_chmod(const char *path, mode_t mode)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatChmod);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceChmod, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = chmod(real_path, mode);
+    NV_IO_RECORD(NvTraceChmod, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_chown(const char *path, uid_t uid, gid_t gid)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatChown);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceChown, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = chown(real_path, uid, gid);
+    NV_IO_RECORD(NvTraceChown, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_symlink(const char *target, const char *path)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatSymlink);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceSymlink, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = symlink(target, real_path);
+    NV_IO_RECORD(NvTraceSymlink, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_remove(const char *path)
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatRemove);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceRemove, path, NULL, NULL);
+    }
+
+    NV_IO_PATH(real_path, path, buf, -1);
+
+    start = NV_IO_START();
+    ret = remove(real_path);
+    NV_IO_RECORD(NvTraceRemove, path, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+int nv_io_posix_spawn(pid_t *pid, const char *path,
+                      const posix_spawn_file_actions_t *file_actions,
+                      const posix_spawnattr_t *attrp,
+                      char *const argv[], char *const envp[])
+{
+    char buf[PATH_MAX];
+    const char *real_path;
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatSpawn);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay_spawn(pid, path);
+    }
+
+    real_path = nv_io_path(path, buf);
+    if (real_path == NULL)
+    {
+        return errno;
+    }
+
+    start = NV_IO_START();
+    ret = posix_spawn(pid, real_path, file_actions, attrp, argv, envp);
+
+    if (NV_IO_RECORDING)
+    {
+        nv_trace_record_spawn(*pid, path, start, ret);
+    }
+
+    return ret;
+}
+
+/*
+ * Processes started with nv_io_posix_spawn() must be reaped with
+ * nv_io_waitpid(), so that their run time can be recorded.
+ */
+pid_t nv_io_waitpid(pid_t pid, int *status, int options)
+{
+    pid_t ret = waitpid(pid, status, options);
+
+    if ((ret > 0) && NV_IO_RECORDING)
+    {
+        nv_trace_record_reaped(ret);
+    }
+
+    return ret;
+}
+
+/*
+ * Below a root prefix, the kernel modules are those of the fake tree
+ * rather than of the running kernel: ROOT/sbin/rmmod (see
+ * gen-fake-root.sh) is run in place of delete_module(2), and its exit
+ * status is the errno of the call.
+ */
+#define NV_IO_FAKE_RMMOD_PATH "/sbin/rmmod"
+
+static int nv_io_fake_delete_module(const char *name)
+{
+    char buf[PATH_MAX], module[64];
+    char *argv[] = { "rmmod", module, NULL };
+    static char *envp[] = { "PATH=/sbin:/bin:/usr/bin", NULL };
+    const char *path;
+    pid_t pid;
+    int status, err;
+
+    path = nv_io_path(NV_IO_FAKE_RMMOD_PATH, buf);
+    if (path == NULL)
+    {
+        return -1;
+    }
+
+    snprintf(module, sizeof(module), "%s", name);
+
+    err = posix_spawn(&pid, path, NULL, NULL, argv, envp);
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        return -1;
+    }
+
+    if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+    {
+        return 0;
+    }
+
+    errno = WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+    return -1;
+}
+
+/*
+ * Unload a kernel module; 'flags' are those of delete_module(2), e.g.
+ * O_NONBLOCK.
+ */
+int nv_io_delete_module(const char *name, unsigned int flags)
+{
+    long long start;
+    int ret;
+
+    NV_IO_COUNT(NvModprobeStatDeleteModule);
+
+    if (NV_IO_REPLAYING)
+    {
+        return nv_trace_replay(NvTraceDeleteModule, name, NULL, NULL);
+    }
+
+    start = NV_IO_START();
+
+    if (nv_io_root_len != 0)
+    {
+        ret = nv_io_fake_delete_module(name);
+    }
+    else
+    {
+        ret = syscall(SYS_delete_module, name, flags);
+    }
+
+    NV_IO_RECORD(NvTraceDeleteModule, name, start, ret, NULL, NULL);
+
+    return ret;
+}
+
+#endif /* NV_LINUX */
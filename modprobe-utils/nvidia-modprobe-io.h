@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file declares the wrappers through which modprobe-utils performs
+ * its file system and process operations, so that they can be accounted
+ * for (see nvidia_modprobe_get_stats()) and redirected below a root
+ * prefix (see nvidia_modprobe_set_root()) or recorded and replayed (see
+ * nvidia_modprobe_set_trace()).  It is not part of the
+ * modprobe-utils interface.
+ */
+
+#ifndef __NVIDIA_MODPROBE_IO_H__
+#define __NVIDIA_MODPROBE_IO_H__
+
+#if defined(NV_LINUX)
+
+#include <stdio.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "nvidia-modprobe-utils.h"
+
+/*
+ * A file opened for buffered reading with nv_io_fopen().  Unlike a stdio
+ * FILE, it lives in storage provided by the caller, usually its stack, so
+ * that reading /proc and /sys files does not allocate.
+ */
+#define NV_IO_FILE_BUF_SIZE 4096
+
+typedef struct {
+    int fd;
+    int eof;
+    int error;
+    size_t pos;
+    size_t len;
+    char buf[NV_IO_FILE_BUF_SIZE];
+} NvIoFile;
+
+NvIoFile *nv_io_fopen(NvIoFile *fp, const char *path);
+int nv_io_fclose(NvIoFile *fp);
+size_t nv_io_fread(void *ptr, size_t size, size_t n, NvIoFile *fp);
+char *nv_io_fgets(char *s, int size, NvIoFile *fp);
+int nv_io_ferror(const NvIoFile *fp);
+
+int nv_io_open(const char *path, int flags, mode_t mode);
+int nv_io_close(int fd);
+ssize_t nv_io_read(int fd, void *buf, size_t count);
+ssize_t nv_io_write(int fd, const void *buf, size_t count);
+
+DIR *nv_io_opendir(const char *path);
+struct dirent *nv_io_readdir(DIR *dir);
+int nv_io_closedir(DIR *dir);
+
+int nv_io_access(const char *path, int mode);
+int nv_io_stat(const char *path, struct stat *st);
+char *nv_io_realpath(const char *path, char *resolved_path);
+ssize_t nv_io_readlink(const char *path, char *buf, size_t size);
+
+int nv_io_mknod(const char *path, mode_t mode, dev_t dev);
+int nv_io_mkdir(const char *path, mode_t mode);
+int nv_io_chmod(const char *path, mode_t mode);
+int nv_io_chown(const char *path, uid_t uid, gid_t gid);
+int nv_io_symlink(const char *target, const char *path);
+int nv_io_remove(const char *path);
+
+int nv_io_posix_spawn(pid_t *pid, const char *path,
+                      const posix_spawn_file_actions_t *file_actions,
+                      const posix_spawnattr_t *attrp,
+                      char *const argv[], char *const envp[]);
+pid_t nv_io_waitpid(pid_t pid, int *status, int options);
+
+int nv_io_delete_module(const char *name, unsigned int flags);
+
+void nv_io_count(NvModprobeStat stat);
+
+int nv_io_is_setuid(void);
+
+#endif /* NV_LINUX */
+
+#endif /* __NVIDIA_MODPROBE_IO_H__ */
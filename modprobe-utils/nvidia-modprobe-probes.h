@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file defines the USDT (user-level statically defined tracing)
+ * probes of modprobe-utils.  When <sys/sdt.h> is available, each probe
+ * compiles to a single nop plus an ELF note, which tools such as
+ * bpftrace or perf can attach to at run time, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/nvidia-modprobe:nvidia_modprobe:mknod__done
+ *                { printf("%s %d\n", str(arg0), arg2); }'
+ *
+ * Otherwise, or if NV_DISABLE_USDT is defined, the probes compile to
+ * nothing.
+ *
+ * Probes (arguments in order):
+ *
+ *   modprobe__start    module name
+ *   modprobe__done     module name, result
+ *   unload__start      module name
+ *   unload__done       module name, result
+ *   pci__scan__start   vendor id, device class
+ *   pci__scan__done    number of matches, errno
+ *   pci__cfg__start    domain, bus, device, function, offset
+ *   pci__cfg__done     domain, bus, device, function, errno
+ *   link__start        domain, bus, device, function, enable
+ *   link__done         domain, bus, device, function, errno
+ *   mknod__start       path, major, minor
+ *   mknod__done        path, major, minor, result
+ *   symlink__start     path, major, minor
+ *   symlink__done      path, major, minor, result
+ */
+
+#ifndef __NVIDIA_MODPROBE_PROBES_H__
+#define __NVIDIA_MODPROBE_PROBES_H__
+
+#if !defined(NV_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define NV_USDT_ENABLED 1
+#endif
+#endif
+
+#if defined(NV_USDT_ENABLED)
+
+#include <sys/sdt.h>
+
+#define NV_PROBE1(name, a) \
+    DTRACE_PROBE1(nvidia_modprobe, name, a)
+#define NV_PROBE2(name, a, b) \
+    DTRACE_PROBE2(nvidia_modprobe, name, a, b)
+#define NV_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(nvidia_modprobe, name, a, b, c)
+#define NV_PROBE4(name, a, b, c, d) \
+    DTRACE_PROBE4(nvidia_modprobe, name, a, b, c, d)
+#define NV_PROBE5(name, a, b, c, d, e) \
+    DTRACE_PROBE5(nvidia_modprobe, name, a, b, c, d, e)
+
+#else
+
+#define NV_PROBE1(name, a)                  do { } while (0)
+#define NV_PROBE2(name, a, b)               do { } while (0)
+#define NV_PROBE3(name, a, b, c)            do { } while (0)
+#define NV_PROBE4(name, a, b, c, d)         do { } while (0)
+#define NV_PROBE5(name, a, b, c, d, e)      do { } while (0)
+
+#endif /* NV_USDT_ENABLED */
+
+#endif /* __NVIDIA_MODPROBE_PROBES_H__ */
@@ -0,0 +1,904 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Recording and replay of the file system and process operations of
+ * modprobe-utils.
+ *
+ * A recording is a text file with one line per operation:
+ *
+ *   OP NS RET ERRNO PATH DATA [MODE RDEV UID GID INO SIZE]
+ *
+ * where NS is the latency of the operation in nanoseconds, PATH is the
+ * path as given by modprobe-utils (before any root prefix), and DATA is
+ * '-', or '=' followed by the content of the file for "open", the
+ * '/'-separated entries for "opendir" or the resolved path for
+ * "realpath" and "readlink".  For "delete_module", PATH is the name of
+ * the kernel module.  PATH and DATA are percent-encoded.  The stat(2) fields
+ * are only present for successful "stat" operations.  For "open", NS
+ * is the latency of open(2) alone: the content is read afterwards, outside
+ * of the operations being timed.  For "spawn", NS is the time until the
+ * process exited.
+ *
+ * On replay, each operation is looked up by kind and path: the recorded
+ * operations on a given path are served in order, the last one being
+ * repeated if needed, each after its recorded latency.  Files are served
+ * from anonymous memory files, and modprobe is replaced by sleep(1).
+ */
+
+#if defined(NV_LINUX)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "nvidia-modprobe-trace.h"
+#include "nvidia-modprobe-io.h"
+
+#define NV_TRACE_MAX_CONTENT    (1 << 20)
+#define NV_TRACE_MAX_FDS        1024
+#define NV_TRACE_MAX_CHILDREN   16
+#define NV_TRACE_SLEEP_PATH     "/bin/sleep"
+#define NV_TRACE_SPIN_NS        200000
+
+typedef struct
+{
+    NvTraceOp op;
+    char *path;
+    long long ns;
+    int ret;
+    int err;
+    char *data;                 /* NULL if none */
+    size_t data_len;
+    int has_stat;
+    struct stat st;
+    int used;
+} NvTraceEntry;
+
+typedef struct
+{
+    pid_t pid;
+    long long start;
+    char *path;
+} NvTraceChild;
+
+/* A directory being replayed, handed out as a DIR *. */
+typedef struct
+{
+    char *names;
+    size_t len;
+    size_t pos;
+    struct dirent ent;
+} NvTraceDir;
+
+NvModprobeTraceMode nv_trace_mode = NvModprobeTraceOff;
+
+static pthread_mutex_t nv_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static FILE *nv_trace_fp;
+static NvTraceChild nv_trace_children[NV_TRACE_MAX_CHILDREN];
+static char *nv_trace_fd_paths[NV_TRACE_MAX_FDS];
+
+static NvTraceEntry *nv_trace_entries;
+static int nv_trace_num_entries;
+
+static const char *op_names[NvTraceNumOps] = {
+    [NvTraceOpen]     = "open",
+    [NvTraceOpendir]  = "opendir",
+    [NvTraceWrite]    = "write",
+    [NvTraceAccess]   = "access",
+    [NvTraceStat]     = "stat",
+    [NvTraceRealpath] = "realpath",
+    [NvTraceMknod]    = "mknod",
+    [NvTraceMkdir]    = "mkdir",
+    [NvTraceChmod]    = "chmod",
+    [NvTraceChown]    = "chown",
+    [NvTraceSymlink]  = "symlink",
+    [NvTraceRemove]   = "remove",
+    [NvTraceReadlink] = "readlink",
+    [NvTraceDeleteModule] = "delete_module",
+    [NvTraceSpawn]    = "spawn",
+};
+
+
+long long nv_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+ * Percent-encode the bytes that would break the line format.
+ */
+static void put_encoded(FILE *fp, const char *s, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        unsigned char c = s[i];
+
+        if ((c <= ' ') || (c >= 0x7f) || (c == '%'))
+        {
+            fprintf(fp, "%%%02x", c);
+        }
+        else
+        {
+            fputc(c, fp);
+        }
+    }
+}
+
+/*
+ * Decode a percent-encoded string in place; returns its length.
+ */
+static size_t decode(char *s)
+{
+    char *in = s, *out = s;
+    unsigned int c;
+
+    while (*in != '\0')
+    {
+        if ((in[0] == '%') && (sscanf(in + 1, "%2x", &c) == 1))
+        {
+            *out++ = c;
+            in += 3;
+        }
+        else
+        {
+            *out++ = *in++;
+        }
+    }
+
+    *out = '\0';
+
+    return out - s;
+}
+
+
+static void write_entry(NvTraceOp op, const char *path, long long ns,
+                        int ret, int err, const char *data, size_t len,
+                        const struct stat *st)
+{
+    int saved_errno = errno;
+
+    if (ret == 0)
+    {
+        err = 0;
+    }
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    if (nv_trace_fp != NULL)
+    {
+        fprintf(nv_trace_fp, "%s %lld %d %d ", op_names[op], ns, ret, err);
+        put_encoded(nv_trace_fp, path, strlen(path));
+
+        if (data != NULL)
+        {
+            fputs(" =", nv_trace_fp);
+            put_encoded(nv_trace_fp, data, len);
+        }
+        else
+        {
+            fputs(" -", nv_trace_fp);
+        }
+
+        if (st != NULL)
+        {
+            fprintf(nv_trace_fp, " %o %llu %u %u %llu %lld",
+                    (unsigned int)st->st_mode,
+                    (unsigned long long)st->st_rdev,
+                    (unsigned int)st->st_uid, (unsigned int)st->st_gid,
+                    (unsigned long long)st->st_ino,
+                    (long long)st->st_size);
+        }
+
+        fputc('\n', nv_trace_fp);
+    }
+
+    pthread_mutex_unlock(&nv_trace_lock);
+
+    errno = saved_errno;
+}
+
+void nv_trace_record(NvTraceOp op, const char *path, long long start,
+                     int ret, int err, const struct stat *st,
+                     const char *resolved_path)
+{
+    long long ns = nv_trace_now() - start;
+
+    write_entry(op, path, ns, ret, err, resolved_path,
+                resolved_path ? strlen(resolved_path) : 0,
+                (ret == 0) ? st : NULL);
+}
+
+/*
+ * Record an open(2), along with the content of the file if it was opened
+ * for reading.  The file is read separately, through a file descriptor of
+ * its own, once the latency of the open has been taken: the snapshot may
+ * read much more of the file than the caller does.
+ */
+void nv_trace_record_open(const char *path, const char *real_path,
+                          long long start, int ret, int err, int readable)
+{
+    long long ns = nv_trace_now() - start;
+    int saved_errno = errno;
+    char *content = NULL;
+    size_t len = 0;
+    ssize_t n;
+    int fd;
+
+    if ((ret == 0) && readable)
+    {
+        content = malloc(NV_TRACE_MAX_CONTENT);
+        fd = open(real_path, O_RDONLY);
+
+        if ((content != NULL) && (fd >= 0))
+        {
+            while ((len < NV_TRACE_MAX_CONTENT) &&
+                   ((n = read(fd, content + len,
+                              NV_TRACE_MAX_CONTENT - len)) > 0))
+            {
+                len += n;
+            }
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    write_entry(NvTraceOpen, path, ns, ret, err,
+                (content != NULL) ? content : NULL, len, NULL);
+
+    free(content);
+    errno = saved_errno;
+}
+
+/*
+ * Record an opendir(3), along with the entries of the directory.
+ */
+void nv_trace_record_opendir(const char *path, const char *real_path,
+                             long long start, int ret, int err)
+{
+    long long ns = nv_trace_now() - start;
+    int saved_errno = errno;
+    char *names = NULL;
+    size_t len = 0, size = 0;
+    struct dirent *d;
+    DIR *dir;
+
+    if (ret == 0)
+    {
+        start = nv_trace_now();
+
+        dir = opendir(real_path);
+
+        while ((dir != NULL) && ((d = readdir(dir)) != NULL))
+        {
+            size_t name_len = strlen(d->d_name);
+            char *new_names;
+
+            if (len + name_len + 1 > size)
+            {
+                size = (len + name_len + 1) * 2;
+                new_names = realloc(names, size);
+                if (new_names == NULL)
+                {
+                    break;
+                }
+                names = new_names;
+            }
+
+            if (len > 0)
+            {
+                names[len++] = '/';
+            }
+            memcpy(names + len, d->d_name, name_len);
+            len += name_len;
+        }
+
+        if (dir != NULL)
+        {
+            closedir(dir);
+        }
+
+        ns += nv_trace_now() - start;
+    }
+
+    write_entry(NvTraceOpendir, path, ns, ret, err,
+                (ret == 0) ? (names ? names : "") : NULL, len, NULL);
+
+    free(names);
+    errno = saved_errno;
+}
+
+/*
+ * A spawned process is recorded when it is reaped, with the time it ran
+ * for; a failed spawn is recorded right away.
+ */
+void nv_trace_record_spawn(pid_t pid, const char *path, long long start,
+                           int ret)
+{
+    int i;
+
+    if (ret != 0)
+    {
+        write_entry(NvTraceSpawn, path, nv_trace_now() - start, ret, ret,
+                    NULL, 0, NULL);
+        return;
+    }
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    for (i = 0; i < NV_TRACE_MAX_CHILDREN; i++)
+    {
+        NvTraceChild *child = &nv_trace_children[i];
+
+        if (child->path == NULL)
+        {
+            child->pid = pid;
+            child->start = start;
+            child->path = strdup(path);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&nv_trace_lock);
+}
+
+void nv_trace_record_reaped(pid_t pid)
+{
+    NvTraceChild child = { 0, 0, NULL };
+    int i;
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    for (i = 0; i < NV_TRACE_MAX_CHILDREN; i++)
+    {
+        if ((nv_trace_children[i].path != NULL) &&
+            (nv_trace_children[i].pid == pid))
+        {
+            child = nv_trace_children[i];
+            nv_trace_children[i].path = NULL;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&nv_trace_lock);
+
+    if (child.path != NULL)
+    {
+        write_entry(NvTraceSpawn, child.path, nv_trace_now() - child.start,
+                    0, 0, NULL, 0, NULL);
+        free(child.path);
+    }
+}
+
+
+void nv_trace_set_fd_path(int fd, const char *path)
+{
+    if ((fd < 0) || (fd >= NV_TRACE_MAX_FDS))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    free(nv_trace_fd_paths[fd]);
+    nv_trace_fd_paths[fd] = path ? strdup(path) : NULL;
+
+    pthread_mutex_unlock(&nv_trace_lock);
+}
+
+const char *nv_trace_get_fd_path(int fd)
+{
+    if ((fd < 0) || (fd >= NV_TRACE_MAX_FDS))
+    {
+        return NULL;
+    }
+
+    return nv_trace_fd_paths[fd];
+}
+
+
+/*
+ * Load a recording; returns 0 or an errno value.
+ */
+static int load_trace(const char *path)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    FILE *fp;
+    int max_entries = 0;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return errno;
+    }
+
+    while (getline(&line, &line_size, fp) >= 0)
+    {
+        char op_name[32];
+        char *save, *token;
+        NvTraceEntry entry;
+        unsigned int mode, uid, gid;
+        unsigned long long rdev, ino;
+        long long size;
+        int n, op;
+
+        memset(&entry, 0, sizeof(entry));
+
+        if ((line[0] == '#') ||
+            (sscanf(line, "%31s %lld %d %d %n", op_name, &entry.ns,
+                    &entry.ret, &entry.err, &n) != 4))
+        {
+            continue;
+        }
+
+        for (op = 0; op < NvTraceNumOps; op++)
+        {
+            if (strcmp(op_name, op_names[op]) == 0)
+            {
+                break;
+            }
+        }
+
+        token = strtok_r(line + n, " \n", &save);
+        if ((op == NvTraceNumOps) || (token == NULL))
+        {
+            continue;
+        }
+
+        entry.op = op;
+        decode(token);
+        entry.path = strdup(token);
+
+        token = strtok_r(NULL, " \n", &save);
+        if ((token != NULL) && (token[0] == '='))
+        {
+            entry.data_len = decode(token + 1);
+            entry.data = malloc(entry.data_len + 1);
+            if (entry.data != NULL)
+            {
+                memcpy(entry.data, token + 1, entry.data_len + 1);
+            }
+        }
+
+        token = strtok_r(NULL, "\n", &save);
+        if ((token != NULL) &&
+            (sscanf(token, "%o %llu %u %u %llu %lld", &mode, &rdev, &uid,
+                    &gid, &ino, &size) == 6))
+        {
+            entry.has_stat = 1;
+            entry.st.st_mode = mode;
+            entry.st.st_rdev = rdev;
+            entry.st.st_uid = uid;
+            entry.st.st_gid = gid;
+            entry.st.st_ino = ino;
+            entry.st.st_size = size;
+        }
+
+        if (nv_trace_num_entries == max_entries)
+        {
+            NvTraceEntry *entries;
+
+            max_entries = max_entries ? max_entries * 2 : 256;
+            entries = realloc(nv_trace_entries,
+                              max_entries * sizeof(*entries));
+            if (entries == NULL)
+            {
+                free(entry.path);
+                free(entry.data);
+                break;
+            }
+            nv_trace_entries = entries;
+        }
+
+        nv_trace_entries[nv_trace_num_entries++] = entry;
+    }
+
+    free(line);
+    fclose(fp);
+
+    return 0;
+}
+
+static void free_trace(void)
+{
+    int i;
+
+    for (i = 0; i < nv_trace_num_entries; i++)
+    {
+        free(nv_trace_entries[i].path);
+        free(nv_trace_entries[i].data);
+    }
+
+    free(nv_trace_entries);
+    nv_trace_entries = NULL;
+    nv_trace_num_entries = 0;
+}
+
+/*
+ * Wait until the given time.  Short delays are spun, since sleeping
+ * typically takes tens of microseconds longer than asked for.
+ */
+static void delay_until(long long deadline)
+{
+    struct timespec ts;
+
+    if (deadline - nv_trace_now() > NV_TRACE_SPIN_NS)
+    {
+        ts.tv_sec = (deadline - NV_TRACE_SPIN_NS) / 1000000000LL;
+        ts.tv_nsec = (deadline - NV_TRACE_SPIN_NS) % 1000000000LL;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                               &ts, NULL) == EINTR);
+    }
+
+    while (nv_trace_now() < deadline);
+}
+
+/*
+ * Find the next recorded operation of the given kind on the given path,
+ * and wait for as long as it took.
+ */
+static const NvTraceEntry *next_entry(NvTraceOp op, const char *path)
+{
+    NvTraceEntry *entry, *last = NULL;
+    long long start = nv_trace_now();
+    int i;
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    for (i = 0; i < nv_trace_num_entries; i++)
+    {
+        entry = &nv_trace_entries[i];
+
+        if ((entry->op != op) || (strcmp(entry->path, path) != 0))
+        {
+            continue;
+        }
+
+        if (!entry->used)
+        {
+            entry->used = 1;
+            last = entry;
+            break;
+        }
+
+        last = entry;
+    }
+
+    pthread_mutex_unlock(&nv_trace_lock);
+
+    if (last != NULL)
+    {
+        delay_until(start + last->ns);
+    }
+
+    return last;
+}
+
+int nv_trace_replay(NvTraceOp op, const char *path, struct stat *st,
+                    char *resolved_path)
+{
+    const NvTraceEntry *entry = next_entry(op, path);
+
+    if (entry == NULL)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if ((st != NULL) && entry->has_stat)
+    {
+        memset(st, 0, sizeof(*st));
+        st->st_mode = entry->st.st_mode;
+        st->st_rdev = entry->st.st_rdev;
+        st->st_uid = entry->st.st_uid;
+        st->st_gid = entry->st.st_gid;
+        st->st_ino = entry->st.st_ino;
+        st->st_size = entry->st.st_size;
+    }
+
+    if ((resolved_path != NULL) && (entry->data != NULL))
+    {
+        snprintf(resolved_path, PATH_MAX, "%s", entry->data);
+    }
+
+    errno = entry->err;
+    return entry->ret;
+}
+
+/*
+ * Serve a recorded file from an anonymous memory file.
+ */
+int nv_trace_replay_open(const char *path)
+{
+    const NvTraceEntry *entry = next_entry(NvTraceOpen, path);
+    size_t len = 0;
+    ssize_t n;
+    int fd = -1;
+
+    if (entry == NULL)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (entry->ret != 0)
+    {
+        errno = entry->err;
+        return -1;
+    }
+
+#if defined(SYS_memfd_create)
+    fd = syscall(SYS_memfd_create, "nvidia-modprobe-replay", 0);
+#endif
+
+    if (fd < 0)
+    {
+        FILE *fp = tmpfile();
+
+        if (fp == NULL)
+        {
+            return -1;
+        }
+
+        fd = dup(fileno(fp));
+        fclose(fp);
+
+        if (fd < 0)
+        {
+            return -1;
+        }
+    }
+
+    while ((entry->data != NULL) && (len < entry->data_len) &&
+           ((n = write(fd, entry->data + len, entry->data_len - len)) > 0))
+    {
+        len += n;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+
+    return fd;
+}
+
+DIR *nv_trace_replay_opendir(const char *path)
+{
+    const NvTraceEntry *entry = next_entry(NvTraceOpendir, path);
+    NvTraceDir *dir;
+
+    if (entry == NULL)
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (entry->ret != 0)
+    {
+        errno = entry->err;
+        return NULL;
+    }
+
+    dir = calloc(1, sizeof(*dir));
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+
+    dir->names = entry->data;
+    dir->len = entry->data ? entry->data_len : 0;
+
+    return (DIR *)dir;
+}
+
+struct dirent *nv_trace_replay_readdir(DIR *d)
+{
+    NvTraceDir *dir = (NvTraceDir *)d;
+    const char *name, *end;
+    size_t len;
+
+    if (dir->pos >= dir->len)
+    {
+        return NULL;
+    }
+
+    name = dir->names + dir->pos;
+    end = memchr(name, '/', dir->len - dir->pos);
+    len = end ? (size_t)(end - name) : dir->len - dir->pos;
+
+    dir->pos += len + 1;
+
+    if (len >= sizeof(dir->ent.d_name))
+    {
+        len = sizeof(dir->ent.d_name) - 1;
+    }
+    memcpy(dir->ent.d_name, name, len);
+    dir->ent.d_name[len] = '\0';
+    dir->ent.d_type = DT_UNKNOWN;
+
+    return &dir->ent;
+}
+
+int nv_trace_replay_closedir(DIR *dir)
+{
+    free(dir);
+    return 0;
+}
+
+/*
+ * Replace a recorded process by sleep(1), for as long as the process
+ * ran, so that it can be waited for as usual.
+ */
+int nv_trace_replay_spawn(pid_t *pid, const char *path)
+{
+    const NvTraceEntry *entry;
+    char seconds[32];
+    char *argv[] = { "sleep", seconds, NULL };
+    char *envp[] = { NULL };
+    NvTraceEntry *e;
+    int i;
+
+    /* The delay is the process itself: look the entry up without it. */
+
+    entry = NULL;
+
+    pthread_mutex_lock(&nv_trace_lock);
+
+    for (i = 0; i < nv_trace_num_entries; i++)
+    {
+        e = &nv_trace_entries[i];
+
+        if ((e->op == NvTraceSpawn) && (strcmp(e->path, path) == 0))
+        {
+            entry = e;
+            if (!e->used)
+            {
+                e->used = 1;
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&nv_trace_lock);
+
+    if (entry == NULL)
+    {
+        return ENOENT;
+    }
+
+    if (entry->ret != 0)
+    {
+        return entry->ret;
+    }
+
+    snprintf(seconds, sizeof(seconds), "%lld.%09lld",
+             entry->ns / 1000000000LL, entry->ns % 1000000000LL);
+
+    return posix_spawn(pid, NV_TRACE_SLEEP_PATH, NULL, NULL, argv, envp);
+}
+
+
+/*
+ * Start recording to, or replaying from, the given file;
+ * NvModprobeTraceOff stops recording or replaying.
+ */
+int nvidia_modprobe_set_trace(NvModprobeTraceMode mode, const char *path)
+{
+    int ret = 0;
+
+    if (nv_trace_fp != NULL)
+    {
+        fclose(nv_trace_fp);
+        nv_trace_fp = NULL;
+    }
+
+    free_trace();
+    nv_trace_mode = NvModprobeTraceOff;
+
+    if (mode == NvModprobeTraceOff)
+    {
+        return 0;
+    }
+
+    if (nv_io_is_setuid())
+    {
+        return EPERM;
+    }
+
+    if (mode == NvModprobeTraceRecord)
+    {
+        nv_trace_fp = fopen(path, "w");
+        if (nv_trace_fp == NULL)
+        {
+            return errno;
+        }
+
+        fprintf(nv_trace_fp, "# nvidia-modprobe trace: op ns ret errno "
+                "path data [mode rdev uid gid ino size]\n");
+    }
+    else if (mode == NvModprobeTraceReplay)
+    {
+        ret = load_trace(path);
+        if (ret != 0)
+        {
+            return ret;
+        }
+    }
+    else
+    {
+        return EINVAL;
+    }
+
+    nv_trace_mode = mode;
+
+    return 0;
+}
+
+/*
+ * Start recording or replaying as requested by the NV_MODPROBE_RECORD_ENV
+ * or NV_MODPROBE_REPLAY_ENV environment variable, if either is set.
+ */
+int nvidia_modprobe_set_trace_from_env(void)
+{
+    const char *record = getenv(NV_MODPROBE_RECORD_ENV);
+    const char *replay = getenv(NV_MODPROBE_REPLAY_ENV);
+
+    if ((record != NULL) && (replay != NULL))
+    {
+        return EINVAL;
+    }
+
+    if (record != NULL)
+    {
+        return nvidia_modprobe_set_trace(NvModprobeTraceRecord, record);
+    }
+
+    if (replay != NULL)
+    {
+        return nvidia_modprobe_set_trace(NvModprobeTraceReplay, replay);
+    }
+
+    return 0;
+}
+
+#endif /* NV_LINUX */
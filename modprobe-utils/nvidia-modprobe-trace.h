@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file declares the recording and replay backends of the I/O layer
+ * (see nvidia_modprobe_set_trace()).  It is only used by
+ * nvidia-modprobe-io.c, and is not part of the modprobe-utils interface.
+ */
+
+#ifndef __NVIDIA_MODPROBE_TRACE_H__
+#define __NVIDIA_MODPROBE_TRACE_H__
+
+#if defined(NV_LINUX)
+
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "nvidia-modprobe-utils.h"
+
+typedef enum
+{
+    NvTraceOpen = 0,
+    NvTraceOpendir,
+    NvTraceWrite,
+    NvTraceAccess,
+    NvTraceStat,
+    NvTraceRealpath,
+    NvTraceMknod,
+    NvTraceMkdir,
+    NvTraceChmod,
+    NvTraceChown,
+    NvTraceSymlink,
+    NvTraceRemove,
+    NvTraceReadlink,
+    NvTraceDeleteModule,
+    NvTraceSpawn,
+    NvTraceNumOps
+} NvTraceOp;
+
+extern NvModprobeTraceMode nv_trace_mode;
+
+/* Recording: 'start' is the value of nv_trace_now() before the operation. */
+
+long long nv_trace_now(void);
+
+void nv_trace_record(NvTraceOp op, const char *path, long long start,
+                     int ret, int err, const struct stat *st,
+                     const char *resolved_path);
+void nv_trace_record_open(const char *path, const char *real_path,
+                          long long start, int ret, int err, int readable);
+void nv_trace_record_opendir(const char *path, const char *real_path,
+                             long long start, int ret, int err);
+void nv_trace_record_spawn(pid_t pid, const char *path, long long start,
+                           int ret);
+void nv_trace_record_reaped(pid_t pid);
+
+/* The path an fd was opened with, for tracing the writes to it. */
+
+void nv_trace_set_fd_path(int fd, const char *path);
+const char *nv_trace_get_fd_path(int fd);
+
+/*
+ * Replay: nv_trace_replay() returns the recorded result of an operation,
+ * with errno set to the recorded error, after the recorded delay.
+ */
+
+int nv_trace_replay(NvTraceOp op, const char *path, struct stat *st,
+                    char *resolved_path);
+int nv_trace_replay_open(const char *path);
+DIR *nv_trace_replay_opendir(const char *path);
+struct dirent *nv_trace_replay_readdir(DIR *dir);
+int nv_trace_replay_closedir(DIR *dir);
+int nv_trace_replay_spawn(pid_t *pid, const char *path);
+
+#endif /* NV_LINUX */
+
+#endif /* __NVIDIA_MODPROBE_TRACE_H__ */
@@ -39,9 +39,16 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <stdarg.h>
+#include <limits.h>
 
 #include "nvidia-modprobe-utils.h"
+#include "nvidia-modprobe-internal.h"
+#include "nvidia-modprobe-io.h"
+#include "nvidia-modprobe-probes.h"
 #include "pci-enum.h"
+#include "pci-sysfs.h"
+#include "nvline-utils.h"
 
 #define NV_DEV_PATH "/dev/"
 #define NV_PROC_MODPROBE_PATH "/proc/sys/kernel/modprobe"
@@ -50,16 +57,15 @@
 #define NV_PROC_MODPROBE_PATH_MAX        1024
 #define NV_MAX_MODULE_NAME_SIZE          16
 #define NV_MAX_LINE_LENGTH               256
+#define NV_PROC_FILE_STACK_SIZE          4096
+#define NV_PROC_FILE_MAX_SIZE            (64 * 1024)
 
-#define NV_NVIDIA_MODULE_NAME "nvidia"
 #define NV_PROC_REGISTRY_PATH "/proc/driver/nvidia/params"
+#define NV_PROC_GPUS_PATH "/proc/driver/nvidia/gpus"
 
-#define NV_UVM_MODULE_NAME "nvidia-uvm"
 #define NV_UVM_DEVICE_NAME "/dev/nvidia-uvm"
 #define NV_UVM_TOOLS_DEVICE_NAME "/dev/nvidia-uvm-tools"
 
-#define NV_MODESET_MODULE_NAME "nvidia-modeset"
-
 #define NV_VGPU_VFIO_MODULE_NAME "nvidia-vgpu-vfio"
 
 #define NV_NVLINK_MODULE_NAME "nvidia-nvlink"
@@ -74,6 +80,19 @@
 
 #define NV_MSR_MODULE_NAME "msr"
 
+#define NV_SYS_NODE_PATH "/sys/devices/system/node"
+#define NV_SYS_MEMORY_PATH "/sys/devices/system/memory"
+#define NV_PROC_ZONEINFO_PATH "/proc/zoneinfo"
+#define NV_PROC_MEMINFO_PATH "/proc/meminfo"
+#define NV_SYS_BUS_PCI_DEVICES_PATH "/sys/bus/pci/devices"
+#define NV_SYS_MODULE_PATH "/sys/module"
+#define NV_PROC_IRQ_PATH "/proc/irq"
+#define NV_PROC_PATH "/proc"
+#define NV_PROC_MODULES_PATH "/proc/modules"
+
+#define NV_PROC_MODULES_MIN_SIZE         (16 * 1024)
+#define NV_PROC_MODULES_MAX_SIZE         (1024 * 1024)
+
 #define NV_DEVICE_FILE_MODE_MASK (S_IRWXU|S_IRWXG|S_IRWXO)
 #define NV_DEVICE_FILE_MODE (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH)
 #define NV_DEVICE_FILE_UID 0
@@ -87,13 +106,166 @@
 #define NV_PCI_VENDOR_ID    0x10DE
 
 #define NV_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define NV_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+#define NV_MAX_LOG_MESSAGE_LENGTH        512
+
+void nvidia_modprobe_context_init(NvModprobeContext *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void nvidia_modprobe_context_set_log(NvModprobeContext *ctx,
+                                     NvModprobeLogFunc *log, void *data)
+{
+    ctx->log = log;
+    ctx->log_data = data;
+}
+
+void nvidia_modprobe_context_set_timing(NvModprobeContext *ctx,
+                                        NvModprobeSpanFunc *span, void *data)
+{
+    ctx->span = span;
+    ctx->span_data = data;
+}
+
+void nvidia_modprobe_context_flush_cache(NvModprobeContext *ctx)
+{
+    ctx->num_majors = 0;
+    ctx->num_params = 0;
+    ctx->next_param = 0;
+}
+
+/*
+ * Set the deadline after which the context refuses to start new work;
+ * a NULL deadline removes it.  The same deadline may be given to
+ * several contexts, so that they share one time budget.
+ */
+void nvidia_modprobe_context_set_deadline(NvModprobeContext *ctx,
+                                          const struct timespec *deadline)
+{
+    ctx->has_deadline = (deadline != NULL);
+    ctx->out_of_time = 0;
+
+    if (deadline != NULL)
+    {
+        ctx->deadline = *deadline;
+    }
+}
+
+/*
+ * Set the deadline to budget_ms milliseconds from now.
+ */
+void nvidia_modprobe_context_set_budget(NvModprobeContext *ctx,
+                                        int budget_ms)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    deadline.tv_sec += budget_ms / 1000;
+    deadline.tv_nsec += (budget_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    nvidia_modprobe_context_set_deadline(ctx, &deadline);
+}
+
+/*
+ * Returns 1 if the context's deadline has passed.  Once it has, this
+ * keeps returning 1, so callers can tell afterwards whether work was
+ * refused for lack of time.
+ */
+int nvidia_modprobe_context_out_of_time(NvModprobeContext *ctx)
+{
+    struct timespec now;
+
+    if (!ctx->has_deadline || ctx->out_of_time)
+    {
+        return ctx->out_of_time;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if ((now.tv_sec > ctx->deadline.tv_sec) ||
+        ((now.tv_sec == ctx->deadline.tv_sec) &&
+         (now.tv_nsec >= ctx->deadline.tv_nsec)))
+    {
+        ctx->out_of_time = 1;
+    }
+
+    return ctx->out_of_time;
+}
+
+/*
+ * Report an error through the context's log sink, or to stderr if no
+ * sink has been set.
+ */
+static void nv_ctx_log(NvModprobeContext *ctx, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void nv_ctx_log(NvModprobeContext *ctx, const char *fmt, ...)
+{
+    char msg[NV_MAX_LOG_MESSAGE_LENGTH];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    if (ctx->log != NULL)
+    {
+        ctx->log(ctx->log_data, msg);
+    }
+    else
+    {
+        fputs(msg, stderr);
+    }
+}
+
+/*
+ * Measure a phase for the context's timing callback; when no callback is
+ * set, these only cost a test of ctx->span.
+ */
+static void nv_span_begin(NvModprobeContext *ctx, struct timespec *start)
+{
+    if (ctx->span != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, start);
+    }
+    else
+    {
+        start->tv_sec = 0;
+        start->tv_nsec = 0;
+    }
+}
+
+static void nv_span_end(NvModprobeContext *ctx, const struct timespec *start,
+                        const char *name, const char *arg)
+{
+    struct timespec end;
+
+    if (ctx->span == NULL)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ctx->span(ctx->span_data, name, arg,
+              (end.tv_sec - start->tv_sec) * 1000000000LL +
+              (end.tv_nsec - start->tv_nsec));
+}
 
 /*
  * Check whether the specified module is loaded by checking if its
  * initstate file exists; returns 1 if the kernel module is loaded.
  * Otherwise, it returns 0.
  */
-static int is_kernel_module_loaded(const char *nv_module_name)
+int nvidia_is_module_loaded(const char *nv_module_name)
 {
     int i;
     char init_path[NV_MAX_LINE_LENGTH];
@@ -115,23 +287,20 @@ static int is_kernel_module_loaded(const char *nv_module_name)
             init_path[i] = '_';
     }
 
-    return (access(init_path, R_OK) == 0);
+    return (nv_io_access(init_path, R_OK) == 0);
 }
 
 /*
- * Create posix_spawn rules to redirect STDOUT and STDERR to /dev/null.
+ * Create posix_spawn rules to redirect STDOUT and STDERR to /dev/null,
+ * in the caller's storage; returns file_actions, or NULL on failure.
  *
  * This is only for the cosmetics of silencing warnings, so do not
  * treat any errors here as fatal.
  */
-static posix_spawn_file_actions_t* silence_process_actions(void)
+static posix_spawn_file_actions_t*
+silence_process_actions(posix_spawn_file_actions_t *file_actions)
 {
-    posix_spawn_file_actions_t *file_actions = malloc(sizeof *file_actions);
-
-    if (!file_actions ||
-        posix_spawn_file_actions_init(file_actions)) {
-
-        free(file_actions);
+    if (posix_spawn_file_actions_init(file_actions)) {
         return NULL;
     }
 
@@ -143,15 +312,15 @@ static posix_spawn_file_actions_t* silence_process_actions(void)
 static bool is_tegra(void)
 {
     char soc_family_name[NV_MAX_SOC_FAMILY_NAME_SIZE];
-    FILE *fp;
+    NvIoFile file, *fp;
     size_t n;
 
-    fp = fopen(NV_SYS_DEVICES_SOC_FAMILY, "r");
+    fp = nv_io_fopen(&file, NV_SYS_DEVICES_SOC_FAMILY);
     if (fp != NULL)
     {
-        n = fread(soc_family_name, 1, sizeof(soc_family_name), fp);
+        n = nv_io_fread(soc_family_name, 1, sizeof(soc_family_name), fp);
 
-        fclose(fp);
+        nv_io_fclose(fp);
 
         n = NV_MIN(n, sizeof(soc_family_name) - 1);
         soc_family_name[n] = '\0';
@@ -166,15 +335,19 @@ static bool is_tegra(void)
 }
 
 /*
- * Attempt to load a kernel module; returns 1 if kernel module is
- * successfully loaded.  Returns 0 if the kernel module could not be
- * loaded.
+ * Start loading a kernel module: returns NvModprobeSpawnLoaded if the
+ * module is already loaded, NvModprobeSpawnStarted (and the pid of the
+ * modprobe process in *pid_out) if modprobe was spawned, or
+ * NvModprobeSpawnFailed if the module could not be loaded.
  *
- * If any error is encountered and print_errors is non-0, then print the
- * error to stderr.
+ * If any error is encountered and print_errors is non-0, then report the
+ * error through the context's log sink.
  */
-static int modprobe_helper(const int print_errors, const char *module_name,
-                           bool allow_on_tegra)
+NvModprobeSpawnStatus nvidia_modprobe_spawn(NvModprobeContext *ctx,
+                                            const int print_errors,
+                                            const char *module_name,
+                                            bool allow_on_tegra,
+                                            pid_t *pid_out)
 {
     char modprobe_path[NV_PROC_MODPROBE_PATH_MAX];
     int status = 1;
@@ -182,8 +355,10 @@ static int modprobe_helper(const int print_errors, const char *module_name,
     pid_t pid;
     const char * const argv[] = { "modprobe", module_name, NULL };
     static const char *envp[] = { "PATH=/sbin", NULL };
-    posix_spawn_file_actions_t *file_actions;
-    FILE *fp;
+    posix_spawn_file_actions_t file_actions_storage, *file_actions;
+    NvIoFile file, *fp;
+    struct timespec start;
+    int loaded;
 
     /*
      * Use PCI_BASE_CLASS_MASK to cover both types of DISPLAY controllers that
@@ -202,21 +377,36 @@ static int modprobe_helper(const int print_errors, const char *module_name,
     modprobe_path[0] = '\0';
 
     if (module_name == NULL || module_name[0] == '\0') {
-        return 0;
+        return NvModprobeSpawnFailed;
     }
 
     /* If the kernel module is already loaded, nothing more to do: success. */
 
-    if (is_kernel_module_loaded(module_name))
+    nv_span_begin(ctx, &start);
+    loaded = nvidia_is_module_loaded(module_name);
+    nv_span_end(ctx, &start, "is_module_loaded", module_name);
+
+    if (loaded)
     {
-        return 1;
+        return NvModprobeSpawnLoaded;
+    }
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        if (print_errors)
+        {
+            nv_ctx_log(ctx, "NVIDIA: out of time, not loading %s\n",
+                       module_name);
+        }
+
+        return NvModprobeSpawnFailed;
     }
 
     /* Only attempt to load the kernel module if root. */
 
     if (geteuid() != 0)
     {
-        return 0;
+        return NvModprobeSpawnFailed;
     }
 
     /*
@@ -228,7 +418,10 @@ static int modprobe_helper(const int print_errors, const char *module_name,
      * If our check fails, for whatever reason, continue with the modprobe just
      * in case.
      */
+    nv_span_begin(ctx, &start);
     status = pci_enum_match_id(&id_match);
+    nv_span_end(ctx, &start, "pci_enum_match_id", NULL);
+
     if (status == 0 && id_match.num_matches == 0)
     {
         /*
@@ -240,23 +433,24 @@ static int modprobe_helper(const int print_errors, const char *module_name,
         {
             if (print_errors)
             {
-                fprintf(stderr,
-                        "NVIDIA: no NVIDIA devices found\n");
+                nv_ctx_log(ctx, "NVIDIA: no NVIDIA devices found\n");
             }
 
-            return 0;
+            return NvModprobeSpawnFailed;
         }
     }
 
     /* Attempt to read the full path to the modprobe executable from /proc. */
 
-    fp = fopen(NV_PROC_MODPROBE_PATH, "r");
+    nv_span_begin(ctx, &start);
+
+    fp = nv_io_fopen(&file, NV_PROC_MODPROBE_PATH);
     if (fp != NULL)
     {
         char *str;
         size_t n;
 
-        n = fread(modprobe_path, 1, sizeof(modprobe_path), fp);
+        n = nv_io_fread(modprobe_path, 1, sizeof(modprobe_path), fp);
 
         /*
          * Null terminate the string, but make sure 'n' is in the range
@@ -276,7 +470,7 @@ static int modprobe_helper(const int print_errors, const char *module_name,
             *str = '\0';
         }
 
-        fclose(fp);
+        nv_io_fclose(fp);
     }
 
     /* If we couldn't read it from /proc, pick a reasonable default. */
@@ -288,16 +482,22 @@ static int modprobe_helper(const int print_errors, const char *module_name,
 
     /* Do not attempt to exec(3) modprobe if it does not exist. */
 
-    if (stat(modprobe_path, &file_status) != 0 ||
+    status = nv_io_stat(modprobe_path, &file_status);
+
+    nv_span_end(ctx, &start, "modprobe_path", modprobe_path);
+
+    if (status != 0 ||
         !S_ISREG(file_status.st_mode) ||
         (file_status.st_mode & S_IXUSR) != S_IXUSR)
     {
-        return 0;
+        return NvModprobeSpawnFailed;
     }
 
     /* Fork and exec modprobe from the child process. */
 
-    file_actions = silence_process_actions();
+    nv_span_begin(ctx, &start);
+
+    file_actions = silence_process_actions(&file_actions_storage);
 
     /*
      * POSIX specifies that the argv and envp arguments are arrays of non-const
@@ -308,26 +508,41 @@ static int modprobe_helper(const int print_errors, const char *module_name,
      */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
-    status = posix_spawn(&pid, modprobe_path, file_actions,
-                         NULL /* attrp */,
-                         (char **) argv,
-                         (char **) envp);
+    status = nv_io_posix_spawn(&pid, modprobe_path, file_actions,
+                               NULL /* attrp */,
+                               (char **) argv,
+                               (char **) envp);
 #pragma GCC diagnostic pop
 
     if (file_actions) {
         posix_spawn_file_actions_destroy(file_actions);
-        free(file_actions);
     }
 
+    nv_span_end(ctx, &start, "spawn", module_name);
+
     if (status) {
         if (print_errors) {
-            fprintf(stderr,
-                    "NVIDIA: failed to execute `%s`: %s.\n",
-                    modprobe_path, strerror(status));
+            nv_ctx_log(ctx, "NVIDIA: failed to execute `%s`: %s.\n",
+                       modprobe_path, strerror(status));
         }
-        return 0;
+        return NvModprobeSpawnFailed;
     }
 
+    *pid_out = pid;
+
+    return NvModprobeSpawnStarted;
+}
+
+/*
+ * Wait for the modprobe process started by nvidia_modprobe_spawn() for a
+ * kernel module; returns 1 if the module is then loaded, and 0 otherwise.
+ */
+static int modprobe_wait(NvModprobeContext *ctx, const char *module_name,
+                         pid_t pid)
+{
+    struct timespec start;
+    int loaded;
+
     /*
      * waitpid(2) is not always guaranteed to return success even if
      * the child terminated normally.  For example, if the process
@@ -339,20 +554,173 @@ static int modprobe_helper(const int print_errors, const char *module_name,
      * Hence, ignore waitpid(2) error codes and instead check
      * whether the desired kernel module is loaded.
      */
-    waitpid(pid, NULL, 0);
+    nv_span_begin(ctx, &start);
+    nv_io_waitpid(pid, NULL, 0);
+    nv_span_end(ctx, &start, "wait", module_name);
+
+    nv_span_begin(ctx, &start);
+    loaded = nvidia_is_module_loaded(module_name);
+    nv_span_end(ctx, &start, "is_module_loaded", module_name);
+
+    NV_PROBE2(modprobe__done, module_name, loaded);
+
+    return loaded;
+}
+
+/*
+ * Attempt to load a kernel module; returns 1 if kernel module is
+ * successfully loaded.  Returns 0 if the kernel module could not be
+ * loaded.
+ *
+ * If any error is encountered and print_errors is non-0, then report the
+ * error through the context's log sink.
+ */
+static int modprobe_helper(NvModprobeContext *ctx, const int print_errors,
+                           const char *module_name, bool allow_on_tegra)
+{
+    NvModprobeSpawnStatus status;
+    pid_t pid;
+    int loaded;
+
+    NV_PROBE1(modprobe__start, module_name);
+
+    status = nvidia_modprobe_spawn(ctx, print_errors, module_name,
+                                   allow_on_tegra, &pid);
+    if (status != NvModprobeSpawnStarted)
+    {
+        loaded = (status == NvModprobeSpawnLoaded);
+        NV_PROBE2(modprobe__done, module_name, loaded);
+        return loaded;
+    }
 
-    return is_kernel_module_loaded(module_name);
+    return modprobe_wait(ctx, module_name, pid);
 }
 
 
 /*
  * Attempt to load an NVIDIA kernel module
  */
-int nvidia_modprobe(const int print_errors)
+int nvidia_modprobe_ctx(NvModprobeContext *ctx, const int print_errors)
+{
+    return modprobe_helper(ctx, print_errors, NV_NVIDIA_MODULE_NAME, false);
+}
+
+
+/*
+ * Read a /proc file into buf, nul-terminated; returns its length, or -1
+ * if it could not be read.  Anything past size - 1 bytes is not read.
+ */
+static ssize_t read_proc_file_into(const char *path, char *buf, size_t size)
+{
+    ssize_t len = 0, n = 0;
+    int fd;
+
+    fd = nv_io_open(path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    while ((size_t) len < size - 1)
+    {
+        n = nv_io_read(fd, buf + len, size - 1 - len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        len += n;
+    }
+
+    nv_io_close(fd);
+
+    if (n < 0)
+    {
+        return -1;
+    }
+
+    buf[len] = '\0';
+
+    return len;
+}
+
+/*
+ * Read a /proc file whole, nul-terminated, so that its lines can be
+ * walked with NVLineIter: into buf (of buf_size bytes, and which may be
+ * NULL) if it fits, else into a malloc'ed buffer, doubled and the file
+ * read again until it fits or reaches max_size bytes.  In that case the
+ * last, cut-off, line is dropped, so that no partial line is parsed.
+ *
+ * Returns buf, the malloc'ed buffer, to be freed with free_proc_file(),
+ * or NULL if the file could not be read.
+ */
+static char *read_proc_file(const char *path, char *buf, size_t buf_size,
+                            size_t max_size, size_t *len_out)
 {
-    return modprobe_helper(print_errors, NV_NVIDIA_MODULE_NAME, false);
+    size_t size = buf_size;
+    char *data = buf;
+    ssize_t len;
+
+    while (1)
+    {
+        if (data == NULL)
+        {
+            data = malloc(size);
+            if (data == NULL)
+            {
+                return NULL;
+            }
+        }
+
+        len = read_proc_file_into(path, data, size);
+        if (len < 0)
+        {
+            break;
+        }
+
+        if ((size_t) len < size - 1)
+        {
+            *len_out = len;
+            return data;
+        }
+
+        if (size >= max_size)
+        {
+            while ((len > 0) && (data[len - 1] != '\n'))
+            {
+                len--;
+            }
+            data[len] = '\0';
+            *len_out = len;
+            return data;
+        }
+
+        if (data != buf)
+        {
+            free(data);
+        }
+        data = NULL;
+        size *= 2;
+    }
+
+    if (data != buf)
+    {
+        free(data);
+    }
+
+    return NULL;
 }
 
+static void free_proc_file(char *data, char *buf)
+{
+    if (data != buf)
+    {
+        free(data);
+    }
+}
 
 /*
  * Determine the requested device file parameters: allow users to
@@ -361,12 +729,20 @@ int nvidia_modprobe(const int print_errors)
  * the attributes are managed globally, and can be adjusted via the
  * appropriate kernel module parameters.
  */
-static void init_device_file_parameters(uid_t *uid, gid_t *gid, mode_t *mode,
-                                        int *modify, const char *proc_path)
+static void do_init_device_file_parameters(NvModprobeContext *ctx,
+                                           uid_t *uid, gid_t *gid,
+                                           mode_t *mode, int *modify,
+                                           const char *proc_path)
 {
-    FILE *fp;
+    char buf[NV_PROC_FILE_STACK_SIZE];
+    char *data;
+    NVLineIter iter;
+    char *line;
+    size_t line_len, len;
     char name[32];
     unsigned int value;
+    NvModprobeParamsCacheEntry *entry;
+    int i;
 
     *mode = NV_DEVICE_FILE_MODE;
     *uid = NV_DEVICE_FILE_UID;
@@ -378,15 +754,40 @@ static void init_device_file_parameters(uid_t *uid, gid_t *gid, mode_t *mode,
         return;
     }
 
-    fp = fopen(proc_path, "r");
+    for (i = 0; i < ctx->num_params; i++)
+    {
+        entry = &ctx->params[i];
 
-    if (fp == NULL)
+        if (strcmp(entry->proc_path, proc_path) == 0)
+        {
+            *uid = entry->uid;
+            *gid = entry->gid;
+            *mode = entry->mode;
+            *modify = entry->modify;
+            nv_io_count(NvModprobeStatCacheHit);
+            return;
+        }
+    }
+
+    data = read_proc_file(proc_path, buf, sizeof(buf),
+                          NV_PROC_FILE_MAX_SIZE, &len);
+
+    if (data == NULL)
     {
         return;
     }
 
-    while (fscanf(fp, "%31[^:]: %u\n", name, &value) == 2)
+    nv_line_iter_init(&iter, data, len);
+
+    while (nv_line_iter_next(&iter, &line, &line_len))
     {
+        line[line_len] = '\0';
+
+        if (sscanf(line, "%31[^:]: %u", name, &value) != 2)
+        {
+            break;
+        }
+
         name[31] = '\0';
         if (strcmp(name, "DeviceFileUID") == 0)
         {
@@ -407,7 +808,38 @@ static void init_device_file_parameters(uid_t *uid, gid_t *gid, mode_t *mode,
         }
     }
 
-    fclose(fp);
+    free_proc_file(data, buf);
+
+    /* Remember the parameters, replacing the oldest entry if needed. */
+
+    if (strlen(proc_path) >= sizeof(entry->proc_path))
+    {
+        return;
+    }
+
+    entry = &ctx->params[ctx->next_param];
+    ctx->next_param = (ctx->next_param + 1) % NV_MODPROBE_CACHE_PARAMS;
+    if (ctx->num_params < NV_MODPROBE_CACHE_PARAMS)
+    {
+        ctx->num_params++;
+    }
+
+    strcpy(entry->proc_path, proc_path);
+    entry->uid = *uid;
+    entry->gid = *gid;
+    entry->mode = *mode;
+    entry->modify = *modify;
+}
+
+static void init_device_file_parameters(NvModprobeContext *ctx,
+                                        uid_t *uid, gid_t *gid, mode_t *mode,
+                                        int *modify, const char *proc_path)
+{
+    struct timespec start;
+
+    nv_span_begin(ctx, &start);
+    do_init_device_file_parameters(ctx, uid, gid, mode, modify, proc_path);
+    nv_span_end(ctx, &start, "init_device_file_parameters", proc_path);
 }
 
 /*
@@ -427,7 +859,7 @@ static int get_file_state_helper(
     int ret;
     int state = 0;
 
-    ret = stat(path, &stat_buf);
+    ret = nv_io_stat(path, &stat_buf);
     if (ret == 0)
     {
         nvidia_update_file_state(&state, NvDeviceFileStateFileExists);
@@ -448,7 +880,7 @@ static int get_file_state_helper(
     return state;
 }
 
-int nvidia_get_file_state(int minor)
+int nvidia_get_file_state_ctx(NvModprobeContext *ctx, int minor)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     mode_t mode;
@@ -459,7 +891,7 @@ int nvidia_get_file_state(int minor)
 
     assign_device_file_name(path, minor);
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 NV_PROC_REGISTRY_PATH);
 
     state = get_file_state_helper(path, NV_MAJOR_DEVICE_NUMBER, minor,
@@ -472,7 +904,7 @@ int nvidia_get_file_state(int minor)
  * Symbolically link the /dev/char/<major:minor> file to the given
  * device node.
  */
-static int symlink_char_dev(int major, int minor, const char *dev_path)
+static int do_symlink_char_dev(int major, int minor, const char *dev_path)
 {
     char symlink_path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     char dev_rel_path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
@@ -489,7 +921,7 @@ static int symlink_char_dev(int major, int minor, const char *dev_path)
     }
 
     /* Verify that the target device node exists and is a character device. */
-    if (stat(dev_path, &dev_status) != 0 || !S_ISCHR(dev_status.st_mode))
+    if (nv_io_stat(dev_path, &dev_status) != 0 || !S_ISCHR(dev_status.st_mode))
     {
         return 0;
     }
@@ -517,9 +949,9 @@ static int symlink_char_dev(int major, int minor, const char *dev_path)
      * Any error is discarded since the failure checks below will handle
      * the problematic cases.
      */
-    (void)remove(symlink_path);
+    (void)nv_io_remove(symlink_path);
 
-    ret = symlink(dev_rel_path, symlink_path);
+    ret = nv_io_symlink(dev_rel_path, symlink_path);
 
     /*
      * If the symlink(3) failed, we either don't have permission to create it,
@@ -528,7 +960,7 @@ static int symlink_char_dev(int major, int minor, const char *dev_path)
      * device (stat(2) will follow the link).
      */
     if (ret < 0 &&
-        (stat(symlink_path, &link_status) != 0 ||
+        (nv_io_stat(symlink_path, &link_status) != 0 ||
          link_status.st_ino != dev_status.st_ino))
     {
         return 0;
@@ -537,14 +969,31 @@ static int symlink_char_dev(int major, int minor, const char *dev_path)
     return 1;
 }
 
+static int symlink_char_dev(NvModprobeContext *ctx,
+                            int major, int minor, const char *dev_path)
+{
+    struct timespec start;
+    int ret;
+
+    NV_PROBE3(symlink__start, dev_path, major, minor);
+
+    nv_span_begin(ctx, &start);
+    ret = do_symlink_char_dev(major, minor, dev_path);
+    nv_span_end(ctx, &start, "symlink_char_dev", dev_path);
+
+    NV_PROBE4(symlink__done, dev_path, major, minor, ret);
+
+    return ret;
+}
+
 /*
  * Attempt to create the specified device file with the specified major
  * and minor number.  If proc_path is specified, scan it for custom file
  * permissions.  Returns 1 if the file is successfully created; returns 0
  * if the file could not be created.
  */
-static int mknod_helper(int major, int minor, const char *path,
-                        const char *proc_path)
+static int do_mknod_helper(NvModprobeContext *ctx, int major, int minor,
+                           const char *path, const char *proc_path)
 {
     dev_t dev = NV_MAKE_DEVICE(major, minor);
     mode_t mode;
@@ -560,14 +1009,19 @@ static int mknod_helper(int major, int minor, const char *path,
         return 0;
     }
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        return 0;
+    }
+
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 proc_path);
 
     /* If device file modification is not allowed, nothing to do: success. */
 
     if (modification_allowed != 1)
     {
-        return symlink_char_dev(major, minor, path);
+        return symlink_char_dev(ctx, major, minor, path);
     }
 
     state = get_file_state_helper(path, major, minor,
@@ -577,7 +1031,7 @@ static int mknod_helper(int major, int minor, const char *path,
         nvidia_test_file_state(state, NvDeviceFileStateChrDevOk) &&
         nvidia_test_file_state(state, NvDeviceFileStatePermissionsOk))
     {
-        return symlink_char_dev(major, minor, path);
+        return symlink_char_dev(ctx, major, minor, path);
     }
 
     /* If the stat(2) above failed, we need to create the device file. */
@@ -597,7 +1051,7 @@ static int mknod_helper(int major, int minor, const char *path,
     if (!do_mknod &&
         !nvidia_test_file_state(state, NvDeviceFileStateChrDevOk))
     {
-        ret = remove(path);
+        ret = nv_io_remove(path);
         if (ret != 0)
         {
             return 0;
@@ -607,7 +1061,7 @@ static int mknod_helper(int major, int minor, const char *path,
 
     if (do_mknod)
     {
-        ret = mknod(path, S_IFCHR | mode, dev);
+        ret = nv_io_mknod(path, S_IFCHR | mode, dev);
         if (ret != 0)
         {
             return 0;
@@ -619,30 +1073,47 @@ static int mknod_helper(int major, int minor, const char *path,
      * we created the device above and either of the below fails, then
      * also delete the device file.
      */
-    if ((chmod(path, mode) != 0) ||
-        (chown(path, uid, gid) != 0))
+    if ((nv_io_chmod(path, mode) != 0) ||
+        (nv_io_chown(path, uid, gid) != 0))
     {
         if (do_mknod)
         {
-            remove(path);
+            nv_io_remove(path);
         }
         return 0;
     }
 
-    return symlink_char_dev(major, minor, path);
+    return symlink_char_dev(ctx, major, minor, path);
+}
+
+static int mknod_helper(NvModprobeContext *ctx, int major, int minor,
+                        const char *path, const char *proc_path)
+{
+    struct timespec start;
+    int ret;
+
+    NV_PROBE3(mknod__start, path, major, minor);
+
+    nv_span_begin(ctx, &start);
+    ret = do_mknod_helper(ctx, major, minor, path, proc_path);
+    nv_span_end(ctx, &start, "mknod", path);
+
+    NV_PROBE4(mknod__done, path, major, minor, ret);
+
+    return ret;
 }
 
 /*
  * Attempt to create a device file with the specified minor number for
  * the specified NVIDIA module instance.
  */
-int nvidia_mknod(int minor)
+int nvidia_mknod_ctx(NvModprobeContext *ctx, int minor)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
 
     assign_device_file_name(path, minor);
 
-    return mknod_helper(NV_MAJOR_DEVICE_NUMBER, minor, path, NV_PROC_REGISTRY_PATH);
+    return mknod_helper(ctx, NV_MAJOR_DEVICE_NUMBER, minor, path, NV_PROC_REGISTRY_PATH);
 }
 
 
@@ -651,41 +1122,52 @@ int nvidia_mknod(int minor)
  * device with the specified name.  Returns the major number on success,
  * or -1 on failure.
  */
-int nvidia_get_chardev_major(const char *name)
+static int do_get_chardev_major(NvModprobeContext *ctx, const char *name)
 {
     int ret = -1;
-    char line[NV_MAX_LINE_LENGTH];
-    FILE *fp;
-
-    line[NV_MAX_LINE_LENGTH - 1] = '\0';
-
-    fp = fopen(NV_PROC_DEVICES_PATH, "r");
-    if (!fp)
-    {
-        goto done;
-    }
-
-    /* Find the beginning of the 'Character devices:' section */
+    char buf[NV_PROC_FILE_STACK_SIZE];
+    char *data;
+    NVLineIter iter;
+    char *line;
+    size_t line_len, len;
+    int in_chardevs = 0;
+    int i;
 
-    while (fgets(line, NV_MAX_LINE_LENGTH - 1, fp))
+    for (i = 0; i < ctx->num_majors; i++)
     {
-        if (strcmp(line, "Character devices:\n") == 0)
+        if (strcmp(ctx->majors[i].name, name) == 0)
         {
-            break;
+            nv_io_count(NvModprobeStatCacheHit);
+            return ctx->majors[i].major;
         }
     }
 
-    if (ferror(fp)) {
+    data = read_proc_file(NV_PROC_DEVICES_PATH, buf, sizeof(buf),
+                          NV_PROC_FILE_MAX_SIZE, &len);
+    if (data == NULL)
+    {
         goto done;
     }
 
-    /* Search for the given module name */
+    nv_line_iter_init(&iter, data, len);
 
-    while (fgets(line, NV_MAX_LINE_LENGTH - 1, fp))
+    while (nv_line_iter_next(&iter, &line, &line_len))
     {
         char *found;
 
-        if (strcmp(line, "\n") == 0 )
+        line[line_len] = '\0';
+
+        /* Find the beginning of the 'Character devices:' section */
+
+        if (!in_chardevs)
+        {
+            in_chardevs = (strcmp(line, "Character devices:") == 0);
+            continue;
+        }
+
+        /* Search for the given module name */
+
+        if (line_len == 0)
         {
             /* we've reached the end of the 'Character devices:' section */
             break;
@@ -693,9 +1175,9 @@ int nvidia_get_chardev_major(const char *name)
 
         found = strstr(line, name);
 
-        /* Check for a newline to avoid partial matches */
+        /* Check for the end of the line to avoid partial matches */
 
-        if (found && found[strlen(name)] == '\n')
+        if (found && found[strlen(name)] == '\0')
         {
             int major;
 
@@ -710,17 +1192,37 @@ int nvidia_get_chardev_major(const char *name)
         }
     }
 
+    free_proc_file(data, buf);
+
 done:
 
-    if (fp)
+    /* Only cache successful lookups: the module may not be loaded yet. */
+
+    if ((ret >= 0) &&
+        (ctx->num_majors < NV_MODPROBE_CACHE_MAJORS) &&
+        (strlen(name) < NV_MODPROBE_CACHE_NAME_LEN))
     {
-        fclose(fp);
+        strcpy(ctx->majors[ctx->num_majors].name, name);
+        ctx->majors[ctx->num_majors].major = ret;
+        ctx->num_majors++;
     }
 
     return ret;
 }
 
-int nvidia_nvlink_get_file_state(void)
+int nvidia_get_chardev_major_ctx(NvModprobeContext *ctx, const char *name)
+{
+    struct timespec start;
+    int major;
+
+    nv_span_begin(ctx, &start);
+    major = do_get_chardev_major(ctx, name);
+    nv_span_end(ctx, &start, "get_chardev_major", name);
+
+    return major;
+}
+
+int nvidia_nvlink_get_file_state_ctx(NvModprobeContext *ctx)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     mode_t mode;
@@ -728,7 +1230,7 @@ int nvidia_nvlink_get_file_state(void)
     gid_t gid;
     int modification_allowed;
     int ret;
-    int major = nvidia_get_chardev_major(NV_NVLINK_MODULE_NAME);
+    int major = nvidia_get_chardev_major_ctx(ctx, NV_NVLINK_MODULE_NAME);
 
     if (major < 0)
     {
@@ -746,14 +1248,14 @@ int nvidia_nvlink_get_file_state(void)
 
 done:
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 NV_NVLINK_PROC_PERM_PATH);
 
     return get_file_state_helper(path, major, 0,
                                  NV_NVLINK_PROC_PERM_PATH, uid, gid, mode);
 }
 
-int nvidia_nvswitch_get_file_state(int minor)
+int nvidia_nvswitch_get_file_state_ctx(NvModprobeContext *ctx, int minor)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     mode_t mode;
@@ -761,7 +1263,7 @@ int nvidia_nvswitch_get_file_state(int minor)
     gid_t gid;
     int modification_allowed;
     int ret;
-    int major = nvidia_get_chardev_major(NV_NVSWITCH_MODULE_NAME);
+    int major = nvidia_get_chardev_major_ctx(ctx, NV_NVSWITCH_MODULE_NAME);
 
     if ((major < 0) || (minor < 0) || (minor > NV_NVSWITCH_CTL_MINOR))
     {
@@ -787,7 +1289,7 @@ int nvidia_nvswitch_get_file_state(int minor)
 
 done:
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 NV_NVSWITCH_PROC_PERM_PATH);
 
     return get_file_state_helper(path, major, minor,
@@ -797,51 +1299,51 @@ done:
 /*
  * Attempt to create the NVIDIA Unified Memory device file
  */
-int nvidia_uvm_mknod(int base_minor)
+int nvidia_uvm_mknod_ctx(NvModprobeContext *ctx, int base_minor)
 {
-    int major = nvidia_get_chardev_major(NV_UVM_MODULE_NAME);
+    int major = nvidia_get_chardev_major_ctx(ctx, NV_UVM_MODULE_NAME);
 
     if (major < 0)
     {
         return 0;
     }
 
-    return mknod_helper(major, base_minor, NV_UVM_DEVICE_NAME, NULL) &&
-           mknod_helper(major, base_minor + 1, NV_UVM_TOOLS_DEVICE_NAME, NULL);
+    return mknod_helper(ctx, major, base_minor, NV_UVM_DEVICE_NAME, NULL) &&
+           mknod_helper(ctx, major, base_minor + 1, NV_UVM_TOOLS_DEVICE_NAME, NULL);
 }
 
 
 /*
  * Attempt to load the NVIDIA Unified Memory kernel module
  */
-int nvidia_uvm_modprobe(void)
+int nvidia_uvm_modprobe_ctx(NvModprobeContext *ctx)
 {
-    return modprobe_helper(0, NV_UVM_MODULE_NAME, false);
+    return modprobe_helper(ctx, 0, NV_UVM_MODULE_NAME, false);
 }
 
 /*
  * Attempt to load msr module
  */
-int nvidia_msr_modprobe(void)
+int nvidia_msr_modprobe_ctx(NvModprobeContext *ctx)
 {
-    return modprobe_helper(0, NV_MSR_MODULE_NAME, false);
+    return modprobe_helper(ctx, 0, NV_MSR_MODULE_NAME, false);
 }
 
 /*
  * Attempt to load the NVIDIA modeset driver.
  */
-int nvidia_modeset_modprobe(void)
+int nvidia_modeset_modprobe_ctx(NvModprobeContext *ctx)
 {
-    return modprobe_helper(0, NV_MODESET_MODULE_NAME, true);
+    return modprobe_helper(ctx, 0, NV_MODESET_MODULE_NAME, true);
 }
 
 
 /*
  * Attempt to create the NVIDIA modeset driver device file.
  */
-int nvidia_modeset_mknod(void)
+int nvidia_modeset_mknod_ctx(NvModprobeContext *ctx)
 {
-    return mknod_helper(NV_MAJOR_DEVICE_NUMBER,
+    return mknod_helper(ctx, NV_MAJOR_DEVICE_NUMBER,
                         NV_MODESET_MINOR_DEVICE_NUM,
                         NV_MODESET_DEVICE_NAME, NV_PROC_REGISTRY_PATH);
 }
@@ -849,16 +1351,16 @@ int nvidia_modeset_mknod(void)
 /*
  * Attempt to create the NVIDIA NVLink driver device file.
  */
-int nvidia_nvlink_mknod(void)
+int nvidia_nvlink_mknod_ctx(NvModprobeContext *ctx)
 {
-    int major = nvidia_get_chardev_major(NV_NVLINK_MODULE_NAME);
+    int major = nvidia_get_chardev_major_ctx(ctx, NV_NVLINK_MODULE_NAME);
 
     if (major < 0)
     {
         return 0;
     }
 
-    return mknod_helper(major,
+    return mknod_helper(ctx, major,
                         0,
                         NV_NVLINK_DEVICE_NAME,
                         NV_NVLINK_PROC_PERM_PATH);
@@ -867,13 +1369,13 @@ int nvidia_nvlink_mknod(void)
 /*
  * Attempt to create the NVIDIA NVSwitch driver device files.
  */
-int nvidia_nvswitch_mknod(int minor)
+int nvidia_nvswitch_mknod_ctx(NvModprobeContext *ctx, int minor)
 {
     int major = 0;
     char name[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     int ret;
 
-    major = nvidia_get_chardev_major(NV_NVSWITCH_MODULE_NAME);
+    major = nvidia_get_chardev_major_ctx(ctx, NV_NVSWITCH_MODULE_NAME);
 
     if (major < 0)
     {
@@ -896,12 +1398,12 @@ int nvidia_nvswitch_mknod(int minor)
         return 0;
     }
 
-    return mknod_helper(major, minor, name, NV_NVSWITCH_PROC_PERM_PATH);
+    return mknod_helper(ctx, major, minor, name, NV_NVSWITCH_PROC_PERM_PATH);
 }
 
-int nvidia_vgpu_vfio_mknod(int minor_num)
+int nvidia_vgpu_vfio_mknod_ctx(NvModprobeContext *ctx, int minor_num)
 {
-    int major = nvidia_get_chardev_major(NV_VGPU_VFIO_MODULE_NAME);
+    int major = nvidia_get_chardev_major_ctx(ctx, NV_VGPU_VFIO_MODULE_NAME);
     char vgpu_dev_name[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     int ret;
 
@@ -927,37 +1429,52 @@ int nvidia_vgpu_vfio_mknod(int minor_num)
 
     vgpu_dev_name[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN - 1] = '\0';
 
-    return mknod_helper(major, minor_num, vgpu_dev_name, NV_PROC_REGISTRY_PATH);
+    return mknod_helper(ctx, major, minor_num, vgpu_dev_name, NV_PROC_REGISTRY_PATH);
 }
 
-static int nvidia_cap_get_device_file_attrs(const char* cap_file_path,
+static int nvidia_cap_get_device_file_attrs(NvModprobeContext *ctx,
+                                            const char* cap_file_path,
                                             int *major,
                                             int *minor,
                                             char *name)
 {
+    char buf[NV_PROC_FILE_STACK_SIZE];
+    char *data;
+    NVLineIter iter;
+    char *line;
+    size_t line_len, len;
     char field[32];
-    FILE *fp;
     int value;
     int ret;
 
-    *major = nvidia_get_chardev_major(NV_CAPS_MODULE_NAME);
+    *major = nvidia_get_chardev_major_ctx(ctx, NV_CAPS_MODULE_NAME);
 
     if (*major < 0)
     {
         return 0;
     }
 
-    fp = fopen(cap_file_path, "r");
+    data = read_proc_file(cap_file_path, buf, sizeof(buf),
+                          NV_PROC_FILE_MAX_SIZE, &len);
 
-    if (fp == NULL)
+    if (data == NULL)
     {
         return 0;
     }
 
     *minor = -1;
 
-    while (fscanf(fp, "%31[^:]: %d\n", field, &value) == 2)
+    nv_line_iter_init(&iter, data, len);
+
+    while (nv_line_iter_next(&iter, &line, &line_len))
     {
+        line[line_len] = '\0';
+
+        if (sscanf(line, "%31[^:]: %d", field, &value) != 2)
+        {
+            break;
+        }
+
         field[31] = '\0';
         if (strcmp(field, "DeviceFileMinor") == 0)
         {
@@ -966,7 +1483,7 @@ static int nvidia_cap_get_device_file_attrs(const char* cap_file_path,
         }
     }
 
-    fclose(fp);
+    free_proc_file(data, buf);
 
     if (*minor < 0)
     {
@@ -987,35 +1504,37 @@ static int nvidia_cap_get_device_file_attrs(const char* cap_file_path,
 /*
  * Attempt to create the NVIDIA capability device files.
  */
-int nvidia_cap_mknod(const char* cap_file_path, int *minor)
+int nvidia_cap_mknod_ctx(NvModprobeContext *ctx,
+                         const char* cap_file_path, int *minor)
 {
     int major;
     char name[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     int ret;
     mode_t mode = 0755;
 
-    ret = nvidia_cap_get_device_file_attrs(cap_file_path, &major, minor, name);
+    ret = nvidia_cap_get_device_file_attrs(ctx, cap_file_path, &major, minor, name);
     if (ret == 0)
     {
         return 0;
     }
 
-    ret = mkdir("/dev/"NV_CAPS_MODULE_NAME, mode);
+    ret = nv_io_mkdir("/dev/"NV_CAPS_MODULE_NAME, mode);
     if ((ret != 0) && (errno != EEXIST))
     {
         return 0;
     }
 
-    if ((chmod("/dev/"NV_CAPS_MODULE_NAME, mode) != 0) ||
-        (chown("/dev/"NV_CAPS_MODULE_NAME, 0, 0) != 0))
+    if ((nv_io_chmod("/dev/"NV_CAPS_MODULE_NAME, mode) != 0) ||
+        (nv_io_chown("/dev/"NV_CAPS_MODULE_NAME, 0, 0) != 0))
     {
         return 0;
     }
 
-    return mknod_helper(major, *minor, name, cap_file_path);
+    return mknod_helper(ctx, major, *minor, name, cap_file_path);
 }
 
-int nvidia_cap_get_file_state(const char* cap_file_path)
+int nvidia_cap_get_file_state_ctx(NvModprobeContext *ctx,
+                                  const char* cap_file_path)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     mode_t mode;
@@ -1026,13 +1545,13 @@ int nvidia_cap_get_file_state(const char* cap_file_path)
     int major;
     int minor;
 
-    ret = nvidia_cap_get_device_file_attrs(cap_file_path, &major, &minor, path);
+    ret = nvidia_cap_get_device_file_attrs(ctx, cap_file_path, &major, &minor, path);
     if (ret == 0)
     {
         path[0] = '\0';
     }
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 cap_file_path);
 
     return get_file_state_helper(path, major, minor,
@@ -1042,20 +1561,20 @@ int nvidia_cap_get_file_state(const char* cap_file_path)
 /*
  * Attempt to create the NVIDIA IMEX channel device files.
  */
-int nvidia_cap_imex_channel_mknod(int minor)
+int nvidia_cap_imex_channel_mknod_ctx(NvModprobeContext *ctx, int minor)
 {
     int major;
     char name[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     int ret;
     mode_t mode = 0755;
 
-    major = nvidia_get_chardev_major(NV_CAPS_IMEX_CHANNELS_MODULE_NAME);
+    major = nvidia_get_chardev_major_ctx(ctx, NV_CAPS_IMEX_CHANNELS_MODULE_NAME);
     if (major < 0)
     {
         return 0;
     }
 
-    ret = mkdir("/dev/"NV_CAPS_IMEX_CHANNELS_MODULE_NAME, mode);
+    ret = nv_io_mkdir("/dev/"NV_CAPS_IMEX_CHANNELS_MODULE_NAME, mode);
     if ((ret != 0) && (errno != EEXIST))
     {
         return 0;
@@ -1068,10 +1587,10 @@ int nvidia_cap_imex_channel_mknod(int minor)
         return 0;
     }
 
-    return mknod_helper(major, minor, name, NV_PROC_REGISTRY_PATH);
+    return mknod_helper(ctx, major, minor, name, NV_PROC_REGISTRY_PATH);
 }
 
-int nvidia_cap_imex_channel_file_state(int minor)
+int nvidia_cap_imex_channel_file_state_ctx(NvModprobeContext *ctx, int minor)
 {
     char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
     mode_t mode;
@@ -1082,7 +1601,7 @@ int nvidia_cap_imex_channel_file_state(int minor)
     int major;
     int ret;
 
-    major = nvidia_get_chardev_major(NV_CAPS_IMEX_CHANNELS_MODULE_NAME);
+    major = nvidia_get_chardev_major_ctx(ctx, NV_CAPS_IMEX_CHANNELS_MODULE_NAME);
     if (major < 0)
     {
         return state;
@@ -1095,7 +1614,7 @@ int nvidia_cap_imex_channel_file_state(int minor)
         return state;
     }
 
-    init_device_file_parameters(&uid, &gid, &mode, &modification_allowed,
+    init_device_file_parameters(ctx, &uid, &gid, &mode, &modification_allowed,
                                 NV_PROC_REGISTRY_PATH);
 
     state = get_file_state_helper(path, NV_MAJOR_DEVICE_NUMBER, minor,
@@ -1104,45 +1623,1769 @@ int nvidia_cap_imex_channel_file_state(int minor)
     return state;
 }
 
+/*
+ * Read the minor number the NVIDIA kernel module assigned to the GPU at
+ * the given PCI address, from its /proc/driver/nvidia/gpus information
+ * file.  Returns the minor number, or -1 if the GPU is not known to the
+ * module.
+ */
+int nvidia_get_gpu_minor_ctx(NvModprobeContext *ctx, unsigned int domain,
+                             unsigned int bus, unsigned int device,
+                             unsigned int ftn)
+{
+    char path[PATH_MAX];
+    char line[NV_MAX_LINE_LENGTH];
+    NvIoFile file, *fp;
+    struct timespec start;
+    int minor = -1;
+
+    nv_span_begin(ctx, &start);
+
+    snprintf(path, sizeof(path), NV_PROC_GPUS_PATH "/%04x:%02x:%02x.%x"
+             "/information", domain, bus, device, ftn);
+
+    fp = nv_io_fopen(&file, path);
+    if (fp != NULL)
+    {
+        while (nv_io_fgets(line, sizeof(line), fp))
+        {
+            if (sscanf(line, "Device Minor: %d", &minor) == 1)
+            {
+                break;
+            }
+        }
+
+        nv_io_fclose(fp);
+    }
+
+    nv_span_end(ctx, &start, "get_gpu_minor", NULL);
+
+    return minor;
+}
+
 /*
  * Attempt to enable auto onlining mode online_movable
  */
-int nvidia_enable_auto_online_movable(const int print_errors)
+int nvidia_enable_auto_online_movable_ctx(NvModprobeContext *ctx,
+                                          const int print_errors)
 {
     int fd;
     const char path_to_file[] = "/sys/devices/system/memory/auto_online_blocks";
     const char str[] = "online_movable";
     ssize_t write_count;
 
-    fd = open(path_to_file, O_RDWR, 0);
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        return 0;
+    }
+
+    fd = nv_io_open(path_to_file, O_RDWR, 0);
     if (fd < 0)
     {
         if (print_errors)
         {
-            fprintf(stderr,
-                    "NVIDIA: failed to open `%s`: %s.\n",
-                    path_to_file, strerror(errno));
+            nv_ctx_log(ctx, "NVIDIA: failed to open `%s`: %s.\n",
+                       path_to_file, strerror(errno));
         }
         return 0;
     }
 
-    write_count = write(fd, str, sizeof(str));
+    write_count = nv_io_write(fd, str, sizeof(str));
     if (write_count != sizeof(str))
     {
         if (print_errors)
         {
-            fprintf(stderr,
-                    "NVIDIA: unable to write to `%s`: %s.\n",
-                    path_to_file, strerror(errno));
+            nv_ctx_log(ctx, "NVIDIA: unable to write to `%s`: %s.\n",
+                       path_to_file, strerror(errno));
+        }
+
+        nv_io_close(fd);
+        return 0;
+    }
+
+    nv_io_close(fd);
+
+    return 1;
+}
+
+/*
+ * Read the first line of a sysfs attribute, without its newline.
+ * Returns 1 on success and 0 on failure.
+ */
+static int read_sysfs_line(const char *path, char *buf, size_t size)
+{
+    ssize_t len;
+    int fd;
+
+    fd = nv_io_open(path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    len = nv_io_read(fd, buf, size - 1);
+    nv_io_close(fd);
+
+    if (len < 0)
+    {
+        return 0;
+    }
+
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+
+    return 1;
+}
+
+/*
+ * Read an attribute of the given memory block, e.g. its state: "online",
+ * "offline", ...
+ */
+static int read_memory_block_attr(int block, const char *attr, char *buf,
+                                  size_t size)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), NV_SYS_MEMORY_PATH "/memory%d/%s",
+             block, attr);
+
+    return read_sysfs_line(path, buf, size);
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    const int *x = a, *y = b;
+
+    return (*x > *y) - (*x < *y);
+}
+
+/*
+ * Find the NUMA nodes of the GPUs' memory, as reported in
+ * /proc/driver/nvidia/gpus/<bus id>/numa_status on platforms (like Grace
+ * Hopper) where the GPU memory is added to the kernel, in increasing
+ * order.  Returns the number of nodes, or -1 if the GPUs cannot be
+ * listed.
+ */
+static int get_gpu_numa_nodes(int *nodes, int max_nodes)
+{
+    char path[PATH_MAX];
+    char line[NV_MAX_LINE_LENGTH];
+    struct dirent *d;
+    DIR *dir;
+    NvIoFile file, *fp;
+    int num_nodes = 0;
+    int node, i;
+
+    dir = nv_io_opendir(NV_PROC_GPUS_PATH);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    while (((d = nv_io_readdir(dir)) != NULL) && (num_nodes < max_nodes))
+    {
+        if (d->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), NV_PROC_GPUS_PATH "/%s/numa_status",
+                 d->d_name);
+
+        fp = nv_io_fopen(&file, path);
+        if (fp == NULL)
+        {
+            continue;
+        }
+
+        while (nv_io_fgets(line, sizeof(line), fp))
+        {
+            if (sscanf(line, "Node: %d", &node) == 1)
+            {
+                for (i = 0; i < num_nodes; i++)
+                {
+                    if (nodes[i] == node)
+                    {
+                        break;
+                    }
+                }
+
+                if ((node >= 0) && (i == num_nodes))
+                {
+                    nodes[num_nodes++] = node;
+                }
+                break;
+            }
+        }
+
+        nv_io_fclose(fp);
+    }
+
+    nv_io_closedir(dir);
+
+    if (num_nodes > 1)
+    {
+        qsort(nodes, num_nodes, sizeof(*nodes), compare_ints);
+    }
+
+    return num_nodes;
+}
+
+/*
+ * Append the memory blocks of NUMA node 'node' to 'blocks'.  Returns the
+ * new number of blocks.
+ */
+static int add_node_memory_blocks(int node, int **blocks, int num_blocks,
+                                  int *max_blocks)
+{
+    char path[PATH_MAX];
+    struct dirent *d;
+    DIR *dir;
+    int block;
+
+    snprintf(path, sizeof(path), NV_SYS_NODE_PATH "/node%d", node);
+
+    dir = nv_io_opendir(path);
+    if (dir == NULL)
+    {
+        return num_blocks;
+    }
+
+    while ((d = nv_io_readdir(dir)) != NULL)
+    {
+        if (sscanf(d->d_name, "memory%d", &block) != 1)
+        {
+            continue;
+        }
+
+        if (num_blocks == *max_blocks)
+        {
+            int *new_blocks;
+
+            *max_blocks = *max_blocks ? *max_blocks * 2 : 64;
+            new_blocks = realloc(*blocks, *max_blocks * sizeof(**blocks));
+            if (new_blocks == NULL)
+            {
+                break;
+            }
+            *blocks = new_blocks;
+        }
+
+        (*blocks)[num_blocks++] = block;
+    }
+
+    nv_io_closedir(dir);
+
+    return num_blocks;
+}
+
+/*
+ * Find the offline memory blocks of the GPU NUMA nodes.  On success,
+ * *blocks is set to a malloc'ed array of the block numbers in increasing
+ * order, which the caller must free, and the number of blocks is
+ * returned.  Returns -1 if the GPU NUMA nodes cannot be determined.
+ */
+int nvidia_get_offline_gpu_memory_blocks_ctx(NvModprobeContext *ctx,
+                                             int **blocks)
+{
+    int nodes[NV_MODPROBE_MAX_GPU_NODES];
+    char state[NV_MAX_LINE_LENGTH];
+    struct timespec start;
+    int num_nodes, num_blocks = 0, max_blocks = 0;
+    int i, j;
+
+    *blocks = NULL;
+
+    nv_span_begin(ctx, &start);
+
+    num_nodes = get_gpu_numa_nodes(nodes, NV_MODPROBE_MAX_GPU_NODES);
+
+    for (i = 0; i < num_nodes; i++)
+    {
+        num_blocks = add_node_memory_blocks(nodes[i], blocks, num_blocks,
+                                            &max_blocks);
+    }
+
+    for (i = 0, j = 0; i < num_blocks; i++)
+    {
+        if (read_memory_block_attr((*blocks)[i], "state", state,
+                                   sizeof(state)) &&
+            (strcmp(state, "offline") == 0))
+        {
+            (*blocks)[j++] = (*blocks)[i];
+        }
+    }
+    num_blocks = j;
+
+    if (num_blocks > 1)
+    {
+        qsort(*blocks, num_blocks, sizeof(**blocks), compare_ints);
+    }
+
+    nv_span_end(ctx, &start, "find_memory_blocks", NULL);
+
+    return (num_nodes < 0) ? -1 : num_blocks;
+}
+
+/*
+ * Read the zones of the GPU NUMA nodes with present pages from
+ * /proc/zoneinfo.
+ */
+static void read_gpu_zoneinfo(NvModprobeMemoryAudit *audit)
+{
+    char line[NV_MAX_LINE_LENGTH];
+    char zone[NV_MODPROBE_ZONE_NAME_LEN];
+    NvModprobeZoneInfo *info = NULL;
+    NvModprobeNodeAudit *node_audit = NULL;
+    unsigned long long pages;
+    NvIoFile file, *fp;
+    int node, i;
+
+    fp = nv_io_fopen(&file, NV_PROC_ZONEINFO_PATH);
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    while (nv_io_fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "Node %d, zone %15s", &node, zone) == 2)
+        {
+            /* Drop the previous zone if it had no pages. */
+
+            if ((info != NULL) && (info->present_pages == 0))
+            {
+                node_audit->num_zones--;
+            }
+
+            info = NULL;
+            node_audit = NULL;
+
+            for (i = 0; i < audit->num_nodes; i++)
+            {
+                if (audit->nodes[i].node == node)
+                {
+                    node_audit = &audit->nodes[i];
+                }
+            }
+
+            if ((node_audit != NULL) &&
+                (node_audit->num_zones < NV_MODPROBE_MAX_ZONES))
+            {
+                info = &node_audit->zones[node_audit->num_zones++];
+                memset(info, 0, sizeof(*info));
+                strcpy(info->name, zone);
+            }
+        }
+        else if (info == NULL)
+        {
+            continue;
+        }
+        else if (sscanf(line, " present %llu", &pages) == 1)
+        {
+            info->present_pages = pages;
+        }
+        else if (sscanf(line, " managed %llu", &pages) == 1)
+        {
+            info->managed_pages = pages;
+        }
+    }
+
+    if ((info != NULL) && (info->present_pages == 0))
+    {
+        node_audit->num_zones--;
+    }
+
+    nv_io_fclose(fp);
+}
+
+/*
+ * Determine whether the GPU NUMA node has present pages outside of
+ * ZONE_MOVABLE, according to /proc/zoneinfo.
+ */
+static int node_has_unmovable_pages(const NvModprobeNodeAudit *node_audit)
+{
+    int i;
+
+    for (i = 0; i < node_audit->num_zones; i++)
+    {
+        if (strcmp(node_audit->zones[i].name, "Movable") != 0)
+        {
+            return 1;
         }
+    }
+
+    return 0;
+}
+
+/*
+ * Audit the placement of the memory of the GPU NUMA nodes: count their
+ * online and offline memory blocks, read the size of each of their zones
+ * from /proc/zoneinfo, and list the online blocks outside of
+ * ZONE_MOVABLE, which cannot be offlined again by the NVIDIA kernel
+ * module.  To keep this cheap, the zone of each block (its valid_zones
+ * attribute) is only read for the nodes whose zoneinfo shows pages
+ * outside of ZONE_MOVABLE.  The misplaced blocks are returned in a
+ * malloc'ed array; see nvidia_memory_audit_free().
+ */
+int nvidia_audit_gpu_memory_ctx(NvModprobeContext *ctx,
+                                NvModprobeMemoryAudit *audit)
+{
+    int nodes[NV_MODPROBE_MAX_GPU_NODES];
+    char buf[NV_MAX_LINE_LENGTH];
+    char zone[NV_MODPROBE_ZONE_NAME_LEN];
+    struct timespec start;
+    int *blocks = NULL;
+    int num_nodes, num_blocks, max_blocks = 0, max_misplaced = 0;
+    int i, j;
+
+    memset(audit, 0, sizeof(*audit));
 
-        close(fd);
+    nv_span_begin(ctx, &start);
+
+    num_nodes = get_gpu_numa_nodes(nodes, NV_MODPROBE_MAX_GPU_NODES);
+    if (num_nodes < 0)
+    {
+        nv_span_end(ctx, &start, "audit_memory", NULL);
         return 0;
     }
 
-    close(fd);
+    if (read_sysfs_line(NV_SYS_MEMORY_PATH "/block_size_bytes",
+                        buf, sizeof(buf)))
+    {
+        audit->block_size = strtoull(buf, NULL, 16);
+    }
+
+    read_sysfs_line(NV_SYS_MEMORY_PATH "/auto_online_blocks",
+                    audit->auto_online_blocks,
+                    sizeof(audit->auto_online_blocks));
+
+    audit->page_size = sysconf(_SC_PAGESIZE);
+
+    for (i = 0; i < num_nodes; i++)
+    {
+        audit->nodes[i].node = nodes[i];
+    }
+    audit->num_nodes = num_nodes;
+
+    read_gpu_zoneinfo(audit);
+
+    for (i = 0; i < num_nodes; i++)
+    {
+        NvModprobeNodeAudit *node_audit = &audit->nodes[i];
+        int check_zones = node_has_unmovable_pages(node_audit);
+
+        num_blocks = add_node_memory_blocks(node_audit->node, &blocks, 0,
+                                            &max_blocks);
+        node_audit->num_blocks = num_blocks;
+
+        if (num_blocks > 1)
+        {
+            qsort(blocks, num_blocks, sizeof(*blocks), compare_ints);
+        }
+
+        for (j = 0; j < num_blocks; j++)
+        {
+            NvModprobeMisplacedBlock *misplaced;
+
+            if (!read_memory_block_attr(blocks[j], "state", buf,
+                                        sizeof(buf)) ||
+                (strcmp(buf, "online") != 0))
+            {
+                continue;
+            }
+
+            node_audit->num_online++;
+
+            /*
+             * The valid_zones attribute of an online block is the zone
+             * it is in.
+             */
+
+            if (!check_zones ||
+                !read_memory_block_attr(blocks[j], "valid_zones", zone,
+                                        sizeof(zone)) ||
+                (strcmp(zone, "Movable") == 0))
+            {
+                continue;
+            }
+
+            node_audit->num_misplaced++;
+
+            if (audit->num_misplaced == max_misplaced)
+            {
+                NvModprobeMisplacedBlock *new_misplaced;
+
+                max_misplaced = max_misplaced ? max_misplaced * 2 : 16;
+                new_misplaced = realloc(audit->misplaced, max_misplaced *
+                                        sizeof(*audit->misplaced));
+                if (new_misplaced == NULL)
+                {
+                    continue;
+                }
+                audit->misplaced = new_misplaced;
+            }
+
+            misplaced = &audit->misplaced[audit->num_misplaced++];
+            misplaced->block = blocks[j];
+            misplaced->node = node_audit->node;
+            strcpy(misplaced->zone, zone);
+        }
+    }
+
+    free(blocks);
+
+    nv_span_end(ctx, &start, "audit_memory", NULL);
 
     return 1;
 }
 
+void nvidia_memory_audit_free(NvModprobeMemoryAudit *audit)
+{
+    free(audit->misplaced);
+    audit->misplaced = NULL;
+    audit->num_misplaced = 0;
+}
+
+/*
+ * Attempt to online the given memory block in ZONE_MOVABLE, so that it
+ * can later be offlined again by the NVIDIA kernel module.
+ */
+int nvidia_online_movable_memory_block_ctx(NvModprobeContext *ctx, int block,
+                                           const int print_errors)
+{
+    char path[PATH_MAX];
+    char name[32];
+    const char str[] = "online_movable";
+    struct timespec start;
+    ssize_t write_count;
+    int fd, ret = 0;
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), NV_SYS_MEMORY_PATH "/memory%d/state", block);
+    snprintf(name, sizeof(name), "memory%d", block);
+
+    nv_span_begin(ctx, &start);
+
+    fd = nv_io_open(path, O_WRONLY, 0);
+    if (fd < 0)
+    {
+        if (print_errors)
+        {
+            nv_ctx_log(ctx, "NVIDIA: failed to open `%s`: %s.\n",
+                       path, strerror(errno));
+        }
+        goto done;
+    }
+
+    write_count = nv_io_write(fd, str, strlen(str));
+    if (write_count != strlen(str))
+    {
+        if (print_errors)
+        {
+            nv_ctx_log(ctx, "NVIDIA: unable to write to `%s`: %s.\n",
+                       path, strerror(errno));
+        }
+    }
+    else
+    {
+        ret = 1;
+    }
+
+    nv_io_close(fd);
+
+done:
+    nv_span_end(ctx, &start, "online_memory_block", name);
+
+    return ret;
+}
+
+/*
+ * Find the NUMA nodes local to the GPUs known to the NVIDIA kernel
+ * module, from the numa_node attribute of their PCI devices, in
+ * increasing order.  GPUs without a NUMA node (on non-NUMA systems) are
+ * taken to be local to node 0.  Returns the number of nodes, or -1 if
+ * the GPUs cannot be listed.
+ */
+int nvidia_get_gpu_local_numa_nodes_ctx(NvModprobeContext *ctx, int *nodes,
+                                        int max_nodes)
+{
+    char path[PATH_MAX];
+    char buf[NV_MAX_LINE_LENGTH];
+    struct timespec start;
+    struct dirent *d;
+    DIR *dir;
+    int num_nodes = 0;
+    int node, i;
+
+    nv_span_begin(ctx, &start);
+
+    dir = nv_io_opendir(NV_PROC_GPUS_PATH);
+    if (dir == NULL)
+    {
+        nv_span_end(ctx, &start, "find_local_nodes", NULL);
+        return -1;
+    }
+
+    while (((d = nv_io_readdir(dir)) != NULL) && (num_nodes < max_nodes))
+    {
+        if (d->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), NV_SYS_BUS_PCI_DEVICES_PATH
+                 "/%s/numa_node", d->d_name);
+
+        node = 0;
+        if (read_sysfs_line(path, buf, sizeof(buf)) && (atoi(buf) > 0))
+        {
+            node = atoi(buf);
+        }
+
+        for (i = 0; i < num_nodes; i++)
+        {
+            if (nodes[i] == node)
+            {
+                break;
+            }
+        }
+
+        if (i == num_nodes)
+        {
+            nodes[num_nodes++] = node;
+        }
+    }
+
+    nv_io_closedir(dir);
+
+    if (num_nodes > 1)
+    {
+        qsort(nodes, num_nodes, sizeof(*nodes), compare_ints);
+    }
+
+    nv_span_end(ctx, &start, "find_local_nodes", NULL);
+
+    return num_nodes;
+}
+
+/*
+ * Read the default huge page size, in kB, from /proc/meminfo.  Returns 0
+ * if huge pages are not supported.
+ */
+unsigned long nvidia_get_default_hugepage_size_ctx(NvModprobeContext *ctx)
+{
+    char line[NV_MAX_LINE_LENGTH];
+    unsigned long size_kb = 0;
+    NvIoFile file, *fp;
+
+    fp = nv_io_fopen(&file, NV_PROC_MEMINFO_PATH);
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    while (nv_io_fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "Hugepagesize: %lu kB", &size_kb) == 1)
+        {
+            break;
+        }
+    }
+
+    nv_io_fclose(fp);
+
+    return size_kb;
+}
+
+/*
+ * Make sure at least 'count' huge pages of 'size_kb' kB are reserved on
+ * NUMA node 'node': if fewer are, the node's pool is grown to 'count'.
+ * The kernel may obtain fewer pages than requested if the node's memory
+ * is fragmented; the number of pages in the pool afterwards is returned
+ * in *obtained, and the number before in *before.  Returns 1 if at
+ * least 'count' pages are reserved, and 0 otherwise.  If the context is
+ * out of time, the pool is left alone and 0 is returned with errno set
+ * to ETIME.
+ */
+int nvidia_reserve_hugepages_ctx(NvModprobeContext *ctx, int node,
+                                 unsigned long size_kb, unsigned long count,
+                                 unsigned long *before,
+                                 unsigned long *obtained)
+{
+    char path[PATH_MAX];
+    char buf[32];
+    char name[32];
+    struct timespec start;
+    int fd, len;
+
+    *before = 0;
+    *obtained = 0;
+
+    snprintf(path, sizeof(path), NV_SYS_NODE_PATH
+             "/node%d/hugepages/hugepages-%lukB/nr_hugepages", node, size_kb);
+    snprintf(name, sizeof(name), "node%d", node);
+
+    if (!read_sysfs_line(path, buf, sizeof(buf)))
+    {
+        nv_ctx_log(ctx, "NVIDIA: failed to read `%s`: %s.\n",
+                   path, strerror(errno));
+        return 0;
+    }
+
+    *before = *obtained = strtoul(buf, NULL, 10);
+
+    if (*before >= count)
+    {
+        return 1;
+    }
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        errno = ETIME;
+        return 0;
+    }
+
+    nv_span_begin(ctx, &start);
+
+    fd = nv_io_open(path, O_WRONLY, 0);
+    if (fd < 0)
+    {
+        nv_ctx_log(ctx, "NVIDIA: failed to open `%s`: %s.\n",
+                   path, strerror(errno));
+        nv_span_end(ctx, &start, "reserve_hugepages", name);
+        return 0;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%lu", count);
+
+    if (nv_io_write(fd, buf, len) != len)
+    {
+        nv_ctx_log(ctx, "NVIDIA: unable to write to `%s`: %s.\n",
+                   path, strerror(errno));
+    }
+
+    nv_io_close(fd);
+
+    if (read_sysfs_line(path, buf, sizeof(buf)))
+    {
+        *obtained = strtoul(buf, NULL, 10);
+    }
+
+    nv_span_end(ctx, &start, "reserve_hugepages", name);
+
+    return *obtained >= count;
+}
+
+static int compare_pci_info(const void *a, const void *b)
+{
+    const pci_info_t *x = a, *y = b;
+
+    if (x->domain != y->domain) return (x->domain < y->domain) ? -1 : 1;
+    if (x->bus != y->bus)       return (x->bus < y->bus) ? -1 : 1;
+    if (x->dev != y->dev)       return (x->dev < y->dev) ? -1 : 1;
+    if (x->ftn != y->ftn)       return (x->ftn < y->ftn) ? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * Plan the affinity of the MSI and MSI-X interrupts of the NVIDIA PCI
+ * devices: each interrupt should be handled by the CPUs local to its
+ * device (the device's local_cpulist).  The current affinity of each
+ * interrupt is read from /proc/irq/<irq>/smp_affinity_list; nothing is
+ * changed.  The interrupts of each device are returned in a malloc'ed
+ * array; see nvidia_irq_plan_free().
+ */
+int nvidia_plan_irq_affinity_ctx(NvModprobeContext *ctx,
+                                 NvModprobeIrqPlan *plan)
+{
+    struct pci_id_match id_match = {
+        NV_PCI_VENDOR_ID,       /* Vendor ID    = 0x10DE                 */
+        PCI_MATCH_ANY,          /* Device ID    = any                    */
+        PCI_MATCH_ANY,          /* Subvendor ID = any                    */
+        PCI_MATCH_ANY,          /* Subdevice ID = any                    */
+        0,                      /* Device Class = any                    */
+        0,                      /* Class Mask   = none                   */
+        0                       /* Initial number of matches             */
+    };
+    pci_info_t devices[NV_MODPROBE_MAX_IRQ_DEVICES];
+    int irqs[NV_MODPROBE_MAX_DEVICE_IRQS];
+    char path[PATH_MAX];
+    char buf[NV_MAX_LINE_LENGTH];
+    struct timespec start;
+    int i, j, num_devices, num_irqs;
+
+    memset(plan, 0, sizeof(*plan));
+
+    nv_span_begin(ctx, &start);
+
+    if (pci_enum_find_devices(&id_match, devices,
+                              NV_MODPROBE_MAX_IRQ_DEVICES) != 0)
+    {
+        nv_span_end(ctx, &start, "plan_irq_affinity", NULL);
+        return 0;
+    }
+
+    num_devices = NV_MIN(id_match.num_matches, NV_MODPROBE_MAX_IRQ_DEVICES);
+    qsort(devices, num_devices, sizeof(*devices), compare_pci_info);
+
+    for (i = 0; i < num_devices; i++)
+    {
+        NvModprobeIrqDevice *device = &plan->devices[plan->num_devices];
+
+        if ((pci_get_msi_irqs(&devices[i], irqs, NV_MODPROBE_MAX_DEVICE_IRQS,
+                              &num_irqs) != 0) || (num_irqs == 0) ||
+            (pci_read_attr(&devices[i], "local_cpulist",
+                           device->local_cpulist,
+                           sizeof(device->local_cpulist)) != 0))
+        {
+            continue;
+        }
+
+        snprintf(device->name, sizeof(device->name), "%04x:%02x:%02x.%x",
+                 devices[i].domain, devices[i].bus, devices[i].dev,
+                 devices[i].ftn);
+
+        device->numa_node = -1;
+        if (pci_read_attr(&devices[i], "numa_node", buf, sizeof(buf)) == 0)
+        {
+            device->numa_node = atoi(buf);
+        }
+
+        num_irqs = NV_MIN(num_irqs, NV_MODPROBE_MAX_DEVICE_IRQS);
+        qsort(irqs, num_irqs, sizeof(*irqs), compare_ints);
+
+        device->irqs = calloc(num_irqs, sizeof(*device->irqs));
+        if (device->irqs == NULL)
+        {
+            continue;
+        }
+
+        for (j = 0; j < num_irqs; j++)
+        {
+            NvModprobeIrq *irq = &device->irqs[j];
+
+            irq->irq = irqs[j];
+
+            snprintf(path, sizeof(path), NV_PROC_IRQ_PATH
+                     "/%d/smp_affinity_list", irq->irq);
+            read_sysfs_line(path, irq->affinity, sizeof(irq->affinity));
+
+            irq->change = (strcmp(irq->affinity, device->local_cpulist) != 0);
+        }
+
+        device->num_irqs = num_irqs;
+        plan->num_devices++;
+    }
+
+    nv_span_end(ctx, &start, "plan_irq_affinity", NULL);
+
+    return 1;
+}
+
+/*
+ * Apply a plan made by nvidia_plan_irq_affinity_ctx(): set the affinity
+ * of each interrupt not already handled by the CPUs local to its device.
+ * The result of each write is recorded in the plan.  The kernel refuses
+ * (EIO) to change the affinity of the interrupts whose affinity it
+ * manages itself; these are not considered failures.  Returns 1 if every
+ * other interrupt was set, and 0 otherwise.
+ */
+int nvidia_apply_irq_affinity_ctx(NvModprobeContext *ctx,
+                                  NvModprobeIrqPlan *plan)
+{
+    char path[PATH_MAX];
+    struct timespec start;
+    int i, j, fd, len, ret = 1;
+
+    nv_span_begin(ctx, &start);
+
+    for (i = 0; i < plan->num_devices; i++)
+    {
+        NvModprobeIrqDevice *device = &plan->devices[i];
+
+        for (j = 0; j < device->num_irqs; j++)
+        {
+            NvModprobeIrq *irq = &device->irqs[j];
+
+            if (!irq->change)
+            {
+                continue;
+            }
+
+            if (nvidia_modprobe_context_out_of_time(ctx))
+            {
+                irq->error = ETIME;
+                ret = 0;
+                continue;
+            }
+
+            snprintf(path, sizeof(path), NV_PROC_IRQ_PATH
+                     "/%d/smp_affinity_list", irq->irq);
+            len = strlen(device->local_cpulist);
+
+            fd = nv_io_open(path, O_WRONLY, 0);
+            if (fd < 0)
+            {
+                irq->error = errno;
+            }
+            else
+            {
+                errno = 0;
+                if (nv_io_write(fd, device->local_cpulist, len) != len)
+                {
+                    irq->error = errno ? errno : EIO;
+                }
+                nv_io_close(fd);
+            }
+
+            if ((irq->error != 0) && (irq->error != EIO))
+            {
+                ret = 0;
+            }
+        }
+    }
+
+    nv_span_end(ctx, &start, "apply_irq_affinity", NULL);
+
+    return ret;
+}
+
+void nvidia_irq_plan_free(NvModprobeIrqPlan *plan)
+{
+    int i;
+
+    for (i = 0; i < plan->num_devices; i++)
+    {
+        free(plan->devices[i].irqs);
+        plan->devices[i].irqs = NULL;
+        plan->devices[i].num_irqs = 0;
+    }
+
+    plan->num_devices = 0;
+}
+
+static long long elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Read /proc/modules whole into a malloc'ed, nul-terminated buffer; it
+ * is usually larger than the other /proc files read by read_proc_file().
+ * Returns NULL if it cannot be read.
+ */
+static char *read_proc_modules(size_t *len_out)
+{
+    return read_proc_file(NV_PROC_MODULES_PATH, NULL,
+                          NV_PROC_MODULES_MIN_SIZE, NV_PROC_MODULES_MAX_SIZE,
+                          len_out);
+}
+
+static int is_driver_module(const char *name)
+{
+    return (strcmp(name, "nvidia") == 0) ||
+           (strncmp(name, "nvidia_", strlen("nvidia_")) == 0);
+}
+
+/*
+ * Compare a module name as listed by the kernel, e.g. "nvidia_uvm", with
+ * one as given to modprobe, e.g. "nvidia-uvm": modprobe treats '-' and
+ * '_' alike.
+ */
+static int is_module_named(const char *loaded, const char *name)
+{
+    for (; (*loaded != '\0') && (*name != '\0'); loaded++, name++)
+    {
+        if ((*loaded != *name) &&
+            !(((*loaded == '-') || (*loaded == '_')) &&
+              ((*name == '-') || (*name == '_'))))
+        {
+            return 0;
+        }
+    }
+
+    return (*loaded == '\0') && (*name == '\0');
+}
+
+static int find_driver_module(const NvModprobeDriverPlan *plan,
+                              const char *name)
+{
+    int i;
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        if (strcmp(plan->modules[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Record that the module of a plan at index is used by the module holder,
+ * unless already known.
+ */
+static void add_driver_holder(NvModprobeDriverPlan *plan, int index,
+                              const char *holder)
+{
+    NvModprobeDriverModule *module = &plan->modules[index];
+    size_t len = strlen(module->other_holders);
+    const char *other;
+    int i, j;
+
+    j = find_driver_module(plan, holder);
+    if (j >= 0)
+    {
+        for (i = 0; i < module->num_holders; i++)
+        {
+            if (module->holders[i] == j)
+            {
+                return;
+            }
+        }
+        module->holders[module->num_holders++] = j;
+        return;
+    }
+
+    for (other = module->other_holders; *other != '\0'; other += i)
+    {
+        i = strcspn(other, ",");
+        if ((strncmp(other, holder, i) == 0) && (holder[i] == '\0'))
+        {
+            return;
+        }
+        if (other[i] == ',')
+        {
+            i++;
+        }
+    }
+
+    snprintf(module->other_holders + len, sizeof(module->other_holders) - len,
+             "%s%s", (len > 0) ? "," : "", holder);
+}
+
+/*
+ * Add the holders of a module listed in /sys/module/<name>/holders; the
+ * used-by column of /proc/modules may not list them all, e.g. modules
+ * holding it through symbol references taken after loading.
+ */
+static void read_sys_module_holders(NvModprobeDriverPlan *plan, int index)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), NV_SYS_MODULE_PATH "/%s/holders",
+             plan->modules[index].name);
+
+    dir = nv_io_opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((entry = nv_io_readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            add_driver_holder(plan, index, entry->d_name);
+        }
+    }
+
+    nv_io_closedir(dir);
+}
+
+/*
+ * Plan the reload of the NVIDIA driver: list its loaded kernel modules,
+ * with their reference counts and the modules using them, from a single
+ * read of /proc/modules and from their /sys/module/<name>/holders
+ * directories, and sort them into unload waves.  Nothing is changed.
+ * Returns 1 on success, and 0 if /proc/modules cannot be read.
+ */
+int nvidia_plan_driver_reload_ctx(NvModprobeContext *ctx,
+                                  NvModprobeDriverPlan *plan)
+{
+    char used_by[NV_MODPROBE_MAX_DRIVER_MODULES][256];
+    char *buf, *line, *save, *name, *refcount, *holder;
+    NVLineIter iter;
+    size_t len, line_len;
+    struct timespec start;
+    int i, j, pass, changed;
+
+    memset(plan, 0, sizeof(*plan));
+
+    nv_span_begin(ctx, &start);
+
+    buf = read_proc_modules(&len);
+    if (buf == NULL)
+    {
+        nv_span_end(ctx, &start, "plan_driver_reload", NULL);
+        return 0;
+    }
+
+    /* Each line is "name size refcount used-by state address [taints]". */
+
+    nv_line_iter_init(&iter, buf, len);
+
+    while (nv_line_iter_next(&iter, &line, &line_len) &&
+           (plan->num_modules < NV_MODPROBE_MAX_DRIVER_MODULES))
+    {
+        NvModprobeDriverModule *module = &plan->modules[plan->num_modules];
+        char *deps;
+
+        line[line_len] = '\0';
+
+        name = strtok_r(line, " ", &save);
+        if ((name == NULL) || !is_driver_module(name) ||
+            (strlen(name) >= sizeof(module->name)))
+        {
+            continue;
+        }
+
+        strtok_r(NULL, " ", &save);
+        refcount = strtok_r(NULL, " ", &save);
+        deps = strtok_r(NULL, " ", &save);
+        if ((refcount == NULL) || (deps == NULL))
+        {
+            continue;
+        }
+
+        strcpy(module->name, name);
+        module->refcount = atoi(refcount);
+        snprintf(used_by[plan->num_modules], sizeof(used_by[0]), "%s", deps);
+
+        plan->num_modules++;
+    }
+
+    free(buf);
+
+    /* The used-by lists are "-", or names each followed by a comma. */
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        for (holder = strtok_r(used_by[i], ",", &save);
+             holder != NULL;
+             holder = strtok_r(NULL, ",", &save))
+        {
+            if (strcmp(holder, "-") != 0)
+            {
+                add_driver_holder(plan, i, holder);
+            }
+        }
+
+        read_sys_module_holders(plan, i);
+    }
+
+    /*
+     * Each module goes in the wave after the last of its holders; the
+     * kernel does not allow cycles, but bound the passes anyway.
+     */
+
+    changed = 1;
+
+    for (pass = 0; changed && (pass < plan->num_modules); pass++)
+    {
+        changed = 0;
+
+        for (i = 0; i < plan->num_modules; i++)
+        {
+            NvModprobeDriverModule *module = &plan->modules[i];
+
+            for (j = 0; j < module->num_holders; j++)
+            {
+                int wave = plan->modules[module->holders[j]].wave;
+
+                if (module->wave <= wave)
+                {
+                    module->wave = wave + 1;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        plan->num_waves = NV_MAX(plan->num_waves, plan->modules[i].wave + 1);
+    }
+
+    nv_span_end(ctx, &start, "plan_driver_reload", NULL);
+
+    return 1;
+}
+
+/*
+ * The kernel module providing a device file: /dev/nvidia-uvm* and
+ * /dev/nvidia-modeset belong to their own modules, and the other
+ * /dev/nvidia* files, including the capability and IMEX channel device
+ * files, to the nvidia module.  Returns NULL for other files.
+ */
+static const char *device_file_module(const char *path)
+{
+    if (strncmp(path, NV_UVM_DEVICE_NAME, strlen(NV_UVM_DEVICE_NAME)) == 0)
+    {
+        return "nvidia_uvm";
+    }
+
+    if (strcmp(path, NV_MODESET_DEVICE_NAME) == 0)
+    {
+        return "nvidia_modeset";
+    }
+
+    if (strncmp(path, NV_DEV_PATH "nvidia", strlen(NV_DEV_PATH "nvidia")) == 0)
+    {
+        return "nvidia";
+    }
+
+    return NULL;
+}
+
+static void add_driver_user(NvModprobeDriverPlan *plan, pid_t pid,
+                            const char *path, const char *module)
+{
+    NvModprobeModuleUser *user;
+    char comm_path[PATH_MAX];
+    int i;
+
+    /* Count each device file once per process, however many fds. */
+
+    for (i = 0; i < NV_MIN(plan->num_users, NV_MODPROBE_MAX_MODULE_USERS); i++)
+    {
+        if ((plan->users[i].pid == pid) &&
+            (strcmp(plan->users[i].path, path) == 0))
+        {
+            return;
+        }
+    }
+
+    if (plan->num_users++ >= NV_MODPROBE_MAX_MODULE_USERS)
+    {
+        return;
+    }
+
+    user = &plan->users[plan->num_users - 1];
+    user->pid = pid;
+    user->module = find_driver_module(plan, module);
+    snprintf(user->path, sizeof(user->path), "%s", path);
+
+    snprintf(comm_path, sizeof(comm_path), NV_PROC_PATH "/%d/comm", (int) pid);
+    if (!read_sysfs_line(comm_path, user->comm, sizeof(user->comm)))
+    {
+        strcpy(user->comm, "?");
+    }
+}
+
+/*
+ * Find the processes holding NVIDIA device files open, which keep the
+ * modules providing them from being unloaded, by reading the links in
+ * /proc/<pid>/fd.  The processes found are recorded in the plan.  Since
+ * this lists the open files of every user's processes, it is refused
+ * unless the real user ID is 0, i.e. also when running setuid root.
+ * Returns 1 on success, and 0 with errno set to EPERM if refused, or if
+ * /proc cannot be read.
+ */
+int nvidia_find_driver_users_ctx(NvModprobeContext *ctx,
+                                 NvModprobeDriverPlan *plan)
+{
+    char target[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
+    char pid_name[32], path[PATH_MAX];
+    struct dirent *entry;
+    DIR *proc_dir, *fd_dir;
+    struct timespec start;
+    const char *module;
+    char *end;
+    long pid;
+
+    plan->num_users = 0;
+
+    if (getuid() != 0)
+    {
+        errno = EPERM;
+        return 0;
+    }
+
+    nv_span_begin(ctx, &start);
+
+    proc_dir = nv_io_opendir(NV_PROC_PATH);
+    if (proc_dir == NULL)
+    {
+        nv_span_end(ctx, &start, "find_driver_users", NULL);
+        return 0;
+    }
+
+    while ((entry = nv_io_readdir(proc_dir)) != NULL)
+    {
+        pid = strtol(entry->d_name, &end, 10);
+        if ((*end != '\0') || (pid <= 0) ||
+            (strlen(entry->d_name) >= sizeof(pid_name)))
+        {
+            continue;
+        }
+
+        strcpy(pid_name, entry->d_name);
+
+        snprintf(path, sizeof(path), NV_PROC_PATH "/%s/fd", pid_name);
+        fd_dir = nv_io_opendir(path);
+        if (fd_dir == NULL)
+        {
+            continue;
+        }
+
+        while ((entry = nv_io_readdir(fd_dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+            {
+                continue;
+            }
+
+            snprintf(path, sizeof(path), NV_PROC_PATH "/%s/fd/%s",
+                     pid_name, entry->d_name);
+
+            if (nv_io_readlink(path, target, sizeof(target)) < 0)
+            {
+                continue;
+            }
+
+            module = device_file_module(target);
+            if (module != NULL)
+            {
+                add_driver_user(plan, pid, target, module);
+            }
+        }
+
+        nv_io_closedir(fd_dir);
+    }
+
+    nv_io_closedir(proc_dir);
+
+    nv_span_end(ctx, &start, "find_driver_users", NULL);
+
+    return 1;
+}
+
+/*
+ * Unload a module of a plan made by nvidia_plan_driver_reload_ctx() with
+ * delete_module(2), in O_NONBLOCK mode: while the module is in use, the
+ * call fails right away with EWOULDBLOCK rather than waiting.  Modules
+ * still used by other modules are not attempted, and fail the same way.
+ * The result and duration are recorded in the plan.
+ *
+ * Unloading is refused with EPERM unless the real user ID is 0, so that
+ * a setuid root caller cannot unload the driver on behalf of any user.
+ *
+ * The modules of a wave may be unloaded concurrently, from threads using
+ * their own contexts, once those of the previous waves are done.
+ * Returns 1 if the module was unloaded, and 0 otherwise.
+ */
+int nvidia_unload_driver_module_ctx(NvModprobeContext *ctx,
+                                    NvModprobeDriverPlan *plan, int index)
+{
+    NvModprobeDriverModule *module;
+    struct timespec start;
+    int i;
+
+    if ((index < 0) || (index >= plan->num_modules))
+    {
+        return 0;
+    }
+
+    module = &plan->modules[index];
+    module->unload_error = 0;
+
+    if (getuid() != 0)
+    {
+        module->unload_error = EPERM;
+        return 0;
+    }
+
+    if (module->other_holders[0] != '\0')
+    {
+        module->unload_error = EWOULDBLOCK;
+        return 0;
+    }
+
+    for (i = 0; i < module->num_holders; i++)
+    {
+        if (!plan->modules[module->holders[i]].unloaded)
+        {
+            module->unload_error = EWOULDBLOCK;
+            return 0;
+        }
+    }
+
+    if (nvidia_modprobe_context_out_of_time(ctx))
+    {
+        module->unload_error = ETIME;
+        return 0;
+    }
+
+    NV_PROBE1(unload__start, module->name);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (nv_io_delete_module(module->name, O_NONBLOCK) == 0)
+    {
+        module->unloaded = 1;
+    }
+    else
+    {
+        module->unload_error = errno;
+    }
+
+    module->unload_ns = elapsed_ns(&start);
+
+    nv_span_end(ctx, &start, "delete_module", module->name);
+
+    NV_PROBE2(unload__done, module->name, module->unloaded);
+
+    return module->unloaded;
+}
+
+/*
+ * Create again the device files of a reloaded module: /dev/nvidiactl and
+ * those of the GPUs listed in /proc/driver/nvidia/gpus for nvidia, those
+ * of nvidia-uvm and nvidia-modeset for theirs.  The other modules create
+ * theirs on demand, e.g. with nvidia_cap_mknod_ctx().  Returns 1 on
+ * success, and 0 if any device file could not be created.
+ */
+static int recreate_device_files(NvModprobeContext *ctx, const char *name)
+{
+    unsigned int domain, bus, device, ftn;
+    struct dirent *entry;
+    DIR *dir;
+    int minor, ret;
+
+    if (is_module_named(name, NV_UVM_MODULE_NAME))
+    {
+        return nvidia_uvm_mknod_ctx(ctx, 0);
+    }
+
+    if (is_module_named(name, NV_MODESET_MODULE_NAME))
+    {
+        return nvidia_modeset_mknod_ctx(ctx);
+    }
+
+    if (!is_module_named(name, NV_NVIDIA_MODULE_NAME))
+    {
+        return 1;
+    }
+
+    ret = nvidia_mknod_ctx(ctx, NV_CTL_DEVICE_NUM);
+
+    dir = nv_io_opendir(NV_PROC_GPUS_PATH);
+    if (dir == NULL)
+    {
+        return ret;
+    }
+
+    while ((entry = nv_io_readdir(dir)) != NULL)
+    {
+        if (sscanf(entry->d_name, "%x:%x:%x.%x",
+                   &domain, &bus, &device, &ftn) != 4)
+        {
+            continue;
+        }
+
+        minor = nvidia_get_gpu_minor_ctx(ctx, domain, bus, device, ftn);
+        if ((minor < 0) || !nvidia_mknod_ctx(ctx, minor))
+        {
+            ret = 0;
+        }
+    }
+
+    nv_io_closedir(dir);
+
+    return ret;
+}
+
+/*
+ * Load again the modules of a plan unloaded by
+ * nvidia_unload_driver_module_ctx(), in the reverse order of the waves.
+ * The modules of a wave do not depend on each other, so modprobe is
+ * started for all of them, as by nvidia_modprobe_ctx() and, on Tegra,
+ * nvidia_modeset_modprobe_ctx(), before any is waited for.  The caches of
+ * the context are flushed first, since the reloaded modules may register
+ * different character device majors.  The device files of each module
+ * loaded again are then created again, with the new majors.
+ *
+ * The time budget of the context does not apply, so as not to leave the
+ * driver unloaded.  Returns 1 if every module unloaded was loaded again
+ * with its device files, and 0 otherwise.
+ */
+int nvidia_reload_driver_ctx(NvModprobeContext *ctx,
+                             NvModprobeDriverPlan *plan)
+{
+    NvModprobeSpawnStatus status[NV_MODPROBE_MAX_DRIVER_MODULES];
+    struct timespec start[NV_MODPROBE_MAX_DRIVER_MODULES];
+    pid_t pids[NV_MODPROBE_MAX_DRIVER_MODULES];
+    int has_deadline = ctx->has_deadline;
+    int out_of_time = ctx->out_of_time;
+    bool allow_on_tegra;
+    int wave, i, ret = 1;
+
+    nvidia_modprobe_context_flush_cache(ctx);
+
+    ctx->has_deadline = 0;
+    ctx->out_of_time = 0;
+
+    for (wave = plan->num_waves - 1; wave >= 0; wave--)
+    {
+        for (i = 0; i < plan->num_modules; i++)
+        {
+            NvModprobeDriverModule *module = &plan->modules[i];
+
+            status[i] = NvModprobeSpawnFailed;
+
+            if ((module->wave != wave) || !module->unloaded)
+            {
+                continue;
+            }
+
+            NV_PROBE1(modprobe__start, module->name);
+
+            clock_gettime(CLOCK_MONOTONIC, &start[i]);
+
+            /* nvidia-modeset is also loaded on Tegra, without NVIDIA GPUs */
+
+            allow_on_tegra = is_module_named(module->name,
+                                             NV_MODESET_MODULE_NAME);
+
+            status[i] = nvidia_modprobe_spawn(ctx, 1, module->name,
+                                              allow_on_tegra, &pids[i]);
+            if (status[i] != NvModprobeSpawnStarted)
+            {
+                module->reloaded = (status[i] == NvModprobeSpawnLoaded);
+                module->reload_ns = elapsed_ns(&start[i]);
+                NV_PROBE2(modprobe__done, module->name, module->reloaded);
+            }
+        }
+
+        for (i = 0; i < plan->num_modules; i++)
+        {
+            NvModprobeDriverModule *module = &plan->modules[i];
+
+            if ((module->wave == wave) &&
+                (status[i] == NvModprobeSpawnStarted))
+            {
+                module->reloaded = modprobe_wait(ctx, module->name, pids[i]);
+                module->reload_ns = elapsed_ns(&start[i]);
+            }
+        }
+    }
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        NvModprobeDriverModule *module = &plan->modules[i];
+
+        if (module->reloaded)
+        {
+            module->recreated = recreate_device_files(ctx, module->name);
+        }
+
+        if (module->unloaded && !(module->reloaded && module->recreated))
+        {
+            ret = 0;
+        }
+    }
+
+    ctx->has_deadline = has_deadline;
+    ctx->out_of_time = out_of_time;
+
+    return ret;
+}
+
+/*
+ * Entry points without a caller-provided context: each call gets a
+ * private context, so no state is shared or cached between calls.
+ */
+
+#define NV_CALL_WITH_PRIVATE_CONTEXT(func, ...)    \
+do {                                               \
+    NvModprobeContext ctx;                         \
+    nvidia_modprobe_context_init(&ctx);            \
+    return func(&ctx, ##__VA_ARGS__);              \
+} while (0)
+
+int nvidia_get_file_state(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_file_state_ctx, minor);
+}
+
+int nvidia_modprobe(const int print_errors)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_modprobe_ctx, print_errors);
+}
+
+int nvidia_mknod(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_mknod_ctx, minor);
+}
+
+int nvidia_uvm_modprobe(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_uvm_modprobe_ctx);
+}
+
+int nvidia_uvm_mknod(int base_minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_uvm_mknod_ctx, base_minor);
+}
+
+int nvidia_modeset_modprobe(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_modeset_modprobe_ctx);
+}
+
+int nvidia_modeset_mknod(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_modeset_mknod_ctx);
+}
+
+int nvidia_vgpu_vfio_mknod(int minor_num)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_vgpu_vfio_mknod_ctx, minor_num);
+}
+
+int nvidia_nvlink_mknod(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_nvlink_mknod_ctx);
+}
+
+int nvidia_nvlink_get_file_state(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_nvlink_get_file_state_ctx);
+}
+
+int nvidia_nvswitch_mknod(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_nvswitch_mknod_ctx, minor);
+}
+
+int nvidia_nvswitch_get_file_state(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_nvswitch_get_file_state_ctx, minor);
+}
+
+int nvidia_cap_mknod(const char* cap_file_path, int *minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_cap_mknod_ctx, cap_file_path, minor);
+}
+
+int nvidia_cap_get_file_state(const char* cap_file_path)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_cap_get_file_state_ctx, cap_file_path);
+}
+
+int nvidia_cap_imex_channel_mknod(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_cap_imex_channel_mknod_ctx, minor);
+}
+
+int nvidia_cap_imex_channel_file_state(int minor)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_cap_imex_channel_file_state_ctx, minor);
+}
+
+int nvidia_get_gpu_minor(unsigned int domain, unsigned int bus,
+                         unsigned int device, unsigned int ftn)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_gpu_minor_ctx,
+                                 domain, bus, device, ftn);
+}
+
+int nvidia_get_chardev_major(const char *name)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_chardev_major_ctx, name);
+}
+
+int nvidia_msr_modprobe(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_msr_modprobe_ctx);
+}
+
+int nvidia_enable_auto_online_movable(const int print_errors)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_enable_auto_online_movable_ctx, print_errors);
+}
+
+int nvidia_get_offline_gpu_memory_blocks(int **blocks)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_offline_gpu_memory_blocks_ctx,
+                                 blocks);
+}
+
+int nvidia_online_movable_memory_block(int block, const int print_errors)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_online_movable_memory_block_ctx,
+                                 block, print_errors);
+}
+
+int nvidia_audit_gpu_memory(NvModprobeMemoryAudit *audit)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_audit_gpu_memory_ctx, audit);
+}
+
+int nvidia_get_gpu_local_numa_nodes(int *nodes, int max_nodes)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_gpu_local_numa_nodes_ctx,
+                                 nodes, max_nodes);
+}
+
+unsigned long nvidia_get_default_hugepage_size(void)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_get_default_hugepage_size_ctx);
+}
+
+int nvidia_reserve_hugepages(int node, unsigned long size_kb,
+                             unsigned long count, unsigned long *before,
+                             unsigned long *obtained)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_reserve_hugepages_ctx, node, size_kb,
+                                 count, before, obtained);
+}
+
+int nvidia_plan_irq_affinity(NvModprobeIrqPlan *plan)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_plan_irq_affinity_ctx, plan);
+}
+
+int nvidia_apply_irq_affinity(NvModprobeIrqPlan *plan)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_apply_irq_affinity_ctx, plan);
+}
+
+int nvidia_plan_driver_reload(NvModprobeDriverPlan *plan)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_plan_driver_reload_ctx, plan);
+}
+
+int nvidia_find_driver_users(NvModprobeDriverPlan *plan)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_find_driver_users_ctx, plan);
+}
+
+int nvidia_unload_driver_module(NvModprobeDriverPlan *plan, int module)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_unload_driver_module_ctx, plan,
+                                 module);
+}
+
+int nvidia_reload_driver(NvModprobeDriverPlan *plan)
+{
+    NV_CALL_WITH_PRIVATE_CONTEXT(nvidia_reload_driver_ctx, plan);
+}
+
 #endif /* NV_LINUX */
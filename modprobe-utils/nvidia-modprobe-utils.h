@@ -29,6 +29,8 @@
 #define __NVIDIA_MODPROBE_UTILS_H__
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
 
 #define NV_MAX_CHARACTER_DEVICE_FILE_STRLEN  128
 #define NV_CTL_DEVICE_NUM                    255
@@ -75,6 +77,303 @@ static __inline__ int nvidia_test_file_state(int state,
     return !!(state & (1 << value));
 }
 
+/*
+ * Log sink for the modprobe-utils functions: 'msg' is a single,
+ * newline-terminated message.  When no sink is set, messages are
+ * written to stderr.
+ */
+typedef void NvModprobeLogFunc(void *data, const char *msg);
+
+/*
+ * Timing callback, called at the end of each instrumented phase (module
+ * loading, /proc parsing, device file creation, ...) with the name of the
+ * phase, its argument (a module name or a path; may be NULL) and its
+ * duration in nanoseconds.
+ */
+typedef void NvModprobeSpanFunc(void *data, const char *name,
+                                const char *arg, long long ns);
+
+#define NV_MODPROBE_CACHE_NAME_LEN      32
+#define NV_MODPROBE_CACHE_MAJORS        8
+#define NV_MODPROBE_CACHE_PARAMS        4
+
+typedef struct
+{
+    char name[NV_MODPROBE_CACHE_NAME_LEN];
+    int major;
+} NvModprobeMajorCacheEntry;
+
+typedef struct
+{
+    char proc_path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
+    uid_t uid;
+    gid_t gid;
+    mode_t mode;
+    int modify;
+} NvModprobeParamsCacheEntry;
+
+/*
+ * Per-caller state for the modprobe-utils functions.  Nothing in
+ * modprobe-utils is shared between contexts, so separate threads may
+ * run requests concurrently as long as each uses its own context.
+ *
+ * The context caches the character device majors found in
+ * /proc/devices and the device file parameters read from the
+ * registry/permission files, so that creating many device files only
+ * parses those files once.  Only successful lookups are cached; call
+ * nvidia_modprobe_context_flush_cache() if a kernel module may have
+ * been unloaded or reloaded since the context was last used.
+ */
+typedef struct
+{
+    NvModprobeLogFunc *log;
+    void *log_data;
+
+    NvModprobeSpanFunc *span;
+    void *span_data;
+
+    int num_majors;
+    NvModprobeMajorCacheEntry majors[NV_MODPROBE_CACHE_MAJORS];
+
+    int num_params;
+    int next_param;
+    NvModprobeParamsCacheEntry params[NV_MODPROBE_CACHE_PARAMS];
+
+    /*
+     * Optional deadline, on the CLOCK_MONOTONIC clock, after which no new
+     * work (loading a kernel module, waiting for a PCI link, creating a
+     * device file) is started.  Work already in progress is completed.
+     */
+    int has_deadline;
+    int out_of_time;
+    struct timespec deadline;
+} NvModprobeContext;
+
+/*
+ * Counters of the file system and process operations performed by
+ * modprobe-utils on the calling thread, by kind of operation, and of the
+ * lookups served from the context caches.
+ */
+typedef enum
+{
+    NvModprobeStatOpen = 0,
+    NvModprobeStatRead,
+    NvModprobeStatWrite,
+    NvModprobeStatStat,
+    NvModprobeStatMknod,
+    NvModprobeStatMkdir,
+    NvModprobeStatChmod,
+    NvModprobeStatChown,
+    NvModprobeStatSymlink,
+    NvModprobeStatRemove,
+    NvModprobeStatSpawn,
+    NvModprobeStatDeleteModule,
+    NvModprobeStatCacheHit,
+    NvModprobeNumStats
+} NvModprobeStat;
+
+typedef struct
+{
+    unsigned long count[NvModprobeNumStats];
+} NvModprobeStats;
+
+void nvidia_modprobe_get_stats(NvModprobeStats *stats);
+void nvidia_modprobe_reset_stats(void);
+const char *nvidia_modprobe_stat_name(NvModprobeStat stat);
+
+/*
+ * Root prefix for the file system paths used by modprobe-utils (/sys,
+ * /proc, /dev, and the modprobe binary): with a root of "/tmp/root",
+ * /proc/devices is read from /tmp/root/proc/devices.  This allows running
+ * against a fake tree, e.g. one built by gen-fake-root.sh, without any
+ * NVIDIA hardware.
+ *
+ * The root prefix is process-wide and must be set before any request is
+ * started.  It is refused (EPERM) when running setuid or setgid.  These
+ * functions return 0 or an errno value.
+ */
+#define NV_MODPROBE_ROOT_ENV "NVIDIA_MODPROBE_ROOT"
+
+int nvidia_modprobe_set_root(const char *root);
+int nvidia_modprobe_set_root_from_env(void);
+const char *nvidia_modprobe_get_root(void);
+
+/*
+ * Recording and replay of the file system and process operations of
+ * modprobe-utils.  When recording, every path accessed is logged to the
+ * given file along with the result, the content read and the latency of
+ * the access; when replaying, the accesses are served from such a file,
+ * with the same results and delays, instead of from the file system.
+ *
+ * Like the root prefix, this is process-wide, must be set before any
+ * request is started, and is refused (EPERM) when running setuid or
+ * setgid.  These functions return 0 or an errno value.
+ */
+typedef enum
+{
+    NvModprobeTraceOff = 0,
+    NvModprobeTraceRecord,
+    NvModprobeTraceReplay
+} NvModprobeTraceMode;
+
+#define NV_MODPROBE_RECORD_ENV "NVIDIA_MODPROBE_RECORD"
+#define NV_MODPROBE_REPLAY_ENV "NVIDIA_MODPROBE_REPLAY"
+
+int nvidia_modprobe_set_trace(NvModprobeTraceMode mode, const char *path);
+int nvidia_modprobe_set_trace_from_env(void);
+
+/*
+ * Placement of the memory of the GPU NUMA nodes; see
+ * nvidia_audit_gpu_memory_ctx().
+ */
+#define NV_MODPROBE_MAX_GPU_NODES       64
+#define NV_MODPROBE_MAX_ZONES           8
+#define NV_MODPROBE_ZONE_NAME_LEN       16
+
+typedef struct
+{
+    char name[NV_MODPROBE_ZONE_NAME_LEN];
+    unsigned long long present_pages;
+    unsigned long long managed_pages;
+} NvModprobeZoneInfo;
+
+typedef struct
+{
+    int node;
+    int num_blocks;
+    int num_online;
+    int num_misplaced;          /* online blocks outside ZONE_MOVABLE */
+
+    /* the zones of the node with present pages, from /proc/zoneinfo */
+    NvModprobeZoneInfo zones[NV_MODPROBE_MAX_ZONES];
+    int num_zones;
+} NvModprobeNodeAudit;
+
+typedef struct
+{
+    int block;
+    int node;
+    char zone[NV_MODPROBE_ZONE_NAME_LEN];
+} NvModprobeMisplacedBlock;
+
+typedef struct
+{
+    unsigned long long block_size;
+    long page_size;
+    char auto_online_blocks[32];
+
+    NvModprobeNodeAudit nodes[NV_MODPROBE_MAX_GPU_NODES];
+    int num_nodes;
+
+    NvModprobeMisplacedBlock *misplaced;
+    int num_misplaced;
+} NvModprobeMemoryAudit;
+
+void nvidia_memory_audit_free(NvModprobeMemoryAudit *audit);
+
+/*
+ * Affinity of the interrupts of the NVIDIA PCI devices; see
+ * nvidia_plan_irq_affinity_ctx().
+ */
+#define NV_MODPROBE_MAX_IRQ_DEVICES     64
+#define NV_MODPROBE_MAX_DEVICE_IRQS     2048
+#define NV_MODPROBE_CPULIST_LEN         256
+
+typedef struct
+{
+    int irq;
+    char affinity[NV_MODPROBE_CPULIST_LEN];     /* smp_affinity_list */
+    int change;                 /* not handled by the local CPUs */
+    int error;                  /* errno of setting the affinity */
+} NvModprobeIrq;
+
+typedef struct
+{
+    char name[16];              /* PCI domain:bus:device.function */
+    int numa_node;
+    char local_cpulist[NV_MODPROBE_CPULIST_LEN];
+
+    NvModprobeIrq *irqs;
+    int num_irqs;
+} NvModprobeIrqDevice;
+
+typedef struct
+{
+    NvModprobeIrqDevice devices[NV_MODPROBE_MAX_IRQ_DEVICES];
+    int num_devices;
+} NvModprobeIrqPlan;
+
+void nvidia_irq_plan_free(NvModprobeIrqPlan *plan);
+
+/*
+ * The loaded kernel modules of the NVIDIA driver ("nvidia" and
+ * "nvidia_*"), for reloading it; see nvidia_plan_driver_reload_ctx().
+ * The modules are unloaded in waves: those of wave 0 are used by no
+ * other module, and each module is unloaded in the wave after the last
+ * of the modules using it.
+ */
+#define NV_MODPROBE_MAX_DRIVER_MODULES  16
+#define NV_MODPROBE_MODULE_NAME_LEN     64
+#define NV_MODPROBE_MAX_MODULE_USERS    32
+
+typedef struct
+{
+    char name[NV_MODPROBE_MODULE_NAME_LEN];
+    int refcount;
+    int wave;
+
+    /* the NVIDIA modules using this one, as indices in the plan */
+    int holders[NV_MODPROBE_MAX_DRIVER_MODULES];
+    int num_holders;
+
+    /* the other modules using this one, comma-separated */
+    char other_holders[256];
+
+    int unloaded;
+    int unload_error;           /* errno of delete_module(2) */
+    long long unload_ns;
+
+    int reloaded;
+    long long reload_ns;
+    int recreated;              /* its device files were created again */
+} NvModprobeDriverModule;
+
+/* A process holding an NVIDIA device file open. */
+typedef struct
+{
+    pid_t pid;
+    char comm[16];
+    char path[NV_MAX_CHARACTER_DEVICE_FILE_STRLEN];
+    int module;                 /* index in the plan, or -1 */
+} NvModprobeModuleUser;
+
+typedef struct
+{
+    NvModprobeDriverModule modules[NV_MODPROBE_MAX_DRIVER_MODULES];
+    int num_modules;
+    int num_waves;
+
+    NvModprobeModuleUser users[NV_MODPROBE_MAX_MODULE_USERS];
+    int num_users;              /* may exceed NV_MODPROBE_MAX_MODULE_USERS */
+} NvModprobeDriverPlan;
+
+void nvidia_modprobe_context_init(NvModprobeContext *ctx);
+void nvidia_modprobe_context_set_log(NvModprobeContext *ctx,
+                                     NvModprobeLogFunc *log, void *data);
+void nvidia_modprobe_context_set_timing(NvModprobeContext *ctx,
+                                        NvModprobeSpanFunc *span, void *data);
+void nvidia_modprobe_context_flush_cache(NvModprobeContext *ctx);
+void nvidia_modprobe_context_set_deadline(NvModprobeContext *ctx,
+                                          const struct timespec *deadline);
+void nvidia_modprobe_context_set_budget(NvModprobeContext *ctx,
+                                        int budget_ms);
+int nvidia_modprobe_context_out_of_time(NvModprobeContext *ctx);
+
+/*
+ * The functions below use a private, temporary context for each call:
+ * errors are written to stderr and nothing is cached between calls.
+ * The *_ctx() variants operate on the given context instead.
+ */
 int nvidia_get_file_state(int minor);
 int nvidia_modprobe(const int print_errors);
 int nvidia_mknod(int minor);
@@ -92,8 +391,75 @@ int nvidia_cap_get_file_state(const char* cap_file_path);
 int nvidia_cap_imex_channel_mknod(int minor);
 int nvidia_cap_imex_channel_file_state(int minor);
 int nvidia_get_chardev_major(const char *name);
+int nvidia_get_gpu_minor(unsigned int domain, unsigned int bus,
+                         unsigned int device, unsigned int ftn);
 int nvidia_msr_modprobe(void);
 int nvidia_enable_auto_online_movable(const int print_errors);
+int nvidia_get_offline_gpu_memory_blocks(int **blocks);
+int nvidia_online_movable_memory_block(int block, const int print_errors);
+int nvidia_audit_gpu_memory(NvModprobeMemoryAudit *audit);
+int nvidia_get_gpu_local_numa_nodes(int *nodes, int max_nodes);
+unsigned long nvidia_get_default_hugepage_size(void);
+int nvidia_reserve_hugepages(int node, unsigned long size_kb,
+                             unsigned long count, unsigned long *before,
+                             unsigned long *obtained);
+int nvidia_plan_irq_affinity(NvModprobeIrqPlan *plan);
+int nvidia_apply_irq_affinity(NvModprobeIrqPlan *plan);
+int nvidia_plan_driver_reload(NvModprobeDriverPlan *plan);
+int nvidia_find_driver_users(NvModprobeDriverPlan *plan);
+int nvidia_unload_driver_module(NvModprobeDriverPlan *plan, int module);
+int nvidia_reload_driver(NvModprobeDriverPlan *plan);
+
+int nvidia_get_file_state_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_modprobe_ctx(NvModprobeContext *ctx, const int print_errors);
+int nvidia_mknod_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_uvm_modprobe_ctx(NvModprobeContext *ctx);
+int nvidia_uvm_mknod_ctx(NvModprobeContext *ctx, int base_minor);
+int nvidia_modeset_modprobe_ctx(NvModprobeContext *ctx);
+int nvidia_modeset_mknod_ctx(NvModprobeContext *ctx);
+int nvidia_vgpu_vfio_mknod_ctx(NvModprobeContext *ctx, int minor_num);
+int nvidia_nvlink_mknod_ctx(NvModprobeContext *ctx);
+int nvidia_nvlink_get_file_state_ctx(NvModprobeContext *ctx);
+int nvidia_nvswitch_mknod_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_nvswitch_get_file_state_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_cap_mknod_ctx(NvModprobeContext *ctx, const char* cap_file_path,
+                         int *minor);
+int nvidia_cap_get_file_state_ctx(NvModprobeContext *ctx,
+                                  const char* cap_file_path);
+int nvidia_cap_imex_channel_mknod_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_cap_imex_channel_file_state_ctx(NvModprobeContext *ctx, int minor);
+int nvidia_get_chardev_major_ctx(NvModprobeContext *ctx, const char *name);
+int nvidia_get_gpu_minor_ctx(NvModprobeContext *ctx, unsigned int domain,
+                             unsigned int bus, unsigned int device,
+                             unsigned int ftn);
+int nvidia_msr_modprobe_ctx(NvModprobeContext *ctx);
+int nvidia_enable_auto_online_movable_ctx(NvModprobeContext *ctx,
+                                          const int print_errors);
+int nvidia_get_offline_gpu_memory_blocks_ctx(NvModprobeContext *ctx,
+                                             int **blocks);
+int nvidia_online_movable_memory_block_ctx(NvModprobeContext *ctx, int block,
+                                           const int print_errors);
+int nvidia_audit_gpu_memory_ctx(NvModprobeContext *ctx,
+                                NvModprobeMemoryAudit *audit);
+int nvidia_get_gpu_local_numa_nodes_ctx(NvModprobeContext *ctx, int *nodes,
+                                        int max_nodes);
+unsigned long nvidia_get_default_hugepage_size_ctx(NvModprobeContext *ctx);
+int nvidia_reserve_hugepages_ctx(NvModprobeContext *ctx, int node,
+                                 unsigned long size_kb, unsigned long count,
+                                 unsigned long *before,
+                                 unsigned long *obtained);
+int nvidia_plan_irq_affinity_ctx(NvModprobeContext *ctx,
+                                 NvModprobeIrqPlan *plan);
+int nvidia_apply_irq_affinity_ctx(NvModprobeContext *ctx,
+                                  NvModprobeIrqPlan *plan);
+int nvidia_plan_driver_reload_ctx(NvModprobeContext *ctx,
+                                  NvModprobeDriverPlan *plan);
+int nvidia_find_driver_users_ctx(NvModprobeContext *ctx,
+                                 NvModprobeDriverPlan *plan);
+int nvidia_unload_driver_module_ctx(NvModprobeContext *ctx,
+                                    NvModprobeDriverPlan *plan, int module);
+int nvidia_reload_driver_ctx(NvModprobeContext *ctx,
+                             NvModprobeDriverPlan *plan);
 
 #endif /* NV_LINUX */
 
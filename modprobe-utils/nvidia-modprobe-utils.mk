@@ -1,6 +1,14 @@
 MODPROBE_UTILS_SRC        += nvidia-modprobe-utils.c
 MODPROBE_UTILS_SRC        += pci-sysfs.c
+MODPROBE_UTILS_SRC        += nvidia-modprobe-async.c
+MODPROBE_UTILS_SRC        += nvidia-modprobe-io.c
+MODPROBE_UTILS_SRC        += nvidia-modprobe-trace.c
 MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-utils.h
+MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-async.h
+MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-internal.h
+MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-io.h
+MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-probes.h
+MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-trace.h
 MODPROBE_UTILS_EXTRA_DIST += nvidia-modprobe-utils.mk
 MODPROBE_UTILS_EXTRA_DIST += pci-enum.h
 MODPROBE_UTILS_EXTRA_DIST += pci-sysfs.h
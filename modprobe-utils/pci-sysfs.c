@@ -57,6 +57,8 @@
 
 #include "pci-enum.h"
 #include "pci-sysfs.h"
+#include "nvidia-modprobe-io.h"
+#include "nvidia-modprobe-probes.h"
 
 #define SYS_BUS_PCI                     "/sys/bus/pci/"
 #define SYS_BUS_PCI_DEVICES SYS_BUS_PCI "devices"
@@ -80,7 +82,12 @@ do  {                                           \
 static int pci_sysfs_read_cfg(uint32_t, uint16_t, uint16_t, uint16_t, uint16_t, void *,
                               uint16_t size, uint16_t *);
 
-static int find_matches(struct pci_id_match *match);
+static int find_matches(struct pci_id_match *match, pci_info_t *devices,
+                        int max_devices);
+
+static int device_matches(const struct pci_id_match *match, unsigned dom,
+                          unsigned bus, unsigned dev, unsigned func,
+                          int *p_matches);
 
 /**
  * Attempt to access PCI subsystem using Linux's sysfs interface to enumerate
@@ -98,9 +105,9 @@ pci_enum_match_id(struct pci_id_match *match)
      * can be accessed using this interface.
      */
     match->num_matches = 0;
-    if (stat(SYS_BUS_PCI_DEVICES, &st) == 0)
+    if (nv_io_stat(SYS_BUS_PCI_DEVICES, &st) == 0)
     {
-        err = find_matches(match);
+        err = find_matches(match, NULL, 0);
     }
     else
     {
@@ -111,31 +118,46 @@ pci_enum_match_id(struct pci_id_match *match)
 }
 
 
+/*
+ * Like pci_enum_match_id(), and also return the addresses of up to
+ * 'max_devices' of the matched devices.
+ */
+int
+pci_enum_find_devices(struct pci_id_match *match, pci_info_t *devices,
+                      int max_devices)
+{
+    match->num_matches = 0;
+
+    return find_matches(match, devices, max_devices);
+}
+
+
 /**
  * The sysfs lookup method uses the directory entries in /sys/bus/pci/devices
  * to enumerate all PCI devices, and then uses a file in each that is mapped to
  * the device's PCI config space to extract the data to match against.
  */
 static int
-find_matches(struct pci_id_match *match)
+find_matches(struct pci_id_match *match, pci_info_t *devices, int max_devices)
 {
     struct dirent *d;
     DIR *sysfs_pci_dir;
     int err = 0;
 
-    sysfs_pci_dir = opendir(SYS_BUS_PCI_DEVICES);
+    NV_PROBE2(pci__scan__start, match->vendor_id, match->device_class);
+
+    sysfs_pci_dir = nv_io_opendir(SYS_BUS_PCI_DEVICES);
     if (sysfs_pci_dir == NULL)
     {
-        return errno;
+        err = errno;
+        NV_PROBE2(pci__scan__done, match->num_matches, err);
+        return err;
     }
 
-    while ((d = readdir(sysfs_pci_dir)) != NULL)
+    while ((d = nv_io_readdir(sysfs_pci_dir)) != NULL)
     {
-        uint8_t config[48];
-        uint16_t bytes;
         unsigned dom, bus, dev, func;
-        uint16_t vendor_id, device_id, subvendor_id, subdevice_id;
-        uint16_t device_class;
+        int matches;
 
         /* Ignore the . and .. dirents */
         if ((strcmp(d->d_name, ".") == 0) || (strcmp(d->d_name, "..") == 0))
@@ -146,31 +168,17 @@ find_matches(struct pci_id_match *match)
         sscanf(d->d_name, PCI_DBDF_FORMAT,
                & dom, & bus, & dev, & func);
 
-        err = pci_sysfs_read_cfg(dom, bus, dev, func, 0, config, 48, & bytes);
-        if ((bytes == 48) && !err)
+        err = device_matches(match, dom, bus, dev, func, &matches);
+        if (!err && matches)
         {
-            vendor_id = (uint16_t)config[0] + ((uint16_t)config[1] << 8);
-            device_id = (uint16_t)config[2] + ((uint16_t)config[3] << 8);
-            device_class = (uint16_t)config[10] +
-                ((uint16_t)config[11] << 8);
-            subvendor_id = (uint16_t)config[44] +
-                ((uint16_t)config[45] << 8);
-            subdevice_id = (uint16_t)config[46] +
-                ((uint16_t)config[47] << 8);
-
-            /*
-             * This logic, originally in common_iterator.c, will tell if
-             * this device is a match for the search criteria.
-             */
-            if (PCI_ID_COMPARE(match->vendor_id,    vendor_id)    &&
-                PCI_ID_COMPARE(match->device_id,    device_id)    &&
-                PCI_ID_COMPARE(match->subvendor_id, subvendor_id) &&
-                PCI_ID_COMPARE(match->subdevice_id, subdevice_id) &&
-                ((device_class & match->device_class_mask) ==
-                    match->device_class))
+            if (match->num_matches < max_devices)
             {
-                match->num_matches++;
+                devices[match->num_matches].domain = dom;
+                devices[match->num_matches].bus = bus;
+                devices[match->num_matches].dev = dev;
+                devices[match->num_matches].ftn = func;
             }
+            match->num_matches++;
         }
 
         if (err)
@@ -179,14 +187,60 @@ find_matches(struct pci_id_match *match)
         }
     }
 
-    closedir(sysfs_pci_dir);
+    nv_io_closedir(sysfs_pci_dir);
+
+    NV_PROBE2(pci__scan__done, match->num_matches, err);
+
     return err;
 }
 
+/*
+ * Read the IDs of a device from its config space and tell, in *p_matches,
+ * whether they meet the search criteria.
+ */
 static int
-pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
-                   uint16_t function, uint16_t off, void *data,
-                   uint16_t size, uint16_t *bytes_read)
+device_matches(const struct pci_id_match *match, unsigned dom, unsigned bus,
+               unsigned dev, unsigned func, int *p_matches)
+{
+    uint8_t config[48];
+    uint16_t bytes;
+    uint16_t vendor_id, device_id, subvendor_id, subdevice_id;
+    uint16_t device_class;
+    int err;
+
+    *p_matches = 0;
+
+    err = pci_sysfs_read_cfg(dom, bus, dev, func, 0, config, 48, & bytes);
+    if ((bytes == 48) && !err)
+    {
+        vendor_id = (uint16_t)config[0] + ((uint16_t)config[1] << 8);
+        device_id = (uint16_t)config[2] + ((uint16_t)config[3] << 8);
+        device_class = (uint16_t)config[10] +
+            ((uint16_t)config[11] << 8);
+        subvendor_id = (uint16_t)config[44] +
+            ((uint16_t)config[45] << 8);
+        subdevice_id = (uint16_t)config[46] +
+            ((uint16_t)config[47] << 8);
+
+        /*
+         * This logic, originally in common_iterator.c, will tell if
+         * this device is a match for the search criteria.
+         */
+        *p_matches = PCI_ID_COMPARE(match->vendor_id,    vendor_id)    &&
+                     PCI_ID_COMPARE(match->device_id,    device_id)    &&
+                     PCI_ID_COMPARE(match->subvendor_id, subvendor_id) &&
+                     PCI_ID_COMPARE(match->subdevice_id, subdevice_id) &&
+                     ((device_class & match->device_class_mask) ==
+                         match->device_class);
+    }
+
+    return err;
+}
+
+static int
+do_pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
+                      uint16_t function, uint16_t off, void *data,
+                      uint16_t size, uint16_t *bytes_read)
 {
     char name[SYSFS_PATH_SIZE];
     uint16_t temp_size = size;
@@ -208,7 +262,7 @@ pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
     snprintf(name, SYSFS_PATH_SIZE - 1, "%s/" PCI_DBDF_FORMAT "/config",
              SYS_BUS_PCI_DEVICES, domain, bus, device, function);
 
-    fd = open(name, O_RDONLY);
+    fd = nv_io_open(name, O_RDONLY, 0);
     if (fd < 0)
     {
         return errno;
@@ -218,14 +272,14 @@ pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
     {
         if (lseek(fd, (off_t) off, SEEK_SET) < 0)
         {
-            close(fd);
+            nv_io_close(fd);
             return errno;
         }
     }
 
     while (temp_size > 0)
     {
-        const ssize_t bytes = read(fd, data_bytes, temp_size);
+        const ssize_t bytes = nv_io_read(fd, data_bytes, temp_size);
 
         /*
          * If zero bytes were read, then we assume it's the end of the
@@ -246,7 +300,24 @@ pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
         *bytes_read = size - temp_size;
     }
 
-    close(fd);
+    nv_io_close(fd);
+    return err;
+}
+
+static int
+pci_sysfs_read_cfg(uint32_t domain, uint16_t bus, uint16_t device,
+                   uint16_t function, uint16_t off, void *data,
+                   uint16_t size, uint16_t *bytes_read)
+{
+    int err;
+
+    NV_PROBE5(pci__cfg__start, domain, bus, device, function, off);
+
+    err = do_pci_sysfs_read_cfg(domain, bus, device, function, off, data,
+                                size, bytes_read);
+
+    NV_PROBE5(pci__cfg__done, domain, bus, device, function, err);
+
     return err;
 }
 
@@ -274,7 +345,7 @@ pci_sysfs_write_cfg(uint32_t domain, uint16_t bus, uint16_t device,
     snprintf(name, SYSFS_PATH_SIZE - 1, "%s/" PCI_DBDF_FORMAT "/config",
              SYS_BUS_PCI_DEVICES, domain, bus, device, function);
 
-    fd = open(name, O_WRONLY);
+    fd = nv_io_open(name, O_WRONLY, 0);
     if (fd < 0)
     {
         return errno;
@@ -284,14 +355,14 @@ pci_sysfs_write_cfg(uint32_t domain, uint16_t bus, uint16_t device,
     {
         if (lseek(fd, (off_t) off, SEEK_SET) < 0)
         {
-            close(fd);
+            nv_io_close(fd);
             return errno;
         }
     }
 
     while (temp_size > 0)
     {
-        const ssize_t bytes = write(fd, data_bytes, temp_size);
+        const ssize_t bytes = nv_io_write(fd, data_bytes, temp_size);
 
         if (bytes < 0)
         {
@@ -316,7 +387,7 @@ pci_sysfs_write_cfg(uint32_t domain, uint16_t bus, uint16_t device,
         *bytes_written = size - temp_size;
     }
 
-    close(fd);
+    nv_io_close(fd);
     return err;
 }
 
@@ -340,16 +411,16 @@ pci_rescan(uint32_t domain, uint8_t bus, uint8_t slot, uint8_t function)
         node = node_buf;
     }
 
-    node_fd = open(node, O_WRONLY);
+    node_fd = nv_io_open(node, O_WRONLY, 0);
 
     if (node_fd < 0)
     {
         return errno;
     }
 
-    cnt = write(node_fd, SYSFS_RESCAN_STRING, SYSFS_RESCAN_STRING_SIZE);
+    cnt = nv_io_write(node_fd, SYSFS_RESCAN_STRING, SYSFS_RESCAN_STRING_SIZE);
 
-    close(node_fd);
+    nv_io_close(node_fd);
 
     return cnt == SYSFS_RESCAN_STRING_SIZE ? 0 : EIO;
 }
@@ -365,7 +436,7 @@ pci_find_parent_bridge(pci_info_t *p_gpu_info, pci_info_t *p_bridge_info)
             p_gpu_info->domain, p_gpu_info->bus,
             p_gpu_info->dev, p_gpu_info->ftn);
 
-    if (realpath(gpu_path, bridge_path) == NULL)
+    if (nv_io_realpath(gpu_path, bridge_path) == NULL)
     {
         return errno;
     }
@@ -389,6 +460,142 @@ pci_find_parent_bridge(pci_info_t *p_gpu_info, pci_info_t *p_bridge_info)
     return 0;
 }
 
+/*
+ * Find the device on the secondary bus of a bridge that meets the search
+ * criteria, e.g. the GPU below a PCIe downstream port after it has been
+ * rescanned.  Only function 0 is considered, so that the other functions
+ * of a multi-function device, such as the HD audio controller of a GPU,
+ * are never taken for it.
+ */
+int
+pci_find_child_device(pci_info_t *p_bridge_info,
+                      const struct pci_id_match *match,
+                      pci_info_t *p_child_info)
+{
+    char            bridge_path[SYSFS_PATH_SIZE];
+    DIR             *dir;
+    struct dirent   *d;
+    int             err = ENOENT;
+
+    snprintf(bridge_path, SYSFS_PATH_SIZE - 1, "%s/" PCI_DBDF_FORMAT, SYS_BUS_PCI_DEVICES,
+            p_bridge_info->domain, p_bridge_info->bus,
+            p_bridge_info->dev, p_bridge_info->ftn);
+
+    dir = nv_io_opendir(bridge_path);
+
+    if (dir == NULL)
+    {
+        return errno;
+    }
+
+    while ((d = nv_io_readdir(dir)) != NULL)
+    {
+        pci_info_t  child;
+        int         matches;
+
+        if ((sscanf(d->d_name, PCI_DBDF_FORMAT,
+                    &child.domain, &child.bus,
+                    &child.dev, &child.ftn) != 4) ||
+            (child.ftn != 0))
+        {
+            continue;
+        }
+
+        if ((device_matches(match, child.domain, child.bus, child.dev,
+                            child.ftn, &matches) == 0) && matches)
+        {
+            *p_child_info = child;
+            err = 0;
+            break;
+        }
+    }
+
+    nv_io_closedir(dir);
+
+    return err;
+}
+
+/*
+ * Read the MSI and MSI-X interrupts of a device from its msi_irqs
+ * directory.  Up to 'max_irqs' of them are returned in 'irqs', and their
+ * total number in *p_num_irqs.
+ */
+int
+pci_get_msi_irqs(const pci_info_t *p_info, int *irqs, int max_irqs,
+                 int *p_num_irqs)
+{
+    char            path[SYSFS_PATH_SIZE];
+    DIR             *dir;
+    struct dirent   *d;
+    int             irq;
+
+    *p_num_irqs = 0;
+
+    snprintf(path, SYSFS_PATH_SIZE - 1, "%s/" PCI_DBDF_FORMAT "/msi_irqs",
+             SYS_BUS_PCI_DEVICES, p_info->domain, p_info->bus,
+             p_info->dev, p_info->ftn);
+
+    dir = nv_io_opendir(path);
+
+    if (dir == NULL)
+    {
+        return errno;
+    }
+
+    while ((d = nv_io_readdir(dir)) != NULL)
+    {
+        if (sscanf(d->d_name, "%d", &irq) == 1)
+        {
+            if (*p_num_irqs < max_irqs)
+            {
+                irqs[*p_num_irqs] = irq;
+            }
+            (*p_num_irqs)++;
+        }
+    }
+
+    nv_io_closedir(dir);
+
+    return 0;
+}
+
+/*
+ * Read a text attribute of a device, e.g. numa_node or local_cpulist,
+ * without its trailing newline.
+ */
+int
+pci_read_attr(const pci_info_t *p_info, const char *attr, char *buf,
+              size_t size)
+{
+    char    path[SYSFS_PATH_SIZE];
+    ssize_t cnt;
+    int     fd;
+
+    snprintf(path, SYSFS_PATH_SIZE - 1, "%s/" PCI_DBDF_FORMAT "/%s",
+             SYS_BUS_PCI_DEVICES, p_info->domain, p_info->bus,
+             p_info->dev, p_info->ftn, attr);
+
+    fd = nv_io_open(path, O_RDONLY, 0);
+
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    cnt = nv_io_read(fd, buf, size - 1);
+    nv_io_close(fd);
+
+    if (cnt < 0)
+    {
+        return errno;
+    }
+
+    buf[cnt] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+
+    return 0;
+}
+
 static int
 pci_find_pcie_caps(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn, uint8_t *p_caps)
 {
@@ -435,19 +642,23 @@ found:
     return 0;
 }
 
+/*
+ * Set or clear the Link Disable bit of a bridge.  When enabling the link,
+ * also record whether the bridge reports Data Link Layer Link Active, so
+ * that the caller can wait for the link with pci_bridge_link_is_active().
+ */
 int
-pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn, int enable)
+pci_bridge_link_write_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn,
+                             int enable, pci_link_info_t *p_link)
 {
     uint8_t         pcie_caps = 0;
     uint16_t        reg;
     uint32_t        cap_reg;
     uint16_t        cnt;
     int             err;
-    struct timeval  start;
-    struct timeval  curr;
-    struct timeval  diff;
-    struct timespec delay = {0, PCI_LINK_DELAY_NS};
-    struct timespec dlllar_disable_delay = {0, PCI_LINK_DLLLAR_DISABLE_DELAY_NS};
+
+    p_link->pcie_caps = 0;
+    p_link->dlllarc = 0;
 
     err = pci_find_pcie_caps(domain, bus, device, ftn, &pcie_caps);
 
@@ -473,6 +684,8 @@ pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t
                             &reg, sizeof(reg), &cnt);
     BAIL_ON_IO_ERR(reg, err, cnt, return err);
 
+    p_link->pcie_caps = pcie_caps;
+
     if (enable)
     {
         /*
@@ -484,44 +697,106 @@ pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t
                                 &cap_reg, sizeof(cap_reg), &cnt);
         BAIL_ON_IO_ERR(cap_reg, err, cnt, return err);
 
-        if (cap_reg & PCI_EXP_LNKCAP_DLLLARC)
+        p_link->dlllarc = !!(cap_reg & PCI_EXP_LNKCAP_DLLLARC);
+    }
+
+    return err;
+}
+
+/*
+ * Read the Data Link Layer Link Active bit of a bridge previously enabled
+ * with pci_bridge_link_write_enable().
+ */
+int
+pci_bridge_link_is_active(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn,
+                          const pci_link_info_t *p_link, int *p_active)
+{
+    uint16_t        reg;
+    uint16_t        cnt;
+    int             err;
+
+    err = pci_sysfs_read_cfg(domain, bus, device, ftn, p_link->pcie_caps + PCI_EXP_LNKSTA,
+                            &reg, sizeof(reg), &cnt);
+    BAIL_ON_IO_ERR(reg, err, cnt, return err);
+
+    *p_active = ((reg & PCI_EXP_LNKSTA_DLLLA) != 0);
+
+    return 0;
+}
+
+static int
+do_pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device,
+                              uint8_t ftn, int enable)
+{
+    pci_link_info_t link;
+    int             active;
+    int             err;
+    struct timeval  start;
+    struct timeval  curr;
+    struct timeval  diff;
+    struct timespec delay = {0, PCI_LINK_DELAY_NS};
+    struct timespec dlllar_disable_delay = {0, PCI_LINK_DLLLAR_DISABLE_DELAY_NS};
+
+    err = pci_bridge_link_write_enable(domain, bus, device, ftn, enable, &link);
+
+    if ((err != 0) || !enable)
+    {
+        return err;
+    }
+
+    if (link.dlllarc)
+    {
+        /* wait for the link to go up and then sleep for 100 ms */
+
+        gettimeofday(&start, NULL);
+
+        for (;;)
         {
-            /* wait for the link to go up and then sleep for 100 ms */
+            err = pci_bridge_link_is_active(domain, bus, device, ftn, &link, &active);
+            if (err != 0)
+            {
+                return err;
+            }
+
+            if (active)
+            {
+                break;
+            }
 
-            gettimeofday(&start, NULL);
+            gettimeofday(&curr, NULL);
+            timersub(&curr, &start, &diff);
 
-            for (;;)
+            if ((diff.tv_sec > 0) || (diff.tv_usec >= PCI_LINK_WAIT_US))
             {
-                err = pci_sysfs_read_cfg(domain, bus, device, ftn, pcie_caps + PCI_EXP_LNKSTA,
-                                    &reg, sizeof(reg), &cnt);
-                BAIL_ON_IO_ERR(reg, err, cnt, return err);
-
-                if ((reg & PCI_EXP_LNKSTA_DLLLA) != 0)
-                {
-                    break;
-                }
-
-                gettimeofday(&curr, NULL);
-                timersub(&curr, &start, &diff);
-
-                if ((diff.tv_sec > 0) || (diff.tv_usec >= PCI_LINK_WAIT_US))
-                {
-                    return ETIME;
-                }
+                return ETIME;
             }
         }
-        else
-        {
-            /*
-             * Measured the time on DGX1 for link to become established in a bridge,
-             * where the DLLLA reporting is supported and its approximately ~9ms,
-             * so wait for 30ms where DLLLA reporting is not supported.
-             */
-            PCI_NANOSLEEP(&dlllar_disable_delay, NULL);
-        }
-
-        PCI_NANOSLEEP(&delay, NULL);
     }
+    else
+    {
+        /*
+         * Measured the time on DGX1 for link to become established in a bridge,
+         * where the DLLLA reporting is supported and its approximately ~9ms,
+         * so wait for 30ms where DLLLA reporting is not supported.
+         */
+        PCI_NANOSLEEP(&dlllar_disable_delay, NULL);
+    }
+
+    PCI_NANOSLEEP(&delay, NULL);
+
+    return err;
+}
+
+int
+pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn, int enable)
+{
+    int err;
+
+    NV_PROBE5(link__start, domain, bus, device, ftn, enable);
+
+    err = do_pci_bridge_link_set_enable(domain, bus, device, ftn, enable);
+
+    NV_PROBE5(link__done, domain, bus, device, ftn, err);
 
     return err;
 }
@@ -31,6 +31,7 @@
 #if defined(NV_LINUX)
 
 #include <stdint.h>
+#include <stddef.h>
 #include <linux/pci.h>
 
 #if !defined(PCI_STD_HEADER_SIZEOF)
@@ -77,9 +78,29 @@ typedef struct  {
     unsigned    ftn;
 }   pci_info_t;
 
+typedef struct  {
+    uint8_t     pcie_caps;  /* offset of the PCI Express capability */
+    int         dlllarc;    /* Data Link Layer Link Active Reporting Capable */
+}   pci_link_info_t;
+
+struct pci_id_match;
+
+int pci_enum_find_devices(struct pci_id_match *match, pci_info_t *devices,
+                          int max_devices);
 int pci_rescan(uint32_t domain, uint8_t bus, uint8_t slot, uint8_t function);
 int pci_find_parent_bridge(pci_info_t *p_gpu_info, pci_info_t *p_bridge_info);
+int pci_find_child_device(pci_info_t *p_bridge_info,
+                          const struct pci_id_match *match,
+                          pci_info_t *p_child_info);
+int pci_get_msi_irqs(const pci_info_t *p_info, int *irqs, int max_irqs,
+                     int *p_num_irqs);
+int pci_read_attr(const pci_info_t *p_info, const char *attr, char *buf,
+                  size_t size);
 int pci_bridge_link_set_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn, int enable);
+int pci_bridge_link_write_enable(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn,
+                                 int enable, pci_link_info_t *p_link);
+int pci_bridge_link_is_active(uint32_t domain, uint8_t bus, uint8_t device, uint8_t ftn,
+                              const pci_link_info_t *p_link, int *p_active);
 
 #endif /* NV_LINUX */
 
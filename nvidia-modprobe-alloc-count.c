@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Heap allocation counter for "make alloc-check", preloaded with
+ * LD_PRELOAD: every malloc(), calloc(), realloc() and aligned allocation
+ * made after the library is initialized, i.e. by the program's own
+ * constructors, main() and exit handlers, is counted, and the count is
+ * written at exit to the file named by NV_ALLOC_COUNT_FILE_ENV.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <malloc.h>
+
+#define NV_ALLOC_COUNT_FILE_ENV "NVIDIA_MODPROBE_ALLOC_COUNT_FILE"
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static unsigned long num_allocs;
+static int counting;
+
+/*
+ * dlsym() may itself call calloc() while the real allocators are looked
+ * up; it is served from this buffer, which is never freed.
+ */
+
+static char bootstrap[4096] __attribute__((aligned(16)));
+static size_t bootstrap_used;
+static int looking_up;
+
+static int in_bootstrap(const void *ptr)
+{
+    return ((const char *) ptr >= bootstrap) &&
+           ((const char *) ptr < bootstrap + sizeof(bootstrap));
+}
+
+static void *bootstrap_alloc(size_t size)
+{
+    void *ptr;
+
+    size = (size + 15) & ~(size_t) 15;
+    if (size > sizeof(bootstrap) - bootstrap_used)
+    {
+        return NULL;
+    }
+
+    ptr = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+
+    return ptr;
+}
+
+static void look_up(void)
+{
+    if ((real_malloc != NULL) || looking_up)
+    {
+        return;
+    }
+
+    looking_up = 1;
+
+    /* assigned through void * as POSIX allows, which ISO C does not */
+
+    *(void **) &real_calloc = dlsym(RTLD_NEXT, "calloc");
+    *(void **) &real_realloc = dlsym(RTLD_NEXT, "realloc");
+    *(void **) &real_free = dlsym(RTLD_NEXT, "free");
+    *(void **) &real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    *(void **) &real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    *(void **) &real_memalign = dlsym(RTLD_NEXT, "memalign");
+    *(void **) &real_malloc = dlsym(RTLD_NEXT, "malloc");
+
+    looking_up = 0;
+}
+
+static void count(void)
+{
+    if (counting)
+    {
+        __atomic_fetch_add(&num_allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+void *malloc(size_t size)
+{
+    look_up();
+    if (real_malloc == NULL)
+    {
+        return bootstrap_alloc(size);
+    }
+
+    count();
+    return real_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    look_up();
+    if (real_calloc == NULL)
+    {
+        /* the buffer is zeroed, and never reused */
+        return (size && (num > (size_t) -1 / size)) ? NULL :
+               bootstrap_alloc(num * size);
+    }
+
+    count();
+    return real_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    look_up();
+    count();
+
+    if (in_bootstrap(ptr))
+    {
+        size_t old_size = bootstrap + sizeof(bootstrap) - (char *) ptr;
+        void *new_ptr = real_malloc(size);
+
+        if (new_ptr != NULL)
+        {
+            memcpy(new_ptr, ptr, (size < old_size) ? size : old_size);
+        }
+        return new_ptr;
+    }
+
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if ((ptr == NULL) || in_bootstrap(ptr))
+    {
+        return;
+    }
+
+    look_up();
+    real_free(ptr);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    look_up();
+    count();
+    return real_posix_memalign(ptr, alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    look_up();
+    count();
+    return real_aligned_alloc(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    look_up();
+    count();
+    return real_memalign(alignment, size);
+}
+
+
+__attribute__((constructor))
+static void start_counting(void)
+{
+    look_up();
+    counting = 1;
+}
+
+__attribute__((destructor))
+static void write_count(void)
+{
+    const char *path = getenv(NV_ALLOC_COUNT_FILE_ENV);
+    char buf[32];
+    int fd, len;
+
+    counting = 0;
+
+    if (path == NULL)
+    {
+        return;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%lu\n",
+                   __atomic_load_n(&num_allocs, __ATOMIC_RELAXED));
+    if (write(fd, buf, len) != len)
+    {
+        /* nothing to be done; the check fails on the missing count */
+    }
+    close(fd);
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "nvidia-modprobe-bench-utils.h"
+
+
+long long bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+int bench_compare_ns(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/*
+ * Build a fake tree in 'root' with gen-fake-root.sh; the nvidia-modprobe
+ * arguments it prints are stored in 'args'.
+ */
+int bench_gen_root(const char *prog, const char *gen_fake_root,
+                   const char *root, const char *gen_args,
+                   char *args, size_t args_len)
+{
+    char cmd[PATH_MAX * 2];
+    FILE *fp;
+    int status;
+
+    snprintf(cmd, sizeof(cmd), "%s %s '%s'", gen_fake_root, gen_args, root);
+
+    fp = popen(cmd, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    if (fgets(args, args_len, fp) == NULL)
+    {
+        args[0] = '\0';
+    }
+    args[strcspn(args, "\n")] = '\0';
+
+    status = pclose(fp);
+
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+        fprintf(stderr, "%s: `%s` failed.\n", prog, cmd);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Remove everything below 'path', but not 'path' itself.
+ */
+void bench_remove_below(const char *path)
+{
+    struct dirent *d;
+    struct stat st;
+    DIR *dir;
+
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((d = readdir(dir)) != NULL)
+    {
+        char child[PATH_MAX];
+
+        if ((strcmp(d->d_name, ".") == 0) || (strcmp(d->d_name, "..") == 0))
+        {
+            continue;
+        }
+
+        snprintf(child, sizeof(child), "%s/%s", path, d->d_name);
+
+        if ((lstat(child, &st) == 0) && S_ISDIR(st.st_mode))
+        {
+            bench_remove_below(child);
+            rmdir(child);
+        }
+        else
+        {
+            unlink(child);
+        }
+    }
+
+    closedir(dir);
+}
+
+
+/*
+ * Remove the device files of a fake tree, and with 'modules', unload its
+ * kernel modules, for a cold run.
+ */
+void bench_reset_root(const char *root, int modules)
+{
+    char path[PATH_MAX + 32];
+
+    if (modules)
+    {
+        snprintf(path, sizeof(path), "%s/sys/module", root);
+        bench_remove_below(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/dev", root);
+    bench_remove_below(path);
+    snprintf(path, sizeof(path), "%s/dev/char", root);
+    mkdir(path, 0755);
+}
+
+
+/*
+ * Append the space-separated words of 'args' (modified in place) to
+ * 'argv', which holds 'argc' arguments and has room for 'max_args'
+ * including the terminating NULL.  Returns the new argument count.
+ */
+int bench_split_args(char *args, char **argv, int argc, int max_args)
+{
+    char *arg, *save;
+
+    for (arg = strtok_r(args, " ", &save);
+         (arg != NULL) && (argc < max_args - 1);
+         arg = strtok_r(NULL, " ", &save))
+    {
+        argv[argc++] = arg;
+    }
+
+    argv[argc] = NULL;
+
+    return argc;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers shared by nvidia-modprobe-bench and nvidia-modprobe-stress, for
+ * timing nvidia-modprobe runs against fake trees built by
+ * gen-fake-root.sh.
+ */
+
+#ifndef __NVIDIA_MODPROBE_BENCH_UTILS_H__
+#define __NVIDIA_MODPROBE_BENCH_UTILS_H__
+
+#include <stddef.h>
+
+long long bench_now_ns(void);
+int bench_compare_ns(const void *a, const void *b);
+
+int bench_gen_root(const char *prog, const char *gen_fake_root,
+                   const char *root, const char *gen_args,
+                   char *args, size_t args_len);
+void bench_remove_below(const char *path);
+void bench_reset_root(const char *root, int modules);
+
+int bench_split_args(char *args, char **argv, int argc, int max_args);
+
+#endif /* __NVIDIA_MODPROBE_BENCH_UTILS_H__ */
@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nvidia-modprobe-bench: benchmarks of the modprobe-utils hot paths and of
+ * complete nvidia-modprobe runs, against fake trees built by
+ * gen-fake-root.sh.  Run through "make bench".
+ *
+ *   nvidia-modprobe-bench [-n RUNS] [-m NVIDIA-MODPROBE] [-g GEN-FAKE-ROOT]
+ *                         [-b BASELINE] [-s BASELINE] [-S] DIR
+ *
+ * Each benchmark is run RUNS times; its p50, p99 and maximum are printed,
+ * along with the change of the p50 from the baseline file given with -b.
+ * With -s, the results are written to the given baseline file.  With -S,
+ * only the complete nvidia-modprobe runs are benchmarked, e.g. to compare
+ * two nvidia-modprobe builds or to train one for profile-guided
+ * optimization.  The fake trees are built below DIR, which should be on a
+ * tmpfs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "nvidia-modprobe-bench-utils.h"
+#include "nvidia-modprobe-utils.h"
+#include "pci-enum.h"
+
+#define BENCH_MAX_ARGS          512
+#define BENCH_MAX_RESULTS       32
+#define BENCH_NAME_LEN          64
+
+extern char **environ;
+
+typedef struct {
+    char name[BENCH_NAME_LEN];
+    long long p50;
+    long long p99;
+    long long max;
+    int failed;
+} BenchResult;
+
+/*
+ * A complete nvidia-modprobe run: the tree is built with the given
+ * gen-fake-root.sh options, and nvidia-modprobe is run with the arguments
+ * printed by gen-fake-root.sh, followed by 'extra_args'.  For 'cold'
+ * scenarios, the kernel modules are unloaded and the device files removed
+ * before each run.
+ */
+typedef struct {
+    const char *name;
+    const char *gen_args;
+    const char *extra_args;
+    int cold;
+} BenchScenario;
+
+static const BenchScenario scenarios[] = {
+    { "main/1gpu-warm",       "-l -g 1",                   "",        0 },
+    { "main/8gpu-warm",       "-l -g 8",                   "",        0 },
+    { "main/8gpu-cold",       "-g 8",                      "",        1 },
+    { "main/8gpu-uvm-cold",   "-g 8",                      "-u",      1 },
+    { "main/8gpu-all-cold",   "-g 8 -v 8 -c 32 -i 64",     "",        1 },
+    { "main/8gpu-all-jobs4",  "-g 8 -v 8 -c 32 -i 64",     "-j 4",    1 },
+    { "main/8gpu-reload",     "-l -g 8",                   "--reload-driver=apply", 0 },
+};
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int num_results;
+
+static const char *gen_fake_root = "./gen-fake-root.sh";
+static const char *nvidia_modprobe_path = "./nvidia-modprobe";
+static int runs = 100;
+
+
+/*
+ * Record the distribution of the given samples under 'name'.
+ */
+static void add_result(const char *name, long long *ns, int n, int failed)
+{
+    BenchResult *result;
+
+    if (num_results >= BENCH_MAX_RESULTS)
+    {
+        return;
+    }
+
+    result = &results[num_results++];
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->failed = failed || (n == 0);
+
+    if (result->failed)
+    {
+        return;
+    }
+
+    qsort(ns, n, sizeof(ns[0]), bench_compare_ns);
+
+    result->p50 = ns[(n - 1) * 50 / 100];
+    result->p99 = ns[(n - 1) * 99 / 100];
+    result->max = ns[n - 1];
+}
+
+
+/*
+ * Microbenchmarks, run in-process against one fake tree.  The internal
+ * phases (device file parameters, device file creation) are timed with
+ * the context's timing callback, so that only the phase itself is
+ * measured.
+ */
+
+typedef struct {
+    const char *name;
+    long long ns;
+} BenchSpan;
+
+static void record_span(void *data, const char *name,
+                        const char *arg, long long ns)
+{
+    BenchSpan *span = data;
+
+    if (strcmp(name, span->name) == 0)
+    {
+        span->ns = ns;
+    }
+}
+
+typedef enum {
+    BenchMknodCold = 0,
+    BenchMknodWarm,
+    BenchMknodNeedsFix,
+} BenchMknodState;
+
+static void bench_mknod(const char *root, const char *name,
+                        BenchMknodState state, long long *ns)
+{
+    char dev_path[PATH_MAX], link_path[PATH_MAX];
+    NvModprobeContext ctx;
+    BenchSpan span = { "mknod", 0 };
+    int i, failed = 0;
+
+    snprintf(dev_path, sizeof(dev_path), "%s/dev/nvidia0", root);
+    snprintf(link_path, sizeof(link_path), "%s/dev/char/195:0", root);
+
+    nvidia_modprobe_context_init(&ctx);
+    nvidia_modprobe_context_set_timing(&ctx, record_span, &span);
+
+    if (!nvidia_mknod_ctx(&ctx, 0))
+    {
+        add_result(name, ns, 0, 1);
+        return;
+    }
+
+    for (i = 0; i < runs; i++)
+    {
+        if (state == BenchMknodCold)
+        {
+            unlink(dev_path);
+            unlink(link_path);
+        }
+        else if (state == BenchMknodNeedsFix)
+        {
+            chmod(dev_path, 0600);
+        }
+
+        nvidia_modprobe_context_flush_cache(&ctx);
+        failed |= !nvidia_mknod_ctx(&ctx, 0);
+        ns[i] = span.ns;
+    }
+
+    add_result(name, ns, runs, failed);
+}
+
+static void run_microbenchmarks(const char *dir, long long *ns)
+{
+    char root[PATH_MAX], args[PATH_MAX];
+    struct pci_id_match match;
+    NvModprobeContext ctx;
+    BenchSpan span = { "init_device_file_parameters", 0 };
+    int i, failed, err;
+    long long start;
+
+    snprintf(root, sizeof(root), "%s/micro", dir);
+
+    if (!bench_gen_root("nvidia-modprobe-bench", gen_fake_root, root,
+                        "-l -g 8 -v 8", args, sizeof(args)))
+    {
+        return;
+    }
+
+    err = nvidia_modprobe_set_root(root);
+    if (err != 0)
+    {
+        fprintf(stderr, "nvidia-modprobe-bench: cannot use %s: %s.\n",
+                root, strerror(err));
+        return;
+    }
+
+    /* PCI enumeration of 8 GPUs with 8 VFs each, behind 8 bridges */
+
+    failed = 0;
+    for (i = 0; i < runs; i++)
+    {
+        memset(&match, 0, sizeof(match));
+        match.vendor_id = 0x10de;
+        match.device_id = PCI_MATCH_ANY;
+        match.subvendor_id = PCI_MATCH_ANY;
+        match.subdevice_id = PCI_MATCH_ANY;
+
+        start = bench_now_ns();
+        err = pci_enum_match_id(&match);
+        ns[i] = bench_now_ns() - start;
+
+        failed |= (err != 0) || (match.num_matches != 72);
+    }
+    add_result("pci_enum_match_id/72dev", ns, runs, failed);
+
+    /* /proc/devices lookup, without the context cache */
+
+    failed = 0;
+    for (i = 0; i < runs; i++)
+    {
+        start = bench_now_ns();
+        err = nvidia_get_chardev_major("nvidia-caps-imex-channels");
+        ns[i] = bench_now_ns() - start;
+
+        failed |= (err < 0);
+    }
+    add_result("get_chardev_major", ns, runs, failed);
+
+    /* registry parsing, without the context cache */
+
+    nvidia_modprobe_context_init(&ctx);
+    nvidia_modprobe_context_set_timing(&ctx, record_span, &span);
+
+    for (i = 0; i < runs; i++)
+    {
+        nvidia_modprobe_context_flush_cache(&ctx);
+        nvidia_get_file_state_ctx(&ctx, 0);
+        ns[i] = span.ns;
+    }
+    add_result("init_device_file_parameters", ns, runs, 0);
+
+    bench_mknod(root, "mknod_helper/cold", BenchMknodCold, ns);
+    bench_mknod(root, "mknod_helper/warm", BenchMknodWarm, ns);
+    bench_mknod(root, "mknod_helper/needs-fix", BenchMknodNeedsFix, ns);
+
+    nvidia_modprobe_set_root(NULL);
+}
+
+
+/*
+ * Run nvidia-modprobe once; returns its exit status, or -1.
+ */
+static int run_nvidia_modprobe(char *const argv[], char *const envp[])
+{
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int status;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+
+    status = posix_spawn(&pid, nvidia_modprobe_path, &actions, NULL,
+                         argv, envp);
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (status != 0)
+    {
+        return -1;
+    }
+
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void run_scenario(const char *dir, const BenchScenario *scenario,
+                         long long *ns)
+{
+    char root[PATH_MAX], args[PATH_MAX * 4], extra_args[256];
+    char env_root[PATH_MAX + 32];
+    char *argv[BENCH_MAX_ARGS];
+    char *envp[] = { env_root, "PATH=/sbin:/bin:/usr/sbin:/usr/bin", NULL };
+    int argc = 0, i, status, failed = 0;
+    long long start;
+
+    snprintf(root, sizeof(root), "%s/scenario", dir);
+
+    if (!bench_gen_root("nvidia-modprobe-bench", gen_fake_root, root,
+                        scenario->gen_args, args, sizeof(args)))
+    {
+        add_result(scenario->name, ns, 0, 1);
+        return;
+    }
+
+    snprintf(env_root, sizeof(env_root), "NVIDIA_MODPROBE_ROOT=%s", root);
+    snprintf(extra_args, sizeof(extra_args), "%s", scenario->extra_args);
+
+    argv[argc++] = "nvidia-modprobe";
+    argc = bench_split_args(args, argv, argc, BENCH_MAX_ARGS);
+    bench_split_args(extra_args, argv, argc, BENCH_MAX_ARGS);
+
+    for (i = 0; i < runs; i++)
+    {
+        if (scenario->cold)
+        {
+            bench_reset_root(root, 1);
+        }
+
+        start = bench_now_ns();
+        status = run_nvidia_modprobe(argv, envp);
+        ns[i] = bench_now_ns() - start;
+
+        if ((status != 0) && !failed)
+        {
+            fprintf(stderr, "nvidia-modprobe-bench: %s: nvidia-modprobe "
+                    "exited with status %d.\n", scenario->name, status);
+        }
+        failed |= (status != 0);
+    }
+
+    add_result(scenario->name, ns, runs, failed);
+}
+
+
+/*
+ * Baseline file: one line per benchmark, with its name, p50, p99 and
+ * maximum, in nanoseconds.
+ */
+
+static int find_baseline(FILE *fp, const char *name, long long *p50)
+{
+    char line[256], entry[BENCH_NAME_LEN];
+    long long value;
+
+    rewind(fp);
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if ((sscanf(line, "%63s %lld", entry, &value) == 2) &&
+            (strcmp(entry, name) == 0))
+        {
+            *p50 = value;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void print_results(const char *baseline_path)
+{
+    FILE *baseline = NULL;
+    int i;
+
+    if (baseline_path != NULL)
+    {
+        baseline = fopen(baseline_path, "r");
+        if (baseline == NULL)
+        {
+            fprintf(stderr, "nvidia-modprobe-bench: no baseline in %s; run "
+                    "`make bench-baseline` to record one.\n", baseline_path);
+        }
+    }
+
+    printf("%-28s %12s %12s %12s %10s\n",
+           "benchmark", "p50 (us)", "p99 (us)", "max (us)", "vs base");
+
+    for (i = 0; i < num_results; i++)
+    {
+        const BenchResult *result = &results[i];
+        long long base;
+
+        if (result->failed)
+        {
+            printf("%-28s %12s\n", result->name, "failed");
+            continue;
+        }
+
+        printf("%-28s %12.1f %12.1f %12.1f", result->name,
+               result->p50 / 1000.0, result->p99 / 1000.0,
+               result->max / 1000.0);
+
+        if ((baseline != NULL) && find_baseline(baseline, result->name, &base) &&
+            (base > 0))
+        {
+            printf(" %+9.1f%%", (result->p50 - base) * 100.0 / base);
+        }
+
+        printf("\n");
+    }
+
+    if (baseline != NULL)
+    {
+        fclose(baseline);
+    }
+}
+
+static int save_results(const char *path)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "nvidia-modprobe-bench: cannot write %s: %s.\n",
+                path, strerror(errno));
+        return 0;
+    }
+
+    fprintf(fp, "# nvidia-modprobe-bench baseline (%d runs): "
+            "name p50 p99 max, in ns\n", runs);
+
+    for (i = 0; i < num_results; i++)
+    {
+        if (!results[i].failed)
+        {
+            fprintf(fp, "%s %lld %lld %lld\n", results[i].name,
+                    results[i].p50, results[i].p99, results[i].max);
+        }
+    }
+
+    fclose(fp);
+
+    return 1;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: nvidia-modprobe-bench [-n RUNS] "
+            "[-m NVIDIA-MODPROBE] [-g GEN-FAKE-ROOT] [-b BASELINE] "
+            "[-s BASELINE] [-S] DIR\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *baseline = NULL;
+    const char *save = NULL;
+    long long *ns;
+    int c, i, failed = 0, scenarios_only = 0;
+
+    while ((c = getopt(argc, argv, "n:m:g:b:s:S")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'm':
+                nvidia_modprobe_path = optarg;
+                break;
+            case 'g':
+                gen_fake_root = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 's':
+                save = optarg;
+                break;
+            case 'S':
+                scenarios_only = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if ((optind != argc - 1) || (runs < 1))
+    {
+        usage();
+    }
+
+    ns = malloc(runs * sizeof(*ns));
+    if (ns == NULL)
+    {
+        return 1;
+    }
+
+    if (!scenarios_only)
+    {
+        run_microbenchmarks(argv[optind], ns);
+    }
+
+    for (i = 0; i < (int)(sizeof(scenarios) / sizeof(scenarios[0])); i++)
+    {
+        run_scenario(argv[optind], &scenarios[i], ns);
+    }
+
+    free(ns);
+
+    print_results(baseline);
+
+    if ((save != NULL) && !save_results(save))
+    {
+        return 1;
+    }
+
+    for (i = 0; i < num_results; i++)
+    {
+        failed |= results[i].failed;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "nvidia-modprobe-bringup.h"
+#include "pci-enum.h"
+#include "common-utils.h"
+#include "msg.h"
+
+/*
+ * The GPU below a bridge: an NVIDIA display controller, VGA or 3D.
+ */
+
+static const struct pci_id_match gpu_match = {
+    0x10de,                 /* Vendor ID    = NVIDIA                 */
+    PCI_MATCH_ANY,          /* Device ID    = any                    */
+    PCI_MATCH_ANY,          /* Subvendor ID = any                    */
+    PCI_MATCH_ANY,          /* Subdevice ID = any                    */
+    0x0300,                 /* Device Class = PCI_BASE_CLASS_DISPLAY */
+    PCI_BASE_CLASS_MASK,    /* Display Mask = base class only        */
+    0                       /* Initial number of matches             */
+};
+
+static const char *stage_names[NV_BRINGUP_NUM_STAGES] = {
+    [NvBringupStageLink]     = "link",
+    [NvBringupStageRescan]   = "rescan",
+    [NvBringupStageModprobe] = "modprobe",
+    [NvBringupStageMknod]    = "mknod",
+};
+
+/*
+ * The NVIDIA kernel module is loaded once, by the first GPU to reach the
+ * modprobe stage; the other GPUs reaching that stage wait for it.
+ */
+typedef enum {
+    NvBringupModprobeIdle = 0,
+    NvBringupModprobeRunning,
+    NvBringupModprobeLoaded,
+    NvBringupModprobeFailed,
+} NvBringupModprobeState;
+
+typedef struct {
+    NvModprobeContext *ctx;
+    NvBringupModprobeState modprobe_state;
+    NvModprobeAsyncOp *modprobe_op;
+} NvBringup;
+
+
+const char *nv_bringup_stage_name(NvBringupStage stage)
+{
+    if (stage >= NV_BRINGUP_NUM_STAGES)
+    {
+        return "done";
+    }
+
+    return stage_names[stage];
+}
+
+
+/*
+ * nv_bringup_parse_bridge() - parse a bridge address of the form
+ * [domain:]bus:device.function, in hexadecimal; returns TRUE on success.
+ */
+
+int nv_bringup_parse_bridge(const char *str, NvBringupGpu *gpu)
+{
+    pci_info_t *bridge = &gpu->bridge;
+    char end;
+
+    memset(gpu, 0, sizeof(*gpu));
+    gpu->minor = -1;
+
+    if (sscanf(str, "%x:%x:%x.%x%c", &bridge->domain, &bridge->bus,
+               &bridge->dev, &bridge->ftn, &end) == 4)
+    {
+        return TRUE;
+    }
+
+    bridge->domain = 0;
+
+    return sscanf(str, "%x:%x.%x%c", &bridge->bus,
+                  &bridge->dev, &bridge->ftn, &end) == 3;
+}
+
+
+static long long elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+
+static void fail_stage(NvBringupGpu *gpu, int error)
+{
+    gpu->stage_ns[gpu->stage] = elapsed_ns(&gpu->stage_start);
+    gpu->failed = TRUE;
+    gpu->error = error;
+}
+
+
+static void start_stage(NvBringup *bringup, NvBringupGpu *gpu,
+                        NvBringupStage stage);
+
+/*
+ * Finish the current stage of a GPU and start the next one.
+ */
+
+static void next_stage(NvBringup *bringup, NvBringupGpu *gpu)
+{
+    gpu->stage_ns[gpu->stage] = elapsed_ns(&gpu->stage_start);
+    start_stage(bringup, gpu, gpu->stage + 1);
+}
+
+
+static void start_stage(NvBringup *bringup, NvBringupGpu *gpu,
+                        NvBringupStage stage)
+{
+    pci_info_t *bridge = &gpu->bridge;
+    int err;
+
+    gpu->stage = stage;
+    clock_gettime(CLOCK_MONOTONIC, &gpu->stage_start);
+
+    if ((stage != NvBringupStageDone) &&
+        nvidia_modprobe_context_out_of_time(bringup->ctx))
+    {
+        fail_stage(gpu, ETIME);
+        return;
+    }
+
+    switch (stage)
+    {
+        case NvBringupStageLink:
+            /*
+             * A GPU already present below the bridge keeps its address
+             * through the rescan; it is only looked for after the rescan
+             * if it was not there before.
+             */
+            gpu->have_gpu = (pci_find_child_device(bridge, &gpu_match,
+                                                   &gpu->gpu) == 0);
+
+            gpu->op = pci_bridge_link_set_enable_async(bringup->ctx,
+                                                       bridge->domain,
+                                                       bridge->bus,
+                                                       bridge->dev,
+                                                       bridge->ftn,
+                                                       1, NULL, NULL);
+            if (gpu->op == NULL)
+            {
+                fail_stage(gpu, ENOMEM);
+            }
+            break;
+
+        case NvBringupStageRescan:
+            gpu->op = pci_rescan_async(bringup->ctx, bridge->domain,
+                                       bridge->bus, bridge->dev, bridge->ftn,
+                                       NULL, NULL);
+            if (gpu->op == NULL)
+            {
+                fail_stage(gpu, ENOMEM);
+            }
+            break;
+
+        case NvBringupStageModprobe:
+            if (!gpu->have_gpu)
+            {
+                err = pci_find_child_device(bridge, &gpu_match, &gpu->gpu);
+                if (err != 0)
+                {
+                    fail_stage(gpu, err);
+                    break;
+                }
+
+                gpu->have_gpu = TRUE;
+            }
+
+            if (bringup->modprobe_state == NvBringupModprobeLoaded)
+            {
+                next_stage(bringup, gpu);
+            }
+            else if (bringup->modprobe_state == NvBringupModprobeFailed)
+            {
+                fail_stage(gpu, 0);
+            }
+            else if (bringup->modprobe_state == NvBringupModprobeIdle)
+            {
+                bringup->modprobe_op = nvidia_modprobe_async(bringup->ctx, 0,
+                                                             NULL, NULL);
+                if (bringup->modprobe_op == NULL)
+                {
+                    bringup->modprobe_state = NvBringupModprobeFailed;
+                    fail_stage(gpu, 0);
+                }
+                else
+                {
+                    bringup->modprobe_state = NvBringupModprobeRunning;
+                }
+            }
+            break;
+
+        case NvBringupStageMknod:
+            gpu->minor = nvidia_get_gpu_minor_ctx(bringup->ctx,
+                                                  gpu->gpu.domain,
+                                                  gpu->gpu.bus,
+                                                  gpu->gpu.dev,
+                                                  gpu->gpu.ftn);
+            if ((gpu->minor < 0) || !nvidia_mknod_ctx(bringup->ctx, gpu->minor))
+            {
+                fail_stage(gpu, 0);
+                break;
+            }
+            next_stage(bringup, gpu);
+            break;
+
+        case NvBringupStageDone:
+            break;
+    }
+}
+
+
+/*
+ * Handle the completion of the asynchronous operation of a GPU's current
+ * stage (link or rescan).
+ */
+
+static void complete_op(NvBringup *bringup, NvBringupGpu *gpu)
+{
+    int result = nvidia_async_op_get_result(gpu->op);
+
+    nvidia_async_op_free(gpu->op);
+    gpu->op = NULL;
+
+    if (result != 0)
+    {
+        fail_stage(gpu, result);
+        return;
+    }
+
+    next_stage(bringup, gpu);
+}
+
+
+/*
+ * Handle the completion of the shared module load: release every GPU
+ * waiting for it.
+ */
+
+static void complete_modprobe(NvBringup *bringup,
+                              NvBringupGpu *gpus, int num_gpus)
+{
+    int loaded = nvidia_async_op_get_result(bringup->modprobe_op);
+    int i;
+
+    nvidia_async_op_free(bringup->modprobe_op);
+    bringup->modprobe_op = NULL;
+    bringup->modprobe_state = loaded ? NvBringupModprobeLoaded :
+                                       NvBringupModprobeFailed;
+
+    for (i = 0; i < num_gpus; i++)
+    {
+        NvBringupGpu *gpu = &gpus[i];
+
+        if (gpu->failed || (gpu->stage != NvBringupStageModprobe))
+        {
+            continue;
+        }
+
+        if (loaded)
+        {
+            next_stage(bringup, gpu);
+        }
+        else
+        {
+            fail_stage(gpu, 0);
+        }
+    }
+}
+
+
+/*
+ * nv_bringup_run() - bring up the given GPUs, each one progressing
+ * through the stages as soon as its previous stage completes.  Returns
+ * the number of GPUs that failed.
+ */
+
+int nv_bringup_run(NvModprobeContext *ctx, NvBringupGpu *gpus, int num_gpus)
+{
+    struct pollfd fds[NV_BRINGUP_MAX_GPUS + 1];
+    NvBringupGpu *owners[NV_BRINGUP_MAX_GPUS + 1];
+    NvBringup bringup;
+    int i, dispatched, num_failed = 0;
+
+    memset(&bringup, 0, sizeof(bringup));
+    bringup.ctx = ctx;
+
+    num_gpus = NV_MIN(num_gpus, NV_BRINGUP_MAX_GPUS);
+
+    for (i = 0; i < num_gpus; i++)
+    {
+        start_stage(&bringup, &gpus[i], NvBringupStageLink);
+    }
+
+    while (1)
+    {
+        int nfds = 0;
+
+        /*
+         * An operation left without a file descriptor (one could not be
+         * allocated) is dispatched directly rather than polled, as
+         * nvidia-modprobe-async.h asks.
+         */
+
+        dispatched = FALSE;
+
+        for (i = 0; i < num_gpus; i++)
+        {
+            if (!gpus[i].failed && (gpus[i].op != NULL) &&
+                (nvidia_async_op_get_fd(gpus[i].op) < 0))
+            {
+                dispatched = TRUE;
+
+                if (nvidia_async_op_dispatch(gpus[i].op))
+                {
+                    complete_op(&bringup, &gpus[i]);
+                }
+            }
+        }
+
+        if ((bringup.modprobe_op != NULL) &&
+            (nvidia_async_op_get_fd(bringup.modprobe_op) < 0))
+        {
+            dispatched = TRUE;
+
+            if (nvidia_async_op_dispatch(bringup.modprobe_op))
+            {
+                complete_modprobe(&bringup, gpus, num_gpus);
+            }
+        }
+
+        if (dispatched)
+        {
+            continue;
+        }
+
+        for (i = 0; i < num_gpus; i++)
+        {
+            if (!gpus[i].failed && (gpus[i].op != NULL))
+            {
+                fds[nfds].fd = nvidia_async_op_get_fd(gpus[i].op);
+                fds[nfds].events = POLLIN;
+                owners[nfds++] = &gpus[i];
+            }
+        }
+
+        if (bringup.modprobe_op != NULL)
+        {
+            fds[nfds].fd = nvidia_async_op_get_fd(bringup.modprobe_op);
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = NULL;
+        }
+
+        if (nfds == 0)
+        {
+            break;
+        }
+
+        if (poll(fds, nfds, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        for (i = 0; i < nfds; i++)
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            if (owners[i] == NULL)
+            {
+                if (nvidia_async_op_dispatch(bringup.modprobe_op))
+                {
+                    complete_modprobe(&bringup, gpus, num_gpus);
+                }
+            }
+            else if (nvidia_async_op_dispatch(owners[i]->op))
+            {
+                complete_op(&bringup, owners[i]);
+            }
+        }
+    }
+
+    /* Only reached early if poll(2) failed; give up on what is left. */
+
+    for (i = 0; i < num_gpus; i++)
+    {
+        if (gpus[i].op != NULL)
+        {
+            nvidia_async_op_free(gpus[i].op);
+            gpus[i].op = NULL;
+            fail_stage(&gpus[i], errno);
+        }
+
+        if (gpus[i].failed || (gpus[i].stage != NvBringupStageDone))
+        {
+            num_failed++;
+        }
+    }
+
+    nvidia_async_op_free(bringup.modprobe_op);
+
+    return num_failed;
+}
+
+
+/*
+ * nv_bringup_report() - print, for each GPU, the time spent in each
+ * stage.
+ */
+
+void nv_bringup_report(const NvBringupGpu *gpus, int num_gpus)
+{
+    int i, stage;
+
+    for (i = 0; i < num_gpus; i++)
+    {
+        const NvBringupGpu *gpu = &gpus[i];
+        char buf[256];
+        long long total_us = 0;
+        int len;
+
+        len = snprintf(buf, sizeof(buf), "%04x:%02x:%02x.%x:",
+                       gpu->bridge.domain, gpu->bridge.bus,
+                       gpu->bridge.dev, gpu->bridge.ftn);
+
+        for (stage = 0; stage <= NV_MIN(gpu->stage, NV_BRINGUP_NUM_STAGES - 1);
+             stage++)
+        {
+            total_us += gpu->stage_ns[stage] / 1000;
+            len += snprintf(buf + len, sizeof(buf) - len, " %s %lld.%03lld ms",
+                            stage_names[stage],
+                            gpu->stage_ns[stage] / 1000000,
+                            (gpu->stage_ns[stage] / 1000) % 1000);
+        }
+
+        if (gpu->failed)
+        {
+            nv_msg(NULL, "%s (failed at %s%s%s)", buf, stage_names[gpu->stage],
+                   gpu->error ? ": " : "",
+                   gpu->error ? strerror(gpu->error) : "");
+        }
+        else
+        {
+            nv_msg(NULL, "%s, total %lld.%03lld ms (minor %d)", buf,
+                   total_us / 1000, total_us % 1000, gpu->minor);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * GPU bring-up: for each GPU, identified by the PCIe bridge above it,
+ * enable the bridge link, rescan the bridge, load the NVIDIA kernel
+ * module and create the GPU's device file.  Each GPU moves through these
+ * stages independently of the others, so a GPU whose link trains early
+ * gets its device file without waiting for the slower ones; only the
+ * module load is shared between GPUs.
+ */
+
+#ifndef __NVIDIA_MODPROBE_BRINGUP_H__
+#define __NVIDIA_MODPROBE_BRINGUP_H__
+
+#include <time.h>
+
+#include "nvidia-modprobe-utils.h"
+#include "nvidia-modprobe-async.h"
+#include "pci-sysfs.h"
+
+#define NV_BRINGUP_MAX_GPUS     64
+
+typedef enum {
+    NvBringupStageLink = 0,
+    NvBringupStageRescan,
+    NvBringupStageModprobe,
+    NvBringupStageMknod,
+    NvBringupStageDone,
+} NvBringupStage;
+
+#define NV_BRINGUP_NUM_STAGES   NvBringupStageDone
+
+typedef struct {
+    pci_info_t bridge;
+    pci_info_t gpu;
+    int have_gpu;               /* gpu holds the GPU's address */
+    int minor;
+
+    NvBringupStage stage;
+    int failed;
+    int error;                  /* errno for the link and rescan stages */
+
+    NvModprobeAsyncOp *op;
+    struct timespec stage_start;
+    long long stage_ns[NV_BRINGUP_NUM_STAGES];
+} NvBringupGpu;
+
+int nv_bringup_parse_bridge(const char *str, NvBringupGpu *gpu);
+int nv_bringup_run(NvModprobeContext *ctx, NvBringupGpu *gpus, int num_gpus);
+void nv_bringup_report(const NvBringupGpu *gpus, int num_gpus);
+
+const char *nv_bringup_stage_name(NvBringupStage stage);
+
+#endif /* __NVIDIA_MODPROBE_BRINGUP_H__ */
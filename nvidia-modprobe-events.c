@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "nvidia-modprobe-events.h"
+#include "nvidia-modprobe-steps.h"
+#include "common-utils.h"
+#include "msg.h"
+
+static struct {
+    NvEventsHeader *header;
+    NvEventsEntry *entries;
+    size_t size;
+} events;
+
+
+static size_t log_size(uint32_t num_entries)
+{
+    return sizeof(NvEventsHeader) + num_entries * sizeof(NvEventsEntry);
+}
+
+static int running_setuid(void)
+{
+    return (getuid() != geteuid()) || (getgid() != getegid());
+}
+
+/*
+ * The event log path given by the user: 'path' if not NULL, else
+ * NV_EVENTS_PATH_ENV if set and not empty, else NULL.
+ */
+static const char *custom_path(const char *path)
+{
+    if (path == NULL)
+    {
+        path = getenv(NV_EVENTS_PATH_ENV);
+    }
+
+    if ((path == NULL) || (path[0] == '\0'))
+    {
+        return NULL;
+    }
+
+    return path;
+}
+
+/*
+ * The event log path: the one given by the user if any, else
+ * NV_EVENTS_DEFAULT_PATH.
+ */
+static const char *events_path(const char *path)
+{
+    path = custom_path(path);
+
+    return (path != NULL) ? path : NV_EVENTS_DEFAULT_PATH;
+}
+
+/*
+ * Create the event log, initialized in a temporary file which is then
+ * linked into place, so that no process ever maps a log without its
+ * header.  Losing the race to another process is not an error.
+ */
+static int create_log(const char *path)
+{
+    char tmp_path[PATH_MAX];
+    NvEventsHeader header;
+    int fd, ret = 0;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int) getpid());
+
+    fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+              0600);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = NV_EVENTS_MAGIC;
+    header.version = NV_EVENTS_VERSION;
+    header.entry_size = sizeof(NvEventsEntry);
+    header.num_entries = NV_EVENTS_NUM_ENTRIES;
+
+    if ((ftruncate(fd, log_size(NV_EVENTS_NUM_ENTRIES)) < 0) ||
+        (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) ||
+        ((link(tmp_path, path) < 0) && (errno != EEXIST)))
+    {
+        ret = -1;
+    }
+
+    close(fd);
+    unlink(tmp_path);
+
+    return ret;
+}
+
+/*
+ * Map an existing event log, checking that it is one.
+ */
+static int map_log(const char *path, int writable)
+{
+    const NvEventsHeader *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) ||
+        (st.st_size < sizeof(NvEventsHeader)))
+    {
+        close(fd);
+        errno = EINVAL;
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+               MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    header = map;
+
+    if ((header->magic != NV_EVENTS_MAGIC) ||
+        (header->version != NV_EVENTS_VERSION) ||
+        (header->entry_size != sizeof(NvEventsEntry)) ||
+        (header->num_entries == 0) ||
+        (st.st_size != log_size(header->num_entries)))
+    {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return 0;
+    }
+
+    events.header = map;
+    events.entries = (NvEventsEntry *) (events.header + 1);
+    events.size = st.st_size;
+
+    return 1;
+}
+
+
+/*
+ * Map the event log.  It is created if needed when 'requested', in
+ * 'path' if not NULL, else in the file NV_EVENTS_PATH_ENV names, if set
+ * and not empty, which also counts as a request; otherwise it is only
+ * appended to if NV_EVENTS_DEFAULT_PATH already exists.  Once enabled,
+ * the log thus records every run, including those of unprivileged users
+ * through the setuid binary.
+ *
+ * When running setuid or setgid, the path given by the user is ignored
+ * and EPERM is returned if there was one: the log records the arguments
+ * of every run, and must stay in NV_EVENTS_DEFAULT_PATH, readable by root
+ * only.  Other failures are silent: the log is best effort, and not
+ * writable when not running as root.
+ */
+int nv_events_open(int requested, const char *path)
+{
+    int ret = 0;
+
+    path = custom_path(path);
+
+    if (path != NULL)
+    {
+        requested = TRUE;
+    }
+
+    if (running_setuid() && (path != NULL))
+    {
+        path = NULL;
+        ret = EPERM;
+    }
+
+    if (path == NULL)
+    {
+        path = NV_EVENTS_DEFAULT_PATH;
+    }
+
+    if (!map_log(path, TRUE) && (errno == ENOENT) && requested)
+    {
+        if (create_log(path) == 0)
+        {
+            map_log(path, TRUE);
+        }
+    }
+
+    return ret;
+}
+
+void nv_events_close(void)
+{
+    if (events.header != NULL)
+    {
+        munmap(events.header, events.size);
+        memset(&events, 0, sizeof(events));
+    }
+}
+
+static long long clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void nv_events_log(const char *phase, const char *target, int result,
+                   long long duration_ns)
+{
+    NvEventsEntry *entry;
+    uint64_t index;
+
+    if (events.header == NULL)
+    {
+        return;
+    }
+
+    index = __atomic_fetch_add(&events.header->next, 1, __ATOMIC_RELAXED);
+    entry = &events.entries[index % events.header->num_entries];
+
+    __atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    entry->realtime_ns = clock_ns(CLOCK_REALTIME);
+    entry->boottime_ns = clock_ns(CLOCK_BOOTTIME);
+    entry->duration_ns = duration_ns;
+    entry->pid = getpid();
+    entry->result = result;
+    strncpy(entry->phase, phase, sizeof(entry->phase) - 1);
+    entry->phase[sizeof(entry->phase) - 1] = '\0';
+    strncpy(entry->target, target ? target : "", sizeof(entry->target) - 1);
+    entry->target[sizeof(entry->target) - 1] = '\0';
+
+    __atomic_store_n(&entry->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+
+static void print_entry(const NvEventsEntry *entry)
+{
+    char date[32], result[32];
+    time_t seconds = entry->realtime_ns / 1000000000LL;
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+    if (strcmp(entry->phase, "run") == 0)
+    {
+        snprintf(result, sizeof(result), "exit %d", entry->result);
+    }
+    else if (strncmp(entry->phase, "step/", 5) == 0)
+    {
+        snprintf(result, sizeof(result), "%s",
+                 nv_step_state_name(entry->result));
+    }
+    else
+    {
+        snprintf(result, sizeof(result), "-");
+    }
+
+    printf("%s.%06lld %12.6f %7d  %-28s %-40s %-12s %10.3f ms\n", date,
+           (entry->realtime_ns % 1000000000LL) / 1000,
+           entry->boottime_ns / 1e9, entry->pid, entry->phase,
+           entry->target, result, entry->duration_ns / 1e6);
+}
+
+/*
+ * Print the entries of the event log in 'path', or in the file
+ * nv_events_open() uses by default, oldest first; the times are those of
+ * the end of each event.  Returns 0 on success, or 1.
+ */
+int nv_events_decode(const char *path)
+{
+    path = events_path(path);
+    uint64_t next, index, num_entries;
+    NvEventsEntry entry;
+
+    if (running_setuid())
+    {
+        nv_error_msg("Unable to read the event log when running setuid or "
+                     "setgid.");
+        return 1;
+    }
+
+    if (!map_log(path, FALSE))
+    {
+        nv_error_msg("Unable to read the event log %s: %s.", path,
+                     strerror(errno));
+        return 1;
+    }
+
+    num_entries = events.header->num_entries;
+    next = __atomic_load_n(&events.header->next, __ATOMIC_ACQUIRE);
+
+    printf("%-26s %12s %7s  %-28s %-40s %-12s %13s\n", "time", "boot (s)",
+           "pid", "phase", "target", "result", "duration");
+
+    for (index = (next > num_entries) ? next - num_entries : 0;
+         index < next; index++)
+    {
+        const NvEventsEntry *slot = &events.entries[index % num_entries];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        memcpy(&entry, slot, sizeof(entry));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        /* skip entries being written, or overwritten since */
+
+        if ((seq != index + 1) ||
+            (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq))
+        {
+            continue;
+        }
+
+        print_entry(&entry);
+    }
+
+    nv_events_close();
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event log: a fixed-size ring buffer of binary entries in a file mapped
+ * by every nvidia-modprobe process once --event-log has created it,
+ * recording each step and run, and the timing spans when they are collected anyway, so that
+ * what nvidia-modprobe did, e.g. while a node booted, can be reconstructed
+ * afterwards with --decode-events.
+ *
+ * An entry is reserved with a single atomic increment of the header's
+ * 'next' counter, so processes append concurrently without locking.  Its
+ * 'seq' field is cleared while it is written and set to its index + 1
+ * last, so that readers can skip entries being written or overwritten.
+ */
+
+#ifndef __NVIDIA_MODPROBE_EVENTS_H__
+#define __NVIDIA_MODPROBE_EVENTS_H__
+
+#include <stdint.h>
+
+#define NV_EVENTS_PATH_ENV      "NVIDIA_MODPROBE_EVENTS"
+#define NV_EVENTS_DEFAULT_PATH  "/run/nvidia-modprobe.events"
+
+#define NV_EVENTS_MAGIC         0x4e564d5045564e54ULL   /* "NVMPEVNT" */
+#define NV_EVENTS_VERSION       1
+#define NV_EVENTS_NUM_ENTRIES   4096
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t num_entries;
+    uint32_t reserved;
+    uint64_t next;              /* index of the next entry to write */
+    uint8_t pad[32];
+} NvEventsHeader;
+
+/*
+ * 'phase' is a timing span name, "step/<kind>" for a step or "run" for
+ * a whole run; 'result' is 0 for a span, the NvStepState of a step and
+ * the exit status of a run.  Times are in nanoseconds, at the end of the
+ * event.
+ */
+typedef struct {
+    uint64_t seq;
+    int64_t realtime_ns;
+    int64_t boottime_ns;
+    int64_t duration_ns;
+    int32_t pid;
+    int32_t result;
+    char phase[32];
+    char target[56];
+} NvEventsEntry;
+
+int nv_events_open(int requested, const char *path);
+void nv_events_close(void);
+void nv_events_log(const char *phase, const char *target, int result,
+                   long long duration_ns);
+
+int nv_events_decode(const char *path);
+
+#endif /* __NVIDIA_MODPROBE_EVENTS_H__ */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "nvidia-modprobe-irq.h"
+#include "common-utils.h"
+#include "msg.h"
+
+
+/*
+ * nv_irq_print_plan() - print, for each device, its local CPUs and the
+ * current and planned affinity of each of its interrupts.
+ */
+
+void nv_irq_print_plan(const NvModprobeIrqPlan *plan)
+{
+    int i, j;
+
+    for (i = 0; i < plan->num_devices; i++)
+    {
+        const NvModprobeIrqDevice *device = &plan->devices[i];
+
+        nv_msg(NULL, "%s: NUMA node %d, local CPUs %s, %d interrupts",
+               device->name, device->numa_node, device->local_cpulist,
+               device->num_irqs);
+
+        for (j = 0; j < device->num_irqs; j++)
+        {
+            const NvModprobeIrq *irq = &device->irqs[j];
+
+            if (irq->change)
+            {
+                nv_msg(TAB, "IRQ %d: %s -> %s", irq->irq, irq->affinity,
+                       device->local_cpulist);
+            }
+            else
+            {
+                nv_msg(TAB, "IRQ %d: %s (local)", irq->irq, irq->affinity);
+            }
+        }
+    }
+}
+
+
+/*
+ * nv_irq_report() - print the interrupts whose affinity could not be set,
+ * followed by a summary of the changes.
+ */
+
+void nv_irq_report(const NvModprobeIrqPlan *plan)
+{
+    int i, j;
+    int num_irqs = 0, num_set = 0, num_managed = 0, num_failed = 0;
+
+    for (i = 0; i < plan->num_devices; i++)
+    {
+        const NvModprobeIrqDevice *device = &plan->devices[i];
+
+        for (j = 0; j < device->num_irqs; j++)
+        {
+            const NvModprobeIrq *irq = &device->irqs[j];
+
+            num_irqs++;
+
+            if (!irq->change)
+            {
+                continue;
+            }
+
+            if (irq->error == 0)
+            {
+                num_set++;
+            }
+            else if (irq->error == EIO)
+            {
+                num_managed++;
+            }
+            else
+            {
+                num_failed++;
+                nv_msg(NULL, "%s: unable to set the affinity of IRQ %d to "
+                       "%s: %s", device->name, irq->irq,
+                       device->local_cpulist, strerror(irq->error));
+            }
+        }
+    }
+
+    nv_msg(NULL, "Set the affinity of %d of %d interrupts of %d NVIDIA "
+           "devices (%d already local, %d managed by the kernel, %d failed)",
+           num_set, num_irqs, plan->num_devices,
+           num_irqs - num_set - num_managed - num_failed, num_managed,
+           num_failed);
+}
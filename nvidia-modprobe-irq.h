@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Interrupt affinity: the MSI and MSI-X interrupts of the NVIDIA PCI
+ * devices are steered to the CPUs local to each device, in one pass over
+ * the devices.  The plan can also be printed without being applied.
+ */
+
+#ifndef __NVIDIA_MODPROBE_IRQ_H__
+#define __NVIDIA_MODPROBE_IRQ_H__
+
+#include "nvidia-modprobe-utils.h"
+
+void nv_irq_print_plan(const NvModprobeIrqPlan *plan);
+void nv_irq_report(const NvModprobeIrqPlan *plan);
+
+#endif /* __NVIDIA_MODPROBE_IRQ_H__ */
@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "nvidia-modprobe-memory.h"
+#include "common-utils.h"
+#include "msg.h"
+
+#define NV_MEMORY_PROGRESS_INTERVAL_S   1
+#define NV_MEMORY_MAX_MISPLACED_LISTED  16
+#define NV_MEMORY_GIB                   (1024.0 * 1024.0 * 1024.0)
+
+typedef struct {
+    NvModprobeContext *ctx;
+    NvMemoryOnline *online;
+    const int *blocks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int next;                   /* next block to online */
+    int num_done;
+    int num_workers;
+} NvMemoryRun;
+
+
+static long long elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+
+/*
+ * Worker thread: online the blocks one at a time, in increasing order
+ * across the workers, until none is left or the context is out of time.
+ */
+
+static void *memory_worker(void *arg)
+{
+    NvMemoryRun *run = arg;
+    NvMemoryOnline *online = run->online;
+    NvModprobeContext ctx = *run->ctx;
+    NvModprobeStats before, after;
+    int i;
+
+    nvidia_modprobe_get_stats(&before);
+
+    pthread_mutex_lock(&run->lock);
+
+    while (run->next < online->num_blocks)
+    {
+        int block = run->blocks[run->next++];
+        int ok;
+
+        if (nvidia_modprobe_context_out_of_time(&ctx))
+        {
+            online->num_not_started++;
+            run->num_done++;
+            continue;
+        }
+
+        pthread_mutex_unlock(&run->lock);
+
+        ok = nvidia_online_movable_memory_block_ctx(&ctx, block, 0);
+
+        pthread_mutex_lock(&run->lock);
+
+        if (ok)
+        {
+            online->num_onlined++;
+        }
+        else
+        {
+            online->num_failed++;
+        }
+        run->num_done++;
+    }
+
+    nvidia_modprobe_get_stats(&after);
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        online->stats.count[i] += after.count[i] - before.count[i];
+    }
+
+    run->num_workers--;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+
+    return NULL;
+}
+
+
+/*
+ * nv_memory_online_run() - online the offline memory blocks of the GPU
+ * NUMA nodes as movable, using up to 'jobs' worker threads.  If
+ * 'progress' is set, the number of blocks onlined so far is printed
+ * every second.  Returns the number of blocks left offline, or 1 if the
+ * GPU NUMA nodes cannot be found.
+ */
+
+int nv_memory_online_run(NvModprobeContext *ctx, int jobs, int progress,
+                         NvMemoryOnline *online)
+{
+    pthread_t threads[NV_MEMORY_MAX_JOBS];
+    NvModprobeStats before;
+    struct timespec start;
+    NvMemoryRun run;
+    int *blocks;
+    int i, num_threads = 0;
+
+    memset(online, 0, sizeof(*online));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    nvidia_modprobe_get_stats(&before);
+    online->num_blocks = nvidia_get_offline_gpu_memory_blocks_ctx(ctx,
+                                                                  &blocks);
+    nvidia_modprobe_get_stats(&online->stats);
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        online->stats.count[i] -= before.count[i];
+    }
+
+    if (online->num_blocks < 0)
+    {
+        online->num_blocks = 0;
+        online->elapsed_ns = elapsed_ns(&start);
+        return 1;
+    }
+
+    memset(&run, 0, sizeof(run));
+    run.ctx = ctx;
+    run.online = online;
+    run.blocks = blocks;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+
+    jobs = NV_MAX(jobs, 1);
+    jobs = NV_MIN(jobs, NV_MEMORY_MAX_JOBS);
+    jobs = NV_MIN(jobs, online->num_blocks);
+
+    /*
+     * The calling thread only reports progress, so it needs at least one
+     * worker; if none can be created, it onlines the blocks itself.  The
+     * workers wait for the lock until they are all accounted for.
+     */
+
+    pthread_mutex_lock(&run.lock);
+
+    for (i = 0; i < jobs; i++)
+    {
+        if (pthread_create(&threads[num_threads], NULL,
+                           memory_worker, &run) == 0)
+        {
+            num_threads++;
+        }
+    }
+
+    run.num_workers = num_threads;
+
+    if ((num_threads == 0) && (online->num_blocks > 0))
+    {
+        run.num_workers = 1;
+        pthread_mutex_unlock(&run.lock);
+        memory_worker(&run);
+        pthread_mutex_lock(&run.lock);
+    }
+
+    while (run.num_workers > 0)
+    {
+        struct timespec deadline;
+        int num_done = run.num_done;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += NV_MEMORY_PROGRESS_INTERVAL_S;
+
+        if ((pthread_cond_timedwait(&run.cond, &run.lock,
+                                    &deadline) == ETIMEDOUT) &&
+            progress && (run.num_done < online->num_blocks))
+        {
+            nv_msg(NULL, "Onlined %d of %d memory blocks (%d done in the "
+                   "last %d s)", online->num_onlined, online->num_blocks,
+                   run.num_done - num_done, NV_MEMORY_PROGRESS_INTERVAL_S);
+        }
+    }
+
+    pthread_mutex_unlock(&run.lock);
+
+    for (i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+    free(blocks);
+
+    online->elapsed_ns = elapsed_ns(&start);
+
+    return online->num_failed + online->num_not_started;
+}
+
+
+/*
+ * nv_memory_online_report() - print the number of blocks onlined and the
+ * total time.
+ */
+
+void nv_memory_online_report(const NvMemoryOnline *online)
+{
+    long long us = online->elapsed_ns / 1000;
+
+    nv_msg(NULL, "Onlined %d of %d offline GPU memory blocks as movable in "
+           "%lld.%03lld ms (%d failed, %d not started)",
+           online->num_onlined, online->num_blocks, us / 1000, us % 1000,
+           online->num_failed, online->num_not_started);
+}
+
+
+/*
+ * nv_memory_audit_report() - print, for each GPU NUMA node, its memory
+ * blocks and the size of each of its zones, followed by the blocks
+ * onlined outside of ZONE_MOVABLE.
+ */
+
+void nv_memory_audit_report(const NvModprobeMemoryAudit *audit)
+{
+    int i, j;
+
+    nv_msg(NULL, "Memory block size %llu MiB, auto_online_blocks %s",
+           audit->block_size >> 20,
+           audit->auto_online_blocks[0] ? audit->auto_online_blocks :
+           "unknown");
+
+    if (strcmp(audit->auto_online_blocks, "online_movable") != 0)
+    {
+        nv_warning_msg("GPU memory added from now on will not be onlined "
+                       "as movable; see --auto-online-movable.");
+    }
+
+    for (i = 0; i < audit->num_nodes; i++)
+    {
+        const NvModprobeNodeAudit *node = &audit->nodes[i];
+
+        nv_msg(NULL, "NUMA node %d: %d memory blocks, %d online, %d offline, "
+               "%d misplaced", node->node, node->num_blocks,
+               node->num_online, node->num_blocks - node->num_online,
+               node->num_misplaced);
+
+        for (j = 0; j < node->num_zones; j++)
+        {
+            const NvModprobeZoneInfo *zone = &node->zones[j];
+
+            nv_msg(TAB, "zone %-10s %10.2f GiB present %10.2f GiB managed",
+                   zone->name,
+                   zone->present_pages * audit->page_size / NV_MEMORY_GIB,
+                   zone->managed_pages * audit->page_size / NV_MEMORY_GIB);
+        }
+    }
+
+    for (i = 0; i < audit->num_misplaced; i++)
+    {
+        const NvModprobeMisplacedBlock *block = &audit->misplaced[i];
+
+        if (i == NV_MEMORY_MAX_MISPLACED_LISTED)
+        {
+            nv_msg(NULL, "... and %d more misplaced memory blocks",
+                   audit->num_misplaced - i);
+            break;
+        }
+
+        nv_msg(NULL, "Memory block %d of NUMA node %d is in zone %s "
+               "instead of Movable", block->block, block->node, block->zone);
+    }
+}
+
+
+/*
+ * nv_memory_parse_hugepages() - parse a huge page reservation request,
+ * COUNT[:SIZE], where SIZE is a number of bytes with an optional k, M or
+ * G suffix (e.g. 2M or 1G).  Both must be plain decimal numbers, at most
+ * NV_MEMORY_MAX_HUGEPAGES and NV_MEMORY_MAX_HUGEPAGE_SIZE.  Returns 1 on
+ * success and 0 on failure.
+ */
+
+int nv_memory_parse_hugepages(const char *str, NvHugepagesReservation *res)
+{
+    unsigned long long size;
+    int shift = 0;
+    char *end;
+
+    memset(res, 0, sizeof(*res));
+
+    /* strtoul() would accept leading spaces and a sign, "-1" included */
+
+    if (!isdigit((unsigned char) str[0]))
+    {
+        return 0;
+    }
+
+    errno = 0;
+    res->count = strtoul(str, &end, 10);
+    if ((errno != 0) || (res->count > NV_MEMORY_MAX_HUGEPAGES))
+    {
+        return 0;
+    }
+
+    if (*end == '\0')
+    {
+        return 1;
+    }
+
+    if (*end != ':')
+    {
+        return 0;
+    }
+
+    str = end + 1;
+    if (!isdigit((unsigned char) str[0]))
+    {
+        return 0;
+    }
+
+    size = strtoull(str, &end, 10);
+    if (errno != 0)
+    {
+        return 0;
+    }
+
+    switch (*end)
+    {
+        case 'g': case 'G': shift = 30; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'k': case 'K': shift = 10; end++; break;
+    }
+
+    if ((*end == 'B') || (*end == 'b'))
+    {
+        end++;
+    }
+
+    if ((*end != '\0') || (size > (NV_MEMORY_MAX_HUGEPAGE_SIZE >> shift)))
+    {
+        return 0;
+    }
+
+    size <<= shift;
+
+    if (size < 1024)
+    {
+        return 0;
+    }
+
+    res->size_kb = size >> 10;
+
+    return 1;
+}
+
+
+typedef struct {
+    NvModprobeContext *ctx;
+    NvHugepagesReservation *res;
+    NvHugepagesNode *node;
+    pthread_mutex_t *lock;
+} NvHugepagesThread;
+
+static void *hugepages_worker(void *arg)
+{
+    NvHugepagesThread *thread = arg;
+    NvHugepagesReservation *res = thread->res;
+    NvHugepagesNode *node = thread->node;
+    NvModprobeContext ctx = *thread->ctx;
+    NvModprobeStats before, after;
+    struct timespec start;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nvidia_modprobe_get_stats(&before);
+
+    node->ok = nvidia_reserve_hugepages_ctx(&ctx, node->node, res->size_kb,
+                                            res->count, &node->before,
+                                            &node->obtained);
+    node->not_started = !node->ok && (errno == ETIME);
+
+    nvidia_modprobe_get_stats(&after);
+    node->elapsed_ns = elapsed_ns(&start);
+
+    pthread_mutex_lock(thread->lock);
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        res->stats.count[i] += after.count[i] - before.count[i];
+    }
+
+    pthread_mutex_unlock(thread->lock);
+
+    return NULL;
+}
+
+
+/*
+ * nv_memory_reserve_hugepages() - reserve res->count huge pages of
+ * res->size_kb kB on each NUMA node local to a GPU, growing the pools of
+ * the nodes concurrently: the kernel may have to compact memory to
+ * obtain the pages, which takes a while on each node.  Returns the
+ * number of nodes on which fewer pages than requested are reserved, or 1
+ * if the GPUs' nodes cannot be found.
+ */
+
+int nv_memory_reserve_hugepages(NvModprobeContext *ctx,
+                                NvHugepagesReservation *res)
+{
+    int nodes[NV_MODPROBE_MAX_GPU_NODES];
+    pthread_t threads[NV_MODPROBE_MAX_GPU_NODES];
+    int created[NV_MODPROBE_MAX_GPU_NODES];
+    NvHugepagesThread args[NV_MODPROBE_MAX_GPU_NODES];
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    NvModprobeStats before;
+    struct timespec start;
+    int i, num_failed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nvidia_modprobe_get_stats(&before);
+
+    if (res->size_kb == 0)
+    {
+        res->size_kb = nvidia_get_default_hugepage_size_ctx(ctx);
+    }
+
+    res->num_nodes = nvidia_get_gpu_local_numa_nodes_ctx(ctx, nodes,
+                                                         ARRAY_LEN(nodes));
+
+    nvidia_modprobe_get_stats(&res->stats);
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        res->stats.count[i] -= before.count[i];
+    }
+
+    if ((res->num_nodes < 0) || (res->size_kb == 0))
+    {
+        res->num_nodes = 0;
+        res->elapsed_ns = elapsed_ns(&start);
+        return 1;
+    }
+
+    /* If a thread cannot be created, reserve on its node from here. */
+
+    for (i = 0; i < res->num_nodes; i++)
+    {
+        res->nodes[i].node = nodes[i];
+        args[i].ctx = ctx;
+        args[i].res = res;
+        args[i].node = &res->nodes[i];
+        args[i].lock = &lock;
+
+        created[i] = (pthread_create(&threads[i], NULL,
+                                     hugepages_worker, &args[i]) == 0);
+    }
+
+    for (i = 0; i < res->num_nodes; i++)
+    {
+        if (created[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            hugepages_worker(&args[i]);
+        }
+
+        if (!res->nodes[i].ok)
+        {
+            num_failed++;
+        }
+    }
+
+    res->elapsed_ns = elapsed_ns(&start);
+
+    return num_failed;
+}
+
+
+/*
+ * nv_memory_hugepages_report() - print the huge pages obtained on each
+ * node.
+ */
+
+void nv_memory_hugepages_report(const NvHugepagesReservation *res)
+{
+    long long us = res->elapsed_ns / 1000;
+    int i;
+
+    for (i = 0; i < res->num_nodes; i++)
+    {
+        const NvHugepagesNode *node = &res->nodes[i];
+        long long node_us = node->elapsed_ns / 1000;
+
+        nv_msg(NULL, "NUMA node %d: %lu of %lu %lu kB huge pages reserved "
+               "(%lu before) in %lld.%03lld ms%s", node->node,
+               node->obtained, res->count, res->size_kb, node->before,
+               node_us / 1000, node_us % 1000,
+               node->ok ? "" :
+               (node->not_started ? " (not started)" : " (failed)"));
+    }
+
+    nv_msg(NULL, "Reserved huge pages on %d NUMA nodes in %lld.%03lld ms",
+           res->num_nodes, us / 1000, us % 1000);
+}
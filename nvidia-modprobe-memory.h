@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Onlining of the GPU memory of platforms (like Grace Hopper) where it is
+ * added to the kernel as NUMA nodes: the memory blocks of these nodes
+ * left offline, e.g. because they were added before the online_movable
+ * auto onlining setting took effect, are onlined as movable by a pool of
+ * worker threads, with periodic progress.  The placement of that memory
+ * in the kernel's zones can also be audited.
+ *
+ * Huge pages can also be reserved on the NUMA nodes local to the GPUs,
+ * one thread per node.
+ */
+
+#ifndef __NVIDIA_MODPROBE_MEMORY_H__
+#define __NVIDIA_MODPROBE_MEMORY_H__
+
+#include "nvidia-modprobe-utils.h"
+
+#define NV_MEMORY_MAX_JOBS      64
+
+/* bounds of a huge page reservation request */
+#define NV_MEMORY_MAX_HUGEPAGES         (1UL << 20)    /* per node */
+#define NV_MEMORY_MAX_HUGEPAGE_SIZE     (16ULL << 30)
+
+typedef struct {
+    int num_blocks;             /* offline blocks found */
+    int num_onlined;
+    int num_failed;
+    int num_not_started;        /* left offline when out of time */
+    long long elapsed_ns;
+
+    /* operations performed by all the workers */
+    NvModprobeStats stats;
+} NvMemoryOnline;
+
+int nv_memory_online_run(NvModprobeContext *ctx, int jobs, int progress,
+                         NvMemoryOnline *online);
+void nv_memory_online_report(const NvMemoryOnline *online);
+
+void nv_memory_audit_report(const NvModprobeMemoryAudit *audit);
+
+typedef struct {
+    int node;
+    int ok;
+    int not_started;            /* left alone when out of time */
+    unsigned long before;       /* huge pages reserved before */
+    unsigned long obtained;     /* huge pages reserved after */
+    long long elapsed_ns;
+} NvHugepagesNode;
+
+typedef struct {
+    unsigned long count;        /* huge pages requested per node */
+    unsigned long size_kb;      /* 0 for the default huge page size */
+
+    NvHugepagesNode nodes[NV_MODPROBE_MAX_GPU_NODES];
+    int num_nodes;
+    long long elapsed_ns;
+
+    /* operations performed by all the threads */
+    NvModprobeStats stats;
+} NvHugepagesReservation;
+
+int nv_memory_parse_hugepages(const char *str, NvHugepagesReservation *res);
+int nv_memory_reserve_hugepages(NvModprobeContext *ctx,
+                                NvHugepagesReservation *res);
+void nv_memory_hugepages_report(const NvHugepagesReservation *res);
+
+#endif /* __NVIDIA_MODPROBE_MEMORY_H__ */
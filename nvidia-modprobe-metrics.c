@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+
+#include "nvidia-modprobe-metrics.h"
+#include "common-utils.h"
+#include "msg.h"
+
+#define NV_METRICS_KEY_LEN      192
+
+/*
+ * The counts of the runs that found the metrics file being updated by
+ * another run, and the ones being folded in by the run holding the lock;
+ * see nv_metrics_update().  The textfile collector only reads the *.prom
+ * files.
+ */
+#define NV_METRICS_PENDING_PREFIX   "." NV_METRICS_FILE ".pending."
+#define NV_METRICS_CLAIMED_PREFIX   "." NV_METRICS_FILE ".claimed."
+#define NV_METRICS_MAX_PENDING      64
+
+/*
+ * The metric families written, in order.  Series of other families found
+ * in the file, e.g. written by another version, are dropped.
+ */
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} families[] = {
+    { "nvidia_modprobe_invocations_total", "counter",
+      "Invocations of nvidia-modprobe, by primary mode." },
+    { "nvidia_modprobe_failed_invocations_total", "counter",
+      "Invocations of nvidia-modprobe that failed or ran out of time." },
+    { "nvidia_modprobe_failures_total", "counter",
+      "Failed steps, by kind." },
+    { "nvidia_modprobe_modprobe_spawns_total", "counter",
+      "modprobe processes spawned to load kernel modules." },
+    { "nvidia_modprobe_cache_hits_total", "counter",
+      "Character device major and device file parameter lookups served "
+      "from the cache." },
+    { "nvidia_modprobe_device_files_total", "counter",
+      "Device files created, or whose mode or owner was fixed." },
+    { "nvidia_modprobe_duration_seconds", "histogram",
+      "Duration of the invocations of nvidia-modprobe." },
+    { "nvidia_modprobe_phase_duration_seconds", "histogram",
+      "Duration of the phases of the invocations of nvidia-modprobe." },
+    { "nvidia_modprobe_last_run_timestamp_seconds", "gauge",
+      "Time of the last invocation of nvidia-modprobe." },
+};
+
+static const char *buckets[] = {
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01",
+    "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5", "10",
+};
+
+typedef struct {
+    char key[NV_METRICS_KEY_LEN];       /* name{labels} */
+    double value;
+} Metric;
+
+static struct {
+    Metric *metrics;
+    int num_metrics;
+    int max_metrics;
+} table;
+
+
+static Metric *find_metric(const char *key)
+{
+    int i;
+
+    for (i = 0; i < table.num_metrics; i++)
+    {
+        if (strcmp(table.metrics[i].key, key) == 0)
+        {
+            return &table.metrics[i];
+        }
+    }
+
+    if (table.num_metrics == table.max_metrics)
+    {
+        table.max_metrics = table.max_metrics ? table.max_metrics * 2 : 128;
+        table.metrics = nvrealloc(table.metrics,
+                                  table.max_metrics * sizeof(Metric));
+    }
+
+    memset(&table.metrics[table.num_metrics], 0, sizeof(Metric));
+    snprintf(table.metrics[table.num_metrics].key, NV_METRICS_KEY_LEN,
+             "%s", key);
+
+    return &table.metrics[table.num_metrics++];
+}
+
+static void metric_add(double value, const char *fmt, ...)
+    NV_ATTRIBUTE_PRINTF(2, 3);
+
+static void metric_add(double value, const char *fmt, ...)
+{
+    char key[NV_METRICS_KEY_LEN];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(key, sizeof(key), fmt, ap);
+    va_end(ap);
+
+    find_metric(key)->value += value;
+}
+
+typedef struct {
+    unsigned long counts[ARRAY_LEN(buckets)];
+    unsigned long count;
+    double sum;
+} Histogram;
+
+static void histogram_observe(Histogram *histogram, double seconds)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(buckets); i++)
+    {
+        histogram->counts[i] += (seconds <= atof(buckets[i]));
+    }
+
+    histogram->count++;
+    histogram->sum += seconds;
+}
+
+/*
+ * Add the observations of a histogram to its series; 'labels' is either
+ * empty or a list of labels such as 'phase="mknod"'.
+ */
+static void histogram_add(const char *name, const char *labels,
+                          const Histogram *histogram)
+{
+    const char *sep = labels[0] ? "," : "";
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(buckets); i++)
+    {
+        metric_add(histogram->counts[i], "%s_bucket{%s%sle=\"%s\"}",
+                   name, labels, sep, buckets[i]);
+    }
+
+    metric_add(histogram->count, "%s_bucket{%s%sle=\"+Inf\"}",
+               name, labels, sep);
+
+    if (labels[0])
+    {
+        metric_add(histogram->sum, "%s_sum{%s}", name, labels);
+        metric_add(histogram->count, "%s_count{%s}", name, labels);
+    }
+    else
+    {
+        metric_add(histogram->sum, "%s_sum", name);
+        metric_add(histogram->count, "%s_count", name);
+    }
+}
+
+
+/*
+ * Return whether the series 'key' belongs to the family 'name'.
+ */
+static int in_family(const char *key, const char *name, const char *type)
+{
+    size_t len = strlen(name);
+    const char *rest = key + len;
+
+    if (strncmp(key, name, len) != 0)
+    {
+        return 0;
+    }
+
+    if (strcmp(type, "histogram") == 0)
+    {
+        if (strncmp(rest, "_bucket", 7) == 0)
+        {
+            rest += 7;
+        }
+        else if (strncmp(rest, "_sum", 4) == 0)
+        {
+            rest += 4;
+        }
+        else if (strncmp(rest, "_count", 6) == 0)
+        {
+            rest += 6;
+        }
+    }
+
+    return (*rest == '\0') || (*rest == '{');
+}
+
+/*
+ * Return the type of the family of the series 'key', or NULL for series
+ * of unknown families.
+ */
+static const char *series_type(const char *key)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(families); i++)
+    {
+        if (in_family(key, families[i].name, families[i].type))
+        {
+            return families[i].type;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Merge the series of a metrics file into the table: counters and
+ * histograms are added up, and the latest value of gauges (timestamps)
+ * is kept.  Returns 0 or an errno value.
+ */
+static int load_metrics(const char *path)
+{
+    char line[NV_METRICS_KEY_LEN + 64];
+    const char *type;
+    Metric *metric;
+    double value;
+    char *sep;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return errno;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        sep = strrchr(line, ' ');
+        if ((line[0] == '#') || (sep == NULL))
+        {
+            continue;
+        }
+
+        *sep = '\0';
+        value = strtod(sep + 1, NULL);
+
+        type = series_type(line);
+        if (type == NULL)
+        {
+            continue;
+        }
+
+        metric = find_metric(line);
+
+        if (strcmp(type, "gauge") != 0)
+        {
+            metric->value += value;
+        }
+        else if (value > metric->value)
+        {
+            metric->value = value;
+        }
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int save_metrics(const char *dir, const char *path)
+{
+    char tmp_path[PATH_MAX];
+    FILE *fp;
+    int fd, i, j, ret;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.%s.%d", dir, NV_METRICS_FILE,
+             (int) getpid());
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    fp = fdopen(fd, "w");
+    if (fp == NULL)
+    {
+        ret = errno;
+        close(fd);
+        unlink(tmp_path);
+        return ret;
+    }
+
+    for (i = 0; i < ARRAY_LEN(families); i++)
+    {
+        fprintf(fp, "# HELP %s %s\n", families[i].name, families[i].help);
+        fprintf(fp, "# TYPE %s %s\n", families[i].name, families[i].type);
+
+        for (j = 0; j < table.num_metrics; j++)
+        {
+            if (in_family(table.metrics[j].key, families[i].name,
+                          families[i].type))
+            {
+                fprintf(fp, "%s %.15g\n", table.metrics[j].key,
+                        table.metrics[j].value);
+            }
+        }
+    }
+
+    if ((fclose(fp) != 0) || (rename(tmp_path, path) != 0))
+    {
+        ret = errno;
+        unlink(tmp_path);
+        return ret;
+    }
+
+    return 0;
+}
+
+
+/*
+ * The spans of the run, by phase, so that each phase's series are only
+ * looked up once.
+ */
+
+#define NV_METRICS_MAX_PHASES   32
+
+typedef struct {
+    const char *name;
+    Histogram histogram;
+} Phase;
+
+typedef struct {
+    Phase phases[NV_METRICS_MAX_PHASES];
+    int num_phases;
+} Phases;
+
+static void observe_phase(void *data, const char *name, const char *arg,
+                          long long ns)
+{
+    Phases *phases = data;
+    int i;
+
+    for (i = 0; i < phases->num_phases; i++)
+    {
+        if (strcmp(phases->phases[i].name, name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == phases->num_phases)
+    {
+        if (i == NV_METRICS_MAX_PHASES)
+        {
+            return;
+        }
+        phases->phases[phases->num_phases++].name = name;
+    }
+
+    histogram_observe(&phases->phases[i].histogram, ns / 1e9);
+}
+
+static void add_run(const NvMetricsRun *run)
+{
+    const NvOutputResult *result = run->result;
+    unsigned long spawns = run->bringup_stats.count[NvModprobeStatSpawn];
+    unsigned long cache_hits =
+        run->bringup_stats.count[NvModprobeStatCacheHit];
+    unsigned long created = 0, fixed = 0;
+    Histogram duration;
+    Phases phases;
+    int i;
+
+    for (i = 0; i < run->num_modes; i++)
+    {
+        metric_add(1, "nvidia_modprobe_invocations_total{mode=\"%s\"}",
+                   run->modes[i]);
+    }
+
+    metric_add(result->exit_status && !result->out_of_time,
+               "nvidia_modprobe_failed_invocations_total{reason=\"failed\"}");
+    metric_add(result->out_of_time,
+               "nvidia_modprobe_failed_invocations_total"
+               "{reason=\"out-of-time\"}");
+
+    for (i = 0; i < result->graph->num_steps; i++)
+    {
+        const NvStep *step = &result->graph->steps[i];
+        const NvModprobeStats *stats = &step->stats;
+
+        spawns += stats->count[NvModprobeStatSpawn];
+        cache_hits += stats->count[NvModprobeStatCacheHit];
+
+        if (step->state == NvStepFailed)
+        {
+            metric_add(1, "nvidia_modprobe_failures_total{kind=\"%s\"}",
+                       step->kind);
+        }
+        else if (step->state == NvStepSucceeded)
+        {
+            if (stats->count[NvModprobeStatMknod] != 0)
+            {
+                created++;
+            }
+            else if ((stats->count[NvModprobeStatChmod] >
+                      stats->count[NvModprobeStatMkdir]) ||
+                     (stats->count[NvModprobeStatChown] >
+                      stats->count[NvModprobeStatMkdir]))
+            {
+                /* the parent directory's mode and owner are always set */
+                fixed++;
+            }
+        }
+    }
+
+    for (i = 0; i < result->num_gpus; i++)
+    {
+        if (result->gpus[i].failed)
+        {
+            metric_add(1, "nvidia_modprobe_failures_total{kind=\"bring-up\"}");
+        }
+    }
+
+    metric_add(spawns, "nvidia_modprobe_modprobe_spawns_total");
+    metric_add(cache_hits, "nvidia_modprobe_cache_hits_total");
+    metric_add(created,
+               "nvidia_modprobe_device_files_total{change=\"created\"}");
+    metric_add(fixed, "nvidia_modprobe_device_files_total{change=\"fixed\"}");
+
+    memset(&duration, 0, sizeof(duration));
+    histogram_observe(&duration, run->elapsed_ns / 1e9);
+    histogram_add("nvidia_modprobe_duration_seconds", "", &duration);
+
+    memset(&phases, 0, sizeof(phases));
+    nv_output_for_each_span(observe_phase, &phases);
+
+    for (i = 0; i < phases.num_phases; i++)
+    {
+        char labels[64];
+
+        snprintf(labels, sizeof(labels), "phase=\"%s\"",
+                 phases.phases[i].name);
+        histogram_add("nvidia_modprobe_phase_duration_seconds", labels,
+                      &phases.phases[i].histogram);
+    }
+
+    find_metric("nvidia_modprobe_last_run_timestamp_seconds")->value =
+        time(NULL);
+}
+
+
+/*
+ * Return the metrics directory: the one requested with --metrics-dir or
+ * NV_METRICS_DIR_ENV, else the one nvidia-modprobe was built with, if
+ * any.  A setuid or setgid nvidia-modprobe only writes to the latter,
+ * since the caller could otherwise have files created in any directory.
+ */
+const char *nv_metrics_get_dir(const char *requested)
+{
+    if (requested == NULL)
+    {
+        requested = getenv(NV_METRICS_DIR_ENV);
+    }
+
+    if ((requested != NULL) &&
+        ((getuid() != geteuid()) || (getgid() != getegid())))
+    {
+        nv_warning_msg("Ignoring the requested metrics directory when "
+                       "running setuid or setgid.");
+        requested = NULL;
+    }
+
+    if ((requested != NULL) && (requested[0] != '\0'))
+    {
+        return requested;
+    }
+
+#if defined(NV_MODPROBE_METRICS_DIR)
+    return NV_MODPROBE_METRICS_DIR;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * Merge the pending files of other runs into the table, and record their
+ * names in 'names' so that they can be removed once the metrics file is
+ * saved.  Each pending file is first renamed to a claimed name, so that
+ * only the file actually merged is removed; claimed files left by a run
+ * that could not save the metrics file are merged as they are.  Returns
+ * the number of files merged.
+ */
+static int load_pending_metrics(const char *dir, int dir_fd,
+                                char names[][NAME_MAX + 1], int max_names)
+{
+    const size_t pending_len = strlen(NV_METRICS_PENDING_PREFIX);
+    const size_t claimed_len = strlen(NV_METRICS_CLAIMED_PREFIX);
+    char path[PATH_MAX];
+    char claimed[NAME_MAX + 1];
+    struct dirent *d;
+    DIR *dirp;
+    int num_names = 0, num_loaded = 0, i;
+
+    dirp = opendir(dir);
+    if (dirp == NULL)
+    {
+        return 0;
+    }
+
+    /*
+     * List the files before renaming any of them, since readdir(3) may or
+     * may not return the entries renamed while it runs.
+     */
+
+    while (((d = readdir(dirp)) != NULL) && (num_names < max_names))
+    {
+        if ((strncmp(d->d_name, NV_METRICS_PENDING_PREFIX,
+                     pending_len) == 0) ||
+            (strncmp(d->d_name, NV_METRICS_CLAIMED_PREFIX,
+                     claimed_len) == 0))
+        {
+            snprintf(names[num_names++], NAME_MAX + 1, "%s", d->d_name);
+        }
+    }
+
+    closedir(dirp);
+
+    for (i = 0; i < num_names; i++)
+    {
+        if (strncmp(names[i], NV_METRICS_PENDING_PREFIX, pending_len) == 0)
+        {
+            snprintf(claimed, sizeof(claimed), "%s%s",
+                     NV_METRICS_CLAIMED_PREFIX, names[i] + pending_len);
+
+            if (renameat(dir_fd, names[i], dir_fd, claimed) != 0)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            memcpy(claimed, names[i], sizeof(claimed));
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", dir, claimed);
+
+        if (load_metrics(path) == 0)
+        {
+            memcpy(names[num_loaded++], claimed, sizeof(claimed));
+        }
+    }
+
+    return num_loaded;
+}
+
+/*
+ * Add the counts and durations of this run to the metrics file in 'dir'.
+ *
+ * Runs never wait for each other: the directory itself is locked with a
+ * non-blocking flock(2).  The run holding the lock folds the file, its
+ * own counts and those left pending by other runs into a new file, which
+ * replaces the old one atomically.  A run finding the directory locked
+ * writes its counts to a pending file of its own instead, for the next
+ * run to fold in.  Returns 0 or an errno value.
+ */
+int nv_metrics_update(const char *dir, const NvMetricsRun *run)
+{
+    static char pending[NV_METRICS_MAX_PENDING][NAME_MAX + 1];
+    char path[PATH_MAX];
+    int dir_fd, num_pending, i, ret;
+
+    dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0)
+    {
+        return errno;
+    }
+
+    add_run(run);
+
+    if (flock(dir_fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        struct timespec now;
+
+        /*
+         * The pid alone does not make the name unique: a later run could
+         * get the same pid before the next run holding the lock folds
+         * this file in, and replace it.
+         */
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        snprintf(path, sizeof(path), "%s/%s%d.%lld", dir,
+                 NV_METRICS_PENDING_PREFIX, (int) getpid(),
+                 (long long) now.tv_sec * 1000000000LL + now.tv_nsec);
+        ret = save_metrics(dir, path);
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, NV_METRICS_FILE);
+
+        load_metrics(path);
+        num_pending = load_pending_metrics(dir, dir_fd, pending,
+                                           NV_METRICS_MAX_PENDING);
+
+        ret = save_metrics(dir, path);
+
+        for (i = 0; (ret == 0) && (i < num_pending); i++)
+        {
+            unlinkat(dir_fd, pending[i], 0);
+        }
+    }
+
+    close(dir_fd);
+
+    nvfree(table.metrics);
+    memset(&table, 0, sizeof(table));
+
+    return ret;
+}
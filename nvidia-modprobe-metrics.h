@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Metrics for the node_exporter textfile collector: each run adds its
+ * counts and durations to NV_METRICS_FILE in the metrics directory, which
+ * is replaced atomically.  Concurrent runs do not wait for each other;
+ * see nv_metrics_update().
+ */
+
+#ifndef __NVIDIA_MODPROBE_METRICS_H__
+#define __NVIDIA_MODPROBE_METRICS_H__
+
+#include "nvidia-modprobe-output.h"
+
+#define NV_METRICS_DIR_ENV      "NVIDIA_MODPROBE_METRICS_DIR"
+#define NV_METRICS_FILE         "nvidia_modprobe.prom"
+#define NV_METRICS_MAX_MODES    16
+
+typedef struct {
+    /* the primary modes requested: "nvidia", "uvm", "bring-up", ... */
+    const char *modes[NV_METRICS_MAX_MODES];
+    int num_modes;
+
+    long long elapsed_ns;
+
+    /* operations performed by --bring-up; the steps have their own */
+    NvModprobeStats bringup_stats;
+
+    const NvOutputResult *result;
+} NvMetricsRun;
+
+const char *nv_metrics_get_dir(const char *requested);
+int nv_metrics_update(const char *dir, const NvMetricsRun *run);
+
+#endif /* __NVIDIA_MODPROBE_METRICS_H__ */
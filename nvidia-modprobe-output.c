@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "nvidia-modprobe-output.h"
+#include "common-utils.h"
+#include "msg.h"
+
+/*
+ * Spans reported by modprobe-utils for --timing.  The step graph workers
+ * report concurrently, hence the lock.
+ */
+
+typedef struct {
+    const char *name;
+    char arg[64];
+    long long ns;
+} TimingSpan;
+
+static struct {
+    pthread_mutex_t lock;
+    TimingSpan *spans;
+    int num_spans;
+    int max_spans;
+} timing = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+void nv_output_record_span(void *data, const char *name,
+                           const char *arg, long long ns)
+{
+    TimingSpan *span;
+
+    pthread_mutex_lock(&timing.lock);
+
+    if (timing.num_spans == timing.max_spans)
+    {
+        timing.max_spans = timing.max_spans ? timing.max_spans * 2 : 64;
+        timing.spans = nvrealloc(timing.spans,
+                                 timing.max_spans * sizeof(TimingSpan));
+    }
+
+    span = &timing.spans[timing.num_spans++];
+    span->name = name;
+    span->ns = ns;
+    snprintf(span->arg, sizeof(span->arg), "%s", arg ? arg : "");
+
+    pthread_mutex_unlock(&timing.lock);
+}
+
+void nv_output_print_timing(void)
+{
+    int i, j;
+
+    for (i = 0; i < timing.num_spans; i++)
+    {
+        const TimingSpan *span = &timing.spans[i];
+
+        nv_msg(NULL, "%-28s %-40s %10.3f ms", span->name, span->arg,
+               span->ns / 1000000.0);
+    }
+
+    /* Then the total for each phase, in order of first appearance. */
+
+    for (i = 0; i < timing.num_spans; i++)
+    {
+        long long total = 0;
+        int count = 0;
+
+        for (j = 0; j < i; j++)
+        {
+            if (strcmp(timing.spans[j].name, timing.spans[i].name) == 0)
+            {
+                break;
+            }
+        }
+
+        if (j < i)
+        {
+            continue;
+        }
+
+        for (j = i; j < timing.num_spans; j++)
+        {
+            if (strcmp(timing.spans[j].name, timing.spans[i].name) == 0)
+            {
+                total += timing.spans[j].ns;
+                count++;
+            }
+        }
+
+        nv_msg(NULL, "%-28s %-40s %10.3f ms (%d)", "total",
+               timing.spans[i].name, total / 1000000.0, count);
+    }
+}
+
+
+
+/*
+ * Call 'func' for each span recorded so far, in order.
+ */
+
+void nv_output_for_each_span(NvModprobeSpanFunc *func, void *data)
+{
+    int i;
+
+    for (i = 0; i < timing.num_spans; i++)
+    {
+        func(data, timing.spans[i].name, timing.spans[i].arg,
+             timing.spans[i].ns);
+    }
+}
+
+
+void nv_output_free(void)
+{
+    nvfree(timing.spans);
+    timing.spans = NULL;
+    timing.num_spans = timing.max_spans = 0;
+}
+
+
+/*
+ * Print 'str' as a JSON string.
+ */
+
+static void json_string(const char *str)
+{
+    const unsigned char *c;
+
+    if (str == NULL)
+    {
+        fputs("null", stdout);
+        return;
+    }
+
+    putchar('"');
+
+    for (c = (const unsigned char *) str; *c != '\0'; c++)
+    {
+        if ((*c == '"') || (*c == '\\'))
+        {
+            printf("\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            printf("\\u%04x", *c);
+        }
+        else
+        {
+            putchar(*c);
+        }
+    }
+
+    putchar('"');
+}
+
+
+static const char *json_bool(int value)
+{
+    return value ? "true" : "false";
+}
+
+
+/*
+ * Describe what a step changed, from the operations it performed.
+ */
+
+static void json_changes(const NvModprobeStats *stats)
+{
+    static const struct {
+        NvModprobeStat stat;
+        const char *change;
+    } changes[] = {
+        { NvModprobeStatSpawn,   "module" },
+        { NvModprobeStatMkdir,   "directory" },
+        { NvModprobeStatRemove,  "removed" },
+        { NvModprobeStatMknod,   "created" },
+        { NvModprobeStatChmod,   "mode" },
+        { NvModprobeStatChown,   "owner" },
+        { NvModprobeStatSymlink, "symlink" },
+        { NvModprobeStatWrite,   "sysfs" },
+    };
+    const char *sep = "";
+    int i;
+
+    putchar('[');
+
+    for (i = 0; i < ARRAY_LEN(changes); i++)
+    {
+        if (stats->count[changes[i].stat] != 0)
+        {
+            printf("%s\"%s\"", sep, changes[i].change);
+            sep = ", ";
+        }
+    }
+
+    putchar(']');
+}
+
+
+static void json_stats(const NvModprobeStats *stats)
+{
+    const char *sep = "";
+    int i;
+
+    putchar('{');
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        if (stats->count[i] != 0)
+        {
+            printf("%s\"%s\": %lu", sep, nvidia_modprobe_stat_name(i),
+                   stats->count[i]);
+            sep = ", ";
+        }
+    }
+
+    putchar('}');
+}
+
+
+static void json_step(const NvStep *step)
+{
+    printf("    {\"name\": ");
+    json_string(step->name);
+    printf(", \"kind\": ");
+    json_string(step->kind);
+    printf(", \"result\": ");
+    json_string(nv_step_state_name(step->state));
+    printf(", \"elapsed_ns\": %lld", step->elapsed_ns);
+
+    if (step->minor >= 0)
+    {
+        printf(", \"minor\": %d", step->minor);
+    }
+
+    if (step->path != NULL)
+    {
+        printf(", \"path\": ");
+        json_string(step->path);
+    }
+
+    if (step->file_state >= 0)
+    {
+        printf(", \"file_state\": {\"value\": %d, \"file_exists\": %s, "
+               "\"chrdev_ok\": %s, \"permissions_ok\": %s}",
+               step->file_state,
+               json_bool(nvidia_test_file_state(step->file_state,
+                                                NvDeviceFileStateFileExists)),
+               json_bool(nvidia_test_file_state(step->file_state,
+                                                NvDeviceFileStateChrDevOk)),
+               json_bool(nvidia_test_file_state(step->file_state,
+                                                NvDeviceFileStatePermissionsOk)));
+    }
+
+    printf(", \"changed\": ");
+    json_changes(&step->stats);
+    printf(", \"stats\": ");
+    json_stats(&step->stats);
+    putchar('}');
+}
+
+
+static void json_bringup_gpu(const NvBringupGpu *gpu)
+{
+    char bdf[32];
+    int stage;
+
+    snprintf(bdf, sizeof(bdf), "%04x:%02x:%02x.%x", gpu->bridge.domain,
+             gpu->bridge.bus, gpu->bridge.dev, gpu->bridge.ftn);
+
+    printf("    {\"bridge\": ");
+    json_string(bdf);
+
+    if (gpu->stage > NvBringupStageRescan)
+    {
+        snprintf(bdf, sizeof(bdf), "%04x:%02x:%02x.%x", gpu->gpu.domain,
+                 gpu->gpu.bus, gpu->gpu.dev, gpu->gpu.ftn);
+        printf(", \"gpu\": ");
+        json_string(bdf);
+    }
+
+    if (gpu->minor >= 0)
+    {
+        printf(", \"minor\": %d", gpu->minor);
+    }
+
+    printf(", \"result\": \"%s\"", gpu->failed ? "failed" : "succeeded");
+
+    if (gpu->failed)
+    {
+        printf(", \"failed_stage\": ");
+        json_string(nv_bringup_stage_name(gpu->stage));
+        if (gpu->error != 0)
+        {
+            printf(", \"error\": ");
+            json_string(strerror(gpu->error));
+        }
+    }
+
+    printf(", \"stages\": {");
+
+    for (stage = 0; stage <= NV_MIN(gpu->stage, NV_BRINGUP_NUM_STAGES - 1);
+         stage++)
+    {
+        printf("%s\"%s_ns\": %lld", stage ? ", " : "",
+               nv_bringup_stage_name(stage), gpu->stage_ns[stage]);
+    }
+
+    printf("}}");
+}
+
+
+/*
+ * nv_output_print_json() - print the result of the run as a JSON object
+ * on stdout.
+ */
+
+void nv_output_print_json(const NvOutputResult *result)
+{
+    int i;
+
+    printf("{\n");
+    printf("  \"version\": ");
+    json_string(NVIDIA_VERSION);
+    printf(",\n");
+    printf("  \"exit_status\": %d,\n", result->exit_status);
+    printf("  \"out_of_time\": %s,\n", json_bool(result->out_of_time));
+
+    printf("  \"steps\": [");
+    for (i = 0; i < result->graph->num_steps; i++)
+    {
+        printf("%s\n", i ? "," : "");
+        json_step(&result->graph->steps[i]);
+    }
+    printf("%s],\n", result->graph->num_steps ? "\n  " : "");
+
+    printf("  \"bring_up\": [");
+    for (i = 0; i < result->num_gpus; i++)
+    {
+        printf("%s\n", i ? "," : "");
+        json_bringup_gpu(&result->gpus[i]);
+    }
+    printf("%s],\n", result->num_gpus ? "\n  " : "");
+
+    printf("  \"spans\": [");
+    for (i = 0; i < timing.num_spans; i++)
+    {
+        const TimingSpan *span = &timing.spans[i];
+
+        printf("%s\n    {\"name\": ", i ? "," : "");
+        json_string(span->name);
+        printf(", \"arg\": ");
+        json_string(span->arg);
+        printf(", \"ns\": %lld}", span->ns);
+    }
+    printf("%s]\n", timing.num_spans ? "\n  " : "");
+
+    printf("}\n");
+}
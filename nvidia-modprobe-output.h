@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reporting of the results of a run: the --timing spans, and the
+ * machine-readable --output=json document.
+ */
+
+#ifndef __NVIDIA_MODPROBE_OUTPUT_H__
+#define __NVIDIA_MODPROBE_OUTPUT_H__
+
+#include "nvidia-modprobe-steps.h"
+#include "nvidia-modprobe-bringup.h"
+
+typedef struct {
+    int exit_status;
+    int out_of_time;
+
+    const NvStepGraph *graph;
+
+    const NvBringupGpu *gpus;
+    int num_gpus;
+} NvOutputResult;
+
+void nv_output_record_span(void *data, const char *name,
+                           const char *arg, long long ns);
+void nv_output_print_timing(void);
+void nv_output_for_each_span(NvModprobeSpanFunc *func, void *data);
+void nv_output_print_json(const NvOutputResult *result);
+void nv_output_free(void);
+
+#endif /* __NVIDIA_MODPROBE_OUTPUT_H__ */
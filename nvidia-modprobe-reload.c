@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "nvidia-modprobe-reload.h"
+#include "common-utils.h"
+#include "msg.h"
+
+typedef struct {
+    NvModprobeContext *ctx;
+    NvDriverReload *reload;
+    int module;
+    pthread_mutex_t *lock;
+} NvReloadThread;
+
+
+static long long elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+
+static void add_stats(NvModprobeStats *stats, const NvModprobeStats *before)
+{
+    NvModprobeStats after;
+    int i;
+
+    nvidia_modprobe_get_stats(&after);
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        stats->count[i] += after.count[i] - before->count[i];
+    }
+}
+
+
+static void *unload_worker(void *arg)
+{
+    NvReloadThread *thread = arg;
+    NvDriverReload *reload = thread->reload;
+    NvModprobeContext ctx = *thread->ctx;
+    NvModprobeStats before;
+
+    nvidia_modprobe_get_stats(&before);
+
+    nvidia_unload_driver_module_ctx(&ctx, &reload->plan, thread->module);
+
+    pthread_mutex_lock(thread->lock);
+    add_stats(&reload->stats, &before);
+    pthread_mutex_unlock(thread->lock);
+
+    return NULL;
+}
+
+
+/*
+ * Unload the modules of a wave, one thread each; the modules of the wave
+ * only record their own results in the plan.  If a thread cannot be
+ * created, its module is unloaded from here, where its operations are
+ * counted along with the rest of the calling thread's by nv_reload_run().
+ */
+
+static void unload_wave(NvModprobeContext *ctx, NvDriverReload *reload,
+                        int wave, pthread_mutex_t *lock)
+{
+    NvModprobeDriverPlan *plan = &reload->plan;
+    pthread_t threads[NV_MODPROBE_MAX_DRIVER_MODULES];
+    int created[NV_MODPROBE_MAX_DRIVER_MODULES];
+    NvReloadThread args[NV_MODPROBE_MAX_DRIVER_MODULES];
+    int i;
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        created[i] = 0;
+
+        if (plan->modules[i].wave != wave)
+        {
+            continue;
+        }
+
+        args[i].ctx = ctx;
+        args[i].reload = reload;
+        args[i].module = i;
+        args[i].lock = lock;
+
+        created[i] = (pthread_create(&threads[i], NULL,
+                                     unload_worker, &args[i]) == 0);
+    }
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        if (plan->modules[i].wave != wave)
+        {
+            continue;
+        }
+
+        if (created[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            nvidia_unload_driver_module_ctx(ctx, plan, i);
+        }
+    }
+}
+
+
+/*
+ * nv_reload_run() - plan the reload of the NVIDIA driver and, if apply is
+ * set, carry it out: unload its modules wave by wave, and load again
+ * those that were unloaded, with their device files.  If a module cannot
+ * be unloaded, the processes holding NVIDIA device files open are looked
+ * for; in plan mode they always are.  Returns the number of modules that
+ * could not be unloaded, loaded again or given their device files again,
+ * or 1 if /proc/modules cannot be read.
+ */
+
+int nv_reload_run(NvModprobeContext *ctx, int apply, NvDriverReload *reload)
+{
+    NvModprobeDriverPlan *plan = &reload->plan;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    NvModprobeStats before;
+    struct timespec start, phase;
+    int i, wave, blocked = 0, num_failed = 0;
+
+    memset(reload, 0, sizeof(*reload));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nvidia_modprobe_get_stats(&before);
+
+    if (!nvidia_plan_driver_reload_ctx(ctx, plan))
+    {
+        add_stats(&reload->stats, &before);
+        reload->elapsed_ns = elapsed_ns(&start);
+        return 1;
+    }
+
+    if (!apply)
+    {
+        nvidia_find_driver_users_ctx(ctx, plan);
+        add_stats(&reload->stats, &before);
+        reload->elapsed_ns = elapsed_ns(&start);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+
+    for (wave = 0; wave < plan->num_waves; wave++)
+    {
+        unload_wave(ctx, reload, wave, &lock);
+    }
+
+    reload->unload_ns = elapsed_ns(&phase);
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        if (plan->modules[i].unloaded)
+        {
+            reload->num_unloaded++;
+        }
+        else
+        {
+            blocked = 1;
+        }
+    }
+
+    /* Find out what keeps the driver loaded before loading it again. */
+
+    if (blocked)
+    {
+        nvidia_find_driver_users_ctx(ctx, plan);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+
+    nvidia_reload_driver_ctx(ctx, plan);
+
+    reload->reload_ns = elapsed_ns(&phase);
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        const NvModprobeDriverModule *module = &plan->modules[i];
+
+        if (module->reloaded)
+        {
+            reload->num_reloaded++;
+        }
+
+        if (!module->unloaded || !module->reloaded || !module->recreated)
+        {
+            num_failed++;
+        }
+    }
+
+    add_stats(&reload->stats, &before);
+    reload->elapsed_ns = elapsed_ns(&start);
+
+    return num_failed;
+}
+
+
+/*
+ * Print the reasons a module cannot be unloaded, with the given indent:
+ * the modules using it, and the processes holding its device files open.
+ */
+
+static void print_blockers(const NvModprobeDriverPlan *plan, int index,
+                           const char *indent)
+{
+    const NvModprobeDriverModule *module = &plan->modules[index];
+    int i;
+
+    for (i = 0; i < module->num_holders; i++)
+    {
+        const NvModprobeDriverModule *holder =
+            &plan->modules[module->holders[i]];
+
+        if (!holder->unloaded)
+        {
+            nv_msg(indent, "used by %s", holder->name);
+        }
+    }
+
+    if (module->other_holders[0] != '\0')
+    {
+        nv_msg(indent, "used by %s", module->other_holders);
+    }
+
+    for (i = 0; i < NV_MIN(plan->num_users, NV_MODPROBE_MAX_MODULE_USERS); i++)
+    {
+        const NvModprobeModuleUser *user = &plan->users[i];
+
+        if (user->module == index)
+        {
+            nv_msg(indent, "held open by %s (pid %d): %s", user->comm,
+                   (int) user->pid, user->path);
+        }
+    }
+}
+
+
+/*
+ * nv_reload_print_plan() - print, for each unload wave, its modules with
+ * their reference counts and users.
+ */
+
+void nv_reload_print_plan(const NvDriverReload *reload)
+{
+    const NvModprobeDriverPlan *plan = &reload->plan;
+    int i, wave;
+
+    if (plan->num_modules == 0)
+    {
+        nv_msg(NULL, "No NVIDIA kernel module is loaded");
+        return;
+    }
+
+    for (wave = 0; wave < plan->num_waves; wave++)
+    {
+        nv_msg(NULL, "Unload wave %d:", wave);
+
+        for (i = 0; i < plan->num_modules; i++)
+        {
+            const NvModprobeDriverModule *module = &plan->modules[i];
+
+            if (module->wave != wave)
+            {
+                continue;
+            }
+
+            nv_msg(TAB, "%s: reference count %d", module->name,
+                   module->refcount);
+            print_blockers(plan, i, BIGTAB);
+        }
+    }
+
+    if (plan->num_users > NV_MODPROBE_MAX_MODULE_USERS)
+    {
+        nv_msg(NULL, "NVIDIA device files are held open %d more times",
+               plan->num_users - NV_MODPROBE_MAX_MODULE_USERS);
+    }
+}
+
+
+/*
+ * nv_reload_report() - print the time taken to unload and load again each
+ * module, the reasons the modules left loaded could not be unloaded, and
+ * a summary.
+ */
+
+void nv_reload_report(const NvDriverReload *reload)
+{
+    const NvModprobeDriverPlan *plan = &reload->plan;
+    long long us = reload->elapsed_ns / 1000;
+    long long unload_us = reload->unload_ns / 1000;
+    long long reload_us = reload->reload_ns / 1000;
+    int i;
+
+    for (i = 0; i < plan->num_modules; i++)
+    {
+        const NvModprobeDriverModule *module = &plan->modules[i];
+        long long module_unload_us = module->unload_ns / 1000;
+        long long module_reload_us = module->reload_ns / 1000;
+
+        if (!module->unloaded)
+        {
+            nv_msg(NULL, "%s: not unloaded: %s", module->name,
+                   strerror(module->unload_error));
+            print_blockers(plan, i, TAB);
+            continue;
+        }
+
+        nv_msg(NULL, "%s: unloaded in %lld.%03lld ms, %s in %lld.%03lld ms",
+               module->name, module_unload_us / 1000, module_unload_us % 1000,
+               module->reloaded ? "loaded" : "failed to load",
+               module_reload_us / 1000, module_reload_us % 1000);
+
+        if (module->reloaded && !module->recreated)
+        {
+            nv_msg(TAB, "failed to create its device files again");
+        }
+    }
+
+    if (plan->num_users > NV_MODPROBE_MAX_MODULE_USERS)
+    {
+        nv_msg(NULL, "NVIDIA device files are held open %d more times",
+               plan->num_users - NV_MODPROBE_MAX_MODULE_USERS);
+    }
+
+    nv_msg(NULL, "Reloaded %d of %d NVIDIA kernel modules in %lld.%03lld ms "
+           "(unloading %lld.%03lld ms, loading %lld.%03lld ms)",
+           reload->num_reloaded, plan->num_modules, us / 1000, us % 1000,
+           unload_us / 1000, unload_us % 1000,
+           reload_us / 1000, reload_us % 1000);
+}
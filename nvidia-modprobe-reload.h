@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Reloading of the NVIDIA kernel modules, e.g. after a driver update: the
+ * modules are unloaded in waves, the modules of a wave (those no longer
+ * used by any other NVIDIA module) concurrently, one thread each, and
+ * then loaded again, with their device files.  When a module cannot be
+ * unloaded, the modules and processes keeping it loaded are reported.
+ */
+
+#ifndef __NVIDIA_MODPROBE_RELOAD_H__
+#define __NVIDIA_MODPROBE_RELOAD_H__
+
+#include "nvidia-modprobe-utils.h"
+
+typedef struct {
+    NvModprobeDriverPlan plan;
+    int num_unloaded;
+    int num_reloaded;
+    long long unload_ns;
+    long long reload_ns;
+    long long elapsed_ns;
+
+    /* operations performed by all the threads */
+    NvModprobeStats stats;
+} NvDriverReload;
+
+int nv_reload_run(NvModprobeContext *ctx, int apply, NvDriverReload *reload);
+void nv_reload_print_plan(const NvDriverReload *reload);
+void nv_reload_report(const NvDriverReload *reload);
+
+#endif /* __NVIDIA_MODPROBE_RELOAD_H__ */
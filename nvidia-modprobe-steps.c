@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "nvidia-modprobe-steps.h"
+#include "common-utils.h"
+
+/*
+ * Steps whose dependencies have all succeeded wait in a FIFO threaded
+ * through NvStep.next_ready, so that picking the next step to run, and
+ * finishing one, only touch the steps involved rather than rescanning
+ * the whole graph under the lock.
+ */
+
+typedef struct {
+    NvStepGraph *graph;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int ready_head;
+    int ready_tail;
+    int num_done;
+    int num_not_succeeded;
+} NvStepRun;
+
+
+void nv_step_graph_init(NvStepGraph *graph)
+{
+    memset(graph, 0, sizeof(*graph));
+    graph->steps = graph->inline_steps;
+    graph->max_steps = NV_STEP_GRAPH_INLINE_STEPS;
+}
+
+
+void nv_step_graph_free(NvStepGraph *graph)
+{
+    if (graph->steps != graph->inline_steps)
+    {
+        nvfree(graph->steps);
+    }
+    nv_step_graph_init(graph);
+}
+
+
+/*
+ * nv_step_graph_add() - append a step of the given kind to the graph;
+ * returns its index.  The step name is formatted from fmt.
+ */
+
+int nv_step_graph_add(NvStepGraph *graph, const char *kind, NvStepFunc *func,
+                      int minor, const char *path, const char *fmt, ...)
+{
+    NvStep *step;
+    va_list ap;
+
+    if (graph->num_steps == graph->max_steps)
+    {
+        graph->max_steps *= 2;
+        if (graph->steps == graph->inline_steps)
+        {
+            graph->steps = nvalloc(graph->max_steps * sizeof(NvStep));
+            memcpy(graph->steps, graph->inline_steps,
+                   graph->num_steps * sizeof(NvStep));
+        }
+        else
+        {
+            graph->steps = nvrealloc(graph->steps,
+                                     graph->max_steps * sizeof(NvStep));
+        }
+    }
+
+    step = &graph->steps[graph->num_steps];
+    memset(step, 0, sizeof(*step));
+
+    va_start(ap, fmt);
+    vsnprintf(step->name, sizeof(step->name), fmt, ap);
+    va_end(ap);
+
+    step->kind = kind;
+    step->func = func;
+    step->file_state = -1;
+    step->minor = minor;
+    step->path = path;
+    step->state = NvStepPending;
+    step->first_dependent = -1;
+    step->next_ready = -1;
+
+    return graph->num_steps++;
+}
+
+
+/*
+ * nv_step_graph_depend() - make 'step' depend on 'dep'.  A step can only
+ * depend on steps added before it, which keeps the graph acyclic.  A
+ * negative 'dep' is ignored, so that callers can pass the index of an
+ * optional step unconditionally.
+ */
+
+void nv_step_graph_depend(NvStepGraph *graph, int step, int dep)
+{
+    NvStep *s = &graph->steps[step];
+    NvStep *d;
+
+    if ((dep < 0) || (dep >= step) || (s->num_deps >= NV_STEP_MAX_DEPS))
+    {
+        return;
+    }
+
+    d = &graph->steps[dep];
+
+    s->next_dependent[s->num_deps] = d->first_dependent;
+    d->first_dependent = step * NV_STEP_MAX_DEPS + s->num_deps;
+
+    s->deps[s->num_deps++] = dep;
+}
+
+
+/*
+ * nv_step_graph_set_file_state_func() - have the state of the device
+ * file created by 'step' recorded once the step has run.
+ */
+
+void nv_step_graph_set_file_state_func(NvStepGraph *graph, int step,
+                                       NvStepFileStateFunc *func)
+{
+    graph->steps[step].file_state_func = func;
+}
+
+
+/*
+ * Append step i to the ready queue.  Must be called with run->lock held.
+ */
+
+static void push_ready_step(NvStepRun *run, int i)
+{
+    NvStep *steps = run->graph->steps;
+
+    steps[i].next_ready = -1;
+
+    if (run->ready_tail < 0)
+    {
+        run->ready_head = i;
+    }
+    else
+    {
+        steps[run->ready_tail].next_ready = i;
+    }
+
+    run->ready_tail = i;
+}
+
+
+/*
+ * Remove the oldest step from the ready queue.  Must be called with
+ * run->lock held; returns -1 if no step is ready.
+ */
+
+static int pop_ready_step(NvStepRun *run)
+{
+    NvStep *steps = run->graph->steps;
+    int i = run->ready_head;
+
+    if (i >= 0)
+    {
+        run->ready_head = steps[i].next_ready;
+        if (run->ready_head < 0)
+        {
+            run->ready_tail = -1;
+        }
+    }
+
+    return i;
+}
+
+
+/*
+ * Record the final state of step i, then walk the steps depending on it:
+ * queue those whose last dependency just succeeded, or, if step i did
+ * not succeed, give up on the ones still pending (and, recursively, on
+ * their own dependents).  Must be called with run->lock held.
+ */
+
+static void finish_step(NvStepRun *run, int i, NvStepState state)
+{
+    NvStep *steps = run->graph->steps;
+    int link;
+
+    steps[i].state = state;
+    run->num_done++;
+    if (state != NvStepSucceeded)
+    {
+        run->num_not_succeeded++;
+    }
+
+    for (link = steps[i].first_dependent; link >= 0;
+         link = steps[link / NV_STEP_MAX_DEPS].
+                    next_dependent[link % NV_STEP_MAX_DEPS])
+    {
+        int d = link / NV_STEP_MAX_DEPS;
+
+        if (steps[d].state != NvStepPending)
+        {
+            continue;
+        }
+
+        if (state == NvStepSucceeded)
+        {
+            if (--steps[d].num_waiting == 0)
+            {
+                push_ready_step(run, d);
+            }
+        }
+        else
+        {
+            finish_step(run, d, (state == NvStepNotStarted) ?
+                                NvStepNotStarted : NvStepSkipped);
+        }
+    }
+}
+
+
+static void *step_worker(void *arg)
+{
+    NvStepRun *run = arg;
+    NvStepGraph *graph = run->graph;
+    NvModprobeContext ctx;
+    NvModprobeStats before;
+    struct timespec start, end;
+
+    if (graph->ctx != NULL)
+    {
+        ctx = *graph->ctx;
+    }
+    else
+    {
+        nvidia_modprobe_context_init(&ctx);
+    }
+
+    pthread_mutex_lock(&run->lock);
+
+    while (run->num_done < graph->num_steps)
+    {
+        NvStep *step;
+        int i, j, ok;
+
+        i = pop_ready_step(run);
+
+        if (i < 0)
+        {
+            pthread_cond_wait(&run->cond, &run->lock);
+            continue;
+        }
+
+        step = &graph->steps[i];
+
+        if (nvidia_modprobe_context_out_of_time(&ctx))
+        {
+            finish_step(run, i, NvStepNotStarted);
+            pthread_cond_broadcast(&run->cond);
+            continue;
+        }
+
+        step->state = NvStepRunning;
+
+        pthread_mutex_unlock(&run->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        nvidia_modprobe_get_stats(&before);
+
+        ok = step->func(&ctx, step);
+
+        nvidia_modprobe_get_stats(&step->stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        step->elapsed_ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+                           (end.tv_nsec - start.tv_nsec);
+
+        for (j = 0; j < NvModprobeNumStats; j++)
+        {
+            step->stats.count[j] -= before.count[j];
+        }
+
+        if (step->file_state_func != NULL)
+        {
+            step->file_state = step->file_state_func(&ctx, step);
+        }
+
+        pthread_mutex_lock(&run->lock);
+
+        finish_step(run, i, ok ? NvStepSucceeded : NvStepFailed);
+
+        pthread_cond_broadcast(&run->cond);
+    }
+
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+
+    return NULL;
+}
+
+
+/*
+ * nv_step_graph_run() - run every step of the graph, using up to 'jobs'
+ * threads (including the calling thread).  Each thread uses its own
+ * modprobe-utils context, so the log and timing callbacks of graph->ctx,
+ * if any, must be thread-safe.  Returns the number of steps that did not
+ * succeed.
+ */
+
+int nv_step_graph_run(NvStepGraph *graph, int jobs)
+{
+    pthread_t threads[NV_STEP_MAX_JOBS];
+    int num_threads = 0;
+    NvStepRun run;
+    int i;
+
+    memset(&run, 0, sizeof(run));
+    run.graph = graph;
+    run.ready_head = -1;
+    run.ready_tail = -1;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+
+    for (i = 0; i < graph->num_steps; i++)
+    {
+        NvStep *step = &graph->steps[i];
+
+        step->num_waiting = step->num_deps;
+        if (step->num_waiting == 0)
+        {
+            push_ready_step(&run, i);
+        }
+    }
+
+    jobs = NV_MAX(jobs, 1);
+    jobs = NV_MIN(jobs, NV_STEP_MAX_JOBS);
+    jobs = NV_MIN(jobs, NV_MAX(graph->num_steps, 1));
+
+    /*
+     * If a thread cannot be created, carry on with the ones we have: the
+     * calling thread alone is enough to run the whole graph.
+     */
+
+    for (i = 1; i < jobs; i++)
+    {
+        if (pthread_create(&threads[num_threads], NULL,
+                           step_worker, &run) == 0)
+        {
+            num_threads++;
+        }
+    }
+
+    step_worker(&run);
+
+    for (i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+
+    return run.num_not_succeeded;
+}
+
+
+const char *nv_step_state_name(NvStepState state)
+{
+    switch (state)
+    {
+        case NvStepPending:    return "pending";
+        case NvStepRunning:    return "running";
+        case NvStepSucceeded:  return "succeeded";
+        case NvStepFailed:     return "failed";
+        case NvStepSkipped:    return "skipped";
+        case NvStepNotStarted: return "not started";
+    }
+
+    return "unknown";
+}
+
+
+/*
+ * nv_step_graph_report() - print the result of each step.
+ */
+
+void nv_step_graph_report(const NvStepGraph *graph)
+{
+    int i;
+
+    for (i = 0; i < graph->num_steps; i++)
+    {
+        const NvStep *step = &graph->steps[i];
+
+        nv_msg(NULL, "%-48s %s", step->name, nv_step_state_name(step->state));
+    }
+}
+
+
+/*
+ * nv_step_print_stats() - print the non-zero operation counts of 'stats'
+ * on one line.
+ */
+
+void nv_step_print_stats(const char *name, const NvModprobeStats *stats)
+{
+    char buf[256];
+    int len = 0;
+    int i;
+
+    buf[0] = '\0';
+
+    for (i = 0; i < NvModprobeNumStats; i++)
+    {
+        if ((stats->count[i] != 0) && (len < sizeof(buf)))
+        {
+            len += snprintf(buf + len, sizeof(buf) - len, " %s %lu",
+                            nvidia_modprobe_stat_name(i), stats->count[i]);
+        }
+    }
+
+    nv_msg(NULL, "%-48s%s", name, buf);
+}
+
+
+/*
+ * nv_step_graph_report_stats() - print the operations performed by each
+ * step, followed by their total.
+ */
+
+void nv_step_graph_report_stats(const NvStepGraph *graph)
+{
+    NvModprobeStats total;
+    int i, j;
+
+    memset(&total, 0, sizeof(total));
+
+    for (i = 0; i < graph->num_steps; i++)
+    {
+        const NvStep *step = &graph->steps[i];
+
+        nv_step_print_stats(step->name, &step->stats);
+
+        for (j = 0; j < NvModprobeNumStats; j++)
+        {
+            total.count[j] += step->stats.count[j];
+        }
+    }
+
+    nv_step_print_stats("total", &total);
+}
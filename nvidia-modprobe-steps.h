@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The work requested on the nvidia-modprobe commandline is described as
+ * a graph of steps: each step (load a kernel module, create a device
+ * file, ...) runs once all the steps it depends on have succeeded, and
+ * is skipped if any of them did not.  Independent steps may run
+ * concurrently on a bounded pool of worker threads.  If the graph's
+ * context has a deadline, steps not started by then are left as not
+ * started, and so are the steps depending on them.
+ */
+
+#ifndef __NVIDIA_MODPROBE_STEPS_H__
+#define __NVIDIA_MODPROBE_STEPS_H__
+
+#include "nvidia-modprobe-utils.h"
+#include "msg.h"
+
+#define NV_STEP_NAME_LEN        64
+#define NV_STEP_MAX_DEPS        4
+#define NV_STEP_MAX_JOBS        64
+
+typedef enum {
+    NvStepPending = 0,
+    NvStepRunning,
+    NvStepSucceeded,
+    NvStepFailed,
+    NvStepSkipped,
+    NvStepNotStarted
+} NvStepState;
+
+typedef struct NvStepRec NvStep;
+
+/*
+ * Step function: returns 1 on success and 0 on failure, following the
+ * modprobe-utils convention.
+ */
+typedef int NvStepFunc(NvModprobeContext *ctx, const NvStep *step);
+
+/*
+ * Device file state function: returns the NvDeviceFileState bits of the
+ * device file created by a step.
+ */
+typedef int NvStepFileStateFunc(NvModprobeContext *ctx, const NvStep *step);
+
+struct NvStepRec {
+    char name[NV_STEP_NAME_LEN];
+    const char *kind;           /* "module", "node", ... */
+    NvStepFunc *func;
+    NvStepFileStateFunc *file_state_func;
+
+    /* arguments for func */
+    int minor;
+    const char *path;
+
+    int deps[NV_STEP_MAX_DEPS];
+    int num_deps;
+
+    /*
+     * Steps depending on this one, as a list threaded through their
+     * next_dependent[] entries: each link is the dependent's index times
+     * NV_STEP_MAX_DEPS plus the slot of this step in its deps[], and -1
+     * ends the list.
+     */
+    int first_dependent;
+    int next_dependent[NV_STEP_MAX_DEPS];
+
+    /* scheduling state of nv_step_graph_run() */
+    int num_waiting;            /* dependencies that have not succeeded */
+    int next_ready;             /* next step in the ready queue, or -1 */
+
+    NvStepState state;
+    long long elapsed_ns;
+    int file_state;             /* -1 if there is no file_state_func */
+
+    /* operations performed by func; see nvidia_modprobe_get_stats() */
+    NvModprobeStats stats;
+};
+
+/*
+ * Number of steps a graph holds without allocating: enough for the
+ * modules and device files of a few GPUs, so that the common case does
+ * not touch the heap.
+ */
+#define NV_STEP_GRAPH_INLINE_STEPS 16
+
+typedef struct {
+    NvStep *steps;              /* inline_steps, until the graph outgrows it */
+    int num_steps;
+    int max_steps;
+    NvStep inline_steps[NV_STEP_GRAPH_INLINE_STEPS];
+
+    /*
+     * Optional context the workers' contexts are copied from, to share
+     * its log sink, timing callback and deadline.
+     */
+    const NvModprobeContext *ctx;
+} NvStepGraph;
+
+void nv_step_graph_init(NvStepGraph *graph);
+void nv_step_graph_free(NvStepGraph *graph);
+int nv_step_graph_add(NvStepGraph *graph, const char *kind, NvStepFunc *func,
+                      int minor, const char *path, const char *fmt, ...)
+    NV_ATTRIBUTE_PRINTF(6, 7);
+void nv_step_graph_depend(NvStepGraph *graph, int step, int dep);
+void nv_step_graph_set_file_state_func(NvStepGraph *graph, int step,
+                                       NvStepFileStateFunc *func);
+int nv_step_graph_run(NvStepGraph *graph, int jobs);
+void nv_step_graph_report(const NvStepGraph *graph);
+void nv_step_graph_report_stats(const NvStepGraph *graph);
+
+void nv_step_print_stats(const char *name, const NvModprobeStats *stats);
+
+const char *nv_step_state_name(NvStepState state);
+
+#endif /* __NVIDIA_MODPROBE_STEPS_H__ */
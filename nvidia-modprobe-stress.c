@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nvidia-modprobe-stress: many nvidia-modprobe processes started at once
+ * against one fake tree built by gen-fake-root.sh, as when every rank of
+ * a large job initializes CUDA at the same time.  Run through
+ * "make stress".
+ *
+ *   nvidia-modprobe-stress [-n PROCS] [-r ROUNDS] [-S SEED]
+ *                          [-m NVIDIA-MODPROBE] [-g GEN-FAKE-ROOT] DIR
+ *
+ * Each round removes the device files of the tree, forks PROCS (at most
+ * NV_STRESS_MAX_PROCS) processes and releases them together; each runs
+ * nvidia-modprobe --output=json with a random mix of -c, -u, -m, -f and
+ * -i requests.  The report gives:
+ *
+ * - the distribution of the completion times, from the release to the
+ *   exit of each process;
+ *
+ * - the failed processes and device file steps: since the same requests
+ *   succeed when run alone against the tree, failed device file steps
+ *   come from processes racing in the stat()/remove()/mknod() sequence
+ *   of mknod_helper();
+ *
+ * - the distribution of the time spent creating each device file (the
+ *   "mknod" timing spans), alone and under contention: nvidia-modprobe
+ *   does not lock or coalesce device file creation across processes, so
+ *   this is where contention, or the wait for such a lock, shows up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "nvidia-modprobe-bench-utils.h"
+
+#define NV_STRESS_MAX_PROCS     512
+#define NV_STRESS_MAX_ARGS      64
+#define NV_STRESS_GPUS          8
+#define NV_STRESS_CAPS          8
+#define NV_STRESS_CHANNELS      8
+
+typedef struct {
+    long long *ns;
+    int n;
+    int size;
+} StressSamples;
+
+typedef struct {
+    pid_t pid;
+    long long ns;
+    int status;
+    char *argv[NV_STRESS_MAX_ARGS];
+    char args[NV_STRESS_MAX_ARGS][64];
+} StressProc;
+
+static const char *gen_fake_root = "./gen-fake-root.sh";
+static const char *nvidia_modprobe_path = "./nvidia-modprobe";
+static int num_procs = 64;
+static int rounds = 10;
+
+static StressProc procs[NV_STRESS_MAX_PROCS];
+
+static StressSamples completion;
+static StressSamples mknod_solo;
+static StressSamples mknod_contended;
+
+static int failed_procs;
+static int failed_nodes;
+static int failed_caps;
+static int failed_channels;
+
+
+static void add_sample(StressSamples *samples, long long ns)
+{
+    if (samples->n == samples->size)
+    {
+        long long *new_ns;
+
+        samples->size = samples->size ? samples->size * 2 : 1024;
+        new_ns = realloc(samples->ns, samples->size * sizeof(*new_ns));
+        if (new_ns == NULL)
+        {
+            fprintf(stderr, "nvidia-modprobe-stress: out of memory.\n");
+            exit(1);
+        }
+        samples->ns = new_ns;
+    }
+
+    samples->ns[samples->n++] = ns;
+}
+
+static void print_samples(const char *name, StressSamples *samples)
+{
+    long long *ns = samples->ns;
+    int n = samples->n;
+
+    if (n == 0)
+    {
+        printf("%-24s %12s\n", name, "-");
+        return;
+    }
+
+    qsort(ns, n, sizeof(ns[0]), bench_compare_ns);
+
+    printf("%-24s %12.1f %12.1f %12.1f %10d\n", name,
+           ns[(n - 1) * 50 / 100] / 1000.0, ns[(n - 1) * 99 / 100] / 1000.0,
+           ns[n - 1] / 1000.0, n);
+}
+
+
+/*
+ * Pick the requests of a process: one or two GPUs, and each of UVM,
+ * modeset, a capability and an IMEX channel half the time or so.
+ */
+static void pick_args(StressProc *proc, unsigned int *seed)
+{
+    int argc = 0, i;
+
+#define ADD_ARG(...)                                                    \
+    do {                                                                \
+        snprintf(proc->args[argc], sizeof(proc->args[argc]), __VA_ARGS__); \
+        proc->argv[argc] = proc->args[argc];                            \
+        argc++;                                                         \
+    } while (0)
+
+    ADD_ARG("nvidia-modprobe");
+    ADD_ARG("--output=json");
+
+    for (i = 0; i < 1 + (rand_r(seed) % 2); i++)
+    {
+        ADD_ARG("-c");
+        ADD_ARG("%d", rand_r(seed) % NV_STRESS_GPUS);
+    }
+
+    if (rand_r(seed) % 2)
+    {
+        ADD_ARG("-u");
+    }
+
+    if (rand_r(seed) % 4 == 0)
+    {
+        ADD_ARG("-m");
+    }
+
+    if (rand_r(seed) % 2)
+    {
+        ADD_ARG("-f");
+        ADD_ARG("/proc/driver/nvidia/capabilities/cap%d",
+                rand_r(seed) % NV_STRESS_CAPS);
+    }
+
+    if (rand_r(seed) % 2)
+    {
+        ADD_ARG("-i");
+        ADD_ARG("%d:1", rand_r(seed) % NV_STRESS_CHANNELS);
+    }
+
+#undef ADD_ARG
+
+    proc->argv[argc] = NULL;
+}
+
+
+/*
+ * Account for the --output=json result of a process: its failed device
+ * file steps and its "mknod" spans.
+ */
+static int parse_output(const char *path, StressSamples *mknod)
+{
+    char line[1024];
+    const char *p;
+    long long ns;
+    int failed = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (strstr(line, "\"result\": \"failed\"") != NULL)
+        {
+            if (strstr(line, "\"kind\": \"node\"") != NULL)
+            {
+                failed_nodes++;
+                failed++;
+            }
+            else if (strstr(line, "\"kind\": \"cap\"") != NULL)
+            {
+                failed_caps++;
+                failed++;
+            }
+            else if (strstr(line, "\"kind\": \"imex-channel\"") != NULL)
+            {
+                failed_channels++;
+                failed++;
+            }
+        }
+        else if ((strstr(line, "{\"name\": \"mknod\"") != NULL) &&
+                 ((p = strstr(line, "\"ns\": ")) != NULL) &&
+                 (sscanf(p + 6, "%lld", &ns) == 1))
+        {
+            add_sample(mknod, ns);
+        }
+    }
+
+    fclose(fp);
+
+    return failed;
+}
+
+
+/*
+ * Fork the first 'n' processes of procs[], held on a pipe until all of them are ready, then
+ * release them together and wait for them.  Each writes its JSON output
+ * to OUT_DIR/<index>.json.
+ */
+static int run_round(int n, const char *out_dir, char *const envp[])
+{
+    char path[PATH_MAX + 32];
+    long long release;
+    int barrier[2];
+    int i, status;
+    pid_t pid;
+
+    if (pipe(barrier) < 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%d.json", out_dir, i);
+
+        procs[i].pid = fork();
+
+        if (procs[i].pid == 0)
+        {
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            char c;
+
+            close(barrier[1]);
+
+            if ((fd < 0) || (dup2(fd, STDOUT_FILENO) < 0))
+            {
+                _exit(127);
+            }
+            close(fd);
+
+            fd = open("/dev/null", O_WRONLY);
+            if (fd >= 0)
+            {
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+
+            while ((read(barrier[0], &c, 1) < 0) && (errno == EINTR));
+
+            execve(nvidia_modprobe_path, procs[i].argv, envp);
+            _exit(127);
+        }
+
+        if (procs[i].pid < 0)
+        {
+            fprintf(stderr, "nvidia-modprobe-stress: fork() failed: %s.\n",
+                    strerror(errno));
+            n = i;
+            break;
+        }
+    }
+
+    close(barrier[0]);
+    release = bench_now_ns();
+    close(barrier[1]);
+
+    for (i = 0; i < n; i++)
+    {
+        int j;
+
+        pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            break;
+        }
+
+        for (j = 0; j < n; j++)
+        {
+            if (procs[j].pid == pid)
+            {
+                procs[j].ns = bench_now_ns() - release;
+                procs[j].status = WIFEXITED(status) ?
+                    WEXITSTATUS(status) : -1;
+                break;
+            }
+        }
+    }
+
+    return n;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: nvidia-modprobe-stress [-n PROCS] [-r ROUNDS] "
+            "[-S SEED] [-m NVIDIA-MODPROBE] [-g GEN-FAKE-ROOT] DIR\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    char root[PATH_MAX], out_dir[PATH_MAX], path[PATH_MAX + 32];
+    char args[PATH_MAX * 4], gen_args[128], env_root[PATH_MAX + 32];
+    char *envp[] = { env_root, "PATH=/sbin:/bin:/usr/sbin:/usr/bin", NULL };
+    unsigned int seed = 1;
+    int c, i, r, n, total = 0;
+
+    while ((c = getopt(argc, argv, "n:r:S:m:g:")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                num_procs = atoi(optarg);
+                break;
+            case 'r':
+                rounds = atoi(optarg);
+                break;
+            case 'S':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                nvidia_modprobe_path = optarg;
+                break;
+            case 'g':
+                gen_fake_root = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if ((optind != argc - 1) || (num_procs < 1) ||
+        (num_procs > NV_STRESS_MAX_PROCS) || (rounds < 1))
+    {
+        usage();
+    }
+
+    snprintf(root, sizeof(root), "%s/root", argv[optind]);
+    snprintf(out_dir, sizeof(out_dir), "%s/out", argv[optind]);
+    snprintf(gen_args, sizeof(gen_args), "-l -g %d -c %d -i %d",
+             NV_STRESS_GPUS, NV_STRESS_CAPS, NV_STRESS_CHANNELS);
+
+    if (!bench_gen_root("nvidia-modprobe-stress", gen_fake_root, root,
+                        gen_args, args, sizeof(args)))
+    {
+        return 1;
+    }
+
+    if ((mkdir(out_dir, 0755) < 0) && (errno != EEXIST))
+    {
+        fprintf(stderr, "nvidia-modprobe-stress: cannot create %s: %s.\n",
+                out_dir, strerror(errno));
+        return 1;
+    }
+
+    snprintf(env_root, sizeof(env_root), "NVIDIA_MODPROBE_ROOT=%s", root);
+
+    /*
+     * A solo run of every request of the tree: it must succeed, and gives
+     * the uncontended device file creation times.
+     */
+
+    procs[0].argv[0] = "nvidia-modprobe";
+    procs[0].argv[1] = "--output=json";
+    procs[0].argv[2] = "-u";
+    procs[0].argv[3] = "-m";
+    bench_split_args(args, procs[0].argv, 4, NV_STRESS_MAX_ARGS);
+
+    bench_reset_root(root, 0);
+    run_round(1, out_dir, envp);
+
+    snprintf(path, sizeof(path), "%s/0.json", out_dir);
+
+    if ((procs[0].status != 0) || (parse_output(path, &mknod_solo) != 0))
+    {
+        fprintf(stderr, "nvidia-modprobe-stress: a solo nvidia-modprobe run "
+                "against %s failed; see %s.\n", root, path);
+        return 1;
+    }
+
+    /* The contended rounds */
+
+    for (r = 0; r < rounds; r++)
+    {
+        for (i = 0; i < num_procs; i++)
+        {
+            pick_args(&procs[i], &seed);
+        }
+
+        bench_reset_root(root, 0);
+        n = run_round(num_procs, out_dir, envp);
+
+        for (i = 0; i < n; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%d.json", out_dir, i);
+            parse_output(path, &mknod_contended);
+
+            add_sample(&completion, procs[i].ns);
+            failed_procs += (procs[i].status != 0);
+        }
+
+        total += n;
+    }
+
+    printf("nvidia-modprobe-stress: %d processes x %d rounds\n\n",
+           num_procs, rounds);
+    printf("%-24s %12s %12s %12s %10s\n",
+           "", "p50 (us)", "p99 (us)", "max (us)", "samples");
+    print_samples("completion", &completion);
+    print_samples("mknod, solo", &mknod_solo);
+    print_samples("mknod, contended", &mknod_contended);
+
+    printf("\nfailed processes:         %d of %d\n", failed_procs, total);
+    printf("failed device file steps: %d (node %d, cap %d, imex-channel %d)\n",
+           failed_nodes + failed_caps + failed_channels,
+           failed_nodes, failed_caps, failed_channels);
+
+    return 0;
+}
@@ -57,6 +57,54 @@ The source code to nvidia-modprobe is available here:
 
 __OPTIONS__
 
+.SH ENVIRONMENT
+.TP
+.B NVIDIA_MODPROBE_ROOT
+Directory prepended to every
+.IR /sys ,
+.I /proc
+and
+.I /dev
+path, and to the path of
+.BR modprobe (8),
+so that
+.B nvidia\-modprobe
+can be run against a fake tree, such as one built by
+.BR gen\-fake\-root.sh ,
+on a system without NVIDIA hardware.  It is ignored when
+.B nvidia\-modprobe
+is running setuid or setgid.
+.TP
+.B NVIDIA_MODPROBE_METRICS_DIR
+Directory of the metrics file, as with
+.BR \-\-metrics\-dir .
+.TP
+.B NVIDIA_MODPROBE_EVENTS
+Event log file, instead of
+.IR /run/nvidia\-modprobe.events ,
+as with
+.BR \-\-event\-log=PATH .
+It is ignored when
+.B nvidia\-modprobe
+is running setuid or setgid.
+.TP
+.B NVIDIA_MODPROBE_RECORD
+File to which every file system access and
+.BR modprobe (8)
+invocation is logged, with its result, the content read and its latency.
+.TP
+.B NVIDIA_MODPROBE_REPLAY
+File, written through
+.BR NVIDIA_MODPROBE_RECORD ,
+from which the file system accesses and
+.BR modprobe (8)
+invocations are served, with the recorded results and delays, instead of
+from the system.  Like
+.BR NVIDIA_MODPROBE_ROOT ,
+these are ignored when
+.B nvidia\-modprobe
+is running setuid or setgid.
+
 .SH EXAMPLES
 .TP
 .B nvidia\-modprobe
@@ -34,13 +34,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <linux/types.h>
 #include <sys/prctl.h>
 
 #include "nvidia-modprobe-utils.h"
+#include "nvidia-modprobe-steps.h"
+#include "nvidia-modprobe-bringup.h"
+#include "nvidia-modprobe-memory.h"
+#include "nvidia-modprobe-irq.h"
+#include "nvidia-modprobe-reload.h"
+#include "nvidia-modprobe-output.h"
+#include "nvidia-modprobe-metrics.h"
+#include "nvidia-modprobe-events.h"
 
 #include "nvgetopt.h"
 #include "option-table.h"
+#include "option-hash.h"
 #include "common-utils.h"
 #include "msg.h"
 
@@ -86,13 +97,227 @@ static void print_help(void)
 }
 
 
+/*
+ * The options changing the system beyond loading the NVIDIA kernel
+ * modules and creating their device files are reserved to root: the
+ * setuid bit only grants unprivileged users what the driver needs.
+ */
+
+static void require_root(const char *option)
+{
+    if (getuid() != 0)
+    {
+        nv_error_msg("Only root may use %s.", option);
+        exit(1);
+    }
+}
+
+
+/*
+ * Step functions for the step graph built by main(); see
+ * nvidia-modprobe-steps.h.
+ */
+
+static int step_nvidia_modprobe(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_modprobe_ctx(ctx, 0);
+}
+
+static int step_nvidia_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_mknod_ctx(ctx, step->minor);
+}
+
+static int step_uvm_modprobe(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_uvm_modprobe_ctx(ctx);
+}
+
+static int step_uvm_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_uvm_mknod_ctx(ctx, step->minor);
+}
+
+static int step_modeset_modprobe(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_modeset_modprobe_ctx(ctx);
+}
+
+static int step_modeset_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_modeset_mknod_ctx(ctx);
+}
+
+static int step_nvlink_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_nvlink_mknod_ctx(ctx);
+}
+
+static int step_nvswitch_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_nvswitch_mknod_ctx(ctx, step->minor);
+}
+
+static int step_chardev_major(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_get_chardev_major_ctx(ctx, step->path) >= 0;
+}
+
+static int step_cap_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    int unused;
+
+    return nvidia_cap_mknod_ctx(ctx, step->path, &unused);
+}
+
+static int step_imex_channel_mknod(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_cap_imex_channel_mknod_ctx(ctx, step->minor);
+}
+
+static int step_nvidia_file_state(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_get_file_state_ctx(ctx, step->minor);
+}
+
+static int step_nvlink_file_state(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_nvlink_get_file_state_ctx(ctx);
+}
+
+static int step_nvswitch_file_state(NvModprobeContext *ctx,
+                                    const NvStep *step)
+{
+    return nvidia_nvswitch_get_file_state_ctx(ctx, step->minor);
+}
+
+static int step_cap_file_state(NvModprobeContext *ctx, const NvStep *step)
+{
+    return nvidia_cap_get_file_state_ctx(ctx, step->path);
+}
+
+static int step_imex_channel_file_state(NvModprobeContext *ctx,
+                                        const NvStep *step)
+{
+    return nvidia_cap_imex_channel_file_state_ctx(ctx, step->minor);
+}
+
+static int step_auto_online_movable(NvModprobeContext *ctx,
+                                    const NvStep *step)
+{
+    return nvidia_enable_auto_online_movable_ctx(ctx, 0);
+}
+
+
+/*
+ * Timing callback, installed for --timing, --output=json and
+ * --metrics-dir: the spans are kept for them, and go to the event log.
+ */
+
+static void record_span(void *data, const char *name, const char *arg,
+                        long long ns)
+{
+    nv_output_record_span(data, name, arg, ns);
+    nv_events_log(name, arg, 0, ns);
+}
+
+/*
+ * Log the whole run, with its arguments as target, to the event log.
+ */
+
+static void log_run(int argc, char *argv[], int status, long long ns)
+{
+    char args[64];
+    size_t len = 0;
+    int i;
+
+    args[0] = '\0';
+
+    for (i = 1; (i < argc) && (len < sizeof(args)); i++)
+    {
+        len += snprintf(args + len, sizeof(args) - len, "%s%s",
+                        (i > 1) ? " " : "", argv[i]);
+    }
+
+    nv_events_log("run", args, status, ns);
+}
+
+
+/*
+ * Whether any of the requested work was refused because the time budget
+ * ran out, rather than attempted and failed: a step left not started, or
+ * a bring-up stage, memory block, huge page pool, interrupt or module
+ * unload given up with ETIME.  hugepages is NULL if none were requested.
+ */
+
+static int refused_for_time(const NvStepGraph *graph,
+                            const NvBringupGpu *gpus, int num_gpus,
+                            const NvMemoryOnline *online,
+                            const NvHugepagesReservation *hugepages,
+                            const NvModprobeIrqPlan *irq_plan,
+                            const NvDriverReload *reload)
+{
+    int i, j;
+
+    for (i = 0; i < graph->num_steps; i++)
+    {
+        if (graph->steps[i].state == NvStepNotStarted)
+        {
+            return TRUE;
+        }
+    }
+
+    for (i = 0; i < num_gpus; i++)
+    {
+        if (gpus[i].failed && (gpus[i].error == ETIME))
+        {
+            return TRUE;
+        }
+    }
+
+    if (online->num_not_started > 0)
+    {
+        return TRUE;
+    }
+
+    for (i = 0; (hugepages != NULL) && (i < hugepages->num_nodes); i++)
+    {
+        if (hugepages->nodes[i].not_started)
+        {
+            return TRUE;
+        }
+    }
+
+    for (i = 0; i < irq_plan->num_devices; i++)
+    {
+        for (j = 0; j < irq_plan->devices[i].num_irqs; j++)
+        {
+            if (irq_plan->devices[i].irqs[j].error == ETIME)
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    for (i = 0; i < reload->plan.num_modules; i++)
+    {
+        if (reload->plan.modules[i].unload_error == ETIME)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
 int main(int argc, char *argv[])
 {
     int minors[64];
     char *cap_files[256];
     int num_cap_files = 0;
     int num_minors = 0;
-    int i, ret = 1;
+    int i, step, failed, status, out_of_time;
     int uvm_modprobe = FALSE;
     int modeset = FALSE;
     int nvswitch = FALSE;
@@ -100,21 +325,57 @@ int main(int argc, char *argv[])
     int imex_channel_minor_start;
     int imex_channel_minors = 0;
     int enable_auto_online_movable = FALSE;
-    int unused;
+    int online_movable_memory = FALSE;
+    int audit_movable_memory = FALSE;
+    NvMemoryOnline memory_online;
+    NvModprobeMemoryAudit memory_audit;
+    int reserve_hugepages = FALSE;
+    NvHugepagesReservation hugepages;
+    int irq_affinity = FALSE, irq_affinity_plan = FALSE;
+    NvModprobeIrqPlan irq_plan;
+    int reload_driver = FALSE, reload_driver_plan = FALSE;
+    NvDriverReload driver_reload;
+    NvBringupGpu bringup_gpus[NV_BRINGUP_MAX_GPUS];
+    int num_bringup_gpus = 0;
+    int jobs = 0;
+    int report = FALSE;
+    int event_log = FALSE;
+    const char *event_log_path = NULL;
+    int print_spans = FALSE;
+    int print_stats = FALSE;
+    int output_json = FALSE;
+    int budget_ms = -1;
+    const char *metrics_dir = NULL;
+    struct timespec start_time, end_time;
+    long long elapsed_ns;
+    NvModprobeStats bringup_stats;
+    int nvidia_step = -1, uvm_step = -1, modeset_step = -1;
+    int caps_step = -1, imex_step = -1;
+    NVGetoptState getopt_state = NVGETOPT_STATE_INIT_WITH_HASH(&__options_hash);
+    NvModprobeContext ctx;
+    NvStepGraph graph;
+    NvOutputResult result;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    /* the option arguments are used in place and never freed */
+
+    getopt_state.flags |= NVGETOPT_STATE_STRVAL_IN_ARGV;
 
     while (1)
     {
         int c, intval;
         char *strval;
 
-        c = nvgetopt(argc,
-                     argv,
-                     __options,
-                     &strval,
-                     NULL, /* boolval */
-                     &intval,
-                     NULL, /* doubleval */
-                     NULL); /* disable */
+        c = nvgetopt_r(&getopt_state,
+                       argc,
+                       argv,
+                       __options,
+                       &strval,
+                       NULL, /* boolval */
+                       &intval,
+                       NULL, /* doubleval */
+                       NULL); /* disable */
 
         if (c == -1) break;
 
@@ -171,6 +432,117 @@ int main(int argc, char *argv[])
             case 'a':
                 enable_auto_online_movable = TRUE;
                 break;
+            case ONLINE_MOVABLE_MEMORY_OPTION:
+                require_root("--online-movable-memory");
+                online_movable_memory = TRUE;
+                break;
+            case AUDIT_MOVABLE_MEMORY_OPTION:
+                audit_movable_memory = TRUE;
+                break;
+            case RESERVE_HUGEPAGES_OPTION:
+                require_root("--reserve-hugepages");
+                if (!nv_memory_parse_hugepages(strval, &hugepages))
+                {
+                    nv_error_msg("Invalid huge page reservation '%s'.",
+                                 strval);
+                    exit(1);
+                }
+                reserve_hugepages = TRUE;
+                break;
+            case IRQ_AFFINITY_OPTION:
+                if (strcmp(strval, "plan") == 0)
+                {
+                    irq_affinity_plan = TRUE;
+                }
+                else if (strcmp(strval, "apply") == 0)
+                {
+                    require_root("--irq-affinity=apply");
+                }
+                else
+                {
+                    nv_error_msg("Invalid interrupt affinity mode '%s'.",
+                                 strval);
+                    exit(1);
+                }
+                irq_affinity = TRUE;
+                break;
+            case RELOAD_DRIVER_OPTION:
+                require_root("--reload-driver");
+                if (strcmp(strval, "plan") == 0)
+                {
+                    reload_driver_plan = TRUE;
+                }
+                else if (strcmp(strval, "apply") != 0)
+                {
+                    nv_error_msg("Invalid driver reload mode '%s'.", strval);
+                    exit(1);
+                }
+                reload_driver = TRUE;
+                break;
+            case BRING_UP_OPTION:
+                require_root("--bring-up");
+                if (num_bringup_gpus >= ARRAY_LEN(bringup_gpus))
+                {
+                    nv_error_msg("Too many GPUs to bring up requested.");
+                    exit(1);
+                }
+                if (!nv_bringup_parse_bridge(strval,
+                                             &bringup_gpus[num_bringup_gpus]))
+                {
+                    nv_error_msg("Invalid PCI bridge address '%s'.", strval);
+                    exit(1);
+                }
+                num_bringup_gpus++;
+                break;
+            case 'j':
+                if (intval < 1)
+                {
+                    nv_error_msg("Invalid number of jobs: %d.", intval);
+                    exit(1);
+                }
+                jobs = intval;
+                break;
+            case BUDGET_MS_OPTION:
+                if (intval < 0)
+                {
+                    nv_error_msg("Invalid time budget: %d ms.", intval);
+                    exit(1);
+                }
+                budget_ms = intval;
+                break;
+            case OUTPUT_OPTION:
+                if (strcmp(strval, "json") == 0)
+                {
+                    output_json = TRUE;
+                }
+                else if (strcmp(strval, "text") == 0)
+                {
+                    output_json = FALSE;
+                }
+                else
+                {
+                    nv_error_msg("Invalid output format '%s'.", strval);
+                    exit(1);
+                }
+                break;
+            case METRICS_DIR_OPTION:
+                metrics_dir = strval;
+                break;
+            case STATS_OPTION:
+                print_stats = TRUE;
+                break;
+            case TIMING_OPTION:
+                print_spans = TRUE;
+                break;
+            case REPORT_OPTION:
+                report = TRUE;
+                break;
+            case EVENT_LOG_OPTION:
+                event_log = TRUE;
+                event_log_path = strval;
+                break;
+            case DECODE_EVENTS_OPTION:
+                exit(nv_events_decode(strval));
             default:
                 nv_error_msg("Invalid commandline, please run `%s --help` "
                              "for usage information.\n", argv[0]);
@@ -178,131 +550,540 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (nvlink)
+    /*
+     * Run against a fake tree if requested; see gen-fake-root.sh.  The
+     * library refuses this when running setuid.
+     */
+
+    status = nvidia_modprobe_set_root_from_env();
+    if (status == EPERM)
+    {
+        nv_warning_msg("Ignoring %s when running setuid or setgid.",
+                       NV_MODPROBE_ROOT_ENV);
+    }
+    else if (status != 0)
+    {
+        nv_error_msg("Invalid %s: %s.", NV_MODPROBE_ROOT_ENV,
+                     strerror(status));
+        exit(1);
+    }
+
+    status = nvidia_modprobe_set_trace_from_env();
+    if (status == EPERM)
+    {
+        nv_warning_msg("Ignoring %s and %s when running setuid or setgid.",
+                       NV_MODPROBE_RECORD_ENV, NV_MODPROBE_REPLAY_ENV);
+    }
+    else if (status != 0)
     {
-        /* Create the NVLink control node. */
+        nv_error_msg("Unable to record or replay file system accesses: %s.",
+                     strerror(status));
+        exit(1);
+    }
+
+    metrics_dir = nv_metrics_get_dir(metrics_dir);
+
+    /*
+     * Reload the driver first, which also creates the device files of the
+     * reloaded modules again, so that the steps below run against the new
+     * modules, then bring up the GPUs, so that the steps below find the
+     * NVIDIA kernel module loaded.
+     */
+
+    failed = 0;
+
+    nvidia_modprobe_context_init(&ctx);
 
-        /* Load the kernel module */
-        ret = nvidia_modprobe(0);
-        if (!ret)
+    if (budget_ms >= 0)
+    {
+        nvidia_modprobe_context_set_budget(&ctx, budget_ms);
+    }
+
+    if (nv_events_open(event_log, event_log_path) == EPERM)
+    {
+        nv_warning_msg("Ignoring the event log path given with --event-log "
+                       "or %s when running setuid or setgid; using %s.",
+                       NV_EVENTS_PATH_ENV, NV_EVENTS_DEFAULT_PATH);
+    }
+
+    /*
+     * Only time the run when the spans are wanted: the event log records
+     * them then, but is not worth the cost of timing on its own.
+     */
+
+    if (print_spans || output_json || (metrics_dir != NULL))
+    {
+        nvidia_modprobe_context_set_timing(&ctx, record_span, NULL);
+    }
+
+    memset(&driver_reload, 0, sizeof(driver_reload));
+
+    if (reload_driver)
+    {
+        int num_failed = nv_reload_run(&ctx, !reload_driver_plan,
+                                       &driver_reload);
+        char modules[32];
+
+        failed += num_failed;
+
+        if ((driver_reload.plan.num_modules == 0) && (num_failed > 0))
         {
-            goto done;
+            nv_error_msg("Unable to read the loaded kernel modules.");
+        }
+        else if (!output_json)
+        {
+            if (reload_driver_plan)
+            {
+                nv_reload_print_plan(&driver_reload);
+            }
+            else
+            {
+                nv_reload_report(&driver_reload);
+            }
         }
 
-        ret = nvidia_nvlink_mknod();
-        if (!ret)
+        if (print_stats && !output_json)
         {
-            goto done;
+            nv_step_print_stats("reload driver", &driver_reload.stats);
         }
+
+        snprintf(modules, sizeof(modules), "%d of %d modules reloaded",
+                 driver_reload.num_reloaded,
+                 driver_reload.plan.num_modules);
+        nv_events_log("reload-driver", modules, num_failed,
+                      driver_reload.elapsed_ns);
     }
-    else if (nvswitch)
+
+    memset(&bringup_stats, 0, sizeof(bringup_stats));
+
+    if (num_bringup_gpus > 0)
     {
-        /* Create the NVSwitch CTL device file or device nodes. */
+        nvidia_modprobe_reset_stats();
+
+        failed += nv_bringup_run(&ctx, bringup_gpus, num_bringup_gpus);
 
-        /* Load the kernel module */
-        ret = nvidia_modprobe(0);
-        if (!ret)
+        nvidia_modprobe_get_stats(&bringup_stats);
+
+        if (!output_json)
         {
-            goto done;
+            nv_bringup_report(bringup_gpus, num_bringup_gpus);
         }
 
-        for (i = 0; i < num_minors; i++)
+        if (print_stats && !output_json)
         {
-            ret = nvidia_nvswitch_mknod(minors[i]);
-            if (!ret)
-            {
-                goto done;
-            }
+            nv_step_print_stats("bring-up", &bringup_stats);
+        }
+    }
+
+    /*
+     * Build the graph of steps to run.  The primary modes (-l, -s, -u,
+     * -a, --online-movable-memory, --audit-movable-memory,
+     * --reserve-hugepages and --bring-up) may be combined; the NVIDIA
+     * kernel module is loaded and NVIDIA device files created when none of
+     * them is given.  --irq-affinity and --reload-driver may be added to
+     * any of them.  The minor numbers given with -c are used for the
+     * NVSwitch device files with -s, for the Unified Memory device files
+     * with -u, and for the NVIDIA device files otherwise.
+     */
+
+    nv_step_graph_init(&graph);
+    graph.ctx = &ctx;
+
+    if (nvlink || nvswitch ||
+        !(uvm_modprobe || enable_auto_online_movable ||
+          online_movable_memory || audit_movable_memory ||
+          reserve_hugepages || (num_bringup_gpus > 0)))
+    {
+        nvidia_step = nv_step_graph_add(&graph, "module", step_nvidia_modprobe,
+                                        -1, NULL, "load nvidia");
+    }
+
+    if (nvlink)
+    {
+        step = nv_step_graph_add(&graph, "node", step_nvlink_mknod,
+                                 -1, NULL, "create nvlink device file");
+        nv_step_graph_set_file_state_func(&graph, step, step_nvlink_file_state);
+        nv_step_graph_depend(&graph, step, nvidia_step);
+    }
+
+    if (uvm_modprobe)
+    {
+        uvm_step = nv_step_graph_add(&graph, "module", step_uvm_modprobe,
+                                     -1, NULL, "load nvidia-uvm");
+    }
+
+    for (i = 0; i < num_minors; i++)
+    {
+        if (nvswitch)
+        {
+            step = nv_step_graph_add(&graph, "node", step_nvswitch_mknod,
+                                     minors[i], NULL,
+                                     "create nvswitch device file %d",
+                                     minors[i]);
+            nv_step_graph_set_file_state_func(&graph, step,
+                                              step_nvswitch_file_state);
+            nv_step_graph_depend(&graph, step, nvidia_step);
+        }
+        else if (uvm_modprobe)
+        {
+            step = nv_step_graph_add(&graph, "node", step_uvm_mknod,
+                                     minors[i], NULL,
+                                     "create nvidia-uvm device file %d",
+                                     minors[i]);
+            nv_step_graph_depend(&graph, step, uvm_step);
+        }
+        else if ((nvidia_step >= 0) && !nvlink)
+        {
+            step = nv_step_graph_add(&graph, "node", step_nvidia_mknod,
+                                     minors[i], NULL,
+                                     "create nvidia device file %d",
+                                     minors[i]);
+            nv_step_graph_set_file_state_func(&graph, step,
+                                              step_nvidia_file_state);
+            nv_step_graph_depend(&graph, step, nvidia_step);
         }
     }
-    else if (uvm_modprobe)
+
+    if (enable_auto_online_movable)
+    {
+        nv_step_graph_add(&graph, "setting", step_auto_online_movable,
+                          -1, NULL, "enable auto online movable");
+    }
+
+    if (modeset)
+    {
+        modeset_step = nv_step_graph_add(&graph, "module",
+                                         step_modeset_modprobe,
+                                         -1, NULL, "load nvidia-modeset");
+        nv_step_graph_depend(&graph, modeset_step, nvidia_step);
+
+        step = nv_step_graph_add(&graph, "node", step_modeset_mknod,
+                                 -1, NULL, "create nvidia-modeset device file");
+        nv_step_graph_depend(&graph, step, modeset_step);
+    }
+
+    /*
+     * The capability and IMEX channel device files need the major number
+     * of their character devices, which are registered by the NVIDIA
+     * kernel module.
+     */
+
+    if (num_cap_files > 0)
+    {
+        caps_step = nv_step_graph_add(&graph, "major", step_chardev_major, -1,
+                                      NV_CAPS_MODULE_NAME,
+                                      "find %s major", NV_CAPS_MODULE_NAME);
+        nv_step_graph_depend(&graph, caps_step, nvidia_step);
+        nv_step_graph_depend(&graph, caps_step, uvm_step);
+    }
+
+    for (i = 0; i < num_cap_files; i++)
+    {
+        step = nv_step_graph_add(&graph, "cap", step_cap_mknod,
+                                 -1, cap_files[i],
+                                 "create capability device file %s",
+                                 cap_files[i]);
+        nv_step_graph_set_file_state_func(&graph, step, step_cap_file_state);
+        nv_step_graph_depend(&graph, step, caps_step);
+    }
+
+    if (imex_channel_minors > 0)
+    {
+        imex_step = nv_step_graph_add(&graph, "major", step_chardev_major, -1,
+                                      NV_CAPS_IMEX_CHANNELS_MODULE_NAME,
+                                      "find %s major",
+                                      NV_CAPS_IMEX_CHANNELS_MODULE_NAME);
+        nv_step_graph_depend(&graph, imex_step, nvidia_step);
+        nv_step_graph_depend(&graph, imex_step, uvm_step);
+    }
+
+    for (i = 0; i < imex_channel_minors; i++)
+    {
+        step = nv_step_graph_add(&graph, "imex-channel",
+                                 step_imex_channel_mknod,
+                                 imex_channel_minor_start + i, NULL,
+                                 "create IMEX channel device file %d",
+                                 imex_channel_minor_start + i);
+        nv_step_graph_set_file_state_func(&graph, step,
+                                          step_imex_channel_file_state);
+        nv_step_graph_depend(&graph, step, imex_step);
+    }
+
+    failed += nv_step_graph_run(&graph, jobs);
+
+    /*
+     * Online the GPU memory blocks left offline once the online_movable
+     * setting, if requested, is in place.  Unless told otherwise, use a
+     * worker per online CPU: each block takes a sysfs write of its own.
+     */
+
+    memset(&memory_online, 0, sizeof(memory_online));
+
+    if (online_movable_memory)
     {
-        /* Load the Unified Memory kernel module */
+        if (jobs == 0)
+        {
+            jobs = NV_MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+        }
+
+        failed += nv_memory_online_run(&ctx, jobs, !output_json,
+                                       &memory_online);
+
+        if (!output_json)
+        {
+            nv_memory_online_report(&memory_online);
+        }
 
-        ret = nvidia_uvm_modprobe();
-        if (!ret)
+        if (print_stats && !output_json)
         {
-            goto done;
+            nv_step_print_stats("online memory", &memory_online.stats);
         }
+    }
+
+    memset(&memory_audit, 0, sizeof(memory_audit));
 
-        /* Create any device files requested */
+    if (audit_movable_memory)
+    {
+        NvModprobeStats before, after;
+        struct timespec audit_start, audit_end;
+        char audit_blocks[32];
+
+        clock_gettime(CLOCK_MONOTONIC, &audit_start);
+        nvidia_modprobe_get_stats(&before);
 
-        for (i = 0; i < num_minors; i++)
+        if (!nvidia_audit_gpu_memory_ctx(&ctx, &memory_audit))
         {
-            ret = nvidia_uvm_mknod(minors[i]);
-            if (!ret)
+            nv_error_msg("Unable to find the GPU NUMA nodes.");
+            failed++;
+        }
+        else
+        {
+            failed += memory_audit.num_misplaced;
+
+            if (!output_json)
             {
-                goto done;
+                nv_memory_audit_report(&memory_audit);
             }
         }
-    }
-    else if (enable_auto_online_movable)
-    {
-        /* Enable auto onlining mode online_movable */
-        ret = nvidia_enable_auto_online_movable(0);
-        if (!ret)
+
+        nvidia_modprobe_get_stats(&after);
+        clock_gettime(CLOCK_MONOTONIC, &audit_end);
+
+        for (i = 0; i < NvModprobeNumStats; i++)
+        {
+            after.count[i] -= before.count[i];
+        }
+
+        snprintf(audit_blocks, sizeof(audit_blocks), "%d blocks misplaced",
+                 memory_audit.num_misplaced);
+        nv_events_log("audit-memory", audit_blocks, 0,
+                      (audit_end.tv_sec - audit_start.tv_sec) * 1000000000LL +
+                      (audit_end.tv_nsec - audit_start.tv_nsec));
+
+        if (print_stats && !output_json)
         {
-            goto done;
+            nv_step_print_stats("audit memory", &after);
         }
     }
-    else
+
+    if (reserve_hugepages)
     {
-        /* Load the kernel module. */
+        int num_failed = nv_memory_reserve_hugepages(&ctx, &hugepages);
+
+        failed += num_failed;
 
-        ret = nvidia_modprobe(0);
-        if (!ret)
+        if ((hugepages.num_nodes == 0) && (num_failed > 0))
         {
-            goto done;
+            nv_error_msg("Unable to find the GPUs' NUMA nodes or the huge "
+                         "page size.");
+        }
+        else if (!output_json)
+        {
+            nv_memory_hugepages_report(&hugepages);
         }
 
-        /* Create any device files requested. */
+        if (print_stats && !output_json)
+        {
+            nv_step_print_stats("reserve huge pages", &hugepages.stats);
+        }
+    }
+
+    /*
+     * Steer the interrupts once the NVIDIA kernel module, which allocates
+     * them, is loaded.
+     */
+
+    memset(&irq_plan, 0, sizeof(irq_plan));
+
+    if (irq_affinity)
+    {
+        NvModprobeStats before, after;
+
+        nvidia_modprobe_get_stats(&before);
 
-        for (i = 0; i < num_minors; i++)
+        if ((nvidia_step >= 0) &&
+            (graph.steps[nvidia_step].state != NvStepSucceeded))
+        {
+            failed++;
+        }
+        else if (!nvidia_plan_irq_affinity_ctx(&ctx, &irq_plan))
+        {
+            nv_error_msg("Unable to list the NVIDIA PCI devices.");
+            failed++;
+        }
+        else if (irq_affinity_plan)
         {
-            ret = nvidia_mknod(minors[i]);
-            if (!ret)
+            if (!output_json)
             {
-                goto done;
+                nv_irq_print_plan(&irq_plan);
             }
         }
-    }
+        else
+        {
+            if (!nvidia_apply_irq_affinity_ctx(&ctx, &irq_plan))
+            {
+                failed++;
+            }
 
-    if (modeset)
-    {
-        /* Load the modeset kernel module and create its device file. */
+            if (!output_json)
+            {
+                nv_irq_report(&irq_plan);
+            }
+        }
+
+        nvidia_modprobe_get_stats(&after);
 
-        ret = nvidia_modeset_modprobe();
-        if (!ret)
+        for (i = 0; i < NvModprobeNumStats; i++)
         {
-            goto done;
+            after.count[i] -= before.count[i];
         }
 
-        ret = nvidia_modeset_mknod();
-        if (!ret)
+        if (print_stats && !output_json)
         {
-            goto done;
+            nv_step_print_stats("irq affinity", &after);
         }
     }
 
-    for (i = 0; i < num_cap_files; i++)
+    /*
+     * If the time budget ran out before everything was done, list the
+     * steps completed and those left undone, and exit with a status
+     * distinct from plain failure so that the caller can retry later.
+     * Work that was attempted and failed is a plain failure, even if the
+     * budget ran out since.
+     */
+
+    out_of_time = failed &&
+                  refused_for_time(&graph, bringup_gpus, num_bringup_gpus,
+                                   &memory_online,
+                                   reserve_hugepages ? &hugepages : NULL,
+                                   &irq_plan, &driver_reload);
+    status = out_of_time ? 2 : (failed != 0);
+
+    memset(&result, 0, sizeof(result));
+    result.exit_status = status;
+    result.out_of_time = out_of_time;
+    result.graph = &graph;
+    result.gpus = bringup_gpus;
+    result.num_gpus = num_bringup_gpus;
+
+    if (output_json)
     {
-        ret = nvidia_cap_mknod(cap_files[i], &unused);
-        if (!ret)
+        nv_output_print_json(&result);
+    }
+    else
+    {
+        if (print_spans)
         {
-            goto done;
+            nv_output_print_timing();
+        }
+
+        if (print_stats)
+        {
+            nv_step_graph_report_stats(&graph);
+        }
+
+        if (report || out_of_time)
+        {
+            nv_step_graph_report(&graph);
         }
     }
 
-    for (i = 0; i < imex_channel_minors; i++)
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    elapsed_ns = (end_time.tv_sec - start_time.tv_sec) * 1000000000LL +
+                 (end_time.tv_nsec - start_time.tv_nsec);
+
+    for (i = 0; i < graph.num_steps; i++)
     {
-        ret = nvidia_cap_imex_channel_mknod(imex_channel_minor_start + i);
-        if (!ret)
+        char phase[32];
+
+        snprintf(phase, sizeof(phase), "step/%s", graph.steps[i].kind);
+        nv_events_log(phase, graph.steps[i].path ? graph.steps[i].path :
+                      graph.steps[i].name, graph.steps[i].state,
+                      graph.steps[i].elapsed_ns);
+    }
+
+    if (online_movable_memory)
+    {
+        char blocks[32];
+
+        snprintf(blocks, sizeof(blocks), "%d of %d blocks onlined",
+                 memory_online.num_onlined, memory_online.num_blocks);
+        nv_events_log("online-memory", blocks, 0, memory_online.elapsed_ns);
+    }
+
+    log_run(argc, argv, status, elapsed_ns);
+    nv_events_close();
+
+    if (metrics_dir != NULL)
+    {
+        const struct {
+            int requested;
+            const char *name;
+        } modes[] = {
+            { nvidia_step >= 0,           "nvidia" },
+            { uvm_modprobe,               "uvm" },
+            { modeset,                    "modeset" },
+            { nvlink,                     "nvlink" },
+            { nvswitch,                   "nvswitch" },
+            { num_cap_files > 0,          "caps" },
+            { imex_channel_minors > 0,    "imex-channels" },
+            { enable_auto_online_movable, "auto-online-movable" },
+            { online_movable_memory,      "online-movable-memory" },
+            { audit_movable_memory,       "audit-movable-memory" },
+            { reserve_hugepages,          "reserve-hugepages" },
+            { irq_affinity,               "irq-affinity" },
+            { reload_driver,              "reload-driver" },
+            { num_bringup_gpus > 0,       "bring-up" },
+        };
+        NvMetricsRun run;
+        int err;
+
+        memset(&run, 0, sizeof(run));
+
+        for (i = 0; i < ARRAY_LEN(modes); i++)
+        {
+            if (modes[i].requested && (run.num_modes < NV_METRICS_MAX_MODES))
+            {
+                run.modes[run.num_modes++] = modes[i].name;
+            }
+        }
+
+        run.elapsed_ns = elapsed_ns;
+        run.bringup_stats = bringup_stats;
+        run.result = &result;
+
+        err = nv_metrics_update(metrics_dir, &run);
+        if (err != 0)
         {
-            goto done;
+            nv_warning_msg("Unable to update the metrics in %s: %s.",
+                           metrics_dir, strerror(err));
         }
     }
 
-done:
+    nvidia_memory_audit_free(&memory_audit);
+    nvidia_irq_plan_free(&irq_plan);
+    nv_output_free();
+    nv_step_graph_free(&graph);
 
-    return !ret;
+    return status;
 }
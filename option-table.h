@@ -16,6 +16,23 @@
 
 #include "nvgetopt.h"
 
+enum {
+    REPORT_OPTION = 1024,
+    BRING_UP_OPTION,
+    BUDGET_MS_OPTION,
+    TIMING_OPTION,
+    STATS_OPTION,
+    OUTPUT_OPTION,
+    METRICS_DIR_OPTION,
+    EVENT_LOG_OPTION,
+    DECODE_EVENTS_OPTION,
+    ONLINE_MOVABLE_MEMORY_OPTION,
+    AUDIT_MOVABLE_MEMORY_OPTION,
+    RESERVE_HUGEPAGES_OPTION,
+    IRQ_AFFINITY_OPTION,
+    RELOAD_DRIVER_OPTION,
+};
+
 static const NVGetoptOption __options[] = {
 
     { "version",
@@ -87,5 +104,180 @@ static const NVGetoptOption __options[] = {
        "platforms (like Grace Hopper) that add and online GPU memory "
        "to the kernel" },
 
+    { "online-movable-memory",
+      ONLINE_MOVABLE_MEMORY_OPTION,
+      0,
+      NULL,
+      "Online, as movable, the memory blocks of the GPU NUMA nodes (as "
+      "listed in /proc/driver/nvidia/gpus/*/numa_status) that are still "
+      "offline, e.g. because they were added before --auto-online-movable "
+      "took effect.  The blocks are onlined by a pool of worker threads, "
+      "as many as given with --jobs or as there are online CPUs; the "
+      "number of blocks onlined is printed every second, followed by the "
+      "total time.  Only root may use this option." },
+
+    { "audit-movable-memory",
+      AUDIT_MOVABLE_MEMORY_OPTION,
+      0,
+      NULL,
+      "Report how the memory of the GPU NUMA nodes is placed in the "
+      "kernel's memory zones: the number of online and offline memory "
+      "blocks of each node, the size of each of its zones (from "
+      "/proc/zoneinfo), and the online blocks outside of ZONE_MOVABLE, "
+      "which hurt performance and prevent the memory from being offlined "
+      "again.  The zone of each block is only read for the nodes with "
+      "memory outside of ZONE_MOVABLE.  nvidia-modprobe exits with a "
+      "non-zero status if any block is misplaced.  The audit runs after "
+      "--online-movable-memory if both are given." },
+
+    { "reserve-hugepages",
+      RESERVE_HUGEPAGES_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "COUNT[:SIZE]",
+      "Make sure at least COUNT huge pages of SIZE bytes (e.g. 2M or 1G; "
+      "the default huge page size if omitted) are reserved on each NUMA "
+      "node local to a GPU, as given by the numa_node attribute of the "
+      "GPU's PCI device, by growing the node's huge page pool.  The nodes' "
+      "pools are grown concurrently, and the number of huge pages actually "
+      "obtained on each node is printed; nvidia-modprobe exits with a "
+      "non-zero status if fewer than COUNT could be obtained on any "
+      "node.  COUNT may be at most 1048576, and SIZE at most 16G.  Only "
+      "root may use this option." },
+
+    { "irq-affinity",
+      IRQ_AFFINITY_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "MODE",
+      "Steer the MSI and MSI-X interrupts of every NVIDIA PCI device (as "
+      "listed in its msi_irqs directory) to the CPUs local to the device "
+      "(its local_cpulist), by writing /proc/irq/<irq>/smp_affinity_list, "
+      "after the NVIDIA kernel module is loaded.  With MODE 'apply', the "
+      "interrupts not handled by the local CPUs yet are changed, and the "
+      "number of interrupts changed is printed; interrupts whose affinity "
+      "is managed by the kernel are left alone; only root may use this "
+      "mode.  With MODE 'plan', the current and planned affinity of each "
+      "interrupt is printed and nothing is changed." },
+
+    { "reload-driver",
+      RELOAD_DRIVER_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "MODE",
+      "Reload the NVIDIA kernel modules, e.g. after the driver was updated, "
+      "before running the other steps.  The loaded modules and the modules "
+      "using them are read from /proc/modules and /sys/module/*/holders.  "
+      "With MODE 'apply', the modules are unloaded in dependency order, "
+      "those no longer used by any other module concurrently, and loaded "
+      "again with modprobe, and the device files of the nvidia, "
+      "nvidia-uvm and nvidia-modeset modules are created again; the time "
+      "taken by each module is printed.  A module still in use is left "
+      "loaded, and the modules and processes using it (those holding its "
+      "device files open) are printed.  With MODE 'plan', the order in "
+      "which the modules would be unloaded and what uses them is printed, "
+      "and nothing is changed.  Only root may use this option." },
+
+    { "bring-up",
+      BRING_UP_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "BRIDGE",
+      "Bring up the GPU below the PCIe bridge with the given "
+      "[domain:]bus:device.function address: enable the bridge link, "
+      "rescan the bridge, load the NVIDIA kernel module and create the "
+      "GPU's NVIDIA device file.  The GPU is function 0 of the NVIDIA "
+      "display controller below the bridge.  This option can be specified "
+      "multiple times; each GPU goes through these stages as soon as it is ready, "
+      "independently of the others.  The time spent in each stage is "
+      "printed for each GPU.  Only root may use this option." },
+
+    { "budget-ms",
+      BUDGET_MS_OPTION,
+      NVGETOPT_INTEGER_ARGUMENT,
+      "MILLISECONDS",
+      "Limit the time spent loading kernel modules, waiting for PCI links "
+      "and creating device files.  Once the given number of milliseconds "
+      "has elapsed, no new work is started, the work in progress is "
+      "completed, the result of each step is printed, and "
+      "nvidia-modprobe exits with status 2 if anything was left "
+      "undone.  Work that was started and failed still gives status 1." },
+
+    { "jobs",
+      'j',
+      NVGETOPT_INTEGER_ARGUMENT,
+      NULL,
+      "Run up to the given number of independent steps (for example, "
+      "creating the device files for different minor numbers) "
+      "concurrently.  The default is 1." },
+
+    { "timing",
+      TIMING_OPTION,
+      0,
+      NULL,
+      "Print the time spent in each phase of the work (PCI enumeration, "
+      "module loading, /proc parsing, device file creation, ...), followed "
+      "by the total time spent in each kind of phase." },
+
+    { "stats",
+      STATS_OPTION,
+      0,
+      NULL,
+      "Print, for each step, the number of file system operations (opens, "
+      "reads, stats, mknods, chmods, chowns, symlinks, ...) and modprobe "
+      "processes spawned, followed by their total." },
+
+    { "output",
+      OUTPUT_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "FORMAT",
+      "Select the format of the results: 'text' (the default) or 'json'.  "
+      "With 'json', a JSON object is printed on stdout listing each step "
+      "(module load, device file, capability, IMEX channel, ...) with its "
+      "result, device file state, what it changed, the operations it "
+      "performed and its duration in nanoseconds, followed by the "
+      "--bring-up GPUs and the timing spans; the text output of --report, "
+      "--stats and --timing is not printed." },
+
+    { "metrics-dir",
+      METRICS_DIR_OPTION,
+      NVGETOPT_STRING_ARGUMENT,
+      "DIR",
+      "Add the counts and durations of the run to the nvidia_modprobe.prom "
+      "file in DIR, for the node_exporter textfile collector: invocations "
+      "by mode, failed steps, modprobe processes spawned, cache hits, device "
+      "files created or fixed, and histograms of the duration of the run "
+      "and of each of its phases.  The file is replaced atomically, and "
+      "concurrent runs never wait for each other: a run that finds the "
+      "file busy leaves its counts for the next run to add.  DIR "
+      "may also be given with the NVIDIA_MODPROBE_METRICS_DIR environment "
+      "variable.  When running setuid or setgid, only the directory "
+      "nvidia-modprobe was built with, if any, is used." },
+
+    { "report",
+      REPORT_OPTION,
+      0,
+      NULL,
+      "Print the result of each step after all of them have run.  Steps "
+      "whose prerequisites failed are reported as skipped." },
+
+    { "event-log",
+      EVENT_LOG_OPTION,
+      NVGETOPT_STRING_ARGUMENT | NVGETOPT_ARGUMENT_IS_OPTIONAL,
+      "PATH",
+      "Record the steps and result of the run, with their time, process "
+      "ID, target and duration, and its timing spans if --timing, "
+      "--output=json or --metrics-dir collect them, in a fixed-size ring "
+      "buffer shared by all runs, in PATH or the file named by the "
+      "NVIDIA_MODPROBE_EVENTS environment variable, else in "
+      "/run/nvidia-modprobe.events, readable by root only.  The log is "
+      "created if needed.  Once /run/nvidia-modprobe.events exists, every "
+      "run records itself in it, including those of other users through "
+      "the setuid binary.  When running setuid or setgid, PATH and "
+      "NVIDIA_MODPROBE_EVENTS are ignored." },
+
+    { "decode-events",
+      DECODE_EVENTS_OPTION,
+      NVGETOPT_STRING_ARGUMENT | NVGETOPT_ARGUMENT_IS_OPTIONAL,
+      "PATH",
+      "Print the event log in PATH, or the one --event-log writes by "
+      "default, oldest entries first, and exit." },
+
     { NULL, 0, 0, NULL, NULL },
 };
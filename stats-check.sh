@@ -0,0 +1,118 @@
+#!/bin/sh
+#
+# Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU General Public License,
+# version 2, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Check the file system and process operations of nvidia-modprobe, as
+# counted by --stats, against a baseline:
+#
+#   stats-check.sh [-u] NVIDIA_MODPROBE BASELINE DIR
+#
+#   -u           record the counts in BASELINE rather than checking them
+#
+# Each scenario runs nvidia-modprobe against a fake tree built in DIR by
+# gen-fake-root.sh (see there for the privileges needed), with the
+# arguments gen-fake-root.sh prints:
+#
+#   warm-noop    8 GPUs, run a second time once everything is in place
+#   cold-8gpu    8 GPUs, kernel module not loaded, no device files
+#   imex-2048    2048 IMEX channels, nothing in place
+#
+# The check fails if any count of the "total" line of --stats is above
+# its baseline.  Cache hits are not checked, since more of them is
+# better.  Lines of BASELINE are "SCENARIO OPERATION COUNT".
+
+set -e
+
+update=0
+
+usage() {
+    echo "usage: $0 [-u] NVIDIA_MODPROBE BASELINE DIR" >&2
+    exit 1
+}
+
+while getopts u opt; do
+    case $opt in
+        u) update=1 ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+[ $# -eq 3 ] || usage
+modprobe=$1
+baseline=$2
+dir=$3
+gen=$(dirname "$0")/gen-fake-root.sh
+counts=$dir.counts
+
+# scenario NAME WARM GEN_ARGS... - append the counts of a scenario to
+# $counts, running nvidia-modprobe once beforehand if WARM is 1
+
+scenario() {
+    name=$1
+    warm=$2
+    shift 2
+    args=$(sh "$gen" "$@" "$dir")
+    if [ "$warm" -eq 1 ]; then
+        env -i NVIDIA_MODPROBE_ROOT="$dir" "$modprobe" $args > /dev/null
+    fi
+    env -i NVIDIA_MODPROBE_ROOT="$dir" "$modprobe" $args --stats > "$counts.out"
+    sed -n 's/^total  *//p' "$counts.out" |
+        awk -v name="$name" '{
+            for (i = 1; i < NF; i += 2) print name, $i, $(i + 1)
+        }' >> "$counts"
+}
+
+: > "$counts"
+scenario warm-noop 1 -l -g 8
+scenario cold-8gpu 0 -g 8
+scenario imex-2048 0 -i 2048
+rm -f "$counts.out"
+
+if [ $update -eq 1 ]; then
+    {
+        echo "# nvidia-modprobe --stats baseline; see stats-check.sh"
+        cat "$counts"
+    } > "$baseline"
+    echo "stats-check: recorded $(wc -l < "$counts") counts in $baseline"
+    rm -f "$counts"
+    exit 0
+fi
+
+status=0
+awk '
+    FNR == NR {
+        if ($1 !~ /^#/) base[$1 " " $2] = $3
+        next
+    }
+    $2 == "cache-hit" { next }
+    {
+        key = $1 " " $2
+        limit = (key in base) ? base[key] : 0
+        checked++
+        if ($3 > limit) {
+            printf "stats-check: %s: %s %d, baseline %d\n", $1, $2, $3, limit
+            failed++
+        }
+    }
+    END {
+        printf "stats-check: %d of %d counts above the baseline\n",
+               failed, checked
+        exit (failed > 0)
+    }
+' "$baseline" "$counts" || status=1
+
+rm -f "$counts"
+exit $status